@@ -0,0 +1,289 @@
+// Times every phase of the pipeline on a set of workloads and prints the
+// results as JSON. Usage: lox_bench [--iterations=N] [workload...]
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "closure_compiler.hpp"
+#include "error.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "logging.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "source.hpp"
+
+namespace {
+// Counted by the replaced global operator new
+size_t allocations = 0;
+size_t allocated_bytes = 0;
+} // namespace
+
+void *operator new(size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t DEFAULT_ITERATIONS = 10;
+
+const std::vector<std::string> phase_names{
+    "lex",       "parse", "resolve",          "optimize",
+    "interpret", "lower", "interpret_lowered"};
+
+struct Sample {
+  Clock::duration time;
+  size_t allocations;
+  size_t allocated_bytes;
+};
+
+/// Measures the time and allocations of its lifetime
+struct Measurement {
+  explicit Measurement(std::vector<Sample> &_samples)
+      : samples(_samples), start_allocations(allocations),
+        start_bytes(allocated_bytes), start(Clock::now()) {}
+  ~Measurement() {
+    const auto end = Clock::now();
+    samples.push_back(Sample{end - start, allocations - start_allocations,
+                             allocated_bytes - start_bytes});
+  }
+
+  Measurement(const Measurement &) = delete;
+  Measurement &operator=(const Measurement &) = delete;
+  Measurement(Measurement &&) = delete;
+  Measurement &operator=(Measurement &&) = delete;
+
+  std::vector<Sample> &samples;
+  const size_t start_allocations;
+  const size_t start_bytes;
+  const Clock::time_point start;
+};
+
+using Samples = std::map<std::string, std::vector<Sample>>;
+
+/// Runs the whole pipeline once. Returns false if the script had an error
+bool run_once(std::string_view source, Samples &samples) {
+  auto err_handler = std::make_shared<CerrHandler>();
+  // Script output is discarded
+  std::ostream sink{nullptr};
+
+  Arena arena;
+  Lexer lexer{source, err_handler};
+  std::vector<Token> tokens;
+  {
+    Measurement measure{samples["lex"]};
+    tokens = lexer.lex();
+  }
+
+  std::vector<stmt> statements;
+  {
+    Measurement measure{samples["parse"]};
+    Parser parser{std::move(tokens), arena, err_handler};
+    statements = parser.parse();
+  }
+
+  Interpreter interpreter{sink, err_handler};
+  {
+    Measurement measure{samples["resolve"]};
+    Resolver resolver{interpreter};
+    resolver.resolve(statements);
+  }
+
+  {
+    Measurement measure{samples["optimize"]};
+    Optimizer optimizer{arena};
+    optimizer.optimize(statements);
+  }
+
+  if (err_handler->has_error()) {
+    return false;
+  }
+
+  {
+    Measurement measure{samples["interpret"]};
+    interpreter.interpret(statements);
+  }
+
+  // The same program on the closure backend, with globals of its own
+  LoweredBody lowered;
+  {
+    Measurement measure{samples["lower"]};
+    lowered = ClosureCompiler{}.compile(statements);
+  }
+
+  Interpreter lowered_interpreter{sink, err_handler};
+  {
+    Measurement measure{samples["interpret_lowered"]};
+    lowered_interpreter.interpret(lowered);
+  }
+
+  return !err_handler->has_runtime_error();
+}
+
+/// Many small functions and classes, to stress the front end
+std::string generate_source() {
+  constexpr size_t FUNCTIONS = 2000;
+
+  std::ostringstream source;
+  for (size_t i = 0; i < FUNCTIONS; ++i) {
+    source << "fun f" << i << "(a, b) {\n"
+           << "  var x = a * " << i << " + b / 2;\n"
+           << "  if (x > 10 and !(b == nil)) {\n"
+           << "    x = x - 1;\n"
+           << "  } else {\n"
+           << "    while (x < 10) x = x + 1;\n"
+           << "  }\n"
+           << "  return x == b ? \"f" << i << "\" : x;\n"
+           << "}\n"
+           << "class C" << i << " {\n"
+           << "  init(value) { this.value = value; }\n"
+           << "  get() { return this.value + f" << i << "(1, 2); }\n"
+           << "}\n";
+  }
+  source << "print C0(1).get();\n";
+  return source.str();
+}
+
+struct Workload {
+  std::string name;
+  std::string source;
+};
+
+std::optional<std::string> read_workload(const std::string &name) {
+  const auto file =
+      SourceFile::map(std::string(LOX_BENCH_DIR) + "/" + name + ".lox");
+  if (!file.has_value()) {
+    return std::nullopt;
+  }
+  return std::string(file->text());
+}
+
+const Sample &percentile(const std::vector<Sample> &sorted, size_t percent) {
+  const auto rank = (sorted.size() * percent + 99) / 100;
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+size_t nanoseconds(Clock::duration duration) {
+  return static_cast<size_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+void write_phase(std::ostream &os, std::vector<Sample> samples) {
+  std::sort(samples.begin(), samples.end(),
+            [](const auto &a, const auto &b) { return a.time < b.time; });
+
+  const auto count = samples.size();
+  const auto total_time = std::accumulate(
+      samples.begin(), samples.end(), Clock::duration{},
+      [](auto sum, const auto &sample) { return sum + sample.time; });
+  size_t total_allocations = 0;
+  size_t total_bytes = 0;
+  for (const auto &sample : samples) {
+    total_allocations += sample.allocations;
+    total_bytes += sample.allocated_bytes;
+  }
+
+  os << "{\"mean_ns\": " << nanoseconds(total_time) / count
+     << ", \"p50_ns\": " << nanoseconds(percentile(samples, 50).time)
+     << ", \"p90_ns\": " << nanoseconds(percentile(samples, 90).time)
+     << ", \"p99_ns\": " << nanoseconds(percentile(samples, 99).time)
+     << ", \"min_ns\": " << nanoseconds(samples.front().time)
+     << ", \"max_ns\": " << nanoseconds(samples.back().time)
+     << ", \"allocations\": " << total_allocations / count
+     << ", \"allocated_bytes\": " << total_bytes / count << "}";
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Logging::set_log_level(Logging::LogLevel::ERROR);
+
+  size_t iterations = DEFAULT_ITERATIONS;
+  std::vector<std::string> selected;
+
+  constexpr std::string_view iterations_prefix = "--iterations=";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg.starts_with(iterations_prefix)) {
+      const auto count = arg.substr(iterations_prefix.size());
+      std::from_chars(count.data(), count.data() + count.size(), iterations);
+    } else if (arg.starts_with("--")) {
+      iterations = 0;
+    } else {
+      selected.emplace_back(arg);
+    }
+  }
+  if (iterations == 0) {
+    std::cerr << "Usage: lox_bench [--iterations=N] [workload...]\n";
+    return 64;
+  }
+
+  std::vector<Workload> workloads;
+  for (const auto *name : {"fib", "classes", "strings", "closures"}) {
+    auto source = read_workload(name);
+    if (!source.has_value()) {
+      std::cerr << "Workload " << name << " could not be read\n";
+      return 66;
+    }
+    workloads.push_back(Workload{name, std::move(*source)});
+  }
+  workloads.push_back(Workload{"generated", generate_source()});
+
+  if (!selected.empty()) {
+    std::erase_if(workloads, [&](const auto &workload) {
+      return std::find(selected.begin(), selected.end(), workload.name) ==
+             selected.end();
+    });
+  }
+
+  std::cout << "{\n  \"iterations\": " << iterations
+            << ",\n  \"workloads\": [";
+  for (size_t w = 0; w < workloads.size(); ++w) {
+    const auto &workload = workloads[w];
+
+    Samples samples;
+    // Warm up caches and the allocator
+    Samples warmup;
+    if (!run_once(workload.source, warmup)) {
+      std::cerr << "Workload " << workload.name << " failed\n";
+      return 70;
+    }
+    for (size_t i = 0; i < iterations; ++i) {
+      run_once(workload.source, samples);
+    }
+
+    std::cout << (w == 0 ? "" : ",") << "\n    {\"name\": \"" << workload.name
+              << "\", \"source_bytes\": " << workload.source.size()
+              << ", \"phases\": {";
+    for (size_t p = 0; p < phase_names.size(); ++p) {
+      std::cout << (p == 0 ? "" : ",") << "\n      \"" << phase_names[p]
+                << "\": ";
+      write_phase(std::cout, samples[phase_names[p]]);
+    }
+    std::cout << "\n    }}";
+  }
+  std::cout << "\n  ]\n}\n";
+
+  return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// Destroys an object that lives in an Arena. The memory stays with the Arena
+struct ArenaDeleter {
+  template <typename T> void operator()(T *object) const { object->~T(); }
+};
+
+/// Owning pointer to an object in an Arena. Must not outlive the Arena
+template <typename T> using ArenaPtr = std::unique_ptr<T, ArenaDeleter>;
+
+/// Bump allocator for everything that lives as long as one compilation unit,
+/// like the nodes of its AST. Allocation just advances a pointer in the
+/// current block. The blocks are all freed at once with the Arena.
+struct Arena {
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&) = delete;
+  Arena &operator=(Arena &&) = delete;
+  ~Arena() = default;
+
+  [[nodiscard]] void *allocate(size_t size, size_t alignment);
+
+  template <typename T, typename... Args> ArenaPtr<T> make(Args &&...args) {
+    void *memory = allocate(sizeof(T), alignof(T));
+    return ArenaPtr<T>(new (memory) T(std::forward<Args>(args)...));
+  }
+
+  /// Copy text into the Arena, for example a source that tokens point into
+  [[nodiscard]] std::string_view copy(std::string_view text);
+
+private:
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<std::byte[]>> blocks;
+  std::byte *next = nullptr;
+  std::byte *end = nullptr;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "value.hpp"
+
+/// Array of numbers of both backends. The elements are stored unboxed and
+/// contiguously, so the array builtins run over plain doubles instead of
+/// going through the interpreter for every element. Arrays can't reference
+/// other objects, so they are not tracked by the collector.
+struct ObjArray : public Obj {
+  explicit ObjArray(std::vector<double> _elements);
+
+  /// Most elements array() creates, 2 GiB of them
+  static constexpr size_t MAX_SIZE = size_t{1} << 28;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  [[nodiscard]] size_t payload_bytes() const {
+    return elements.size() * sizeof(double);
+  }
+
+  /// Position of the element at index, if index is a whole number in range
+  [[nodiscard]] std::optional<size_t> position(const Value &index) const;
+
+  std::vector<double> elements;
+};
+
+Value make_array(std::vector<double> elements);
+
+/// Kernels of the array builtins. They keep several independent partial
+/// results, so optimizing compilers vectorize them without fast-math.
+namespace ArrayKernels {
+[[nodiscard]] double sum(const std::vector<double> &elements);
+
+/// Both must have the same size
+[[nodiscard]] double dot(const std::vector<double> &lhs,
+                         const std::vector<double> &rhs);
+
+[[nodiscard]] std::vector<double> scale(const std::vector<double> &elements,
+                                        double factor);
+
+/// Ascending, with NaNs last
+[[nodiscard]] std::vector<double> sorted(std::vector<double> elements);
+} // namespace ArrayKernels
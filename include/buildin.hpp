@@ -1,7 +1,17 @@
 #pragma once
 
-#include "token.hpp"
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "callable.hpp"
 
 namespace Buildin {
-std::vector<Token> get_buildins();
-}
\ No newline at end of file
+/// Names and functions of all builtins
+std::vector<std::pair<std::string, CallablePtr>> get_buildins();
+
+/// Whether the builtin has no side effects and returns no new objects, so
+/// functions calling it can be memoized
+bool is_pure(std::string_view name);
+} // namespace Buildin
@@ -1,21 +1,34 @@
 #pragma once
 
-#include "token.hpp"
+#include "value.hpp"
 #include <vector>
 
 struct Interpreter;
 
-struct Callable {
-  virtual Token::Value call(Interpreter &interpreter,
-                            const std::vector<Token::Value> &arguments) = 0;
+struct Callable : public Obj {
+  virtual Value call(Interpreter &interpreter,
+                     const std::vector<Value> &arguments) = 0;
   [[nodiscard]] virtual size_t arity() const = 0;
-  [[nodiscard]] virtual std::string to_string() const = 0;
 
   // Base class boilerplate
-  Callable() = default;
-  virtual ~Callable() = default;
-  Callable(const Callable &) = delete;
-  Callable &operator=(const Callable &) = delete;
-  Callable(Callable &&) = delete;
-  Callable &operator=(Callable &&) = delete;
+  Callable() : Obj(Type::CALLABLE) {}
 };
+
+struct Class;
+struct Function;
+struct Instance;
+
+using InstancePtr = Ref<Instance>;
+using CallablePtr = Ref<Callable>;
+using FunctionPtr = Ref<Function>;
+using ClassPtr = Ref<Class>;
+
+template <typename T> Ref<T> get_callable_as(const Value &value) {
+  static_assert(std::is_same_v<T, Class> || std::is_same_v<T, Function>,
+                "Callable must be a class or function");
+
+  if (value.is_obj_type(Obj::Type::CALLABLE)) {
+    return Ref<T>(dynamic_cast<T *>(value.as<Callable>()));
+  }
+  return nullptr;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "value.hpp"
+
+/// Instructions of the bytecode VM. Operands follow the opcode inline in the
+/// code stream. Constant, global and jump operands are 16 bit (big endian),
+/// local, upvalue, argument and element count operands are 8 bit.
+enum class OpCode : uint8_t {
+  CONSTANT,          // u16 constant
+  NIL,
+  TRUE,
+  FALSE,
+  POP,
+  RESULT,            // Pop the value of a top-level expression statement
+  GET_LOCAL,         // u8 slot
+  SET_LOCAL,         // u8 slot
+  GET_GLOBAL,        // u16 global
+  DEFINE_GLOBAL,     // u16 global
+  SET_GLOBAL,        // u16 global
+  GET_UPVALUE,       // u8 upvalue
+  SET_UPVALUE,       // u8 upvalue
+  GET_PROPERTY,      // u16 name constant
+  SET_PROPERTY,      // u16 name constant
+  ARRAY,             // u8 element count
+  GET_INDEX,
+  SET_INDEX,
+  GET_SUPER,         // u16 name constant
+  GET_UNBOUND_SUPER, // u16 name constant
+  EQUAL,
+  NOT_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  NOT,
+  NEGATE,
+  PRINT,
+  JUMP,              // u16 forward offset
+  JUMP_IF_FALSE,     // u16 forward offset. Does not pop the condition
+  LOOP,              // u16 backward offset
+  CALL,              // u8 argument count
+  TAIL_CALL,         // u8 argument count. Calls in place of the frame
+  INVOKE,            // u16 name constant, u8 argument count
+  TAIL_INVOKE,       // u16 name constant, u8 argument count
+  CLOSURE,           // u16 function, then (u8 is_local, u8 index) pairs
+  CLOSE_UPVALUE,
+  RETURN,
+  CLASS,             // u16 name constant
+  INHERIT,
+  METHOD,            // u16 name constant, u8 FunctionKind
+  IMPORT,            // u16 path constant. Pushes the module
+  DEFINE_MODULE,     // u16 global. Unless the global is that module already
+};
+
+const char *str(OpCode);
+
+/// A compiled sequence of bytecode with its constant pool.
+struct Chunk {
+  /// lexeme is of the token the byte was compiled from
+  void write(uint8_t byte, unsigned int line, std::string_view lexeme);
+  void write(OpCode op, unsigned int line, std::string_view lexeme);
+  void write_u16(uint16_t value, unsigned int line, std::string_view lexeme);
+
+  /// Constants are referred to by u16 operands
+  static constexpr size_t MAX_CONSTANTS =
+      size_t{std::numeric_limits<uint16_t>::max()} + 1;
+
+  /// Add a value to the constant pool, which must have fewer than
+  /// MAX_CONSTANTS. Returns its index
+  uint16_t add_constant(Value value);
+
+  /// A local variable and the code it is in scope for, from its declaration
+  /// to the end of its block
+  struct LocalName {
+    std::string name;
+    uint8_t slot;
+    uint32_t start;
+    uint32_t end = std::numeric_limits<uint32_t>::max();
+  };
+
+  /// The lexeme of the token that the code from start up to the next
+  /// Lexeme was compiled from
+  struct Lexeme {
+    uint32_t start;
+    std::string text;
+  };
+
+  /// Lexeme of the token the byte at offset was compiled from
+  [[nodiscard]] std::string_view lexeme_at(size_t offset) const;
+
+  std::vector<uint8_t> code;
+  // One line entry per byte in code, for error reporting
+  std::vector<unsigned int> lines;
+  // Ordered by start, one per run of code from the same token. Also for
+  // error reporting
+  std::vector<Lexeme> lexemes;
+  std::vector<Value> constants;
+  // In declaration order, for printEnv()
+  std::vector<LocalName> local_names;
+};
+
+/// Human-readable listing of the instructions in a chunk, for debug logging.
+std::ostream &operator<<(std::ostream &os, const Chunk &chunk);
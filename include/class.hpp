@@ -2,29 +2,45 @@
 
 #include "function.hpp"
 
-struct Class : public Callable, public std::enable_shared_from_this<Class> {
-  using FunctionMap = std::unordered_map<std::string, FunctionPtr>;
+struct Class : public Callable {
+  using FunctionMap = std::unordered_map<Symbol, FunctionPtr>;
   /// (methods, unbounds, getters)
   using ClassFunctions =
       std::tuple<Class::FunctionMap, Class::FunctionMap, Class::FunctionMap>;
 
   Class(std::string _name, ClassPtr superclass, ClassFunctions);
 
-  Token::Value call(Interpreter &,
-                    const std::vector<Token::Value> &arguments) override;
+  /// The class of a module's object. The properties of its instance are the
+  /// module's globals, so they see later changes to them
+  Class(std::string _name, EnvironmentPtr _module_globals);
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::CLASS;
+
+  Value call(Interpreter &, const std::vector<Value> &arguments) override;
 
   [[nodiscard]] std::string to_string() const override;
 
   [[nodiscard]] size_t arity() const override;
 
-  [[nodiscard]] const FunctionPtr &get_method(const std::string &name) const;
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  [[nodiscard]] const FunctionPtr &get_method(Symbol name) const;
+
+  [[nodiscard]] const FunctionPtr &get_unbound(Symbol name) const;
 
-  [[nodiscard]] const FunctionPtr &get_unbound(const std::string &name) const;
+  [[nodiscard]] const FunctionPtr &get_getter(Symbol name) const;
 
-  [[nodiscard]] const FunctionPtr &get_getter(const std::string &name) const;
+  /// Globals of the module, if this is the class of a module's object
+  [[nodiscard]] const EnvironmentPtr &module_globals() const {
+    return m_module_globals;
+  }
 
   [[nodiscard]] const std::string &name() const;
 
+  /// Shape of new instances, without any fields
+  [[nodiscard]] Shape &instance_shape() { return empty_shape; }
+
 private:
   ClassPtr superclass;
 
@@ -34,5 +50,9 @@ private:
 
   const std::string m_name;
 
+  EnvironmentPtr m_module_globals;
+
+  Shape empty_shape;
+
   const FunctionPtr nullRef = nullptr;
 };
\ No newline at end of file
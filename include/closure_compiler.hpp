@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "expr.hpp"
+#include "function.hpp"
+#include "stmt.hpp"
+
+/// Lowers a resolved AST to a tree of closures, an alternative to walking it
+/// with the Interpreter's visitor. Every closure captures the closures of its
+/// children and what the visitor looks up on every evaluation, like the
+/// operator of a Binary or the slot of a Variable, so nodes are dispatched
+/// once while lowering. The closures run on the state of an Interpreter and
+/// create the same runtime objects. Rare nodes, like array literals, imports
+/// and 'super', are not lowered and run through the Interpreter's visitor.
+struct ClosureCompiler : public ExprVisitor, public StmtVisitor {
+  /// Lower a program. Its AST must outlive the returned closure and the
+  /// functions the program creates
+  [[nodiscard]] LoweredBody compile(const std::vector<stmt> &statements);
+
+  using LoweredExpr = std::function<Value(Interpreter &)>;
+
+  /// What a call calls. Methods called right away are not bound first
+  struct Callee;
+  using LoweredCallee = std::function<Callee(Interpreter &)>;
+
+private:
+  DECLARE_STMT_VISIT_METHODS
+
+  DECLARE_EXPR_VISIT_METHODS
+
+  LoweredExpr lower(Expr &expression);
+  LoweredExpr lower(const expr &expression);
+  LoweredBody lower(const stmt &statement);
+  std::vector<LoweredExpr> lower(const std::vector<expr> &expressions);
+
+  /// The statements run in order, until one doesn't complete normally
+  LoweredBody lower(const std::vector<stmt> &statements);
+
+  /// Body of a function, shared by all functions created from it
+  std::shared_ptr<const LoweredBody>
+  lower_body(const std::vector<stmt> &statements);
+
+  LoweredCallee lower_callee(Expr &callee);
+
+  /// Return the value of returned, making the calls in tail position on it
+  /// as tail calls
+  LoweredBody lower_return(Expr &returned);
+
+  // Result of the last visit
+  LoweredExpr lowered_expr;
+  LoweredBody lowered_stmt;
+};
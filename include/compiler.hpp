@@ -0,0 +1,137 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "expr.hpp"
+#include "object.hpp"
+#include "stmt.hpp"
+
+struct VM;
+
+/// Lowers a resolved AST to bytecode for the VM. Static errors (like reading
+/// a local in its own initializer) are left to the Resolver, which must have
+/// run without errors on the statements first.
+struct Compiler : public ExprVisitor, public StmtVisitor {
+  Compiler(VM &, std::shared_ptr<ErrorHandler>);
+
+  /// Compile a program into the function of a top-level script.
+  /// Returns an empty Ref if compilation failed. Errors are reported to the
+  /// error handler.
+  Ref<ObjFunction> compile(const std::vector<stmt> &statements);
+
+  /// Compile the module file at path into a function that returns the
+  /// module's object. Its top-level names are globals prefixed by the path,
+  /// so they don't clash with those of the script or other modules
+  Ref<ObjFunction> compile_module(const std::vector<stmt> &statements,
+                                  const std::string &path);
+
+private:
+  DECLARE_STMT_VISIT_METHODS
+
+  DECLARE_EXPR_VISIT_METHODS
+
+  struct Local {
+    std::string_view name;
+    int depth;
+    // Captured locals are moved to the heap when they go out of scope
+    bool is_captured = false;
+    // Index in the chunk's local_names, if it has a name
+    std::optional<size_t> name_index = std::nullopt;
+  };
+
+  struct Upvalue {
+    uint8_t index;
+    // Whether the upvalue captures a local of the directly enclosing function,
+    // or one of its upvalues
+    bool is_local;
+  };
+
+  /// Compilation state of the function that is currently compiled
+  struct FunctionState {
+    FunctionState(FunctionState *_enclosing, Ref<ObjFunction> _function,
+                  std::optional<FunctionKind> _kind);
+
+    FunctionState *enclosing;
+    Ref<ObjFunction> function;
+    // nullopt for the top-level script
+    std::optional<FunctionKind> kind;
+    std::vector<Local> locals;
+    std::vector<Upvalue> upvalues;
+    std::unordered_map<Symbol, uint16_t> identifier_constants;
+    int scope_depth = 0;
+  };
+
+  void compile(const stmt &statement);
+  void compile_statements(const std::vector<stmt> &statements);
+  void compile(const expr &expression);
+  void compile(Expr &expression);
+
+  /// Compile a function body and emit the closure creation for it
+  void function(std::string_view name, const std::vector<Token> &params,
+                const std::vector<stmt> &body, FunctionKind kind,
+                bool is_pure);
+
+  [[nodiscard]] Chunk &chunk() const;
+  void emit(OpCode op);
+  void emit(uint8_t byte);
+  void emit_u16(uint16_t value);
+  void emit_constant(Value value);
+  /// Add a value to the constant pool of the chunk. Returns its index
+  uint16_t add_constant(Value value);
+  void emit_return();
+  /// Emit a jump with a placeholder offset. Returns the offset to patch
+  size_t emit_jump(OpCode op);
+  void patch_jump(size_t offset);
+  void emit_loop(size_t loop_start);
+
+  uint16_t identifier_constant(Symbol name);
+
+  /// Slot of the global with this name, or of the module's global for it
+  uint16_t global_slot(Symbol name);
+
+  /// Create an object with a getter for each top-level name of the module
+  /// and return it
+  void emit_module(const std::vector<stmt> &statements,
+                   const std::string &path);
+
+  void begin_scope();
+  void end_scope();
+
+  [[nodiscard]] bool is_global_scope() const;
+  void add_local(std::string_view name);
+  /// Get (or set, when assign is true) the variable with the given name
+  void named_variable(const Token &name, bool assign);
+
+  [[nodiscard]] static std::optional<uint8_t>
+  resolve_local(const FunctionState &state, std::string_view name);
+  std::optional<uint8_t> resolve_upvalue(FunctionState &state,
+                                         std::string_view name);
+  uint8_t add_upvalue(FunctionState &state, uint8_t index, bool is_local);
+
+  VM &vm;
+
+  std::shared_ptr<ErrorHandler> err_handler;
+
+  FunctionState *current = nullptr;
+
+  /// Globals of the compiled module's top-level names, by these names. Empty
+  /// for scripts
+  std::unordered_map<Symbol, Symbol> module_globals;
+
+  /// Make token the most recently compiled one
+  void at(const Token &token);
+
+  /// Throw a CompiletimeError at the most recently compiled token, for limits
+  /// of the bytecode like the number of constants
+  [[noreturn]] void error(const std::string &message) const;
+
+  // Line and lexeme of the most recently compiled token, for the chunk's
+  // tables and for errors
+  unsigned int line = 0;
+  std::string_view lexeme;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+#include "error.hpp"
+#include "expr.hpp"
+#include "gc.hpp"
+#include "interpreter.hpp"
+#include "logging.hpp"
+#include "vm.hpp"
+
+/// How the resolved AST is executed. The tree-walker is the reference
+/// implementation, the VM compiles to bytecode first. The closure backend
+/// lowers the AST to closures that run on the tree-walker's state.
+enum class Backend { TREE_WALKER, VM, CLOSURES };
+
+/// An independent instance of Lox, for programs that embed it. It owns its
+/// backend, globals, error handler, output and heap, and isolates share no
+/// mutable state. So every thread can create and run isolates of its own.
+///
+/// Values never leave their isolate. An isolate may move to another thread
+/// between runs, but must not be used by two threads at once. Globals defined
+/// by a run stay defined for the later runs of the same isolate.
+struct Isolate {
+  struct Options {
+    Backend backend = Backend::TREE_WALKER;
+    /// Calls that may be nested at once, at most
+    /// Interpreter::MAX_CALL_DEPTH
+    size_t max_call_depth = Interpreter::DEFAULT_MAX_CALL_DEPTH;
+    /// Live bytes of the isolate's objects past which creating another one is
+    /// a RuntimeError. 0 for no limit, see GC::Heap
+    size_t max_heap_bytes = 0;
+    /// Log level of the runs. setLogLevel() changes it for the later runs
+    Logging::LogLevel log_level = Logging::LogLevel::ERROR;
+  };
+
+  Isolate();
+  explicit Isolate(const Options &_options);
+  ~Isolate();
+
+  Isolate(const Isolate &) = delete;
+  Isolate &operator=(const Isolate &) = delete;
+  Isolate(Isolate &&) = delete;
+  Isolate &operator=(Isolate &&) = delete;
+
+  enum class Status { OK, COMPILE_ERROR, RUNTIME_ERROR, EXIT };
+
+  struct Result {
+    Status status;
+    /// What the script printed
+    std::string output;
+    /// Reported errors and warnings, one per line
+    std::string errors;
+  };
+
+  /// Lex, parse, resolve, optimize and execute a script
+  Result run(std::string_view source);
+
+private:
+  Status execute(std::string_view source);
+
+  Options options;
+
+  // Destroyed last, since all objects of the isolate live in it
+  GC::Heap heap;
+
+  std::ostringstream output;
+  std::ostringstream errors;
+  const std::shared_ptr<StreamErrorHandler> err_handler;
+
+  // Functions of earlier runs still refer to their AST, and the AST to the
+  // source. Both live in the arena
+  Arena arena;
+  std::vector<std::vector<stmt>> programs;
+
+  // The one of the chosen backend. The VM brings its own front end
+  std::unique_ptr<Interpreter> tree_walker;
+  std::unique_ptr<VM> vm;
+};
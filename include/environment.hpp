@@ -1,48 +1,85 @@
 #pragma once
 
-#include <memory>
 #include <unordered_map>
+#include <vector>
 
-#include "token.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 
-/// Store variable bindings
-struct Environment {
-  explicit Environment(std::shared_ptr<Environment> _enclosing = nullptr);
+struct Environment;
 
-  /// Define a new variable (or function) binding with name and value extracted
-  /// from the Token. May throw RuntimeError if the name is already defined
-  void define(Token variable);
+using EnvironmentPtr = Ref<Environment>;
 
-  void define(std::string identifier, Token::Value value);
+/// Store variable bindings. Values live in a flat vector of slots. Locals are
+/// accessed by the slot the Resolver assigned to them, globals by name.
+struct Environment : public Obj {
+  explicit Environment(EnvironmentPtr _enclosing = nullptr);
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::ENVIRONMENT;
+
+  /// Define a new variable (or function) binding by name.
+  /// May throw RuntimeError if the name is already defined
+  void define(Symbol identifier, Value value);
+
+  /// Define a local in the next free slot. Locals must be defined in the order
+  /// the Resolver assigned their slots. The name is only kept for printing.
+  void define_local(Symbol name, Value value);
+
+  /// Remove the locals defined after the first size slots
+  void truncate(size_t size);
 
   /// Get a variable value by the name of the supplied token.
   /// @throws RuntimeError on unknown variable access.
-  [[nodiscard]] const Token::Value &get(const Token &token) const;
+  [[nodiscard]] const Value &get(const Token &token) const;
 
-  /// Get a variable value by the name.
+  /// Get a variable value by its slot.
   /// This assumes the variable is found in the index'th nested environment
   /// Unlike for get(), this variable must be present
-  [[nodiscard]] const Token::Value &get_at(size_t depth,
-                                           const std::string &name) const;
+  [[nodiscard]] const Value &get_at(size_t depth, size_t slot) const;
 
   /// Assign a new value to an existing variable.
   /// @throws RuntimeError on unknown variable access.
-  void assign(const Token &name, const Token::Value &value);
+  void assign(const Token &name, const Value &value);
 
   /// Assign a new value to an existing variable.
   /// This assumes the variable is found in the index'th nested environment
   /// Unlike for assign(), this variable must be present
-  void assign_at(size_t depth, const std::string &name, Token::Value value);
+  void assign_at(size_t depth, size_t slot, Value value);
+
+  EnvironmentPtr enclosing = nullptr;
 
-  std::shared_ptr<Environment> enclosing = nullptr;
+  [[nodiscard]] std::string to_string() const override;
 
-  [[nodiscard]] std::string to_string() const;
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
 
   [[nodiscard]] std::string to_string_recursive() const;
 
   [[nodiscard]] size_t depth() const;
 
-  std::unordered_map<std::string, Token::Value> variables;
+  std::vector<Value> values;
+
+  /// Name of each slot in values
+  std::vector<Symbol> names;
+
+  /// Slots of the bindings defined by name. Locals are not in here
+  std::unordered_map<Symbol, size_t> slots;
 };
 
-std::ostream &operator<<(std::ostream &os, const Environment &env);
\ No newline at end of file
+std::ostream &operator<<(std::ostream &os, const Environment &env);
+
+/// Pops the locals a block defined in the slots of the enclosing environment
+/// when the block is left, so that the next block can reuse the slots
+struct ScopedLocals {
+  explicit ScopedLocals(Environment &_env)
+      : env(_env), size(env.values.size()) {}
+  ~ScopedLocals() { env.truncate(size); }
+
+  ScopedLocals(const ScopedLocals &) = delete;
+  ScopedLocals &operator=(const ScopedLocals &) = delete;
+  ScopedLocals(ScopedLocals &&) = delete;
+  ScopedLocals &operator=(ScopedLocals &&) = delete;
+
+  Environment &env;
+  const size_t size;
+};
@@ -19,9 +19,16 @@ struct RuntimeError : public std::runtime_error {
   // available
   explicit RuntimeError(const std::string &msg);
 
+  // The same error at another line
+  RuntimeError(const RuntimeError &err, unsigned int line);
+
   const Token token;
 };
 
+/// Rethrow err, which is being handled, at the line of token if it was thrown
+/// without a line, like the errors of builtins and of exceeding the heap limit
+[[noreturn]] void rethrow_at(const RuntimeError &err, const Token &token);
+
 struct CompiletimeError : public std::runtime_error {
   CompiletimeError(Token _token, const std::string &msg);
 
@@ -49,6 +56,7 @@ struct ErrorHandler {
   virtual void runtime_error(unsigned int line, std::string_view message);
 
   virtual void reset_error();
+  virtual void reset_runtime_error();
   [[nodiscard]] virtual bool has_error() const;
 
   [[nodiscard]] virtual bool has_runtime_error() const;
@@ -77,3 +85,14 @@ private:
 
   std::ofstream err_stream;
 };
+
+/// Reports to a stream it doesn't own, like the errors of an Isolate's run
+struct StreamErrorHandler : public ErrorHandler {
+  explicit StreamErrorHandler(std::ostream &_err_stream);
+
+private:
+  void report(unsigned int line, std::string_view where,
+              std::string_view message, bool is_error) override;
+
+  std::ostream &err_stream;
+};
@@ -4,71 +4,86 @@
 #include <optional>
 #include <vector>
 
+#include "arena.hpp"
+#include "shape.hpp"
 #include "token.hpp"
+#include "type_feedback.hpp"
+#include "value.hpp"
 #include "visitor.hpp"
 
 template <typename T> T cp(const T &in) { return in; }
 
-struct Expr {
-  Expr() = default;
-  virtual ~Expr();
-
-  Expr(const Expr &) = default;
-  Expr(Expr &&) = default;
-  Expr &operator=(const Expr &) = default;
-  Expr &operator=(Expr &&) = default;
-
-  virtual void print(std::ostream &os) const = 0;
-
-  // For resolving scope depth.
-  // How many environments out from the current one the correct definition is.
-  std::optional<int> depth = std::nullopt;
-};
-using expr = std::unique_ptr<Expr>;
+struct Expr;
+using expr = ArenaPtr<Expr>;
 
 template <int id, typename... Types> struct ExprProduction;
 
 struct Statement;
-using stmt = std::unique_ptr<Statement>;
+using stmt = ArenaPtr<Statement>;
 
 // ---------------------Alias definitions for convenience---------------------
 
 // clang-format off
-using Binary = ExprProduction<0, expr, Token, expr>;                                      // expr bin_op expr
+using Binary = ExprProduction<0, expr, Token, expr, TypeFeedback>;                        // expr bin_op expr feedback
 using Grouping = ExprProduction<1, expr>;                                                 // (expr)
-using Literal = ExprProduction<2, Token::Value>;                                          // value
-using Unary = ExprProduction<3, Token, expr>;                                             // unary_op expr
+using Literal = ExprProduction<2, Token::Value, Value>;                                   // value runtime_value
+using Unary = ExprProduction<3, Token, expr, TypeFeedback>;                               // unary_op expr feedback
 using Ternary = ExprProduction<4, expr, Token, expr, Token, expr>;                        // expr op expr op expr
 using Malformed = ExprProduction<5, bool, std::string>;                                   // is_critical message
 using Variable = ExprProduction<6, Token>;                                                // name
-using VarPtr = std::unique_ptr<Variable>;
+using VarPtr = ArenaPtr<Variable>;
 using Empty = ExprProduction<7>;                                                          // No data (for empty variable initializer)
 using Assign = ExprProduction<8, Token, expr>;                                            // name value
 using Logical = ExprProduction<9, expr, Token, expr>;                                     // left op right	(where op is "and" or "or")
-using Call = ExprProduction<10, expr, Token, std::vector<expr>>;                          // callee paren arguments
-using Lambda = ExprProduction<11, std::vector<Token>, std::vector<stmt>>;                 // params body
-using Get = ExprProduction<12, expr, Token>;                                              // object name
-using Set = ExprProduction<13, expr, Token, expr>;                                        // object name value
+using Call = ExprProduction<10, expr, Token, std::vector<expr>, bool>;                    // callee paren arguments is_tail_call
+using Lambda = ExprProduction<11, std::vector<Token>, std::vector<stmt>, bool, Token>;    // params body is_pure '|'
+using Get = ExprProduction<12, expr, Token, PropertyCache>;                               // object name cache
+using Set = ExprProduction<13, expr, Token, expr, PropertyCache>;                         // object name value cache
 using This = ExprProduction<14, Token>;                                                   // 'this'
 using Super = ExprProduction<15, Token, Token, bool>;                                     // 'super' accessed_method is_unbound
+using ArrayLiteral = ExprProduction<16, Token, std::vector<expr>>;                        // bracket elements
+using Index = ExprProduction<17, expr, Token, expr>;                                      // array bracket index
+using SetIndex = ExprProduction<18, expr, Token, expr, expr>;                             // array bracket index value
 // clang-format on
 
 #define EXPR_TYPES                                                             \
   Literal, Grouping, Unary, Binary, Ternary, Malformed, Variable, Empty,       \
-      Assign, Logical, Call, Lambda, Get, Set, This, Super
+      Assign, Logical, Call, Lambda, Get, Set, This, Super, ArrayLiteral,      \
+      Index, SetIndex
 
-using ExprVisitableBase = Visitable<EXPR_TYPES>;
-template <int id, typename... Types>
-using ExprProductionVisitableImpl =
-    VisitableImpl<ExprProduction<id, Types...>, EXPR_TYPES>;
 using ExprVisitor = Visitor<EXPR_TYPES>;
+/// Visitor evaluating expressions to their runtime value
+using ExprEvaluator = ResultVisitor<Value, EXPR_TYPES>;
+using ExprVisitableBase = ResultVisitable<Value, EXPR_TYPES>;
 
 //--------------------End of alias definitions--------------------------------
 
+struct Expr : public ExprVisitableBase {
+  Expr() = default;
+  ~Expr() override;
+
+  Expr(const Expr &) = default;
+  Expr(Expr &&) = default;
+  Expr &operator=(const Expr &) = default;
+  Expr &operator=(Expr &&) = default;
+
+  virtual void print(std::ostream &os) const = 0;
+
+  // For resolving scope depth.
+  // How many environments out from the current one the correct definition is.
+  std::optional<int> depth = std::nullopt;
+
+  // Index of the definition in that environment. Only valid with a depth.
+  size_t slot = 0;
+};
+
+template <int id, typename... Types>
+using ExprProductionVisitableImpl =
+    ResultVisitableImpl<ExprProduction<id, Types...>, Expr, Value, EXPR_TYPES>;
+
 /// A generic production for an expression. id is for disambiguation
 template <int id, typename... Types>
-struct ExprProduction : public Expr,
-                        public ExprProductionVisitableImpl<id, Types...> {
+struct ExprProduction : public ExprProductionVisitableImpl<id, Types...> {
   explicit ExprProduction(Types &&... args)
       : derivatives(std::forward<Types>(args)...) {}
 
@@ -112,9 +127,40 @@ std::ostream &operator<<(std::ostream &os, const expr &rhs);
   void visit(Get &) override;                                                  \
   void visit(Set &) override;                                                  \
   void visit(This &) override;                                                 \
-  void visit(Super &) override;
+  void visit(Super &) override;                                                \
+  void visit(ArrayLiteral &) override;                                         \
+  void visit(Index &) override;                                                \
+  void visit(SetIndex &) override;
+
+#define DECLARE_EXPR_EVAL_METHODS                                              \
+  Value visit(Assign &) override;                                              \
+  Value visit(Logical &) override;                                             \
+  Value visit(Variable &) override;                                            \
+  Value visit(Empty &) override;                                               \
+  Value visit(Literal &) override;                                             \
+  Value visit(Unary &) override;                                               \
+  Value visit(Binary &) override;                                              \
+  Value visit(Ternary &) override;                                             \
+  Value visit(Malformed &) override;                                           \
+  Value visit(Call &) override;                                                \
+  Value visit(Grouping &) override;                                            \
+  Value visit(Lambda &) override;                                              \
+  Value visit(Get &) override;                                                 \
+  Value visit(Set &) override;                                                 \
+  Value visit(This &) override;                                                \
+  Value visit(Super &) override;                                               \
+  Value visit(ArrayLiteral &) override;                                        \
+  Value visit(Index &) override;                                               \
+  Value visit(SetIndex &) override;
 
 template <typename Type, typename... arg_types>
-expr new_expr(arg_types &&... args) {
-  return std::make_unique<Type>(std::forward<arg_types>(args)...);
+expr new_expr(Arena &arena, arg_types &&... args) {
+  return arena.make<Type>(std::forward<arg_types>(args)...);
+}
+
+/// Literal of value. Its runtime value is created once here, so evaluating it
+/// is a load instead of interning its string every time
+inline expr new_literal(Arena &arena, Token::Value value) {
+  auto runtime_value = from_literal(value);
+  return new_expr<Literal>(arena, std::move(value), std::move(runtime_value));
 }
@@ -1,37 +1,103 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "callable.hpp"
 #include "environment.hpp"
 #include "stmt.hpp"
 
+/// Code lowered to a closure by the ClosureCompiler. Runs in the current
+/// environment and completes like Interpreter::execute_statements
+using LoweredBody = std::function<Completion(Interpreter &)>;
+
 struct Function : public Callable {
   Function(
       const std::variant<const FunctionStmt *, const Lambda *> &declaration,
-      std::shared_ptr<Environment> closure, FunctionKind kind);
+      EnvironmentPtr closure, EnvironmentPtr globals, FunctionKind kind,
+      Value receiver = NullType{});
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::FUNCTION;
 
-  Token::Value call(Interpreter &interpreter,
-                    const std::vector<Token::Value> &arguments) override;
+  /// Calls bound methods with their receiver
+  Value call(Interpreter &interpreter,
+             const std::vector<Value> &arguments) override;
+
+  /// Call with receiver as 'this', without creating a bound method first.
+  /// The receiver is ignored by functions without one
+  Value invoke(Interpreter &interpreter, const Value &this_value,
+               const std::vector<Value> &arguments);
 
   [[nodiscard]] size_t arity() const override;
   [[nodiscard]] std::string to_string() const override;
 
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
   [[nodiscard]] const std::vector<Token> &parameters() const;
   [[nodiscard]] const std::vector<stmt> &body() const;
 
+  /// Declared name, or "lambda" for lambdas
+  [[nodiscard]] std::string_view name() const;
+
+  /// Name that tells functions of the same name apart, for profiles:
+  /// Class.method for methods, and lambda:line with the line of the
+  /// definition for lambdas
+  [[nodiscard]] std::string qualified_name() const;
+
+  /// Whether the Resolver found the function free of side effects
+  [[nodiscard]] bool is_pure() const;
+
+  /// 'this' of bound methods, else nil
+  [[nodiscard]] const Value &bound_receiver() const { return receiver; }
+
+  /// Globals of the module the function was defined in
+  [[nodiscard]] const EnvironmentPtr &module_globals() const {
+    return globals;
+  }
+
+  /// What other interpreters need to create the same function, over a closure
+  /// of their own
+  struct Definition {
+    std::variant<const FunctionStmt *, const Lambda *> declaration;
+    FunctionKind kind;
+  };
+  [[nodiscard]] Definition definition() const { return {declaration, kind}; }
+
   /* Create a bound method fron this function. A bound method is a method that
    * is identical in AST but has an implicit 'this' variable that is always
    * accessible. 'this' will be bound to the given instance
    *
-   * Note that the Instance will be kept alive due to shared_ptr usage, so
-   * returning a bound method from a scope is fine, even though the object goes
-   * out of scope. It's value will be kept.
+   * Note that the Instance will be kept alive because it is reference
+   * counted, so returning a bound method from a scope is fine, even though the
+   * object goes out of scope. It's value will be kept.
+   *
+   * Only needed when a method is used as a value. Calls go through invoke().
    */
   FunctionPtr bind(InstancePtr);
 
+  /// Body lowered by the ClosureCompiler, if the function was created by
+  /// lowered code. It runs instead of the AST of the body
+  std::shared_ptr<const LoweredBody> lowered_body;
+
+  /// Name of the class the function is a method of, else empty. Points into
+  /// the AST, like the declaration
+  std::string_view class_name;
+
 private:
+  /// Execute the body for a call, without its tail calls
+  Completion execute_body(Interpreter &interpreter, const Value &this_value,
+                          const std::vector<Value> &arguments);
+
+  /// Result of a call whose body completed
+  Value result(Interpreter &interpreter, Completion completion,
+               const Value &this_value) const;
+
   const std::variant<const FunctionStmt *, const Lambda *> declaration;
-  std::shared_ptr<Environment> closure;
+  EnvironmentPtr closure;
+  EnvironmentPtr globals;
   const FunctionKind kind;
+  /// 'this' of bound methods, else nil
+  Value receiver;
 };
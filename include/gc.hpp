@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+struct Obj;
+
+/// Cycle collector for the reference counted objects of both backends.
+/// Reference counting frees most objects right away, but not objects that
+/// reference each other, like a function and the environment it is defined in.
+///
+/// A collection looks at all tracked objects. References between tracked
+/// objects are subtracted from their reference counts. Whatever still has
+/// references left is referenced from outside the heap (the C++ stack, the
+/// interpreter's environments, the VM stack or globals) and is a root.
+/// Everything not reachable from a root is garbage and is freed by dropping
+/// its references.
+namespace GC {
+
+/// Kinds of objects whose allocations are counted separately. Both backends'
+/// objects of a kind count as it, like the tree-walker's and the VM's
+/// functions
+enum class Kind : uint8_t {
+  ENVIRONMENT,
+  FUNCTION,
+  CLASS,
+  INSTANCE,
+  STRING,
+  OTHER,
+};
+
+constexpr size_t KIND_COUNT = static_cast<size_t>(Kind::OTHER) + 1;
+
+/// Allocations of one kind of object in a heap. The bytes of an object are its
+/// size and the characters or elements it was created with. Storage that only
+/// grows later, like the slots of an environment, isn't counted
+struct Allocations {
+  // Created since the heap was
+  size_t count = 0;
+  size_t bytes = 0;
+  // Not freed yet
+  size_t live = 0;
+  size_t live_bytes = 0;
+};
+
+/// The tracked objects of one group of objects and the state of their
+/// collector. Every thread has a heap of its own, which creates its objects
+/// unless another heap is made current with a HeapScope. Objects must be freed
+/// while the heap they were created in is current, and each heap must only be
+/// used by one thread at a time.
+struct Heap {
+  Heap() = default;
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+  Heap(Heap &&) = delete;
+  Heap &operator=(Heap &&) = delete;
+
+  static constexpr size_t MIN_THRESHOLD = 10000;
+
+  // Doubly linked list of all tracked objects
+  Obj *tracked = nullptr;
+  size_t tracked_count = 0;
+
+  // New objects since the last collection, and how many trigger the next one
+  size_t allocations = 0;
+  size_t threshold = MIN_THRESHOLD;
+
+  bool collecting = false;
+
+  // Counted allocations of all objects, tracked or not, by Kind
+  std::array<Allocations, KIND_COUNT> allocated{};
+  size_t live_bytes = 0;
+  size_t peak_bytes = 0;
+
+  // Live bytes past which creating an object throws a RuntimeError, 0 for no
+  // limit. Garbage cycles count until they are collected, so maybe_collect()
+  // also collects once the live bytes grew by a quarter of the limit
+  size_t limit = 0;
+  size_t live_bytes_after_collection = 0;
+
+  // Objects reached but not yet traced, while marking
+  std::vector<Obj *> *worklist = nullptr;
+
+  // Objects freed while another one is destroyed, waiting for their turn
+  std::vector<Obj *> *pending_destruction = nullptr;
+};
+
+/// Heap that objects are created in and freed from on this thread
+[[nodiscard]] Heap &current_heap();
+
+/// Makes a heap current on this thread for as long as it lives
+struct HeapScope {
+  explicit HeapScope(Heap &heap);
+  ~HeapScope();
+
+  HeapScope(const HeapScope &) = delete;
+  HeapScope &operator=(const HeapScope &) = delete;
+  HeapScope(HeapScope &&) = delete;
+  HeapScope &operator=(HeapScope &&) = delete;
+
+private:
+  Heap *previous;
+};
+
+/// Count the creation of obj of the given kind and bytes in the current heap.
+/// @throws RuntimeError if that exceeds the heap's limit. obj must be owned by
+/// a counted reference by then, so it's freed again
+void account(Obj &obj, Kind kind, size_t bytes);
+
+/// Count bytes that obj allocated after it was created, like the characters
+/// of a joined rope.
+/// @throws RuntimeError before exceeding the heap's limit
+void grow(const Obj &obj, size_t bytes);
+
+/// Check that the current heap has room for bytes more, before allocating a
+/// large payload that is counted once its object is created.
+/// @throws RuntimeError if the bytes would exceed the heap's limit
+void reserve(size_t bytes);
+
+/// Free all objects that are only kept alive by reference cycles.
+/// Returns the number of freed objects
+size_t collect();
+
+/// Collect if enough tracked objects were created since the last collection.
+/// Only call where every live object is held by a counted reference
+void maybe_collect();
+
+/// Number of currently tracked objects of the current heap
+[[nodiscard]] size_t tracked_objects();
+
+/// Print the allocations of the current heap, one line per kind
+void write_stats(std::ostream &os);
+
+} // namespace GC
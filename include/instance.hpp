@@ -1,23 +1,48 @@
 #pragma once
 
 #include <memory>
-#include <unordered_map>
+#include <optional>
+#include <vector>
 
 #include "class.hpp"
+#include "shape.hpp"
 
-struct Instance : public std::enable_shared_from_this<Instance> {
+struct Instance : public Obj {
   explicit Instance(ClassPtr);
 
-  [[nodiscard]] std::string to_string() const;
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::INSTANCE;
 
-  [[nodiscard]] Token::Value get_field(const Token &name, Interpreter &);
+  [[nodiscard]] std::string to_string() const override;
 
-  void set_field(const Token &name, Token::Value);
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  /// Get a getter's result, field or bound method, in that order.
+  /// The cache belongs to the accessing site.
+  [[nodiscard]] Value get_field(const Token &name, PropertyCache &cache,
+                                Interpreter &);
+
+  void set_field(const Token &name, Value, PropertyCache &cache);
+
+  /// What the property resolves to for getting it. Looked up and cached on a
+  /// miss. Throws for undefined properties. The entry is only valid until the
+  /// cache is used again
+  [[nodiscard]] const PropertyCache::Entry &lookup(const Token &name,
+                                                   PropertyCache &cache);
 
 private:
-  // Field are more general than properties. A field is anything defined on an
-  // instance, like a method or property
-  std::unordered_map<std::string, Token::Value> fields;
+  /// Look up a property without the cache. Throws for undefined properties
+  [[nodiscard]] PropertyCache::Entry lookup_get(const Token &name) const;
+  [[nodiscard]] PropertyCache::Entry lookup_set(const Token &name);
+
+  /// Slot of the global name in the module, if this is a module's object
+  [[nodiscard]] std::optional<size_t> module_binding(Symbol name) const;
 
   ClassPtr klass;
+
+  // Field are more general than properties. A field is anything defined on an
+  // instance, like a method or property. The shape tells which field is in
+  // which slot. Shapes are owned by the class.
+  Shape *shape;
+  std::vector<Value> fields;
 };
@@ -2,16 +2,23 @@
 
 #include "environment.hpp"
 
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "arena.hpp"
 #include "class.hpp"
 #include "error.hpp"
 #include "expr.hpp"
 #include "stmt.hpp"
+#include "task.hpp"
 
 struct Parser;
+struct Profiler;
 
-struct Interpreter : public ExprVisitor, public StmtVisitor {
+struct Interpreter : public ExprEvaluator, public StmtExecutor {
   explicit Interpreter(std::ostream &_os,
                        std::shared_ptr<ErrorHandler> _err_handler);
 
@@ -19,34 +26,146 @@ struct Interpreter : public ExprVisitor, public StmtVisitor {
   Interpreter(Interpreter &&) noexcept = delete;
   Interpreter &operator=(const Interpreter &) = delete;
   Interpreter &operator=(Interpreter &&) noexcept = delete;
-  ~Interpreter() override = default;
+  ~Interpreter() override;
 
   /// Interprets a list of statements, representing a program
   void interpret(std::vector<stmt> &statements);
 
-  void execute(const stmt &statement);
+  /// Runs a program lowered by the ClosureCompiler
+  void interpret(const LoweredBody &program);
 
-  void execute_block(const std::vector<stmt> &body,
-                     std::shared_ptr<Environment> enclosing_env);
+  Completion execute(const stmt &statement);
+
+  /// Execute the statements with env as the current environment
+  Completion execute_block(const std::vector<stmt> &body, EnvironmentPtr env);
+
+  /// Execute lowered code with env as the current environment
+  Completion execute_block(const LoweredBody &body, EnvironmentPtr env);
+
+  /// Execute the statements in the current environment
+  Completion execute_statements(const std::vector<stmt> &body);
+
+  /// Define a variable in the current environment. Globals are defined by
+  /// name, locals in their next slot
+  void define(const Token &name, Value value);
+
+  /// Get the property of node from the already evaluated object
+  Value get_property(Get &node, const Value &object);
+
+  /// A new environment enclosed by enclosing_env. Reuses a released
+  /// environment and its storage if one is available
+  EnvironmentPtr new_environment(EnvironmentPtr enclosing_env);
+
+  /// Hand back an environment whose scope was left. It is only reused if
+  /// nothing else, like a closure, still refers to it
+  void release_environment(EnvironmentPtr env);
+
+  /// An empty argument list for a call. Reuses the storage of a released one
+  /// if one is available
+  std::vector<Value> new_arguments();
+
+  /// Hand back the arguments of a finished call
+  void release_arguments(std::vector<Value> &&arguments);
 
   std::ostream &out_stream;
 
-  const std::shared_ptr<Environment> globals;
+  /// A program run by eval() or imported as a module. Its tokens point into
+  /// the source, and the functions it declares into its AST, so both are kept
+  struct Program {
+    std::string source;
+    Arena arena;
+    std::vector<stmt> statements;
+  };
+
+  /// Programs run by eval(), keyed by their source. Evaluating the same
+  /// source again runs the program without lexing, parsing and resolving.
+  /// Programs declaring functions or classes are always kept, since those
+  /// refer to their AST. Other programs are only kept until there are
+  /// MAX_EVAL_PROGRAMS of them, like the VM's eval scripts.
+  /// Declared before the globals, so it outlives the functions in them
+  std::unordered_map<std::string_view, std::shared_ptr<Program>>
+      eval_programs;
+  size_t kept_eval_programs = 0;
+  static constexpr size_t MAX_EVAL_PROGRAMS = 1024;
+
+  /// Programs of the imported modules. Also declared before the globals
+  std::vector<std::unique_ptr<Program>> module_programs;
 
-  std::shared_ptr<Environment> environment;
+  /// Module objects by the canonical path of their file. Nil while the module
+  /// runs, to detect circular imports
+  std::unordered_map<std::string, Value> modules;
 
-  /// Used to unwind the interpreter execution when functions return
-  struct Return : std::exception {
-    explicit Return(Token::Value _val) : val(std::move(_val)) {}
-    Token::Value val;
+  /// Canonical path of the module file at path, relative to the interpreted
+  /// file. @throws RuntimeError if there is no such file
+  [[nodiscard]] std::string module_path(const Token &path) const;
+
+  /// Lex, parse, resolve and optimize the module file at path. Returns
+  /// nullptr if it can't be read or has errors, which are reported
+  [[nodiscard]] std::unique_ptr<Program> parse_module(const std::string &path);
+
+  /// The module imported by path. Its file only runs on its first import,
+  /// later imports return the same module
+  Value import_module(const Token &path);
+
+  const EnvironmentPtr globals;
+
+  /// Globals of the running code. The top-level names of a module are
+  /// defined in an environment of its own, enclosed by the globals. Names
+  /// the Resolver didn't find in a scope are looked up there
+  EnvironmentPtr current_globals;
+
+  EnvironmentPtr environment;
+
+  /// Value of the executing return statement. Only valid while its
+  /// Completion::RETURN propagates up to the function call
+  Value return_value;
+
+  /// Call made by the executing tail call. Only valid while its
+  /// Completion::TAIL_CALL propagates up to the function call it replaces
+  struct TailCall {
+    FunctionPtr function;
+    Value receiver;
+    std::vector<Value> arguments;
   };
+  TailCall tail_call;
 
   const std::shared_ptr<ErrorHandler> err_handler;
 
-  Token::Value last_value;
+  /// Value of the last top-level expression statement. Returned by eval()
+  Value last_value;
 
   std::string interpreter_path;
 
+  /// Text of a file read by includeStr(), and when the file was modified
+  struct IncludedFile {
+    std::filesystem::file_time_type modified;
+    Value text;
+  };
+
+  /// Files read by includeStr(), by path. Read again once they are modified
+  std::unordered_map<std::string, IncludedFile> included_files;
+
+  /// Times all calls if set. Not owned
+  Profiler *profiler = nullptr;
+
+  /// Tasks spawned by the program. They use its AST, so interpret() waits
+  /// for them before the AST may be freed
+  TaskGroup tasks;
+
+  /// Calls that may be nested at once. Tail calls don't nest
+  size_t max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+
+  static constexpr size_t DEFAULT_MAX_CALL_DEPTH = 10000;
+
+  /// Larger call depths are rejected. The depth of a run is also limited to
+  /// what fits on the native stack that could be allocated for it
+  static constexpr size_t MAX_CALL_DEPTH = 1000000;
+
+  /// Native stack a program runs on per allowed call. Generous, since a
+  /// call nests a few visits per expression and statement of its body, and
+  /// only the used part of the stack takes up memory
+  static constexpr size_t NATIVE_STACK_PER_CALL = 16 * 1024;
+
   struct CheckedRecursiveDepth {
     CheckedRecursiveDepth(Interpreter &, const Token &location);
     ~CheckedRecursiveDepth();
@@ -57,23 +176,81 @@ struct Interpreter : public ExprVisitor, public StmtVisitor {
     CheckedRecursiveDepth operator=(CheckedRecursiveDepth &&) = delete;
 
     Interpreter &interpreter;
+  };
 
-    static constexpr size_t MAX_RECURSION_DEPTH = 1000;
+  /// Makes env the current globals until the scope is left, also when a
+  /// RuntimeError passes through it
+  struct ScopedGlobals {
+    ScopedGlobals(Interpreter &, EnvironmentPtr env);
+    ~ScopedGlobals();
+
+    ScopedGlobals(const ScopedGlobals &) = delete;
+    ScopedGlobals operator=(const ScopedGlobals &) = delete;
+    ScopedGlobals(ScopedGlobals &&) = delete;
+    ScopedGlobals operator=(ScopedGlobals &&) = delete;
+
+    Interpreter &interpreter;
+    EnvironmentPtr enclosing;
   };
 
 private:
-  DECLARE_STMT_VISIT_METHODS
+  DECLARE_STMT_EXEC_METHODS
 
-  DECLARE_EXPR_VISIT_METHODS
+  DECLARE_EXPR_EVAL_METHODS
 
   size_t recursion_depth = 0;
 
-  Token::Value get_evaluated(const expr &expression);
-  Token::Value get_evaluated(Expr &expression);
+  /// Whether interpret() runs already, for nested calls from eval()
+  bool is_interpreting = false;
+
+  /// Released environments, ready to be reused as call frames or blocks
+  std::vector<EnvironmentPtr> environment_pool;
+
+  static constexpr size_t MAX_POOLED_ENVIRONMENTS = 64;
+
+  /// Released argument lists, ready to be reused by later calls
+  std::vector<std::vector<Value>> arguments_pool;
+
+  static constexpr size_t MAX_POOLED_ARGUMENTS = 64;
+
+  Value get_evaluated(const expr &expression);
+  Value get_evaluated(Expr &expression);
+
+  /// Check the arity and evaluate the arguments of a call
+  std::vector<Value> evaluate_arguments(Call &node, const Callable &callee);
+
+  /// The value called by node. Methods that are called right away are
+  /// returned with their receiver instead, without creating a bound method
+  struct Callee {
+    Value value;
+    Function *method = nullptr;
+    Value receiver;
+  };
+  Callee evaluate_callee(Call &node);
+
+  Value call_value(Call &node, const Value &callee);
+
+  /// Call a method with receiver as 'this', without binding it
+  Value call_method(Call &node, Function &method, const Value &receiver);
+
+  /// Return the value of a returned expression with tail calls in it
+  Completion return_result(Expr &returned);
+
+  /// Return the result of node from the executing function. Calls of Lox
+  /// functions are left to the function call as a TailCall
+  Completion return_call(Call &node);
+
+  /// Run the top-level statements, reporting runtime errors
+  void execute_program(std::vector<stmt> &statements);
+
+  /// Run a program on a native stack deep enough for max_call_depth calls,
+  /// and wait for the tasks it spawned
+  void run_program(const std::function<void()> &program);
 
   [[nodiscard]] Class::ClassFunctions split_class_functions(
+      std::string_view class_name,
       const std::vector<FunctionStmtPtr> &class_functions) const;
 
-  [[nodiscard]] const Token::Value &lookup_variable(const Token &name,
-                                                    const Expr &) const;
+  [[nodiscard]] const Value &lookup_variable(const Token &name,
+                                             const Expr &) const;
 };
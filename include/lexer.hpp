@@ -1,24 +1,33 @@
 #pragma once
 
 #include <memory>
-#include <unordered_map>
+#include <optional>
+#include <string_view>
 #include <vector>
 
 #include "error.hpp"
 #include "token.hpp"
 
+/// Splits a source text into tokens. It doesn't copy the text: token lexemes
+/// point into it, so the text must outlive all tokens.
 struct Lexer {
   using Type = Token::TokenType;
 
-  explicit Lexer(std::string _source,
+  explicit Lexer(std::string_view _source,
                  std::shared_ptr<ErrorHandler> _err_handler =
                      std::make_shared<CerrHandler>());
 
+  /// Lex the whole source at once
   std::vector<Token> lex();
 
-  // clang-format off
-  static const std::unordered_map<std::string, Type> keywords;
-  // clang-format on
+  /// Scan the next token on demand. Returns EOF_ tokens at the end
+  Token next_token();
+
+  /// Whether a syntax error was reported so far
+  [[nodiscard]] bool has_error() const { return had_error; }
+
+  /// Type of the keyword text, or IDENTIFIER if it isn't one
+  [[nodiscard]] static Type keyword(std::string_view text);
 
 private:
   [[nodiscard]] bool is_at_end() const;
@@ -31,10 +40,12 @@ private:
   void number();
   [[nodiscard]] char peek_next() const;
   void identifier();
+  void skip_blanks();
   void slash_or_comment();
 
-  std::string source;
-  std::vector<Token> tokens;
+  std::string_view source;
+  // Token found by the last scan_token(), if any
+  std::optional<Token> scanned;
   unsigned int start = 0;
   unsigned int current = 0;
   unsigned int line = 1;
@@ -43,6 +54,7 @@ private:
   std::shared_ptr<ErrorHandler> err_handler;
   unsigned int syntax_error_start_line = 0;
   bool last_character_expected = true;
+  bool had_error = false;
   std::string last_syntax_error;
 
   void report_last_syntax_error();
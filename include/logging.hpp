@@ -4,6 +4,11 @@
 #include <iostream>
 #include <string>
 
+// Log levels below this are compiled out, like LOG_DEBUG in release builds
+#ifndef LOX_MIN_LOG_LEVEL
+#define LOX_MIN_LOG_LEVEL 0
+#endif
+
 namespace Logging {
 enum class LogLevel {
   DEBUG = 0,
@@ -14,9 +19,19 @@ enum class LogLevel {
 
 std::ostream &operator<<(std::ostream &, LogLevel level);
 
-void set_log_level(LogLevel level);
+namespace detail {
+// Every thread has its own, so isolates on other threads don't change it
+inline thread_local LogLevel log_level = LogLevel::WARNING;
+} // namespace detail
+
+inline void set_log_level(LogLevel level) { detail::log_level = level; }
 
-LogLevel get_log_level();
+inline LogLevel get_log_level() { return detail::log_level; }
+
+/// Whether messages of level are logged at the current log level
+inline bool is_enabled(LogLevel level) {
+  return static_cast<int>(level) >= static_cast<int>(detail::log_level);
+}
 
 template <typename... Arg>
 void log(const std::string &filename, int line, const Arg &...args) {
@@ -24,7 +39,7 @@ void log(const std::string &filename, int line, const Arg &...args) {
 
   ((std::cout << args), ...); // Print all variadic args
 
-  std::cout << std::endl;
+  std::cout << '\n';
 }
 
 void newline(LogLevel);
@@ -34,31 +49,42 @@ void newline(LogLevel);
 #define FILENAME_ONLY                                                          \
   (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
-#define LOG_ERROR(...)                                                         \
-  [&]() {                                                                      \
-    if (static_cast<int>(Logging::LogLevel::ERROR) >=                          \
-        static_cast<int>(Logging::get_log_level())) {                          \
+#define LOG_AT(level, ...)                                                     \
+  do {                                                                         \
+    if (Logging::is_enabled(Logging::LogLevel::level)) {                       \
       Logging::log(FILENAME_ONLY, __LINE__, __VA_ARGS__);                      \
     }                                                                          \
-  }()
-#define LOG_WARNING(...)                                                       \
-  [&]() {                                                                      \
-    if (static_cast<int>(Logging::LogLevel::WARNING) >=                        \
-        static_cast<int>(Logging::get_log_level())) {                          \
-      Logging::log(FILENAME_ONLY, __LINE__, __VA_ARGS__);                      \
-    }                                                                          \
-  }()
-#define LOG_INFO(...)                                                          \
-  [&]() {                                                                      \
-    if (static_cast<int>(Logging::LogLevel::INFO) >=                           \
-        static_cast<int>(Logging::get_log_level())) {                          \
-      Logging::log(FILENAME_ONLY, __LINE__, __VA_ARGS__);                      \
-    }                                                                          \
-  }()
-#define LOG_DEBUG(...)                                                         \
-  [&]() {                                                                      \
-    if (static_cast<int>(Logging::LogLevel::DEBUG) >=                          \
-        static_cast<int>(Logging::get_log_level())) {                          \
+  } while (false)
+
+// Compiled out levels are still type checked, but generate no code and don't
+// evaluate their arguments
+#define LOG_DISABLED(...)                                                      \
+  do {                                                                         \
+    if constexpr (false) {                                                     \
       Logging::log(FILENAME_ONLY, __LINE__, __VA_ARGS__);                      \
     }                                                                          \
-  }()
+  } while (false)
+
+#if LOX_MIN_LOG_LEVEL <= 3
+#define LOG_ERROR(...) LOG_AT(ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOX_MIN_LOG_LEVEL <= 2
+#define LOG_WARNING(...) LOG_AT(WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOX_MIN_LOG_LEVEL <= 1
+#define LOG_INFO(...) LOG_AT(INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOX_MIN_LOG_LEVEL <= 0
+#define LOG_DEBUG(...) LOG_AT(DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISABLED(__VA_ARGS__)
+#endif
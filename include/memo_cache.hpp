@@ -0,0 +1,43 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "value.hpp"
+
+/// Results of a pure function by its arguments, for memoize(). Arguments are
+/// compared with ==, so strings by content and other objects by identity.
+/// Arrays can change in place, so calls with array arguments or results are
+/// never cached. Once full, the least recently used result is dropped.
+struct MemoCache {
+  explicit MemoCache(size_t _capacity = DEFAULT_CAPACITY);
+
+  /// Result of a call with these arguments, if it is cached
+  [[nodiscard]] const Value *find(const std::vector<Value> &arguments);
+
+  /// Does nothing for arrays, see above
+  void insert(std::vector<Value> arguments, Value result);
+
+  void trace(Tracer tracer) const;
+  void clear();
+
+  static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+private:
+  struct Entry {
+    std::vector<Value> arguments;
+    Value result;
+  };
+
+  struct Hash {
+    size_t operator()(const std::vector<Value> &arguments) const noexcept;
+  };
+
+  const size_t capacity;
+  /// Most recently used first
+  std::list<Entry> entries;
+  /// Keys are copies of the arguments of the entries
+  std::unordered_map<std::vector<Value>, std::list<Entry>::iterator, Hash>
+      positions;
+};
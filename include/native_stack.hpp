@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/// Native stacks for deeply recursive code, like the tree-walker's calls.
+namespace NativeStack {
+
+/// Smallest stack run() falls back to before giving up on a stack of its own
+constexpr size_t MIN_SIZE = 1024 * 1024;
+
+/// Run body on a new native stack of at least size bytes. The stack is
+/// allocated from the heap, and memory is only used for its touched pages.
+/// Exceptions thrown by body are rethrown. If no stack of that size can be
+/// allocated, the largest smaller one down to MIN_SIZE is used. If not even
+/// that can be allocated, body runs on the current stack. body is passed the
+/// size of the stack it may use, so it can limit its recursion to it.
+///
+/// body sees the caller's heap and log level, and changes to the log level
+/// are kept.
+void run(size_t size, const std::function<void(size_t stack_size)> &body);
+
+} // namespace NativeStack
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.hpp"
+#include "stmt.hpp"
+#include "value.hpp"
+
+struct VM;
+
+/// A compiled function prototype. Closures over it are created at runtime.
+struct ObjFunction : public Obj {
+  ObjFunction(std::string _name, FunctionKind _kind);
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::FUNCTION;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  const std::string name;
+  const FunctionKind kind;
+  size_t arity = 0;
+  size_t upvalue_count = 0;
+  /// Found free of side effects by the Resolver
+  bool is_pure = false;
+  Chunk chunk;
+};
+
+/// A function implemented in C++. Arguments are passed as a pointer to the
+/// first of arity() values on the VM stack
+struct ObjNative : public Obj {
+  using Fn = std::function<Value(VM &, const Value *arguments)>;
+
+  ObjNative(std::string _name, size_t _arity, Fn _function,
+            Value _wrapped = NullType{});
+
+  [[nodiscard]] std::string to_string() const override;
+
+  const std::string name;
+  const size_t arity;
+  const Fn function;
+  /// Closure that this native only adds to, like the function of a memoized
+  /// one. Tasks run it instead
+  const Value wrapped;
+};
+
+/// A variable captured by a closure. While the variable is still on the stack,
+/// location points to its stack slot. When the variable goes out of scope its
+/// value is moved into closed, and location is redirected there.
+struct ObjUpvalue : public Obj {
+  explicit ObjUpvalue(Value *_location);
+
+  [[nodiscard]] std::string to_string() const override;
+
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  Value *location;
+  Value closed;
+  // Intrusive list of upvalues that still point into the stack, ordered by
+  // descending stack slot. Non-owning.
+  ObjUpvalue *next_open = nullptr;
+};
+
+struct ObjClosure : public Obj {
+  explicit ObjClosure(Ref<ObjFunction> _function);
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::FUNCTION;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  const Ref<ObjFunction> function;
+  std::vector<Ref<ObjUpvalue>> upvalues;
+};
+
+struct ObjClass : public Obj {
+  using MethodMap = std::unordered_map<Symbol, Ref<ObjClosure>>;
+
+  explicit ObjClass(std::string _name);
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::CLASS;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  /// Copy down all functions of the superclass. Functions defined later on
+  /// this class override the inherited ones.
+  void inherit(const ObjClass &superclass);
+
+  void add_function(Symbol name, Ref<ObjClosure> function);
+
+  /// nullptr if no function of this name exists
+  [[nodiscard]] static ObjClosure *find(const MethodMap &functions,
+                                        Symbol name);
+
+  const std::string name;
+  MethodMap methods;
+  MethodMap unbounds;
+  MethodMap getters;
+};
+
+struct ObjInstance : public Obj {
+  explicit ObjInstance(Ref<ObjClass> _klass);
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::INSTANCE;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  Ref<ObjClass> klass;
+  std::unordered_map<Symbol, Value> fields;
+};
+
+/// A method that is accessed as a value, with its receiver attached
+struct ObjBoundMethod : public Obj {
+  ObjBoundMethod(Value _receiver, Ref<ObjClosure> _method);
+
+  [[nodiscard]] std::string to_string() const override;
+
+  void trace(Tracer tracer) const override;
+  void clear_references() override;
+
+  Value receiver;
+  Ref<ObjClosure> method;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "stmt.hpp"
+
+/// Simplifies a resolved AST before it is run. Operators over literals are
+/// folded into literals, branches that can never be taken are dropped, and
+/// Grouping and EmptyStmt nodes are removed.
+/// Operations that would raise a RuntimeError are left in place, so the error
+/// is still reported when and where the program runs into it.
+struct Optimizer : public ExprVisitor, public StmtVisitor {
+  explicit Optimizer(Arena &_arena);
+
+  void optimize(std::vector<stmt> &statements);
+
+private:
+  DECLARE_STMT_VISIT_METHODS
+
+  DECLARE_EXPR_VISIT_METHODS
+
+  void optimize(stmt &statement);
+  void optimize(expr &expression);
+
+  /// The value of an optimized expression, or nullptr if it's not a literal
+  [[nodiscard]] static const Token::Value *constant(const expr &expression);
+
+  void replace_with_literal(Token::Value value);
+
+  Arena &arena;
+
+  // Set by a visit method to replace the visited node in its parent
+  expr expr_replacement = nullptr;
+  stmt stmt_replacement = nullptr;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <vector>
+
+/// Stream buffer that collects output for a file descriptor and writes it in
+/// large chunks. It is written when full, on flush, and when destroyed.
+/// Output to a terminal is also written at the end of every line, so it shows
+/// up right away.
+struct OutputBuffer : std::streambuf {
+  /// A capacity of 0 writes everything right away
+  OutputBuffer(int _fd, size_t capacity);
+  ~OutputBuffer() override;
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+  OutputBuffer(OutputBuffer &&) = delete;
+  OutputBuffer &operator=(OutputBuffer &&) = delete;
+
+  static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+protected:
+  int_type overflow(int_type character) override;
+  std::streamsize xsputn(const char *text, std::streamsize count) override;
+  int sync() override;
+
+private:
+  /// Write all of text to the descriptor
+  bool write_all(const char *text, size_t count) const;
+  bool write_buffer();
+
+  const int fd;
+  std::vector<char> buffer;
+  const bool line_buffered;
+};
@@ -3,29 +3,44 @@
 #include "expr.hpp"
 #include "stmt.hpp"
 #include "token.hpp"
+#include "token_stream.hpp"
 #include <exception>
+#include <string>
 #include <vector>
 
 /// Parse an collection of Token to return an AST representation of it's syntax.
-/// This is a recursive descent parser
+/// This is a recursive descent parser. The nodes are allocated in the arena,
+/// which has to outlive the returned AST.
 struct Parser {
-  explicit Parser(std::vector<Token> _tokens,
-                  std::shared_ptr<ErrorHandler> _err_handler =
-                      std::make_shared<CerrHandler>());
+  Parser(std::vector<Token> _tokens, Arena &_arena,
+         std::shared_ptr<ErrorHandler> _err_handler =
+             std::make_shared<CerrHandler>());
+
+  /// Parse while lexing, pulling tokens from the lexer as they are needed
+  Parser(Lexer &lexer, Arena &_arena,
+         std::shared_ptr<ErrorHandler> _err_handler =
+             std::make_shared<CerrHandler>());
 
   bool match(const std::vector<Token::TokenType> &matched_types);
   bool match(Token::TokenType matched_type);
   [[nodiscard]] const Token &previous() const;
 
+  /// Report a syntax error at token. Errors caused by invalid tokens are not
+  /// reported, since the lexer already reported them
+  void report(const Token &token, const std::string &message);
+
   std::vector<stmt> parse();
 
   std::shared_ptr<ErrorHandler> err_handler;
 
+  Arena &arena;
+
 private:
   // Statements
   stmt declaration();
   stmt var_declaration();
   stmt class_declaration();
+  stmt import_declaration();
   FunctionStmtPtr function_declaration(FunctionKind kind);
   FunctionStmtPtr getter_declaration(Token name);
   stmt statement();
@@ -63,12 +78,10 @@ private:
 
   struct ParseError : std::exception {
     [[nodiscard]] const char *what() const noexcept override;
-    explicit ParseError(const char *_message) : message(_message) {}
-    explicit ParseError(const std::string &_message)
-        : message(_message.c_str()) {}
+    explicit ParseError(std::string _message) : message(std::move(_message)) {}
 
   private:
-    const char *message;
+    std::string message;
   };
   /// Report a syntax error. Returns throwable ParseError for parser recursion
   /// stack unwinding. Error is returned so caller can decide whether to unwind
@@ -82,6 +95,5 @@ private:
   [[nodiscard]] bool check(Token::TokenType type) const;
   const Token &advance();
 
-  const std::vector<Token> tokens;
-  unsigned int current = 0;
+  TokenStream tokens;
 };
\ No newline at end of file
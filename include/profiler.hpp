@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "callable.hpp"
+
+/// Instrumenting profiler of the tree-walker. Every call is timed with a
+/// monotonic clock. Per function it counts calls and sums up inclusive time,
+/// which includes callees, and exclusive time, which doesn't. The exclusive
+/// time is also attributed to the call stack it was spent in, which is
+/// written in the collapsed stack format of flamegraph tools.
+struct Profiler {
+  using Clock = std::chrono::steady_clock;
+
+  /// Starts timing the top-level code of the script
+  Profiler();
+
+  /// A function was called. name must not contain ';'
+  void enter(const std::string &name);
+
+  /// The innermost called function returned
+  void leave();
+
+  /// Leave all open frames, including the top-level one. Needed when the
+  /// script is terminated from within a function, e.g. by exit()
+  void stop();
+
+  /// Table of all functions, with the most exclusive time first
+  void write_summary(std::ostream &os) const;
+
+  /// One line per call stack: the functions separated by ';', followed by
+  /// the nanoseconds spent in the innermost one
+  void write_collapsed(std::ostream &os) const;
+
+  /// Times the call of callee for its lifetime. Does nothing without profiler
+  struct Scope {
+    Scope(Profiler *_profiler, const Callable &callee);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    Scope(Scope &&) = delete;
+    Scope &operator=(Scope &&) = delete;
+
+    Profiler *profiler;
+  };
+
+private:
+  struct FunctionStats {
+    size_t calls = 0;
+    Clock::duration inclusive{};
+    Clock::duration exclusive{};
+    // Number of frames of the function on the stack. Only the outermost of
+    // recursive calls adds to the inclusive time
+    size_t active = 0;
+  };
+
+  struct Frame {
+    FunctionStats *stats;
+    Clock::time_point start;
+    Clock::duration callees{};
+    // Length of path without this frame
+    size_t parent_path_length;
+  };
+
+  // Node based, so frames can point to the stats
+  std::unordered_map<std::string, FunctionStats> functions;
+  std::unordered_map<std::string, Clock::duration> stacks;
+
+  std::vector<Frame> frames;
+  // The names of all frames, separated by ';'
+  std::string path;
+};
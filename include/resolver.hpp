@@ -1,6 +1,9 @@
 #pragma once
 
 #include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "interpreter.hpp"
 
@@ -10,6 +13,12 @@ struct Resolver : public ExprVisitor, public StmtVisitor {
   void resolve(const std::vector<stmt> &);
   void resolve(const stmt &);
 
+  /// Whether the resolved code declares functions, lambdas or classes. Those
+  /// refer to the AST, so it must live as long as they might
+  [[nodiscard]] bool declares_functions() const {
+    return has_declared_functions;
+  }
+
 private:
   DECLARE_STMT_VISIT_METHODS
 
@@ -23,17 +32,110 @@ private:
 
   enum class ClassKind { NONE, CLASS, SUBCLASS };
 
+  enum class ScopeKind {
+    /// Parameters of a function, always in a new environment per call
+    FUNCTION,
+    /// Locals of a function body, kept in the environment of the parameters
+    BODY,
+    /// Locals of a block, which only get an environment if captured
+    BLOCK,
+    /// 'super' of a class
+    SUPER,
+  };
+
+  void begin_scope(ScopeKind kind, BlockStmt *block = nullptr);
+  void end_scope();
+
   void resolve_local(Expr &node, const Token &identifier);
+
+  /// Where a variable is declared, as seen from the current function
+  enum class Declaration { LOCAL, ENCLOSING_FUNCTION, GLOBAL };
+  [[nodiscard]] Declaration declaration_of(Symbol name) const;
+
+  /// is_pure is set once the purity of the whole program is known
   void resolve_function(const std::vector<Token> &params,
-                        const std::vector<stmt> &body, FunctionKind);
+                        const std::vector<stmt> &body, FunctionKind,
+                        bool &is_pure);
+
+  /// Decide which scopes need an environment, and annotate the blocks and
+  /// variable uses of the finished top-level scope accordingly
+  void assign_slots();
 
   Interpreter &interpreter;
 
-  // The bool represents whether the variable is initialized
-  std::vector<std::unordered_map<std::string, bool>> scopes;
+  bool has_declared_functions = false;
+
+  struct Binding {
+    bool is_initialized;
+    // Position among the declarations of its scope
+    size_t index;
+  };
+
+  struct Scope {
+    std::unordered_map<Symbol, Binding> bindings;
+    // Paths of the modules imported into bindings
+    std::unordered_map<Symbol, std::string_view> imports;
+    // Index of the scope's ScopeInfo
+    size_t info;
+  };
+
+  static constexpr size_t NO_SCOPE = static_cast<size_t>(-1);
+
+  /// Whether a scope gets an environment at runtime is only known once all
+  /// uses in it are resolved, so this stays around until assign_slots()
+  struct ScopeInfo {
+    ScopeKind kind;
+    size_t parent;
+    // Declarations in the parent before this scope started
+    size_t parent_declarations;
+    size_t declarations = 0;
+    bool is_captured = false;
+    BlockStmt *block;
+
+    bool has_environment = false;
+    // Innermost scope with an environment that holds this scope's locals
+    size_t home = NO_SCOPE;
+    // Slot in home's environment of the first local
+    size_t first_slot = 0;
+  };
+
+  struct Use {
+    Expr *node;
+    size_t scope;
+    size_t declaration_scope;
+    size_t index;
+  };
+
+  std::vector<Scope> scopes;
+  std::vector<ScopeInfo> scope_infos;
+  std::vector<Use> uses;
 
   std::optional<FunctionKind> function_kind = std::nullopt;
   ClassKind class_kind = ClassKind::NONE;
 
   bool function_needs_return = false;
+
+  /// What decides whether a function is pure: it has no side effects of its
+  /// own, and calls only pure functions
+  struct Purity {
+    bool *is_pure;
+    bool has_effects = false;
+    std::vector<Symbol> called_globals;
+  };
+
+  /// The innermost function being resolved has a side effect
+  void add_effect();
+
+  /// The global with this name no longer only refers to its function
+  void rebind_global(Symbol name);
+
+  /// Annotate all functions of the program with their purity
+  void analyse_purity();
+
+  std::vector<Purity> purities;
+  /// Indices of the purities of the functions being resolved, innermost last
+  std::vector<size_t> enclosing_purities;
+  /// Index of the purity of the global functions, if the global is only ever
+  /// bound to one function declaration. Else nullopt
+  std::unordered_map<Symbol, std::optional<size_t>> global_functions;
 };
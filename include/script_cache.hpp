@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "object.hpp"
+
+struct VM;
+
+/// Compiled form of a script for the VM, cached in a .loxc file next to it.
+/// Loading it skips lexing, parsing, resolving, optimizing and compiling. A
+/// cache is only used for the same source and the same build of the
+/// interpreter, otherwise it is replaced.
+struct ScriptCache {
+  ScriptCache(const std::string &script, std::string_view source);
+
+  /// The cached compiled script, or nullptr if there is no valid cache.
+  /// Creates the globals of the script in vm, which must not have compiled
+  /// anything else
+  [[nodiscard]] Ref<ObjFunction> load(VM &vm) const;
+
+  /// Write the cache of the script compiled by vm. Failures are ignored,
+  /// since the cache is only an optimization
+  void store(const ObjFunction &script, const VM &vm) const;
+
+  /// Bumped whenever the layout of cache files changes
+  static constexpr uint32_t FORMAT_VERSION = 3;
+
+private:
+  // The script's name with .loxc appended rather than replacing its
+  // extension, so that a script named *.loxc isn't overwritten by its cache
+  std::string path;
+  // Of the source and the interpreter build. nullopt if the build can't be
+  // identified, then nothing is cached
+  std::optional<uint64_t> key;
+};
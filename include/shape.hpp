@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "symbol.hpp"
+
+struct Function;
+
+/// The field layout of instances: which field lives in which slot.
+/// Instances of a class that got the same fields in the same order share one
+/// Shape. Adding a field moves an instance along a transition to the next
+/// Shape, which is created once and then reused.
+struct Shape {
+  Shape();
+
+  Shape(const Shape &) = delete;
+  Shape &operator=(const Shape &) = delete;
+  Shape(Shape &&) = delete;
+  Shape &operator=(Shape &&) = delete;
+  ~Shape() = default;
+
+  static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  /// Slot of the field, or NOT_FOUND
+  [[nodiscard]] size_t find(Symbol name) const;
+
+  /// The Shape with the additional field name in the next slot.
+  /// The returned Shape is owned by this one
+  [[nodiscard]] Shape *with_field(Symbol name);
+
+  [[nodiscard]] const std::vector<Symbol> &field_names() const {
+    return fields;
+  }
+
+  /// Unique for the whole run, so caches cannot confuse a freed Shape with a
+  /// new one at the same address
+  const uint64_t id;
+
+private:
+  std::vector<Symbol> fields;
+  std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions;
+};
+
+/// Inline cache of a property access site. Remembers what the property
+/// resolved to for the last few Shapes seen at the site.
+struct PropertyCache {
+  enum class Kind : uint8_t {
+    FIELD,     // Field in slot
+    ADD_FIELD, // New field in slot, instance moves to transition
+    METHOD,
+    GETTER,
+    BINDING, // Global of a module in slot of its environment
+  };
+
+  struct Entry {
+    uint64_t shape_id = 0; // 0 is never a Shape id, so unused entries miss
+    Kind kind = Kind::FIELD;
+    size_t slot = 0;
+    Function *function = nullptr;
+    Shape *transition = nullptr;
+  };
+
+  static constexpr size_t SIZE = 4;
+
+  /// nullptr on a cache miss
+  [[nodiscard]] const Entry *find(const Shape &shape) const {
+    for (const auto &entry : entries) {
+      if (entry.shape_id == shape.id) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Add an entry. Once the site is megamorphic, evicts round-robin
+  const Entry &insert(const Entry &entry) {
+    auto &inserted = entries[next];
+    inserted = entry;
+    next = (next + 1) % SIZE;
+    return inserted;
+  }
+
+  std::array<Entry, SIZE> entries{};
+  size_t next = 0;
+};
+
+/// Caches are runtime state, so AST printing skips them
+std::ostream &operator<<(std::ostream &os, const PropertyCache &cache);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// The text of a script file, mapped read-only into memory. Lexing it doesn't
+/// copy the text, and the tokens point into the mapping. So it must outlive
+/// everything tokens end up in, like the AST.
+struct SourceFile {
+  /// Files that can't be mapped, like pipes, are read into memory instead.
+  /// nullopt if the file can't be opened or read
+  static std::optional<SourceFile> map(const std::string &filename);
+
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  SourceFile(SourceFile &&other) noexcept;
+  SourceFile &operator=(SourceFile &&other) noexcept;
+  ~SourceFile();
+
+  [[nodiscard]] std::string_view text() const { return {data, size}; }
+
+private:
+  SourceFile(const char *_data, size_t _size);
+  explicit SourceFile(std::vector<char> &&_buffer);
+
+  /// Reads the rest of fd, which it closes
+  static std::optional<SourceFile> read(int fd);
+
+  const char *data;
+  size_t size;
+  // Holds the text if it wasn't mapped. Moving it keeps data valid
+  std::vector<char> buffer;
+};
@@ -3,18 +3,6 @@
 #include "visitor.hpp"
 #include <vector>
 
-struct Statement {
-  Statement() noexcept = default;
-  virtual ~Statement();
-  Statement(const Statement &) = default;
-  Statement(Statement &&) = default;
-  Statement &operator=(Statement &&) noexcept = default;
-  Statement &operator=(const Statement &) = default;
-
-  virtual void print(std::ostream &os) const = 0;
-};
-using stmt = std::unique_ptr<Statement>;
-
 template <int id, typename... Types> struct StmtProduction;
 
 enum class FunctionKind {
@@ -30,36 +18,66 @@ std::string str(FunctionKind);
 
 std::ostream &operator<<(std::ostream &, FunctionKind);
 
+/// Whether functions of this kind are called with an instance as 'this'.
+/// 'this' then lives in slot 0 of the parameter scope
+bool has_receiver(FunctionKind);
+
 // clang-format off
 using PrintStmt = StmtProduction<0, expr>;                                                                 // expression (for printing)
 using ExprStmt = StmtProduction<1, expr>;                                                                  // expression
 using VarStmt = StmtProduction<2, Token, expr>;                                                            // name initializer
 using MalformedStmt = StmtProduction<3, bool, std::string>;                                                // is_critical message
-using BlockStmt = StmtProduction<4, std::vector<stmt>>;                                                    // statements
+using BlockStmt = StmtProduction<4, std::vector<stmt>, bool>;                                              // statements needs_environment
 using IfStmt = StmtProduction<5, expr, stmt, stmt>;                                                        //	condition then-stmt	else-stmt
 using EmptyStmt = StmtProduction<6>;
 using WhileStmt = StmtProduction<7, expr, stmt>;                                                           //	cond body
-using FunctionStmt = StmtProduction<8, Token, std::vector<Token>, std::vector<stmt>, FunctionKind>;        // name params body kind
-using ReturnStmt = StmtProduction<9, Token, expr>;                                                         // 'return' body
-using FunctionStmtPtr = std::unique_ptr<FunctionStmt>;        
+using FunctionStmt = StmtProduction<8, Token, std::vector<Token>, std::vector<stmt>, FunctionKind, bool>;  // name params body kind is_pure
+using ReturnStmt = StmtProduction<9, Token, expr, bool>;                                                   // 'return' body has_tail_call
+using FunctionStmtPtr = ArenaPtr<FunctionStmt>;
 using ClassStmt = StmtProduction<10, Token, std::vector<FunctionStmtPtr>, VarPtr>;                         // name methods superclass
+using ImportStmt = StmtProduction<11, Token, Token, bool>;                                                 // path name is_reimport
 // clang-format on
 
 #define STMT_TYPES                                                             \
   PrintStmt, ExprStmt, VarStmt, MalformedStmt, BlockStmt, IfStmt, EmptyStmt,   \
-      WhileStmt, FunctionStmt, ReturnStmt, ClassStmt
+      WhileStmt, FunctionStmt, ReturnStmt, ClassStmt, ImportStmt
+
+/// How the execution of a statement finished. Anything but NORMAL unwinds the
+/// enclosing statements up to the construct that handles it, like a function
+/// call for RETURN.
+enum class Completion : uint8_t {
+  NORMAL,
+  RETURN,
+  /// A return of a call in tail position. The function call that handles it
+  /// makes the pending call in place of itself
+  TAIL_CALL,
+};
+
+using StmtVisitor = Visitor<STMT_TYPES>;
+/// Visitor executing statements and reporting how they completed
+using StmtExecutor = ResultVisitor<Completion, STMT_TYPES>;
+using StmtVisitableBase = ResultVisitable<Completion, STMT_TYPES>;
+
+struct Statement : public StmtVisitableBase {
+  Statement() noexcept = default;
+  ~Statement() override;
+  Statement(const Statement &) = default;
+  Statement(Statement &&) = default;
+  Statement &operator=(Statement &&) noexcept = default;
+  Statement &operator=(const Statement &) = default;
+
+  virtual void print(std::ostream &os) const = 0;
+};
 
 template <int id, typename... Types>
 using StmtProductionVisitableImpl =
-    VisitableImpl<StmtProduction<id, Types...>, STMT_TYPES>;
-using StmtVisitor = Visitor<STMT_TYPES>;
-using StmtVisitableBase = Visitable<STMT_TYPES>;
+    ResultVisitableImpl<StmtProduction<id, Types...>, Statement, Completion,
+                        STMT_TYPES>;
 
 /// A production for statements.
 /// id is for disambiguation for identical template args
 template <int id, typename... Types>
-struct StmtProduction : public Statement,
-                        public StmtProductionVisitableImpl<id, Types...> {
+struct StmtProduction : public StmtProductionVisitableImpl<id, Types...> {
   explicit StmtProduction(Types... args) : derivatives(std::move(args)...) {}
 
   void print(std::ostream &os) const override {
@@ -93,7 +111,22 @@ struct StmtProduction : public Statement,
   void visit(EmptyStmt &) override;                                            \
   void visit(FunctionStmt &) override;                                         \
   void visit(ReturnStmt &) override;                                           \
-  void visit(ClassStmt &) override;
+  void visit(ClassStmt &) override;                                            \
+  void visit(ImportStmt &) override;
+
+#define DECLARE_STMT_EXEC_METHODS                                              \
+  Completion visit(VarStmt &) override;                                        \
+  Completion visit(MalformedStmt &) override;                                  \
+  Completion visit(BlockStmt &) override;                                      \
+  Completion visit(PrintStmt &) override;                                      \
+  Completion visit(ExprStmt &) override;                                       \
+  Completion visit(IfStmt &) override;                                         \
+  Completion visit(WhileStmt &) override;                                      \
+  Completion visit(EmptyStmt &) override;                                      \
+  Completion visit(FunctionStmt &) override;                                   \
+  Completion visit(ReturnStmt &) override;                                     \
+  Completion visit(ClassStmt &) override;                                      \
+  Completion visit(ImportStmt &) override;
 
 std::ostream &operator<<(std::ostream &os, const Statement &rhs);
 
@@ -103,6 +136,6 @@ std::ostream &operator<<(std::ostream &os,
 std::ostream &operator<<(std::ostream &os, const std::vector<stmt> &rhs);
 
 template <typename Type, typename... arg_types>
-stmt new_stmt(arg_types &&... args) {
-  return std::make_unique<Type>(std::forward<arg_types>(args)...);
+stmt new_stmt(Arena &arena, arg_types &&... args) {
+  return arena.make<Type>(std::forward<arg_types>(args)...);
 }
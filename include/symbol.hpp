@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+/// An interned string. All Symbols of equal strings share one immortal copy of
+/// the string, so Symbols are compared and hashed by pointer.
+struct Symbol {
+  /// The null symbol. It doesn't name anything and compares unequal to every
+  /// interned string
+  Symbol() = default;
+
+  /// Intern name. Thread-safe
+  explicit Symbol(std::string_view name);
+
+  [[nodiscard]] const std::string &str() const;
+
+  explicit operator bool() const { return string != nullptr; }
+
+  friend bool operator==(Symbol lhs, Symbol rhs) {
+    return lhs.string == rhs.string;
+  }
+
+private:
+  friend struct std::hash<Symbol>;
+
+  const std::string *string = nullptr;
+};
+
+template <> struct std::hash<Symbol> {
+  size_t operator()(Symbol symbol) const noexcept {
+    return std::hash<const std::string *>{}(symbol.string);
+  }
+};
+
+std::ostream &operator<<(std::ostream &os, Symbol symbol);
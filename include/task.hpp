@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "value.hpp"
+
+/// A value passed between heaps, like the argument and result of a task.
+/// Only nil, booleans, numbers, strings and arrays can be passed. Strings and
+/// arrays are copied, so nothing mutable is shared between threads.
+using Message =
+    std::variant<NullType, bool, double, std::string, std::vector<double>>;
+
+/// nullopt if the value can't be passed to another heap
+[[nodiscard]] std::optional<Message> to_message(const Value &value);
+
+/// The value of a message, created in the current heap
+[[nodiscard]] Value from_message(const Message &message);
+
+/// Result of a spawned task. Shared by the task and its future
+struct TaskState {
+  /// Run task on this thread and keep its result or exception
+  void run(const std::function<Message()> &task);
+
+  /// Block until the task finished. Rethrows the exception of a failed task
+  [[nodiscard]] const Message &wait();
+
+private:
+  std::mutex mutex;
+  std::condition_variable finished;
+  bool done = false;
+  Message result;
+  std::exception_ptr error;
+};
+
+/// Value returned by spawn() and awaited by await(). Holds no objects of
+/// the heap, so it isn't tracked.
+struct ObjFuture : public Obj {
+  explicit ObjFuture(std::shared_ptr<TaskState> _state);
+
+  [[nodiscard]] std::string to_string() const override;
+
+  const std::shared_ptr<TaskState> state;
+};
+
+/// Counts the running tasks of a program, so that everything they use of it,
+/// like its AST, is kept until they finished
+struct TaskGroup {
+  void add();
+  void finish();
+
+  /// Block until all added tasks finished
+  void wait();
+
+private:
+  std::mutex mutex;
+  std::condition_variable idle;
+  size_t running = 0;
+};
+
+/// Pool of worker threads that run tasks. Every worker has a queue of its
+/// own. Tasks submitted by a worker go to the back of its queue, others are
+/// spread over the queues. Workers take tasks from the back of their queue
+/// and then steal from the front of the others, so busy workers are helped.
+struct Scheduler {
+  explicit Scheduler(size_t worker_count);
+  ~Scheduler();
+
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+  Scheduler(Scheduler &&) = delete;
+  Scheduler &operator=(Scheduler &&) = delete;
+
+  void submit(std::function<void()> task);
+
+  /// The pool of all tasks, with a worker per core. Started on first use
+  static Scheduler &shared();
+
+  /// Native stack of a worker. Enough for the default call depth of the
+  /// tree-walker
+  static constexpr size_t STACK_SIZE = 256 * 1024 * 1024;
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void work(size_t index);
+
+  /// A queued task, preferring the worker's own queue
+  std::function<void()> take(size_t index);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> next_worker = 0;
+
+  std::mutex mutex;
+  std::condition_variable queued_task;
+  // Tasks in all queues that no worker has claimed yet
+  size_t queued = 0;
+  bool stopping = false;
+};
@@ -2,24 +2,17 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+#include "symbol.hpp"
+
 struct NullType {};
 
 bool operator==(const NullType &, const NullType &);
 bool operator!=(const NullType &, const NullType &);
 
-struct Callable;
-struct Class;
-struct Function;
-struct Instance;
-
-using InstancePtr = std::shared_ptr<Instance>;
-using CallablePtr = std::shared_ptr<Callable>;
-using FunctionPtr = std::shared_ptr<Function>;
-using ClassPtr = std::shared_ptr<Class>;
-
 std::ostream &operator<<(std::ostream &os, const NullType &rhs);
 
 struct Token {
@@ -29,6 +22,8 @@ struct Token {
     RIGHT_PAREN,
     LEFT_BRACE,
     RIGHT_BRACE,
+    LEFT_BRACKET,
+    RIGHT_BRACKET,
     COMMA,
     DOT,
     MINUS,
@@ -72,18 +67,23 @@ struct Token {
     TRUE,
     VAR,
     WHILE,
+    IMPORT,
     UNBOUND, // For methods that aren't bound (static methods)
 
     EOF_
   };
 
-  using Value = std::variant<double, std::string, NullType, bool, CallablePtr,
-                             InstancePtr>;
+  /// Payload of literals. Runtime values use the separate Value type
+  using Value = std::variant<double, std::string, NullType, bool>;
 
-  Token(TokenType _type, std::string _lexeme, Value _value, unsigned int _line);
+  Token(TokenType _type, std::string_view _lexeme, Value _value,
+        unsigned int _line);
 
   const TokenType type;
-  const std::string lexeme;
+  /// Points into the source text, which must outlive the token
+  const std::string_view lexeme;
+  /// Interned lexeme of names (identifiers, 'this' and 'super'), else null
+  const Symbol symbol;
   Value value;
   const unsigned int line;
 };
@@ -95,16 +95,3 @@ std::ostream &operator<<(std::ostream &os, const Token::Value &value);
 std::ostream &operator<<(std::ostream &os, const std::vector<Token> &value);
 
 std::string stringify(const Token::Value &value);
-
-template <typename T>
-std::shared_ptr<T> get_callable_as(const Token::Value &value) {
-  static_assert(std::is_same_v<T, Class> || std::is_same_v<T, Function>,
-                "Callable must be a class or function");
-
-  if (const auto *val = std::get_if<CallablePtr>(&value)) {
-    if (auto casted = std::dynamic_pointer_cast<T>(*val)) {
-      return casted;
-    }
-  }
-  return nullptr;
-}
\ No newline at end of file
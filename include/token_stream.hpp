@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "lexer.hpp"
+#include "token.hpp"
+
+/// The tokens a Parser consumes. They are pulled from a Lexer on demand, or
+/// taken from an already lexed vector. Only the last few tokens are kept in a
+/// ring buffer, so memory doesn't grow with the length of the source.
+struct TokenStream {
+  /// Lexes while parsing. The lexer must outlive the stream
+  explicit TokenStream(Lexer &_lexer);
+  explicit TokenStream(std::vector<Token> _tokens);
+
+  /// The next token to be consumed
+  [[nodiscard]] const Token &peek() const;
+
+  /// The last consumed token. Only valid after an advance()
+  [[nodiscard]] const Token &previous() const;
+
+  /// Consume the current token. EOF_ is never consumed
+  void advance();
+
+  /// Whether the lexer reported an error in the tokens pulled so far
+  [[nodiscard]] bool lexing_failed() const;
+
+private:
+  Token pull();
+
+  // The parser looks one token back. The remaining slots keep references
+  // to earlier tokens valid for a few more tokens.
+  static constexpr size_t RING_SIZE = 4;
+
+  [[nodiscard]] static size_t slot(size_t position) {
+    return position % RING_SIZE;
+  }
+
+  Lexer *lexer = nullptr;
+  std::vector<Token> tokens;
+  size_t next_token = 0;
+
+  std::array<std::optional<Token>, RING_SIZE> ring;
+  // Position of the current token in the whole stream
+  size_t current = 0;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+#include "token.hpp"
+#include "value.hpp"
+
+/// Types of the operands an operator site evaluated
+enum class OperandTypes : uint8_t { OTHER, NUMBERS, STRINGS };
+
+template <typename... Operands>
+[[nodiscard]] OperandTypes operand_types(const Operands &...operands) {
+  if ((operands.is_number() && ...)) {
+    return OperandTypes::NUMBERS;
+  }
+  if ((operands.is_string() && ...)) {
+    return OperandTypes::STRINGS;
+  }
+  return OperandTypes::OTHER;
+}
+
+/// Operators specialized to the types of their operands. Each one guards
+/// that its operands still have those types
+enum class Quickened : uint8_t {
+  GENERIC,
+  NUMBER_ADD,
+  NUMBER_SUBTRACT,
+  NUMBER_MULTIPLY,
+  NUMBER_DIVIDE,
+  NUMBER_GREATER,
+  NUMBER_GREATER_EQUAL,
+  NUMBER_LESS,
+  NUMBER_LESS_EQUAL,
+  NUMBER_EQUAL,
+  NUMBER_NOT_EQUAL,
+  NUMBER_NEGATE,
+  STRING_CONCATENATE,
+  STRING_GREATER,
+  STRING_GREATER_EQUAL,
+  STRING_LESS,
+  STRING_LESS_EQUAL,
+};
+
+/// Type feedback of an operator site, like a Binary. The Interpreter
+/// observes the operand types of the generic operator, and once they were
+/// the same STABLE_OBSERVATIONS times in a row, the site is quickened to the
+/// operator specialized to them. When its guard fails, the site is
+/// de-optimized back to the generic operator and observed again. After
+/// MAX_DEOPTIMIZATIONS, the site is polymorphic and stays generic.
+///
+/// A quickened site whose right operand is a number Literal reads it in
+/// place, instead of evaluating the Literal through the visitor.
+///
+/// Tasks run the AST of pure functions in parallel, so the state is atomic.
+/// Racing updates only lose observations, since the guards check the types.
+struct TypeFeedback {
+  static constexpr uint8_t STABLE_OBSERVATIONS = 8;
+  static constexpr uint8_t MAX_DEOPTIMIZATIONS = 4;
+
+  TypeFeedback() = default;
+  TypeFeedback(const TypeFeedback &other)
+      : state(other.state.load(std::memory_order_relaxed)) {}
+  TypeFeedback &operator=(const TypeFeedback &other) {
+    state.store(other.state.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    return *this;
+  }
+  ~TypeFeedback() = default;
+
+  struct State {
+    Quickened quickened = Quickened::GENERIC;
+    OperandTypes types = OperandTypes::OTHER;
+    uint8_t observations : 4 = 0;
+    uint8_t deoptimizations : 4 = 0;
+    /// The right operand is a number Literal
+    bool constant_right = false;
+  };
+
+  [[nodiscard]] State quickening() const {
+    return state.load(std::memory_order_relaxed);
+  }
+
+  /// Count an evaluation of the generic operator op on operands. True if
+  /// that quickened the site
+  template <typename... Operands>
+  bool observe(Token::TokenType op, const Operands &...operands) {
+    return record(op, sizeof...(Operands) == 1, operand_types(operands...));
+  }
+
+  /// Read the right operand of the quickened site in place from now on
+  void set_constant_right();
+
+  /// Back to the generic operator, after the guard of the quickened one
+  /// failed
+  void deoptimize();
+
+private:
+  bool record(Token::TokenType op, bool is_unary, OperandTypes types);
+
+  std::atomic<State> state;
+  static_assert(std::atomic<State>::is_always_lock_free);
+};
+
+/// Feedback is runtime state, so AST printing skips it
+std::ostream &operator<<(std::ostream &os, const TypeFeedback &feedback);
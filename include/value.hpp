@@ -0,0 +1,337 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "gc.hpp"
+#include "symbol.hpp"
+#include "token.hpp"
+
+struct Obj;
+
+/// Called by Obj::trace() for every object referenced by the traced one
+using Tracer = void (*)(Obj *);
+
+/// Base of all heap-allocated runtime objects.
+/// Objects are reference counted intrusively, so copying a Value only bumps a
+/// plain integer instead of going through shared_ptr's atomic control block.
+/// Objects that can be part of reference cycles are additionally tracked by
+/// the cycle collector (see gc.hpp).
+struct Obj {
+  enum class Type : uint8_t {
+    STRING,
+    ARRAY,
+    FUTURE,
+    // Objects of the bytecode VM
+    FUNCTION,
+    NATIVE,
+    CLOSURE,
+    UPVALUE,
+    CLASS,
+    INSTANCE,
+    BOUND_METHOD,
+    // Objects of the tree-walking Interpreter
+    CALLABLE,
+    TREE_INSTANCE,
+    ENVIRONMENT,
+  };
+
+  // Defined by the collector, which keeps a list of the tracked objects
+  explicit Obj(Type _type);
+  virtual ~Obj();
+  Obj(const Obj &) = delete;
+  Obj &operator=(const Obj &) = delete;
+  Obj(Obj &&) = delete;
+  Obj &operator=(Obj &&) = delete;
+
+  [[nodiscard]] virtual std::string to_string() const = 0;
+
+  /// Call tracer once for every counted reference this object holds.
+  /// Objects that hold references must override this and clear_references()
+  virtual void trace(Tracer) const {}
+
+  /// Drop all held references. Used to break unreachable reference cycles
+  virtual void clear_references() {}
+
+  // Both are hidden by subclasses and looked up on the created type by
+  // make_obj()
+
+  /// Bytes an object was created with on top of its size, like characters
+  [[nodiscard]] size_t payload_bytes() const { return 0; }
+
+  /// What allocations of the object count as
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::OTHER;
+
+  /// Objects that can't reference tracked objects are not tracked
+  [[nodiscard]] bool is_tracked() const {
+    return type != Type::STRING && type != Type::ARRAY &&
+           type != Type::FUTURE && type != Type::FUNCTION &&
+           type != Type::NATIVE;
+  }
+
+  const Type type;
+  uint32_t ref_count = 0;
+
+  /// Reference count of objects that are never freed. Their count is never
+  /// changed, so they can be shared by all threads
+  static constexpr uint32_t IMMORTAL = UINT32_MAX;
+
+  // State of the cycle collector
+  int64_t gc_refs = 0;
+  bool gc_reachable = false;
+  // Set by GC::account() once the object is counted. Grows with what the
+  // object allocates later, which might happen through a const object
+  GC::Kind gc_kind = GC::Kind::OTHER;
+  mutable uint32_t gc_bytes = 0;
+  Obj *gc_previous = nullptr;
+  Obj *gc_next = nullptr;
+};
+
+inline void retain(Obj *obj) {
+  if (obj->ref_count != Obj::IMMORTAL) {
+    ++obj->ref_count;
+  }
+}
+
+/// Free an object that is no longer referenced. Defined by the collector
+void destroy(Obj *obj);
+
+inline void release(Obj *obj) {
+  if (obj->ref_count != Obj::IMMORTAL && --obj->ref_count == 0) {
+    destroy(obj);
+  }
+}
+
+/// Owning counted reference to an Obj of a known type.
+template <typename T> struct Ref {
+  Ref() = default;
+  Ref(std::nullptr_t) {} // NOLINT: implicit like for smart pointers
+  explicit Ref(T *_ptr) : ptr(_ptr) {
+    if (ptr != nullptr) {
+      retain(ptr);
+    }
+  }
+  Ref(const Ref &other) : Ref(other.ptr) {}
+  Ref(Ref &&other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+  template <typename U>
+    requires std::is_convertible_v<U *, T *>
+  Ref(Ref<U> other) noexcept // NOLINT: implicit upcast like for smart pointers
+      : ptr(other.release()) {}
+  Ref &operator=(Ref other) noexcept {
+    std::swap(ptr, other.ptr);
+    return *this;
+  }
+  ~Ref() {
+    if (ptr != nullptr) {
+      ::release(ptr);
+    }
+  }
+
+  [[nodiscard]] T *get() const { return ptr; }
+  T *operator->() const { return ptr; }
+  T &operator*() const { return *ptr; }
+  explicit operator bool() const { return ptr != nullptr; }
+
+  /// Give up ownership without decrementing the reference count
+  [[nodiscard]] T *release() { return std::exchange(ptr, nullptr); }
+
+  friend bool operator==(const Ref &lhs, std::nullptr_t) {
+    return lhs.ptr == nullptr;
+  }
+  friend bool operator==(const Ref &lhs, const Ref &rhs) {
+    return lhs.ptr == rhs.ptr;
+  }
+
+private:
+  T *ptr = nullptr;
+};
+
+template <typename T, typename... Args> Ref<T> make_obj(Args &&...args) {
+  Ref<T> obj(new T(std::forward<Args>(args)...));
+  GC::account(*obj, T::ALLOCATION_KIND, sizeof(T) + obj->payload_bytes());
+  return obj;
+}
+
+/// A runtime value of both backends in 8 bytes, using NaN-boxing.
+/// Numbers are stored as the plain double. nil, booleans and object pointers
+/// are stored in the unused payload of quiet NaNs. Object values are counted
+/// references to their Obj.
+struct Value {
+  Value() noexcept = default;
+  Value(NullType) noexcept {} // NOLINT: implicit conversion is intended
+  Value(bool boolean) noexcept // NOLINT
+      : bits(boolean ? TRUE_BITS : FALSE_BITS) {}
+  Value(double number) noexcept // NOLINT
+      : bits(std::bit_cast<uint64_t>(number)) {}
+  Value(Obj *obj) noexcept // NOLINT
+      : bits(SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(obj)) {
+    retain(obj);
+  }
+  template <typename T>
+  Value(const Ref<T> &ref) noexcept // NOLINT
+      : Value(static_cast<Obj *>(ref.get())) {}
+
+  Value(const Value &other) noexcept : bits(other.bits) {
+    if (is_obj()) {
+      retain(as_obj());
+    }
+  }
+
+  Value(Value &&other) noexcept : bits(std::exchange(other.bits, NIL_BITS)) {}
+
+  Value &operator=(const Value &other) noexcept {
+    Value copy{other};
+    swap(copy);
+    return *this;
+  }
+
+  Value &operator=(Value &&other) noexcept {
+    Value moved{std::move(other)};
+    swap(moved);
+    return *this;
+  }
+
+  ~Value() {
+    if (is_obj()) {
+      release(as_obj());
+    }
+  }
+
+  void swap(Value &other) noexcept { std::swap(bits, other.bits); }
+
+  [[nodiscard]] bool is_nil() const { return bits == NIL_BITS; }
+  [[nodiscard]] bool is_bool() const { return (bits | 1U) == TRUE_BITS; }
+  [[nodiscard]] bool is_number() const { return (bits & QNAN) != QNAN; }
+  [[nodiscard]] bool is_obj() const {
+    return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+  }
+  [[nodiscard]] bool is_obj_type(Obj::Type obj_type) const {
+    return is_obj() && as_obj()->type == obj_type;
+  }
+  [[nodiscard]] bool is_string() const {
+    return is_obj_type(Obj::Type::STRING);
+  }
+
+  [[nodiscard]] bool as_bool() const { return bits == TRUE_BITS; }
+  [[nodiscard]] double as_number() const {
+    return std::bit_cast<double>(bits);
+  }
+  [[nodiscard]] Obj *as_obj() const {
+    // NOLINTNEXTLINE: cppcoreguidelines-pro-type-reinterpret-cast
+    return reinterpret_cast<Obj *>(bits & ~(SIGN_BIT | QNAN));
+  }
+
+  /// Unchecked downcast of the held object. Check is_obj_type() first.
+  template <typename T> [[nodiscard]] T *as() const {
+    return static_cast<T *>(as_obj());
+  }
+
+  /// All values except nil and false are truthy
+  [[nodiscard]] bool is_truthy() const {
+    return bits != NIL_BITS && bits != FALSE_BITS;
+  }
+
+private:
+  friend struct std::hash<Value>;
+
+  static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+  // Exponent, quiet bit and one more bit, so no NaN produced by arithmetic
+  // looks like a boxed value
+  static constexpr uint64_t QNAN = 0x7ffc000000000000;
+
+  static constexpr uint64_t NIL_BITS = QNAN | 1U;
+  static constexpr uint64_t FALSE_BITS = QNAN | 2U;
+  static constexpr uint64_t TRUE_BITS = QNAN | 3U;
+
+  uint64_t bits = NIL_BITS;
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t));
+
+/// Values of different types are never equal. Strings compare by content,
+/// other objects by identity. Two interned strings are equal only if they are
+/// the same object.
+bool operator==(const Value &lhs, const Value &rhs);
+bool operator!=(const Value &lhs, const Value &rhs);
+
+/// Consistent with ==, so equal strings hash alike
+template <> struct std::hash<Value> {
+  size_t operator()(const Value &value) const noexcept;
+};
+
+std::string stringify(const Value &value);
+
+inline void trace(Tracer tracer, const Value &value) {
+  if (value.is_obj()) {
+    tracer(value.as_obj());
+  }
+}
+
+template <typename T> void trace(Tracer tracer, const Ref<T> &ref) {
+  if (ref != nullptr) {
+    tracer(ref.get());
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, const Value &value);
+
+/// Immutable string. Concatenating long strings only creates a node that
+/// references both parts (a rope), so appending to a string in a loop doesn't
+/// copy all previous characters every time. The parts are joined into one
+/// flat string the first time the characters are needed.
+struct ObjString : public Obj {
+  explicit ObjString(std::string _chars, Symbol _symbol = Symbol());
+  ObjString(Ref<ObjString> _left, Ref<ObjString> _right);
+  ~ObjString() override;
+
+  ObjString(const ObjString &) = delete;
+  ObjString &operator=(const ObjString &) = delete;
+  ObjString(ObjString &&) = delete;
+  ObjString &operator=(ObjString &&) = delete;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  [[nodiscard]] size_t payload_bytes() const { return flat.size(); }
+
+  static constexpr GC::Kind ALLOCATION_KIND = GC::Kind::STRING;
+
+  /// The characters. Joins the parts of a concatenation
+  [[nodiscard]] const std::string &chars() const;
+
+  /// Number of characters, without joining the parts
+  [[nodiscard]] size_t size() const { return length; }
+
+  /// Set if this is the interned string of this symbol
+  const Symbol symbol;
+
+  /// Concatenations shorter than this are copied right away
+  static constexpr size_t MIN_ROPE_LENGTH = 256;
+
+private:
+  void flatten() const;
+
+  // Only complete once the parts are joined
+  mutable std::string flat;
+  // Parts of a concatenation until they are joined, else nullptr
+  mutable Ref<ObjString> left;
+  mutable Ref<ObjString> right;
+  const size_t length;
+};
+
+Value make_string(std::string chars);
+
+/// The string of left followed by the string of right. Values that aren't
+/// strings are stringified
+Value concatenate(const Value &left, const Value &right);
+
+/// The one immortal string object of this symbol, shared by all threads. Names
+/// and literals use these, so they neither allocate per use nor compare by
+/// content.
+Value intern_string(Symbol symbol);
+
+/// The runtime value of a literal from the source code
+Value from_literal(const Token::Value &literal);
@@ -7,15 +7,14 @@
 //
 // Usage:
 // Subclasses of Visitable:
-//	class Mesh : public Object, public VisitableImpl<Mesh, Mesh, Text> {};
-//	class Text : public Object, public VisitableImpl<Text, Mesh, Text> {};
+//	class Object : public Visitable<Mesh, Text> {};
+//	class Mesh : public VisitableImpl<Mesh, Object, Mesh, Text> {};
+//	class Text : public VisitableImpl<Text, Object, Mesh, Text> {};
 // Visitor subclass:
 //	class Renderer : public Visitor<Mesh, Text>{};
 //
 // Then later on, use through a Visitor<Mesh, Text> pointer or reference.
-//	some_mesh_ptr->accept(some_renderer);
-// To optain this, you probably need to static_cast to it, but that's fine
-// because this is all compile-time decided
+//	some_object_ptr->accept(some_renderer);
 #pragma once
 template <typename... Types> struct Visitor;
 
@@ -36,6 +35,29 @@ struct Visitor<T, Types...> : public Visitor<Types...> {
   virtual void visit(T &visitable) = 0;
 };
 
+/// Like Visitor, but every visit returns a Result. Used by visitors that
+/// compute a value for each node, so the value does not need to be passed
+/// through a member
+template <typename Result, typename... Types> struct ResultVisitor;
+
+template <typename Result, typename T> struct ResultVisitor<Result, T> {
+  ResultVisitor() = default;
+  virtual ~ResultVisitor() = default;
+  ResultVisitor(const ResultVisitor &) = default;
+  ResultVisitor(ResultVisitor &&) noexcept = default;
+  ResultVisitor &operator=(ResultVisitor &&) noexcept = default;
+  ResultVisitor &operator=(const ResultVisitor &) = default;
+
+  virtual Result visit(T &visitable) = 0;
+};
+
+template <typename Result, typename T, typename... Types>
+struct ResultVisitor<Result, T, Types...>
+    : public ResultVisitor<Result, Types...> {
+  using ResultVisitor<Result, Types...>::visit;
+  virtual Result visit(T &visitable) = 0;
+};
+
 template <typename... Types> struct Visitable {
   Visitable() = default;
   virtual ~Visitable() = default;
@@ -47,9 +69,28 @@ template <typename... Types> struct Visitable {
   virtual void accept(Visitor<Types...> &visitor) = 0;
 };
 
-template <typename Derived, typename... Types>
-struct VisitableImpl : public Visitable<Types...> {
-  virtual void accept(Visitor<Types...> &visitor) {
+/// A Visitable that additionally accepts ResultVisitors with a fixed Result
+template <typename Result, typename... Types>
+struct ResultVisitable : public Visitable<Types...> {
+  using Visitable<Types...>::accept;
+  virtual Result accept(ResultVisitor<Result, Types...> &visitor) = 0;
+};
+
+/// Implements accept() for Derived. Base is the Visitable that Derived
+/// (indirectly) inherits from, usually the base of the node hierarchy. That way
+/// nodes are visited through their base without any cross-cast
+template <typename Derived, typename Base, typename... Types>
+struct VisitableImpl : public Base {
+  void accept(Visitor<Types...> &visitor) override {
     visitor.visit(static_cast<Derived &>(*this));
   }
 };
+
+template <typename Derived, typename Base, typename Result, typename... Types>
+struct ResultVisitableImpl : public VisitableImpl<Derived, Base, Types...> {
+  using VisitableImpl<Derived, Base, Types...>::accept;
+
+  Result accept(ResultVisitor<Result, Types...> &visitor) override {
+    return visitor.visit(static_cast<Derived &>(*this));
+  }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "interpreter.hpp"
+#include "object.hpp"
+
+/// Stack-based virtual machine executing the bytecode produced by the
+/// Compiler. This is an alternative backend to the tree-walking Interpreter
+/// with the same language semantics.
+struct VM {
+  VM(std::ostream &_os, std::shared_ptr<ErrorHandler> _err_handler);
+
+  VM(const VM &) = delete;
+  VM(VM &&) noexcept = delete;
+  VM &operator=(const VM &) = delete;
+  VM &operator=(VM &&) noexcept = delete;
+  ~VM();
+
+  /// Execute a compiled top-level script. Runtime errors are reported to the
+  /// error handler. May be called re-entrantly from native functions.
+  void interpret(const Ref<ObjFunction> &script);
+
+  /// Globals are referred to by u16 operands
+  static constexpr size_t MAX_GLOBALS =
+      size_t{std::numeric_limits<uint16_t>::max()} + 1;
+
+  /// Index of the global variable with this name. The global is created
+  /// undefined if it does not exist yet. Used by the Compiler.
+  /// @throws CompiletimeError if there are MAX_GLOBALS already
+  uint16_t global_slot(Symbol name);
+
+  [[nodiscard]] bool has_global(Symbol name) const;
+  [[nodiscard]] size_t global_count() const;
+
+  /// Names of all globals, by slot
+  [[nodiscard]] std::vector<std::string> global_names() const;
+
+  void define_native(const std::string &name, size_t arity, ObjNative::Fn fn);
+
+  std::ostream &out_stream;
+
+  const std::shared_ptr<ErrorHandler> err_handler;
+
+  /// Context for the builtins shared with the tree-walker. Their state, like
+  /// the interpreter_path used by includeStr(), lives here.
+  Interpreter host;
+
+  /// Value of the last top-level expression statement. Returned by eval()
+  Value last_value;
+
+  /// Allow this many nested calls. Only while nothing is executed
+  void set_max_call_depth(size_t depth);
+
+  // Maximum number of locals and temporaries of a single call frame
+  static constexpr size_t FRAME_SLOTS = 256;
+
+  // Stack slots per allowed call. Most frames need only a few
+  static constexpr size_t AVERAGE_FRAME_SLOTS = 32;
+
+private:
+  struct CallFrame {
+    ObjClosure *closure;
+    const uint8_t *ip;
+    // First stack slot of the frame. Holds the callee or receiver ('this')
+    Value *slots;
+  };
+
+  struct Global {
+    std::string name;
+    Value value;
+    bool defined = false;
+  };
+
+  /// Run a script on the current native stack, reporting runtime errors
+  void execute(const Ref<ObjFunction> &script);
+
+  /// Execute instructions until the frame at index base_frame returns
+  void run(size_t base_frame);
+
+  /// Counts the runs nested by natives that call back into Lox, like map()
+  /// and eval(). Each nests native frames, unlike calls from Lox code.
+  /// @throws RuntimeError once more are nested than fit on the native stack
+  struct NestedRun {
+    explicit NestedRun(VM &_vm);
+    ~NestedRun();
+
+    NestedRun(const NestedRun &) = delete;
+    NestedRun &operator=(const NestedRun &) = delete;
+    NestedRun(NestedRun &&) = delete;
+    NestedRun &operator=(NestedRun &&) = delete;
+
+    VM &vm;
+  };
+
+  void push(Value value) { *stack_top++ = std::move(value); }
+  Value pop() { return std::move(*--stack_top); }
+  [[nodiscard]] Value &peek(size_t distance) const {
+    return stack_top[-1 - static_cast<std::ptrdiff_t>(distance)];
+  }
+  /// Release all stack values above new_top
+  void pop_until(Value *new_top);
+
+  void call_value(const Value &callee, uint8_t argc);
+  void call(ObjClosure *closure, uint8_t argc);
+  void invoke(Symbol name, uint8_t argc);
+
+  /// Call a getter with the receiver on top of the stack. The receiver is
+  /// replaced by the result once the getter's frame returns.
+  void call_getter(ObjClosure *getter);
+
+  /// Let the frame just pushed for a tail call take the place of its caller,
+  /// which has nothing left to do but return the call's result
+  void replace_caller_frame();
+
+  /// Call callee and run it until it returned. Used by natives that call back
+  /// into Lox
+  Value call_to_completion(const Value &callee, const Value *arguments,
+                           uint8_t argc);
+
+  [[nodiscard]] ObjUpvalue *capture_upvalue(Value *local);
+  void close_upvalues(const Value *last);
+
+  /// Line of the instruction currently executed by the innermost frame
+  [[nodiscard]] unsigned int current_line() const;
+
+  /// An error with message at the token of the instruction currently
+  /// executed by the innermost frame, like those of the tree-walker
+  [[nodiscard]] RuntimeError
+  instruction_error(const std::string &message) const;
+
+  void define_buildins();
+
+  /// The module imported by path. Its file only runs on its first import
+  Value import_module(const std::string &path);
+
+  std::vector<CallFrame> frames;
+  size_t frame_count = 0;
+
+  std::unique_ptr<Value[]> stack;
+  size_t stack_size = 0;
+  Value *stack_top = nullptr;
+
+  ObjUpvalue *open_upvalues = nullptr;
+
+  size_t nested_runs = 0;
+  /// Nested runs that fit on the native stack of interpret(). 0 while
+  /// nothing is interpreted, like in the VMs of tasks, which aren't limited
+  size_t max_nested_runs = 0;
+
+  std::vector<Global> globals;
+  std::unordered_map<Symbol, uint16_t> global_slots;
+
+  /// Scripts compiled by eval(), by source. Evaluating the same source again
+  /// runs the script without compiling it. Unlike the tree-walker's, they
+  /// hold no AST, so sources beyond the limit are just compiled every time
+  std::unordered_map<std::string, Ref<ObjFunction>> eval_scripts;
+  static constexpr size_t MAX_EVAL_SCRIPTS = 1024;
+
+  /// Module objects by the canonical path of their file. Nil while the module
+  /// runs, to detect circular imports
+  std::unordered_map<std::string, Value> modules;
+};
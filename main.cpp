@@ -1,18 +1,67 @@
+#include <unistd.h>
+
+#include <charconv>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
-#include <sstream>
+#include <optional>
 #include <vector>
 
+#include "closure_compiler.hpp"
+#include "compiler.hpp"
+#include "embed.hpp"
 #include "error.hpp"
 #include "expr.hpp"
+#include "gc.hpp"
 #include "interpreter.hpp"
 #include "lexer.hpp"
 #include "logging.hpp"
+#include "optimizer.hpp"
+#include "output.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
 #include "resolver.hpp"
+#include "script_cache.hpp"
+#include "source.hpp"
+#include "vm.hpp"
+
+struct Options {
+  Backend backend = Backend::TREE_WALKER;
+  std::optional<std::string> script = std::nullopt;
+  /// File the collapsed call stacks are written to, if profiling
+  std::optional<std::string> profile = std::nullopt;
+  /// Bytes of output buffered before they are written
+  size_t output_buffer = OutputBuffer::DEFAULT_CAPACITY;
+  /// Calls that may be nested at once
+  size_t max_call_depth = Interpreter::DEFAULT_MAX_CALL_DEPTH;
+  /// Load and store compiled scripts of the VM in .loxc files
+  bool cache = true;
+  /// Print the allocations of the heap at exit
+  bool mem_stats = false;
+  /// Live bytes of objects past which the script fails, 0 for no limit
+  size_t max_heap = 0;
+};
+
+/// Redirects std::cout into an OutputBuffer for as long as it lives
+struct BufferedStdout {
+  explicit BufferedStdout(size_t capacity)
+      : buffer(STDOUT_FILENO, capacity), original(std::cout.rdbuf(&buffer)) {}
+  ~BufferedStdout() {
+    std::cout.flush();
+    std::cout.rdbuf(original);
+  }
+
+  BufferedStdout(const BufferedStdout &) = delete;
+  BufferedStdout &operator=(const BufferedStdout &) = delete;
+  BufferedStdout(BufferedStdout &&) = delete;
+  BufferedStdout &operator=(BufferedStdout &&) = delete;
+
+  OutputBuffer buffer;
+  std::streambuf *original;
+};
 
 static void log_tokens(const std::vector<Token> &tokens) {
   LOG_DEBUG("\nTokens after parse:");
@@ -24,27 +73,127 @@ static void log_tokens(const std::vector<Token> &tokens) {
   LOG_DEBUG("\n");
 }
 
+// Backends are created on first use and keep their state across REPL lines
+static Interpreter &
+tree_walker(const std::shared_ptr<ErrorHandler> &err_handler) {
+  static Interpreter interpreter{std::cout, err_handler};
+  return interpreter;
+}
+
+static VM &vm(const std::shared_ptr<ErrorHandler> &err_handler) {
+  static VM machine{std::cout, err_handler};
+  return machine;
+}
+
+static Profiler &profiler() {
+  static Profiler instance;
+  return instance;
+}
+
+/// Print the summary and write the call stacks of the profiled run
+static void write_profile(const Options &options) {
+  if (!options.profile.has_value()) {
+    return;
+  }
+
+  profiler().stop();
+  profiler().write_summary(std::cerr);
+
+  std::ofstream file{*options.profile};
+  if (!file) {
+    LOG_ERROR("Profile could not be written to ", *options.profile);
+    return;
+  }
+  profiler().write_collapsed(file);
+}
+
+/// Print the allocations of the heap, if asked for
+static void write_mem_stats(const Options &options) {
+  if (options.mem_stats) {
+    GC::write_stats(std::cerr);
+  }
+}
+
+/// Runs execution. When the script calls exit(), the process exits right away
+static void exit_on_request(const std::function<void()> &execution,
+                            const Options &options) {
+  try {
+    execution();
+  } catch (const Exit &e) {
+    LOG_INFO("Interpretation terminated: ", e.what());
+    write_profile(options);
+    write_mem_stats(options);
+    std::exit(0);
+  }
+}
+
+static void execute(std::vector<stmt> &statements,
+                    const std::shared_ptr<ErrorHandler> &err_handler,
+                    Backend backend, const ScriptCache *cache) {
+  if (backend == Backend::TREE_WALKER) {
+    tree_walker(err_handler).interpret(statements);
+    return;
+  }
+  if (backend == Backend::CLOSURES) {
+    tree_walker(err_handler).interpret(ClosureCompiler{}.compile(statements));
+    return;
+  }
+
+  Compiler compiler{vm(err_handler), err_handler};
+  const auto script = compiler.compile(statements);
+  if (script) {
+    if (cache != nullptr) {
+      cache->store(*script, vm(err_handler));
+    }
+    vm(err_handler).interpret(script);
+  }
+}
+
+/// The returned AST lives in arena, and its tokens point into source
 static std::vector<stmt>
-run(const std::string &source, const std::shared_ptr<ErrorHandler> &err_handler,
+run(std::string_view source, Arena &arena,
+    const std::shared_ptr<ErrorHandler> &err_handler, const Options &options,
     std::optional<std::string> maybe_filename = std::nullopt) {
-  static Interpreter interpreter{std::cout, err_handler};
+  const auto backend = options.backend;
+  // The VM shares the front-end and the builtins' context with the
+  // tree-walker through its host interpreter
+  Interpreter &interpreter = backend == Backend::VM ? vm(err_handler).host
+                                                    : tree_walker(err_handler);
 
   if (maybe_filename.has_value()) {
     interpreter.interpreter_path =
         std::filesystem::path(*maybe_filename).remove_filename().string();
   }
 
+  // Only the VM's compiled scripts of files are cached
+  std::optional<ScriptCache> cache;
+  if (options.cache && backend == Backend::VM && maybe_filename.has_value()) {
+    cache.emplace(*maybe_filename, source);
+    if (const auto script = cache->load(vm(err_handler))) {
+      exit_on_request([&] { vm(err_handler).interpret(script); }, options);
+      return {};
+    }
+  }
+
   Lexer lexer{source, err_handler};
-  std::vector<Token> tokens = lexer.lex();
+  std::vector<stmt> statements;
 
-  if (err_handler->has_error()) {
-    return {};
-  }
+  if (Logging::get_log_level() <= Logging::LogLevel::DEBUG) {
+    std::vector<Token> tokens = lexer.lex();
+
+    if (err_handler->has_error()) {
+      return {};
+    }
 
-  Parser parser{tokens, err_handler};
-  std::vector<stmt> statements = parser.parse();
+    log_tokens(tokens);
 
-  log_tokens(tokens);
+    Parser parser{std::move(tokens), arena, err_handler};
+    statements = parser.parse();
+  } else {
+    // Lexing errors are reported as the parser runs into them
+    Parser parser{lexer, arena, err_handler};
+    statements = parser.parse();
+  }
 
   if (err_handler->has_error()) {
     return {};
@@ -57,15 +206,17 @@ run(const std::string &source, const std::shared_ptr<ErrorHandler> &err_handler,
     return {};
   }
 
-  try {
-    interpreter.interpret(statements);
+  Optimizer optimizer{arena};
+  optimizer.optimize(statements);
 
-    if (err_handler->has_runtime_error()) {
-      return {};
-    }
-  } catch (const Exit &e) {
-    LOG_INFO("Interpretation terminated: ", e.what());
-    std::exit(0);
+  exit_on_request(
+      [&] {
+        execute(statements, err_handler, backend,
+                cache.has_value() ? &*cache : nullptr);
+      },
+      options);
+  if (err_handler->has_error() || err_handler->has_runtime_error()) {
+    return {};
   }
 
   Logging::newline(Logging::LogLevel::DEBUG);
@@ -73,21 +224,28 @@ run(const std::string &source, const std::shared_ptr<ErrorHandler> &err_handler,
   return statements;
 }
 
-static int run_prompt(const std::shared_ptr<ErrorHandler> &err_handler) {
+static int run_prompt(const std::shared_ptr<ErrorHandler> &err_handler,
+                      const Options &options) {
   std::string line{};
 
   // Save statements so the AST of previous prompt inputs stays alive. Required
-  // for proper handling of function declarations across input lines
+  // for proper handling of function declarations across input lines. All of
+  // them live in the same arena, which has to be destroyed last
+  Arena arena;
   std::vector<stmt> run_statements;
 
   while (true) {
     std::cout << "> ";
     std::getline(std::cin, line);
     if (std::cin.eof()) {
+      write_profile(options);
+      write_mem_stats(options);
       return 0;
     }
 
-    auto newly_run_statements = run(line, err_handler);
+    // The line is overwritten by the next input, but the AST still needs it
+    auto newly_run_statements =
+        run(arena.copy(line), arena, err_handler, options);
     run_statements.insert(run_statements.end(),
                           std::make_move_iterator(newly_run_statements.begin()),
                           std::make_move_iterator(newly_run_statements.end()));
@@ -96,18 +254,20 @@ static int run_prompt(const std::shared_ptr<ErrorHandler> &err_handler) {
   }
 }
 
-static int run_file(const char *filename,
-                    const std::shared_ptr<ErrorHandler> &err_handler) {
-  std::ifstream ifstr(filename);
-  std::stringstream ss{};
-  ss << ifstr.rdbuf();
-
-  if (!ifstr) {
+static int run_file(const std::string &filename,
+                    const std::shared_ptr<ErrorHandler> &err_handler,
+                    const Options &options) {
+  // Declared before the arena, since the AST points into the source
+  const auto source = SourceFile::map(filename);
+  if (!source.has_value()) {
     LOG_ERROR("File ", filename, " could not be opened");
     return 42;
   }
 
-  run(ss.str(), err_handler, filename);
+  Arena arena;
+  run(source->text(), arena, err_handler, options, filename);
+  write_profile(options);
+  write_mem_stats(options);
   if (err_handler->has_error()) {
     return 65;
   }
@@ -117,18 +277,102 @@ static int run_file(const char *filename,
   return 0;
 }
 
+/// Returns nullopt on invalid usage
+static std::optional<Options> parse_options(int argc, char *argv[]) {
+  Options options;
+  constexpr std::string_view profile_prefix = "--profile=";
+  constexpr std::string_view output_buffer_prefix = "--output-buffer=";
+  constexpr std::string_view max_call_depth_prefix = "--max-call-depth=";
+  constexpr std::string_view max_heap_prefix = "--max-heap=";
+
+  // Parses all of text as a size
+  const auto parse_size = [](std::string_view text, size_t &size) {
+    const auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), size);
+    return error == std::errc{} && end == text.data() + text.size();
+  };
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--backend=tree") {
+      options.backend = Backend::TREE_WALKER;
+    } else if (arg == "--backend=vm") {
+      options.backend = Backend::VM;
+    } else if (arg == "--backend=closures") {
+      options.backend = Backend::CLOSURES;
+    } else if (arg == "--no-cache") {
+      options.cache = false;
+    } else if (arg == "--mem-stats") {
+      options.mem_stats = true;
+    } else if (arg == "--profile") {
+      options.profile = "lox.folded";
+    } else if (arg.starts_with(profile_prefix)) {
+      options.profile = std::string(arg.substr(profile_prefix.size()));
+    } else if (arg.starts_with(output_buffer_prefix)) {
+      if (!parse_size(arg.substr(output_buffer_prefix.size()),
+                      options.output_buffer)) {
+        return std::nullopt;
+      }
+    } else if (arg.starts_with(max_call_depth_prefix)) {
+      if (!parse_size(arg.substr(max_call_depth_prefix.size()),
+                      options.max_call_depth) ||
+          options.max_call_depth == 0 ||
+          options.max_call_depth > Interpreter::MAX_CALL_DEPTH) {
+        return std::nullopt;
+      }
+    } else if (arg.starts_with(max_heap_prefix)) {
+      if (!parse_size(arg.substr(max_heap_prefix.size()), options.max_heap) ||
+          options.max_heap == 0) {
+        return std::nullopt;
+      }
+    } else if (arg.starts_with("--") || options.script.has_value()) {
+      return std::nullopt;
+    } else {
+      options.script = std::string(arg);
+    }
+  }
+
+  // Only the tree-walker's calls are instrumented
+  if (options.profile.has_value() && options.backend == Backend::VM) {
+    return std::nullopt;
+  }
+
+  return options;
+}
+
 int main(int argc, char *argv[]) {
   (void)std::setprecision(3);
   Logging::set_log_level(Logging::LogLevel::ERROR);
-  if (argc > 2) {
-    std::cout << "Usage: Lox [script]";
+
+  const auto options = parse_options(argc, argv);
+  if (!options.has_value()) {
+    std::cout << "Usage: Lox [--backend=tree|vm|closures] [--no-cache] "
+                 "[--profile[=file]] [--output-buffer=bytes] "
+                 "[--max-call-depth=calls] [--mem-stats] "
+                 "[--max-heap=bytes] [script]";
     return 64;
   }
 
+  // Flushed at exit, also through exit(). Constructed before the backends,
+  // so it outlives them
+  static BufferedStdout output{options->output_buffer};
+
   auto err_handler{std::make_shared<CerrHandler>()};
 
-  if (argc == 2) {
-    return run_file(argv[1], err_handler);
+  if (options->profile.has_value()) {
+    tree_walker(err_handler).profiler = &profiler();
+  }
+
+  if (options->backend == Backend::VM) {
+    vm(err_handler).set_max_call_depth(options->max_call_depth);
+  } else {
+    tree_walker(err_handler).max_call_depth = options->max_call_depth;
+  }
+  // Set once the builtins are created, so only the script's objects count
+  GC::current_heap().limit = options->max_heap;
+
+  if (options->script.has_value()) {
+    return run_file(*options->script, err_handler, *options);
   }
-  return run_prompt(err_handler);
+  return run_prompt(err_handler, *options);
 }
@@ -0,0 +1,31 @@
+# Profiles a script with methods and lambdas of the same name on the backends
+# with a profiler. Their frames must be told apart
+set(script ${CMAKE_CURRENT_BINARY_DIR}/profile_names.lox)
+set(profile ${CMAKE_CURRENT_BINARY_DIR}/profile_names.folded)
+file(WRITE ${script} [[
+class Square { area() { return 4; } }
+class Circle { area() { return 3; } }
+var double = |x| x * 2;
+var half = |x| x / 2;
+Square().area();
+Circle().area();
+double(1);
+half(1);
+]])
+
+foreach(backend tree closures)
+  execute_process(COMMAND ${LOX} --backend=${backend} --profile=${profile}
+                          ${script}
+                  ERROR_VARIABLE error RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "The ${backend} backend failed: ${error}")
+  endif()
+  file(READ ${profile} stacks)
+  foreach(frame "Square.area " "Circle.area " "lambda:3 " "lambda:4 ")
+    string(FIND "${stacks}" ";${frame}" found)
+    if(found EQUAL -1)
+      message(FATAL_ERROR "No frame ${frame}on ${backend}:\n${stacks}")
+    endif()
+  endforeach()
+endforeach()
+file(REMOVE ${script} ${profile})
@@ -0,0 +1,24 @@
+# Runs a script named like a cache file twice on the VM with caching enabled.
+# Its cache must be written next to it instead of over it
+set(script ${CMAKE_CURRENT_BINARY_DIR}/script_cache_name.loxc)
+set(source "print 1 + 2;\n")
+file(WRITE ${script} "${source}")
+file(REMOVE ${script}.loxc)
+
+foreach(run first second)
+  execute_process(COMMAND ${LOX} --backend=vm ${script}
+                  OUTPUT_VARIABLE output ERROR_VARIABLE error
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0 OR NOT output STREQUAL "3\n")
+    message(FATAL_ERROR "The ${run} run failed: ${output}${error}")
+  endif()
+endforeach()
+
+file(READ ${script} contents)
+if(NOT contents STREQUAL source)
+  message(FATAL_ERROR "The script was overwritten by its cache")
+endif()
+if(NOT EXISTS ${script}.loxc)
+  message(FATAL_ERROR "No cache was written to ${script}.loxc")
+endif()
+file(REMOVE ${script} ${script}.loxc)
@@ -0,0 +1,14 @@
+# Runs a script piped to /dev/stdin, which can't be mapped, on every backend
+set(script ${CMAKE_CURRENT_BINARY_DIR}/stdin_script.lox)
+file(WRITE ${script} "print 1 + 2;\n")
+
+foreach(backend tree vm closures)
+  execute_process(COMMAND cat ${script}
+                  COMMAND ${LOX} --backend=${backend} /dev/stdin
+                  OUTPUT_VARIABLE output ERROR_VARIABLE error
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0 OR NOT output STREQUAL "3\n")
+    message(FATAL_ERROR "The ${backend} backend failed: ${output}${error}")
+  endif()
+endforeach()
+file(REMOVE ${script})
@@ -0,0 +1,31 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+void *Arena::allocate(size_t size, size_t alignment) {
+  auto address = reinterpret_cast<uintptr_t>(next);
+  auto padding = (alignment - address % alignment) % alignment;
+
+  if (next == nullptr || padding + size > static_cast<size_t>(end - next)) {
+    // Objects larger than a block get a block of their own
+    const auto block_size = std::max(BLOCK_SIZE, size + alignment);
+    // NOLINTNEXTLINE: cppcoreguidelines-avoid-c-arrays
+    blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+    next = blocks.back().get();
+    end = next + block_size;
+    address = reinterpret_cast<uintptr_t>(next);
+    padding = (alignment - address % alignment) % alignment;
+  }
+
+  auto *memory = next + padding;
+  next = memory + size;
+  return memory;
+}
+
+std::string_view Arena::copy(std::string_view text) {
+  auto *memory = static_cast<char *>(allocate(text.size(), alignof(char)));
+  std::memcpy(memory, text.data(), text.size());
+  return {memory, text.size()};
+}
@@ -0,0 +1,104 @@
+#include "array.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+ObjArray::ObjArray(std::vector<double> _elements)
+    : Obj(Type::ARRAY), elements(std::move(_elements)) {}
+
+std::string ObjArray::to_string() const {
+  std::string representation = "[";
+  for (size_t i = 0; i < elements.size(); ++i) {
+    if (i > 0) {
+      representation += ", ";
+    }
+    representation += stringify(Token::Value{elements[i]});
+  }
+  return representation + "]";
+}
+
+std::optional<size_t> ObjArray::position(const Value &index) const {
+  if (!index.is_number()) {
+    return std::nullopt;
+  }
+  const auto number = index.as_number();
+  if (number < 0 || number >= static_cast<double>(elements.size()) ||
+      std::trunc(number) != number) {
+    return std::nullopt;
+  }
+  return static_cast<size_t>(number);
+}
+
+Value make_array(std::vector<double> elements) {
+  return make_obj<ObjArray>(std::move(elements));
+}
+
+namespace ArrayKernels {
+namespace {
+// Enough independent additions to fill the vector units and hide their latency
+constexpr size_t LANES = 8;
+
+/// Sum of lanes, added pairwise
+double reduce(const std::array<double, LANES> &partial) {
+  return ((partial[0] + partial[1]) + (partial[2] + partial[3])) +
+         ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+}
+} // namespace
+
+double sum(const std::vector<double> &elements) {
+  const auto *data = elements.data();
+  const auto size = elements.size();
+
+  std::array<double, LANES> partial{};
+  size_t i = 0;
+  for (; i + LANES <= size; i += LANES) {
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      partial[lane] += data[i + lane];
+    }
+  }
+
+  auto result = reduce(partial);
+  for (; i < size; ++i) {
+    result += data[i];
+  }
+  return result;
+}
+
+double dot(const std::vector<double> &lhs, const std::vector<double> &rhs) {
+  const auto *left = lhs.data();
+  const auto *right = rhs.data();
+  const auto size = lhs.size();
+
+  std::array<double, LANES> partial{};
+  size_t i = 0;
+  for (; i + LANES <= size; i += LANES) {
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      partial[lane] += left[i + lane] * right[i + lane];
+    }
+  }
+
+  auto result = reduce(partial);
+  for (; i < size; ++i) {
+    result += left[i] * right[i];
+  }
+  return result;
+}
+
+std::vector<double> scale(const std::vector<double> &elements,
+                          double factor) {
+  std::vector<double> scaled(elements.size());
+  std::transform(elements.cbegin(), elements.cend(), scaled.begin(),
+                 [factor](double element) { return element * factor; });
+  return scaled;
+}
+
+std::vector<double> sorted(std::vector<double> elements) {
+  // NaNs are equivalent to each other and greater than everything else, so
+  // the order stays strict weak
+  std::sort(elements.begin(), elements.end(), [](double lhs, double rhs) {
+    return lhs < rhs || (!std::isnan(lhs) && std::isnan(rhs));
+  });
+  return elements;
+}
+} // namespace ArrayKernels
@@ -1,17 +1,24 @@
 #include "buildin.hpp"
 
 #include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <new>
 #include <sstream>
 #include <unordered_map>
 
+#include "array.hpp"
 #include "callable.hpp"
 #include "error.hpp"
+#include "gc.hpp"
 #include "interpreter.hpp"
 #include "lexer.hpp"
 #include "logging.hpp"
+#include "memo_cache.hpp"
+#include "optimizer.hpp"
 #include "parser.hpp"
 #include "resolver.hpp"
+#include "task.hpp"
 
 namespace {
 /// Built-in function with 0 parameters
@@ -20,9 +27,8 @@ public:
   SimpleBuildin(std::string _name, Closure _action)
       : name(std::move(_name)), action(std::move(_action)) {}
 
-  Token::Value call(Interpreter &interpreter,
-                    const std::vector<Token::Value> &) override {
-    return Token::Value(action(interpreter));
+  Value call(Interpreter &interpreter, const std::vector<Value> &) override {
+    return Value(action(interpreter));
   }
 
   [[nodiscard]] size_t arity() const override { return 0; }
@@ -36,10 +42,161 @@ private:
   Closure action;
 };
 
+/// Built-in function with a fixed number of parameters
+template <typename Closure> struct ArgumentBuildin : public Callable {
+public:
+  ArgumentBuildin(std::string _name, size_t _arity, Closure _action)
+      : name(std::move(_name)), parameter_count(_arity),
+        action(std::move(_action)) {}
+
+  Value call(Interpreter &interpreter,
+             const std::vector<Value> &arguments) override {
+    return action(interpreter, arguments);
+  }
+
+  [[nodiscard]] size_t arity() const override { return parameter_count; }
+
+  [[nodiscard]] std::string to_string() const override {
+    return "<Native fn '" + name + "'>";
+  }
+
+private:
+  const std::string name;
+  const size_t parameter_count;
+  Closure action;
+};
+
+template <typename Closure>
+std::pair<std::string, CallablePtr> make_buildin(std::string name, size_t arity,
+                                                 Closure action) {
+  auto buildin =
+      make_obj<ArgumentBuildin<Closure>>(name, arity, std::move(action));
+  return {std::move(name), std::move(buildin)};
+}
+
+const std::vector<double> &array_argument(const Value &argument) {
+  if (!argument.is_obj_type(Obj::Type::ARRAY)) {
+    throw RuntimeError(stringify(argument), "must be an array", 0);
+  }
+  return argument.as<ObjArray>()->elements;
+}
+
+double number_argument(const Value &argument) {
+  if (!argument.is_number()) {
+    throw RuntimeError(stringify(argument), "must be a number", 0);
+  }
+  return argument.as_number();
+}
+
+/// Builtins of numeric arrays. They run over the unboxed elements, except
+/// map(), which calls a function for every element.
+std::vector<std::pair<std::string, CallablePtr>> array_buildins() {
+  using Arguments = const std::vector<Value> &;
+
+  std::vector<std::pair<std::string, CallablePtr>> buildins;
+
+  buildins.push_back(make_buildin("array", 1, [](Interpreter &, Arguments a) {
+    const auto size = number_argument(a[0]);
+    if (size < 0 || std::trunc(size) != size) {
+      throw RuntimeError(stringify(a[0]), "must be a whole number >= 0", 0);
+    }
+    if (size > static_cast<double>(ObjArray::MAX_SIZE)) {
+      throw RuntimeError("Array size must be at most " +
+                         std::to_string(ObjArray::MAX_SIZE) + ".");
+    }
+    const auto length = static_cast<size_t>(size);
+    // Before allocating, the elements are only counted by make_array()
+    GC::reserve(sizeof(ObjArray) + length * sizeof(double));
+    try {
+      return make_array(std::vector<double>(length));
+    } catch (const std::bad_alloc &) {
+      throw RuntimeError(stringify(a[0]), "elements don't fit in memory", 0);
+    }
+  }));
+
+  buildins.push_back(make_buildin("len", 1, [](Interpreter &, Arguments a) {
+    if (a[0].is_string()) {
+      return Value(static_cast<double>(a[0].as<ObjString>()->size()));
+    }
+    return Value(static_cast<double>(array_argument(a[0]).size()));
+  }));
+
+  buildins.push_back(make_buildin("sum", 1, [](Interpreter &, Arguments a) {
+    return Value(ArrayKernels::sum(array_argument(a[0])));
+  }));
+
+  buildins.push_back(make_buildin("dot", 2, [](Interpreter &, Arguments a) {
+    const auto &lhs = array_argument(a[0]);
+    const auto &rhs = array_argument(a[1]);
+    if (lhs.size() != rhs.size()) {
+      throw RuntimeError(stringify(a[1]),
+                         "must have as many elements as " + stringify(a[0]),
+                         0);
+    }
+    return Value(ArrayKernels::dot(lhs, rhs));
+  }));
+
+  buildins.push_back(make_buildin("scale", 2, [](Interpreter &, Arguments a) {
+    return make_array(
+        ArrayKernels::scale(array_argument(a[0]), number_argument(a[1])));
+  }));
+
+  buildins.push_back(make_buildin("sort", 1, [](Interpreter &, Arguments a) {
+    return make_array(ArrayKernels::sorted(array_argument(a[0])));
+  }));
+
+  buildins.push_back(
+      make_buildin("map", 2, [](Interpreter &interpreter, Arguments a) {
+        const auto &elements = array_argument(a[0]);
+        if (!a[1].is_obj_type(Obj::Type::CALLABLE) ||
+            a[1].as<Callable>()->arity() != 1) {
+          throw RuntimeError(stringify(a[1]),
+                             "must be a function with one parameter", 0);
+        }
+        auto *function = a[1].as<Callable>();
+
+        std::vector<double> mapped;
+        mapped.reserve(elements.size());
+        std::vector<Value> argument(1);
+        // The function may change the array, so elements are read by index
+        for (size_t i = 0; i < elements.size(); ++i) {
+          argument[0] = elements[i];
+          mapped.push_back(
+              number_argument(function->call(interpreter, argument)));
+        }
+        return make_array(std::move(mapped));
+      }));
+
+  return buildins;
+}
+
+/// Collects text in one growing buffer. Calling it appends the stringified
+/// argument and returns the builder, so appends can be chained. Its string
+/// representation is the collected text, so printing it or adding it to a
+/// string yields the text.
+struct StringBuilder : public Callable {
+public:
+  Value call(Interpreter &, const std::vector<Value> &arguments) override {
+    const auto &argument = arguments[0];
+    if (argument.is_string()) {
+      text += argument.as<ObjString>()->chars();
+    } else {
+      text += stringify(argument);
+    }
+    return Value(this);
+  }
+
+  [[nodiscard]] size_t arity() const override { return 1; }
+
+  [[nodiscard]] std::string to_string() const override { return text; }
+
+private:
+  std::string text;
+};
+
 struct SetLogLevel : public Callable {
 public:
-  Token::Value call(Interpreter &,
-                    const std::vector<Token::Value> &arguments) override {
+  Value call(Interpreter &, const std::vector<Value> &arguments) override {
     using Logging::LogLevel;
     const auto &log_level = arguments[0];
 
@@ -50,8 +207,8 @@ public:
         {"debug", LogLevel::DEBUG},
     };
 
-    if (!std::holds_alternative<std::string>(log_level) ||
-        str_to_log_level.contains(std::get<std::string>(log_level))) {
+    if (!log_level.is_string() ||
+        !str_to_log_level.contains(log_level.as<ObjString>()->chars())) {
       const Token error_token{Token::TokenType::FUN, to_string(), NullType{},
                               0};
       throw RuntimeError(
@@ -60,7 +217,7 @@ public:
     }
 
     Logging::set_log_level(
-        str_to_log_level.at(std::get<std ::string>(log_level)));
+        str_to_log_level.at(log_level.as<ObjString>()->chars()));
     return NullType{};
   }
 
@@ -73,39 +230,62 @@ public:
 
 struct Eval : public Callable {
 public:
-  Token::Value call(Interpreter &interpreter,
-                    const std::vector<Token::Value> &arguments) override {
+  Value call(Interpreter &interpreter,
+             const std::vector<Value> &arguments) override {
     using Logging::LogLevel;
     const auto &source = arguments[0];
 
-    if (!std::holds_alternative<std::string>(source)) {
+    if (!source.is_string()) {
       throw RuntimeError(
-          source,
+          stringify(source),
           "eval()'s first argument must be a string containing the source code",
           0);
     }
 
-    Lexer lexer{std::get<std::string>(source), interpreter.err_handler};
-    auto tokens = lexer.lex();
-    if (interpreter.err_handler->has_error()) {
-      return NullType{}; // Error already reported, but eval needs to be stopped
-    }
-
-    Parser parser{tokens, interpreter.err_handler};
-    auto statements = parser.parse();
-
-    if (interpreter.err_handler->has_error()) {
-      return NullType{};
+    auto &programs = interpreter.eval_programs;
+    std::shared_ptr<Interpreter::Program> program;
+    if (const auto cached = programs.find(source.as<ObjString>()->chars());
+        cached != programs.end()) {
+      program = cached->second;
+    } else {
+      program = std::make_shared<Interpreter::Program>();
+      program->source = source.as<ObjString>()->chars();
+
+      Lexer lexer{program->source, interpreter.err_handler};
+      Parser parser{lexer, program->arena, interpreter.err_handler};
+      program->statements = parser.parse();
+
+      if (interpreter.err_handler->has_error()) {
+        return NullType{};
+      }
+
+      Resolver resolver{interpreter};
+      resolver.resolve(program->statements);
+
+      if (interpreter.err_handler->has_error()) {
+        return NullType{};
+      }
+
+      Optimizer optimizer{program->arena};
+      optimizer.optimize(program->statements);
+
+      // Programs that are not kept are freed once they ran
+      if (resolver.declares_functions()) {
+        programs.emplace(program->source, program);
+      } else if (interpreter.kept_eval_programs <
+                 Interpreter::MAX_EVAL_PROGRAMS) {
+        ++interpreter.kept_eval_programs;
+        programs.emplace(program->source, program);
+      }
     }
 
-    Resolver resolver{interpreter};
-    resolver.resolve(statements);
-
-    if (interpreter.err_handler->has_error()) {
-      return NullType{};
-    }
-
-    interpreter.interpret(statements);
+    // The source was resolved as top-level code, so it runs in the globals
+    const Interpreter::ScopedGlobals scoped_globals{interpreter,
+                                                    interpreter.globals};
+    auto enclosing_env = interpreter.environment;
+    interpreter.environment = interpreter.globals;
+    interpreter.interpret(program->statements);
+    interpreter.environment = std::move(enclosing_env);
     return interpreter.last_value;
   }
 
@@ -118,24 +298,33 @@ public:
 
 struct IncludeStr : public Callable {
 public:
-  Token::Value call(Interpreter &interpreter,
-                    const std::vector<Token::Value> &arguments) override {
+  Value call(Interpreter &interpreter,
+             const std::vector<Value> &arguments) override {
     using Logging::LogLevel;
     const auto &filename = arguments[0];
 
-    if (!std::holds_alternative<std::string>(filename)) {
+    if (!filename.is_string()) {
       throw RuntimeError(
-          filename,
+          stringify(filename),
           "must be a string that specifies the name of the file to include", 0);
     }
 
     LOG_DEBUG("Currently interpreted path: ", interpreter.interpreter_path);
 
     auto file = std::filesystem::path(interpreter.interpreter_path)
-                    .append(std::get<std::string>(filename));
+                    .append(filename.as<ObjString>()->chars());
 
     LOG_DEBUG("Requested file for includeStr(): ", file);
 
+    // Files without a modification time are read every time
+    std::error_code error;
+    const auto modified = std::filesystem::last_write_time(file, error);
+    const auto cached = interpreter.included_files.find(file.string());
+    if (!error && cached != interpreter.included_files.cend() &&
+        cached->second.modified == modified) {
+      return cached->second.text;
+    }
+
     std::ifstream ifs{file};
 
     std::stringstream buffer;
@@ -143,10 +332,16 @@ public:
 
     if (!ifs) {
       throw RuntimeError(
-          filename, "There was an error reading the file for includeStr()", 0);
+          stringify(filename),
+          "There was an error reading the file for includeStr()", 0);
     }
 
-    return buffer.str();
+    auto text = make_string(buffer.str());
+    if (!error) {
+      interpreter.included_files.insert_or_assign(
+          file.string(), Interpreter::IncludedFile{modified, text});
+    }
+    return text;
   }
 
   [[nodiscard]] size_t arity() const override { return 1; }
@@ -158,24 +353,24 @@ public:
 
 struct Assert : public Callable {
 public:
-  Token::Value call(Interpreter &,
-                    const std::vector<Token::Value> &arguments) override {
+  Value call(Interpreter &, const std::vector<Value> &arguments) override {
     using Logging::LogLevel;
     const auto &condition = arguments[0];
     const auto &message = arguments[1];
 
-    if (!std::holds_alternative<bool>(condition)) {
-      throw RuntimeError(condition,
+    if (!condition.is_bool()) {
+      throw RuntimeError(stringify(condition),
                          "must be a boolean expression that is asserted", 0);
     }
 
-    if (!std::holds_alternative<std::string>(message)) {
-      throw RuntimeError(message,
+    if (!message.is_string()) {
+      throw RuntimeError(stringify(message),
                          "must be a string that specifies what went wrong", 0);
     }
 
-    if (!std::get<bool>(condition)) {
-      throw RuntimeError(condition, std::get<std::string>(message), 0);
+    if (!condition.as_bool()) {
+      throw RuntimeError(stringify(condition), message.as<ObjString>()->chars(),
+                         0);
     }
 
     return NullType{};
@@ -187,22 +382,230 @@ public:
     return "<Native fn 'assert'>";
   }
 };
+/// Function that caches its results. Calls with arguments it has seen
+/// before return the cached result without running the function.
+struct Memoized : public Callable {
+public:
+  explicit Memoized(FunctionPtr _function) : function(std::move(_function)) {}
+
+  Value call(Interpreter &interpreter,
+             const std::vector<Value> &arguments) override {
+    if (const auto *result = cache.find(arguments)) {
+      return *result;
+    }
+    auto result = function->call(interpreter, arguments);
+    cache.insert(arguments, result);
+    return result;
+  }
+
+  [[nodiscard]] size_t arity() const override { return function->arity(); }
+
+  [[nodiscard]] std::string to_string() const override {
+    return "<Native fn 'memoized " + std::string(function->name()) + "'>";
+  }
+
+  [[nodiscard]] const FunctionPtr &target() const { return function; }
+
+  void trace(Tracer tracer) const override {
+    ::trace(tracer, function);
+    cache.trace(tracer);
+  }
+
+  void clear_references() override {
+    function = nullptr;
+    cache.clear();
+  }
+
+private:
+  FunctionPtr function;
+  MemoCache cache;
+};
+
+struct Memoize : public Callable {
+public:
+  Value call(Interpreter &, const std::vector<Value> &arguments) override {
+    auto function = get_callable_as<Function>(arguments[0]);
+    if (function == nullptr || !function->is_pure()) {
+      throw RuntimeError(stringify(arguments[0]), "must be a pure function",
+                         0);
+    }
+    return make_obj<Memoized>(std::move(function));
+  }
+
+  [[nodiscard]] size_t arity() const override { return 1; }
+
+  [[nodiscard]] std::string to_string() const override {
+    return "<Native fn 'memoize'>";
+  }
+};
+/// The function of value, if value can run as a task. That are pure
+/// functions without a receiver, which only depend on their arguments and
+/// on the global functions they call. A memoized function runs without its
+/// cache
+const Function *task_function(const Value &value) {
+  if (!value.is_obj_type(Obj::Type::CALLABLE)) {
+    return nullptr;
+  }
+  auto *callable = value.as<Callable>();
+  if (auto *memoized = dynamic_cast<Memoized *>(callable)) {
+    callable = memoized->target().get();
+  }
+  const auto *function = dynamic_cast<Function *>(callable);
+  if (function == nullptr || !function->is_pure()) {
+    return nullptr;
+  }
+  const auto kind = function->definition().kind;
+  if (kind != FunctionKind::FUNCTION && kind != FunctionKind::LAMDBDA) {
+    return nullptr;
+  }
+  return function;
+}
+
+/// Runs a pure function with one argument on the Scheduler. The task gets a
+/// heap and interpreter of its own, with the pure global functions the
+/// function may call. Its argument and result are passed as Messages.
+struct Spawn : public Callable {
+public:
+  Value call(Interpreter &interpreter,
+             const std::vector<Value> &arguments) override {
+    const auto *function = task_function(arguments[0]);
+    if (function == nullptr || function->arity() != 1) {
+      throw RuntimeError(stringify(arguments[0]),
+                         "must be a pure function with one parameter", 0);
+    }
+    auto argument = to_message(arguments[1]);
+    if (!argument.has_value()) {
+      throw RuntimeError(stringify(arguments[1]),
+                         "can't be passed to a task. Only nil, booleans, "
+                         "numbers, strings and arrays can",
+                         0);
+    }
+
+    // The task sees the globals of the module that defined the function.
+    // Names of the module come first, since they hide the outer globals
+    std::vector<std::pair<Symbol, Function::Definition>> functions;
+    for (const auto *globals = function->module_globals().get();
+         globals != nullptr; globals = globals->enclosing.get()) {
+      for (const auto &[name, slot] : globals->slots) {
+        if (const auto *global = task_function(globals->values[slot])) {
+          functions.emplace_back(name, global->definition());
+        }
+      }
+    }
+
+    auto state = std::make_shared<TaskState>();
+    auto &group = interpreter.tasks;
+    group.add();
+    Scheduler::shared().submit([definition = function->definition(),
+                                functions = std::move(functions),
+                                argument = std::move(*argument), state,
+                                &group, limit = GC::current_heap().limit] {
+      state->run([&] {
+        return run_task(definition, functions, argument, limit);
+      });
+      group.finish();
+    });
+    return make_obj<ObjFuture>(std::move(state));
+  }
+
+  [[nodiscard]] size_t arity() const override { return 2; }
+
+  [[nodiscard]] std::string to_string() const override {
+    return "<Native fn 'spawn'>";
+  }
+
+private:
+  static Message
+  run_task(const Function::Definition &definition,
+           const std::vector<std::pair<Symbol, Function::Definition>> &functions,
+           const Message &argument, size_t heap_limit) {
+    GC::Heap heap;
+    const GC::HeapScope heap_scope{heap};
+
+    // Pure functions don't print, and errors are thrown to await()
+    std::ostream sink{nullptr};
+    Interpreter worker{sink, std::make_shared<StreamErrorHandler>(sink)};
+    // The task's heap has the limit of the spawning one, not counting the
+    // builtins
+    heap.limit = heap_limit;
+    for (const auto &[name, global] : functions) {
+      if (!worker.globals->slots.contains(name)) {
+        worker.globals->define(
+            name, make_obj<Function>(global.declaration, worker.globals,
+                                     worker.globals, global.kind));
+      }
+    }
+
+    const auto function =
+        make_obj<Function>(definition.declaration, worker.globals,
+                           worker.globals, definition.kind);
+    const auto result = function->call(worker, {from_message(argument)});
+    auto message = to_message(result);
+    if (!message.has_value()) {
+      throw RuntimeError(stringify(result), "can't be returned from a task",
+                         0);
+    }
+    return std::move(*message);
+  }
+};
+
+struct Await : public Callable {
+public:
+  Value call(Interpreter &, const std::vector<Value> &arguments) override {
+    if (!arguments[0].is_obj_type(Obj::Type::FUTURE)) {
+      throw RuntimeError(stringify(arguments[0]), "must be a future", 0);
+    }
+    return from_message(arguments[0].as<ObjFuture>()->state->wait());
+  }
+
+  [[nodiscard]] size_t arity() const override { return 1; }
+
+  [[nodiscard]] std::string to_string() const override {
+    return "<Native fn 'await'>";
+  }
+};
 } // namespace
 
 namespace Buildin {
 
-std::vector<Token> get_buildins() {
-  using Type = Token::TokenType;
-
+std::vector<std::pair<std::string, CallablePtr>> get_buildins() {
   auto clock_closure = [](Interpreter &) {
     return static_cast<double>(
         std::chrono::duration_cast<std::chrono::seconds>(
             std::chrono::system_clock::now().time_since_epoch())
             .count());
   };
-  auto clock_buildin = std::make_shared<SimpleBuildin<decltype(clock_closure)>>(
+  auto clock_buildin = make_obj<SimpleBuildin<decltype(clock_closure)>>(
       "clock", std::move(clock_closure));
 
+  // Monotonic, so differences time sections of a script
+  auto clock_ns_closure = [](Interpreter &) {
+    return static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  };
+  auto clock_ns_buildin = make_obj<SimpleBuildin<decltype(clock_ns_closure)>>(
+      "clockNs", std::move(clock_ns_closure));
+
+  // Allocations of the heap the script runs in, as printed by --mem-stats
+  auto mem_stats_closure = [](Interpreter &) {
+    std::ostringstream stats;
+    GC::write_stats(stats);
+    auto text = stats.str();
+    text.pop_back(); // print adds the last newline
+    return make_string(std::move(text));
+  };
+  auto mem_stats_buildin = make_obj<SimpleBuildin<decltype(mem_stats_closure)>>(
+      "memStats", std::move(mem_stats_closure));
+
+  auto string_builder_closure = [](Interpreter &) {
+    return make_obj<StringBuilder>();
+  };
+  auto string_builder_buildin =
+      make_obj<SimpleBuildin<decltype(string_builder_closure)>>(
+          "stringBuilder", std::move(string_builder_closure));
+
   auto print_env_closure = [](Interpreter &interpreter) {
     interpreter.out_stream << "Globals: \n"
                            << *interpreter.globals << std::endl;
@@ -211,23 +614,38 @@ std::vector<Token> get_buildins() {
     return NullType{};
   };
   auto print_env_buildin =
-      std::make_shared<SimpleBuildin<decltype(print_env_closure)>>(
-          "print_env", std::move(print_env_closure));
+      make_obj<SimpleBuildin<decltype(print_env_closure)>>(
+          "printEnv", std::move(print_env_closure));
 
   auto exit_closure = [](Interpreter &) -> NullType {
     throw Exit("Exit called by buildin exit()");
   };
-  auto exit_buildin = std::make_shared<SimpleBuildin<decltype(exit_closure)>>(
+  auto exit_buildin = make_obj<SimpleBuildin<decltype(exit_closure)>>(
       "exit", std::move(exit_closure));
 
-  return {
-      {Type::FUN, "clock", std::move(clock_buildin), 0},
-      {Type::FUN, "printEnv", std::move(print_env_buildin), 0},
-      {Type::FUN, "exit", std::move(exit_buildin), 0},
-      {Type::FUN, "includeStr", std::make_shared<IncludeStr>(), 0},
-      {Type::FUN, "setLogLevel", std::make_shared<SetLogLevel>(), 0},
-      {Type::FUN, "assert", std::make_shared<Assert>(), 0},
-      {Type::FUN, "eval", std::make_shared<Eval>(), 0},
+  std::vector<std::pair<std::string, CallablePtr>> buildins{
+      {"clock", std::move(clock_buildin)},
+      {"clockNs", std::move(clock_ns_buildin)},
+      {"memStats", std::move(mem_stats_buildin)},
+      {"printEnv", std::move(print_env_buildin)},
+      {"exit", std::move(exit_buildin)},
+      {"includeStr", make_obj<IncludeStr>()},
+      {"setLogLevel", make_obj<SetLogLevel>()},
+      {"assert", make_obj<Assert>()},
+      {"eval", make_obj<Eval>()},
+      {"stringBuilder", std::move(string_builder_buildin)},
+      {"memoize", make_obj<Memoize>()},
+      {"spawn", make_obj<Spawn>()},
+      {"await", make_obj<Await>()},
   };
+
+  for (auto &buildin : array_buildins()) {
+    buildins.push_back(std::move(buildin));
+  }
+  return buildins;
+}
+
+bool is_pure(std::string_view name) {
+  return name == "len" || name == "sum" || name == "dot";
 }
 } // namespace Buildin
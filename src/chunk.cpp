@@ -0,0 +1,220 @@
+#include "chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iterator>
+
+#include "object.hpp"
+
+const char *str(OpCode op) {
+  switch (op) {
+  case OpCode::CONSTANT:
+    return "CONSTANT";
+  case OpCode::NIL:
+    return "NIL";
+  case OpCode::TRUE:
+    return "TRUE";
+  case OpCode::FALSE:
+    return "FALSE";
+  case OpCode::POP:
+    return "POP";
+  case OpCode::RESULT:
+    return "RESULT";
+  case OpCode::GET_LOCAL:
+    return "GET_LOCAL";
+  case OpCode::SET_LOCAL:
+    return "SET_LOCAL";
+  case OpCode::GET_GLOBAL:
+    return "GET_GLOBAL";
+  case OpCode::DEFINE_GLOBAL:
+    return "DEFINE_GLOBAL";
+  case OpCode::SET_GLOBAL:
+    return "SET_GLOBAL";
+  case OpCode::GET_UPVALUE:
+    return "GET_UPVALUE";
+  case OpCode::SET_UPVALUE:
+    return "SET_UPVALUE";
+  case OpCode::GET_PROPERTY:
+    return "GET_PROPERTY";
+  case OpCode::SET_PROPERTY:
+    return "SET_PROPERTY";
+  case OpCode::ARRAY:
+    return "ARRAY";
+  case OpCode::GET_INDEX:
+    return "GET_INDEX";
+  case OpCode::SET_INDEX:
+    return "SET_INDEX";
+  case OpCode::GET_SUPER:
+    return "GET_SUPER";
+  case OpCode::GET_UNBOUND_SUPER:
+    return "GET_UNBOUND_SUPER";
+  case OpCode::EQUAL:
+    return "EQUAL";
+  case OpCode::NOT_EQUAL:
+    return "NOT_EQUAL";
+  case OpCode::GREATER:
+    return "GREATER";
+  case OpCode::GREATER_EQUAL:
+    return "GREATER_EQUAL";
+  case OpCode::LESS:
+    return "LESS";
+  case OpCode::LESS_EQUAL:
+    return "LESS_EQUAL";
+  case OpCode::ADD:
+    return "ADD";
+  case OpCode::SUBTRACT:
+    return "SUBTRACT";
+  case OpCode::MULTIPLY:
+    return "MULTIPLY";
+  case OpCode::DIVIDE:
+    return "DIVIDE";
+  case OpCode::NOT:
+    return "NOT";
+  case OpCode::NEGATE:
+    return "NEGATE";
+  case OpCode::PRINT:
+    return "PRINT";
+  case OpCode::JUMP:
+    return "JUMP";
+  case OpCode::JUMP_IF_FALSE:
+    return "JUMP_IF_FALSE";
+  case OpCode::LOOP:
+    return "LOOP";
+  case OpCode::CALL:
+    return "CALL";
+  case OpCode::TAIL_CALL:
+    return "TAIL_CALL";
+  case OpCode::INVOKE:
+    return "INVOKE";
+  case OpCode::TAIL_INVOKE:
+    return "TAIL_INVOKE";
+  case OpCode::CLOSURE:
+    return "CLOSURE";
+  case OpCode::CLOSE_UPVALUE:
+    return "CLOSE_UPVALUE";
+  case OpCode::RETURN:
+    return "RETURN";
+  case OpCode::CLASS:
+    return "CLASS";
+  case OpCode::INHERIT:
+    return "INHERIT";
+  case OpCode::METHOD:
+    return "METHOD";
+  case OpCode::IMPORT:
+    return "IMPORT";
+  case OpCode::DEFINE_MODULE:
+    return "DEFINE_MODULE";
+  }
+  return "UNKNOWN";
+}
+
+void Chunk::write(uint8_t byte, unsigned int line, std::string_view lexeme) {
+  if (lexemes.empty() || lexemes.back().text != lexeme) {
+    lexemes.push_back(
+        Lexeme{static_cast<uint32_t>(code.size()), std::string(lexeme)});
+  }
+  code.push_back(byte);
+  lines.push_back(line);
+}
+
+void Chunk::write(OpCode op, unsigned int line, std::string_view lexeme) {
+  write(static_cast<uint8_t>(op), line, lexeme);
+}
+
+void Chunk::write_u16(uint16_t value, unsigned int line,
+                      std::string_view lexeme) {
+  write(static_cast<uint8_t>(value >> 8U), line, lexeme);
+  write(static_cast<uint8_t>(value & 0xFFU), line, lexeme);
+}
+
+std::string_view Chunk::lexeme_at(size_t offset) const {
+  const auto after = std::upper_bound(
+      lexemes.cbegin(), lexemes.cend(), offset,
+      [](size_t position, const Lexeme &run) { return position < run.start; });
+  if (after == lexemes.cbegin()) {
+    return {};
+  }
+  return std::prev(after)->text;
+}
+
+uint16_t Chunk::add_constant(Value value) {
+  assert(constants.size() < MAX_CONSTANTS);
+  constants.push_back(std::move(value));
+  return static_cast<uint16_t>(constants.size() - 1);
+}
+
+namespace {
+uint16_t read_u16(const Chunk &chunk, size_t offset) {
+  return static_cast<uint16_t>((chunk.code[offset] << 8U) |
+                               chunk.code[offset + 1]);
+}
+
+/// Print a single instruction. Returns the offset of the next instruction
+size_t disassemble_instruction(std::ostream &os, const Chunk &chunk,
+                               size_t offset) {
+  const auto op = static_cast<OpCode>(chunk.code[offset]);
+  os << std::setw(5) << offset << " [line " << chunk.lines[offset] << "] "
+     << str(op);
+
+  switch (op) {
+  case OpCode::CONSTANT:
+  case OpCode::GET_PROPERTY:
+  case OpCode::SET_PROPERTY:
+  case OpCode::GET_SUPER:
+  case OpCode::GET_UNBOUND_SUPER:
+  case OpCode::CLASS:
+  case OpCode::IMPORT: {
+    const auto constant = read_u16(chunk, offset + 1);
+    os << ' ' << constant << " '" << chunk.constants[constant] << "'\n";
+    return offset + 3;
+  }
+  case OpCode::GET_GLOBAL:
+  case OpCode::DEFINE_GLOBAL:
+  case OpCode::SET_GLOBAL:
+  case OpCode::DEFINE_MODULE:
+    os << ' ' << read_u16(chunk, offset + 1) << '\n';
+    return offset + 3;
+  case OpCode::GET_LOCAL:
+  case OpCode::SET_LOCAL:
+  case OpCode::GET_UPVALUE:
+  case OpCode::SET_UPVALUE:
+  case OpCode::CALL:
+  case OpCode::TAIL_CALL:
+  case OpCode::ARRAY:
+    os << ' ' << static_cast<int>(chunk.code[offset + 1]) << '\n';
+    return offset + 2;
+  case OpCode::JUMP:
+  case OpCode::JUMP_IF_FALSE:
+    os << " -> " << offset + 3 + read_u16(chunk, offset + 1) << '\n';
+    return offset + 3;
+  case OpCode::LOOP:
+    os << " -> " << offset + 3 - read_u16(chunk, offset + 1) << '\n';
+    return offset + 3;
+  case OpCode::INVOKE:
+  case OpCode::TAIL_INVOKE:
+  case OpCode::METHOD: {
+    const auto constant = read_u16(chunk, offset + 1);
+    os << ' ' << constant << " '" << chunk.constants[constant] << "' "
+       << static_cast<int>(chunk.code[offset + 3]) << '\n';
+    return offset + 4;
+  }
+  case OpCode::CLOSURE: {
+    const auto constant = read_u16(chunk, offset + 1);
+    const auto &function = chunk.constants[constant];
+    os << ' ' << constant << ' ' << function << '\n';
+    return offset + 3 + 2 * function.as<ObjFunction>()->upvalue_count;
+  }
+  default:
+    os << '\n';
+    return offset + 1;
+  }
+}
+} // namespace
+
+std::ostream &operator<<(std::ostream &os, const Chunk &chunk) {
+  for (size_t offset = 0; offset < chunk.code.size();) {
+    offset = disassemble_instruction(os, chunk, offset);
+  }
+  return os;
+}
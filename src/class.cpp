@@ -4,53 +4,78 @@
 #include "instance.hpp"
 #include "logging.hpp"
 
+namespace {
+const Symbol init_symbol{"init"};
+} // namespace
+
 Class::Class(std::string _name, ClassPtr _superclass, ClassFunctions _functions)
     : superclass(std::move(_superclass)), methods(std::get<0>(_functions)),
       unbounds(std::move(std::get<1>(_functions))),
       getters(std::move(std::get<2>(_functions))), m_name(std::move(_name)) {}
 
+Class::Class(std::string _name, EnvironmentPtr _module_globals)
+    : m_name(std::move(_name)), m_module_globals(std::move(_module_globals)) {}
+
 const std::string &Class::name() const { return m_name; }
 
 std::string Class::to_string() const {
   std::string representation = "class " + name() + "\nMethods:";
   for (const auto &method : methods) {
-    representation += "\n\t" + method.first;
+    representation += "\n\t" + method.first.str();
   }
   representation += "\nUnbound functions:";
   for (const auto &unbound : unbounds) {
-    representation += "\n\t" + unbound.first;
+    representation += "\n\t" + unbound.first.str();
   }
 
   return representation + '\n';
 }
 
 size_t Class::arity() const {
-  if (const auto &constructor = get_method("init")) {
+  if (const auto &constructor = get_method(init_symbol)) {
     return constructor->arity();
   }
   return 0;
 }
 
-Token::Value Class::call(Interpreter &interpreter,
-                         const std::vector<Token::Value> &arguments) {
+Value Class::call(Interpreter &interpreter,
+                  const std::vector<Value> &arguments) {
   LOG_DEBUG("Creating instance");
 
-  auto instance = std::make_shared<Instance>(shared_from_this());
+  auto instance = make_obj<Instance>(ClassPtr(this));
 
   LOG_DEBUG("Created instance successfully");
 
   // Run constructor method when class is called. Class-call args become
   // constructor args
-  if (const auto &constructor = get_method("init")) {
-    constructor->bind(instance)->call(interpreter, arguments);
+  if (const auto &constructor = get_method(init_symbol)) {
+    constructor->invoke(interpreter, instance, arguments);
   }
 
   return instance;
 }
 
-const FunctionPtr &Class::get_method(const std::string &name) const {
-  if (methods.contains(name)) {
-    return methods.at(name);
+void Class::trace(Tracer tracer) const {
+  ::trace(tracer, superclass);
+  for (const auto *functions : {&methods, &unbounds, &getters}) {
+    for (const auto &[_, function] : *functions) {
+      ::trace(tracer, function);
+    }
+  }
+  ::trace(tracer, m_module_globals);
+}
+
+void Class::clear_references() {
+  superclass = nullptr;
+  methods.clear();
+  unbounds.clear();
+  getters.clear();
+  m_module_globals = nullptr;
+}
+
+const FunctionPtr &Class::get_method(Symbol name) const {
+  if (const auto function = methods.find(name); function != methods.cend()) {
+    return function->second;
   }
 
   if (superclass != nullptr) {
@@ -60,9 +85,9 @@ const FunctionPtr &Class::get_method(const std::string &name) const {
   return nullRef;
 }
 
-const FunctionPtr &Class::get_unbound(const std::string &name) const {
-  if (unbounds.contains(name)) {
-    return unbounds.at(name);
+const FunctionPtr &Class::get_unbound(Symbol name) const {
+  if (const auto function = unbounds.find(name); function != unbounds.cend()) {
+    return function->second;
   }
 
   if (superclass != nullptr) {
@@ -72,9 +97,9 @@ const FunctionPtr &Class::get_unbound(const std::string &name) const {
   return nullRef;
 }
 
-const FunctionPtr &Class::get_getter(const std::string &name) const {
-  if (getters.contains(name)) {
-    return getters.at(name);
+const FunctionPtr &Class::get_getter(Symbol name) const {
+  if (const auto function = getters.find(name); function != getters.cend()) {
+    return function->second;
   }
 
   if (superclass != nullptr) {
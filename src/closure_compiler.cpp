@@ -0,0 +1,713 @@
+#include "closure_compiler.hpp"
+
+#include "class.hpp"
+#include "gc.hpp"
+#include "instance.hpp"
+#include "interpreter.hpp"
+#include "profiler.hpp"
+
+using Type = Token::TokenType;
+using LoweredExpr = ClosureCompiler::LoweredExpr;
+
+struct ClosureCompiler::Callee {
+  Value value;
+  // With its receiver, instead of a bound method in value
+  Function *method = nullptr;
+  Value receiver;
+};
+using Callee = ClosureCompiler::Callee;
+
+namespace {
+const Symbol super_symbol{"super"};
+
+/// Check the arity and evaluate the arguments of a call
+std::vector<Value> evaluate_arguments(Interpreter &interpreter,
+                                      const std::vector<LoweredExpr> &lowered,
+                                      const Callable &callee,
+                                      const Token &paren) {
+  if (lowered.size() != callee.arity()) {
+    throw RuntimeError(paren, "Expected " + std::to_string(callee.arity()) +
+                                  " arguments but got " +
+                                  std::to_string(lowered.size()) + ".");
+  }
+
+  auto arguments = interpreter.new_arguments();
+  arguments.reserve(lowered.size());
+  for (const auto &argument : lowered) {
+    arguments.push_back(argument(interpreter));
+  }
+  return arguments;
+}
+
+Value call_callee(Interpreter &interpreter, const Callee &callee,
+                  const std::vector<LoweredExpr> &lowered, const Token &paren) {
+  GC::maybe_collect();
+
+  if (callee.method != nullptr) {
+    auto arguments =
+        evaluate_arguments(interpreter, lowered, *callee.method, paren);
+    const Interpreter::CheckedRecursiveDepth depth{interpreter, paren};
+    const Profiler::Scope profiled{interpreter.profiler, *callee.method};
+    auto result =
+        callee.method->invoke(interpreter, callee.receiver, arguments);
+    interpreter.release_arguments(std::move(arguments));
+    return result;
+  }
+
+  if (!callee.value.is_obj_type(Obj::Type::CALLABLE)) {
+    throw RuntimeError(paren, "Can only call functions and classes.");
+  }
+  auto *callable = callee.value.as<Callable>();
+  auto arguments = evaluate_arguments(interpreter, lowered, *callable, paren);
+  const Interpreter::CheckedRecursiveDepth depth{interpreter, paren};
+  const Profiler::Scope profiled{interpreter.profiler, *callable};
+  auto result = callable->call(interpreter, arguments);
+  interpreter.release_arguments(std::move(arguments));
+  return result;
+}
+
+/// Call the callee, reporting errors without a line, like those of builtins
+/// and of exceeding the heap limit, at paren
+Value call(Interpreter &interpreter, const Callee &callee,
+           const std::vector<LoweredExpr> &lowered, const Token &paren) {
+  try {
+    return call_callee(interpreter, callee, lowered, paren);
+  } catch (const RuntimeError &err) {
+    rethrow_at(err, paren);
+  }
+}
+
+void assert_numbers(const Token &op, const Value &left, const Value &right) {
+  if (!left.is_number() || !right.is_number()) {
+    throw RuntimeError(op, "Operands must be numbers");
+  }
+}
+
+int compare_strings(const Value &left, const Value &right) {
+  return left.as<ObjString>()->chars().compare(right.as<ObjString>()->chars());
+}
+
+/// Evaluates both operands from left to right and combines them
+template <typename Operation>
+LoweredExpr binary(LoweredExpr left, LoweredExpr right, Operation operation) {
+  return [left = std::move(left), right = std::move(right),
+          operation](Interpreter &interpreter) -> Value {
+    const auto lhs = left(interpreter);
+    const auto rhs = right(interpreter);
+    return operation(lhs, rhs);
+  };
+}
+
+/// Comparison of numbers or of strings
+template <typename Compare>
+LoweredExpr comparison(LoweredExpr left, const Token &op, LoweredExpr right,
+                       Compare compare) {
+  return binary(std::move(left), std::move(right),
+                [&op, compare](const Value &lhs, const Value &rhs) -> Value {
+                  if (lhs.is_number() && rhs.is_number()) {
+                    return compare(lhs.as_number() <=> rhs.as_number());
+                  }
+                  if (lhs.is_string() && rhs.is_string()) {
+                    return compare(compare_strings(lhs, rhs) <=> 0);
+                  }
+                  throw RuntimeError(op,
+                                     "Operands must all be numbers or strings");
+                });
+}
+
+/// Concatenation of the operands of op, which reports errors like exceeding
+/// the heap limit at op
+Value concatenate_at(const Token &op, const Value &left, const Value &right) {
+  try {
+    return concatenate(left, right);
+  } catch (const RuntimeError &err) {
+    rethrow_at(err, op);
+  }
+}
+
+/// Evaluates to an error, for nodes that are only invalid once evaluated
+LoweredExpr failing(const Token &token, const std::string &message) {
+  return [&token, message](Interpreter &) -> Value {
+    throw RuntimeError(token, message);
+  };
+}
+} // namespace
+
+LoweredBody ClosureCompiler::compile(const std::vector<stmt> &statements) {
+  return lower(statements);
+}
+
+ClosureCompiler::LoweredCallee ClosureCompiler::lower_callee(Expr &callee) {
+  if (auto *get = dynamic_cast<Get *>(&callee)) {
+    return [object = lower(get->child<0>()), get](Interpreter &interpreter) {
+      auto receiver = object(interpreter);
+      if (receiver.is_obj_type(Obj::Type::TREE_INSTANCE)) {
+        const auto &property =
+            receiver.as<Instance>()->lookup(get->child<1>(), get->child<2>());
+        if (property.kind == PropertyCache::Kind::METHOD) {
+          return Callee{NullType{}, property.function, std::move(receiver)};
+        }
+      }
+      return Callee{interpreter.get_property(*get, receiver)};
+    };
+  }
+
+  if (auto *super = dynamic_cast<Super *>(&callee);
+      super != nullptr && !super->child<2>()) {
+    return [super, depth = static_cast<size_t>(*super->depth),
+            name = super->child<1>().symbol](Interpreter &interpreter) {
+      auto &environment = *interpreter.environment;
+      const auto superclass =
+          get_callable_as<Class>(environment.get_at(depth, 0));
+      if (const auto &method = superclass->get_method(name)) {
+        return Callee{NullType{}, method.get(),
+                      environment.get_at(depth - 1, 0)};
+      }
+      // Undefined, the Interpreter reports it
+      return Callee{super->accept(interpreter)};
+    };
+  }
+
+  return [value = lower(callee)](Interpreter &interpreter) {
+    return Callee{value(interpreter)};
+  };
+}
+
+LoweredExpr ClosureCompiler::lower(Expr &expression) {
+  expression.accept(*this);
+  return std::move(lowered_expr);
+}
+
+LoweredExpr ClosureCompiler::lower(const expr &expression) {
+  return lower(*expression);
+}
+
+std::vector<LoweredExpr>
+ClosureCompiler::lower(const std::vector<expr> &expressions) {
+  std::vector<LoweredExpr> lowered;
+  lowered.reserve(expressions.size());
+  for (const auto &expression : expressions) {
+    lowered.push_back(lower(expression));
+  }
+  return lowered;
+}
+
+LoweredBody ClosureCompiler::lower(const stmt &statement) {
+  statement->accept(*this);
+  return std::move(lowered_stmt);
+}
+
+LoweredBody ClosureCompiler::lower(const std::vector<stmt> &statements) {
+  if (statements.size() == 1) {
+    return lower(statements.front());
+  }
+
+  std::vector<LoweredBody> lowered;
+  lowered.reserve(statements.size());
+  for (const auto &statement : statements) {
+    lowered.push_back(lower(statement));
+  }
+  return [lowered = std::move(lowered)](Interpreter &interpreter) {
+    for (const auto &statement : lowered) {
+      if (const auto completion = statement(interpreter);
+          completion != Completion::NORMAL) {
+        return completion;
+      }
+    }
+    return Completion::NORMAL;
+  };
+}
+
+std::shared_ptr<const LoweredBody>
+ClosureCompiler::lower_body(const std::vector<stmt> &statements) {
+  return std::make_shared<const LoweredBody>(lower(statements));
+}
+
+LoweredBody ClosureCompiler::lower_return(Expr &returned) {
+  if (auto *call_expr = dynamic_cast<Call *>(&returned);
+      call_expr != nullptr && call_expr->child<3>()) {
+    return [callee = lower_callee(*call_expr->child<0>()),
+            arguments = lower(call_expr->child<2>()),
+            &paren = call_expr->child<1>()](Interpreter &interpreter) {
+      auto target = callee(interpreter);
+      FunctionPtr function{target.method};
+      if (function == nullptr) {
+        // Bound methods are called with their own receiver
+        function = get_callable_as<Function>(target.value);
+        if (function == nullptr) {
+          interpreter.return_value =
+              call(interpreter, target, arguments, paren);
+          return Completion::RETURN;
+        }
+        target.receiver = function->bound_receiver();
+      }
+
+      GC::maybe_collect();
+
+      auto &tail_call = interpreter.tail_call;
+      tail_call.arguments =
+          evaluate_arguments(interpreter, arguments, *function, paren);
+      tail_call.function = std::move(function);
+      tail_call.receiver = std::move(target.receiver);
+      return Completion::TAIL_CALL;
+    };
+  }
+  if (auto *grouping = dynamic_cast<Grouping *>(&returned)) {
+    return lower_return(*grouping->child<0>());
+  }
+  if (auto *ternary = dynamic_cast<Ternary *>(&returned)) {
+    return [condition = lower(ternary->child<0>()),
+            first = lower_return(*ternary->child<2>()),
+            second = lower_return(*ternary->child<4>())](
+               Interpreter &interpreter) {
+      return condition(interpreter).is_truthy() ? first(interpreter)
+                                                : second(interpreter);
+    };
+  }
+
+  return [value = lower(returned)](Interpreter &interpreter) {
+    interpreter.return_value = value(interpreter);
+    return Completion::RETURN;
+  };
+}
+
+//-------------Statement Visitor Methods------------------------------------
+
+void ClosureCompiler::visit(VarStmt &node) {
+  // An Empty initializer evaluates to nil
+  lowered_stmt = [&name = node.child<0>(),
+                  initializer = lower(node.child<1>())](
+                     Interpreter &interpreter) {
+    interpreter.define(name, initializer(interpreter));
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::visit(MalformedStmt &node) {
+  lowered_stmt = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(BlockStmt &node) {
+  auto body = lower(node.child<0>());
+  if (node.child<1>()) {
+    lowered_stmt = [body = std::move(body)](Interpreter &interpreter) {
+      auto env = interpreter.new_environment(interpreter.environment);
+      const auto completion = interpreter.execute_block(body, env);
+      interpreter.release_environment(std::move(env));
+      return completion;
+    };
+    return;
+  }
+  // Like in the Interpreter, the block's locals live in the enclosing
+  // environment then, unless it runs in the globals
+  lowered_stmt = [body = std::move(body)](Interpreter &interpreter) {
+    if (interpreter.environment == interpreter.current_globals) {
+      return body(interpreter);
+    }
+    const ScopedLocals locals{*interpreter.environment};
+    return body(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(PrintStmt &node) {
+  lowered_stmt = [value = lower(node.child<0>())](Interpreter &interpreter) {
+    interpreter.out_stream << value(interpreter) << '\n';
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::visit(ExprStmt &node) {
+  lowered_stmt = [value = lower(node.child<0>())](Interpreter &interpreter) {
+    auto result = value(interpreter);
+    if (interpreter.environment == interpreter.globals) {
+      interpreter.last_value = std::move(result);
+    }
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::visit(IfStmt &node) {
+  // Without an else branch, the else branch is an EmptyStmt
+  lowered_stmt = [condition = lower(node.child<0>()),
+                  then_branch = lower(node.child<1>()),
+                  else_branch = lower(node.child<2>())](
+                     Interpreter &interpreter) {
+    return condition(interpreter).is_truthy() ? then_branch(interpreter)
+                                              : else_branch(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(WhileStmt &node) {
+  lowered_stmt = [condition = lower(node.child<0>()),
+                  body = lower(node.child<1>())](Interpreter &interpreter) {
+    while (condition(interpreter).is_truthy()) {
+      if (const auto completion = body(interpreter);
+          completion != Completion::NORMAL) {
+        return completion;
+      }
+    }
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::visit(EmptyStmt &) {
+  lowered_stmt = [](Interpreter &) { return Completion::NORMAL; };
+}
+
+void ClosureCompiler::visit(FunctionStmt &node) {
+  lowered_stmt = [&node, body = lower_body(node.child<2>())](
+                     Interpreter &interpreter) {
+    auto function =
+        make_obj<Function>(&node, interpreter.environment,
+                           interpreter.current_globals, node.child<3>());
+    function->lowered_body = body;
+    interpreter.define(node.child<0>(), std::move(function));
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::visit(ReturnStmt &node) {
+  if (node.child<2>()) {
+    lowered_stmt = lower_return(*node.child<1>());
+    return;
+  }
+  // An Empty value evaluates to nil
+  lowered_stmt = [value = lower(node.child<1>())](Interpreter &interpreter) {
+    interpreter.return_value = value(interpreter);
+    return Completion::RETURN;
+  };
+}
+
+void ClosureCompiler::visit(ClassStmt &node) {
+  struct Method {
+    const FunctionStmt *declaration;
+    std::shared_ptr<const LoweredBody> body;
+  };
+  std::vector<Method> methods;
+  for (const auto &method : node.child<1>()) {
+    methods.push_back(Method{method.get(), lower_body(method->child<2>())});
+  }
+
+  LoweredExpr superclass;
+  if (node.child<2>() != nullptr) {
+    superclass = lower(*node.child<2>());
+  }
+
+  lowered_stmt = [&node, methods = std::move(methods),
+                  superclass = std::move(superclass)](
+                     Interpreter &interpreter) {
+    ClassPtr base = nullptr;
+    if (superclass) {
+      base = get_callable_as<Class>(superclass(interpreter));
+      if (base == nullptr) {
+        throw RuntimeError(node.child<2>()->child<0>(),
+                           "Superclass must be a class.");
+      }
+      interpreter.environment = make_obj<Environment>(interpreter.environment);
+      // Unlike 'this', super is defined once per class
+      interpreter.environment->define_local(super_symbol, base);
+    }
+
+    Class::ClassFunctions functions;
+    auto &[bound, unbound, getters] = functions;
+    for (const auto &[declaration, body] : methods) {
+      const auto kind = declaration->child<3>();
+      auto function = make_obj<Function>(declaration, interpreter.environment,
+                                         interpreter.current_globals, kind);
+      function->lowered_body = body;
+      function->class_name = node.child<0>().lexeme;
+      auto &map = kind == FunctionKind::UNBOUND  ? unbound
+                  : kind == FunctionKind::GETTER ? getters
+                                                 : bound;
+      map.emplace(declaration->child<0>().symbol, std::move(function));
+    }
+    Value klass = make_obj<Class>(std::string(node.child<0>().lexeme),
+                                  std::move(base), std::move(functions));
+
+    if (superclass) {
+      // Pop the 'super' environment
+      interpreter.environment = interpreter.environment->enclosing;
+    }
+
+    interpreter.define(node.child<0>(), std::move(klass));
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::visit(ImportStmt &node) {
+  lowered_stmt = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
+
+//-------------Expression Visitor Methods------------------------------------
+
+void ClosureCompiler::visit(Assign &node) {
+  auto value = lower(node.child<1>());
+  if (!node.depth.has_value()) {
+    lowered_expr = [&name = node.child<0>(), value = std::move(value)](
+                       Interpreter &interpreter) {
+      auto assigned = value(interpreter);
+      interpreter.current_globals->assign(name, assigned);
+      return assigned;
+    };
+    return;
+  }
+
+  lowered_expr = [depth = static_cast<size_t>(*node.depth), slot = node.slot,
+                  value = std::move(value)](Interpreter &interpreter) {
+    auto assigned = value(interpreter);
+    interpreter.environment->assign_at(depth, slot, assigned);
+    return assigned;
+  };
+}
+
+void ClosureCompiler::visit(Logical &node) {
+  auto left = lower(node.child<0>());
+  auto right = lower(node.child<2>());
+  if (node.child<1>().type == Type::OR) {
+    lowered_expr = [left = std::move(left),
+                    right = std::move(right)](Interpreter &interpreter) {
+      auto lhs = left(interpreter);
+      return lhs.is_truthy() ? lhs : right(interpreter);
+    };
+    return;
+  }
+  lowered_expr = [left = std::move(left),
+                  right = std::move(right)](Interpreter &interpreter) {
+    auto lhs = left(interpreter);
+    return lhs.is_truthy() ? right(interpreter) : lhs;
+  };
+}
+
+void ClosureCompiler::visit(Variable &node) {
+  if (!node.depth.has_value()) {
+    lowered_expr = [&name = node.child<0>()](Interpreter &interpreter) {
+      return interpreter.current_globals->get(name);
+    };
+    return;
+  }
+  // Most variables are locals of the innermost environment
+  if (*node.depth == 0) {
+    lowered_expr = [slot = node.slot](Interpreter &interpreter) {
+      return interpreter.environment->values[slot];
+    };
+    return;
+  }
+  lowered_expr = [depth = static_cast<size_t>(*node.depth),
+                  slot = node.slot](Interpreter &interpreter) {
+    return interpreter.environment->get_at(depth, slot);
+  };
+}
+
+void ClosureCompiler::visit(Empty &) {
+  lowered_expr = [](Interpreter &) -> Value { return NullType{}; };
+}
+
+void ClosureCompiler::visit(Literal &node) {
+  lowered_expr = [value = node.child<1>()](Interpreter &) {
+    return value;
+  };
+}
+
+void ClosureCompiler::visit(Unary &node) {
+  const auto &op = node.child<0>();
+  auto operand = lower(node.child<1>());
+  switch (op.type) {
+  case Type::MINUS:
+    lowered_expr = [&op,
+                    operand = std::move(operand)](Interpreter &interpreter) {
+      const auto value = operand(interpreter);
+      if (!value.is_number()) {
+        throw RuntimeError(op, "Operands must be numbers");
+      }
+      return Value{-value.as_number()};
+    };
+    return;
+  case Type::BANG:
+    lowered_expr = [operand = std::move(operand)](Interpreter &interpreter) {
+      return Value{!operand(interpreter).is_truthy()};
+    };
+    return;
+  default:
+    lowered_expr = failing(op, "Unknown token type in unary operator eval");
+  }
+}
+
+void ClosureCompiler::visit(Binary &node) {
+  const auto &op = node.child<1>();
+  auto left = lower(node.child<0>());
+  auto right = lower(node.child<2>());
+
+  switch (op.type) {
+  case Type::MINUS:
+    lowered_expr = binary(std::move(left), std::move(right),
+                          [&op](const Value &lhs, const Value &rhs) {
+                            assert_numbers(op, lhs, rhs);
+                            return Value{lhs.as_number() - rhs.as_number()};
+                          });
+    return;
+  case Type::SLASH:
+    lowered_expr = binary(
+        std::move(left), std::move(right),
+        [&op](const Value &lhs, const Value &rhs) {
+          assert_numbers(op, lhs, rhs);
+          if (rhs.as_number() == 0) {
+            throw RuntimeError(op, "Right operand of division must not be 0");
+          }
+          return Value{lhs.as_number() / rhs.as_number()};
+        });
+    return;
+  case Type::STAR:
+    lowered_expr = binary(std::move(left), std::move(right),
+                          [&op](const Value &lhs, const Value &rhs) {
+                            assert_numbers(op, lhs, rhs);
+                            return Value{lhs.as_number() * rhs.as_number()};
+                          });
+    return;
+  case Type::PLUS:
+    lowered_expr = binary(
+        std::move(left), std::move(right),
+        [&op](const Value &lhs, const Value &rhs) {
+          if (lhs.is_number() && rhs.is_number()) {
+            return Value{lhs.as_number() + rhs.as_number()};
+          }
+          if (lhs.is_string() || rhs.is_string()) {
+            return concatenate_at(op, lhs, rhs);
+          }
+          throw RuntimeError(op, "Operands must all be numbers or strings");
+        });
+    return;
+  case Type::GREATER:
+    lowered_expr = comparison(std::move(left), op, std::move(right),
+                              [](auto order) { return order > 0; });
+    return;
+  case Type::GREATER_EQUAL:
+    lowered_expr = comparison(std::move(left), op, std::move(right),
+                              [](auto order) { return order >= 0; });
+    return;
+  case Type::LESS:
+    lowered_expr = comparison(std::move(left), op, std::move(right),
+                              [](auto order) { return order < 0; });
+    return;
+  case Type::LESS_EQUAL:
+    lowered_expr = comparison(std::move(left), op, std::move(right),
+                              [](auto order) { return order <= 0; });
+    return;
+  case Type::BANG_EQUAL:
+    lowered_expr = binary(std::move(left), std::move(right),
+                          [](const Value &lhs, const Value &rhs) {
+                            return Value{lhs != rhs};
+                          });
+    return;
+  case Type::EQUAL_EQUAL:
+    lowered_expr = binary(std::move(left), std::move(right),
+                          [](const Value &lhs, const Value &rhs) {
+                            return Value{lhs == rhs};
+                          });
+    return;
+  default:
+    lowered_expr =
+        failing(op, "Unexpected operator in binary expression eval");
+  }
+}
+
+void ClosureCompiler::visit(Ternary &node) {
+  const auto &first_op = node.child<1>();
+  if (first_op.type != Type::QUESTION_MARK) {
+    lowered_expr =
+        failing(first_op, "Unknown token type in ternary operator.");
+    return;
+  }
+  lowered_expr = [condition = lower(node.child<0>()),
+                  first = lower(node.child<2>()),
+                  second = lower(node.child<4>())](Interpreter &interpreter) {
+    return condition(interpreter).is_truthy() ? first(interpreter)
+                                              : second(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(Malformed &node) {
+  lowered_expr = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(Call &node) {
+  lowered_expr = [callee = lower_callee(*node.child<0>()),
+                  arguments = lower(node.child<2>()),
+                  &paren = node.child<1>()](Interpreter &interpreter) {
+    return call(interpreter, callee(interpreter), arguments, paren);
+  };
+}
+
+void ClosureCompiler::visit(Grouping &node) {
+  lowered_expr = lower(node.child<0>());
+}
+
+void ClosureCompiler::visit(Lambda &node) {
+  lowered_expr = [&node, body = lower_body(node.child<1>())](
+                     Interpreter &interpreter) -> Value {
+    auto function =
+        make_obj<Function>(&node, interpreter.environment,
+                           interpreter.current_globals, FunctionKind::LAMDBDA);
+    function->lowered_body = body;
+    return function;
+  };
+}
+
+void ClosureCompiler::visit(Get &node) {
+  lowered_expr = [&node,
+                  object = lower(node.child<0>())](Interpreter &interpreter) {
+    return interpreter.get_property(node, object(interpreter));
+  };
+}
+
+void ClosureCompiler::visit(Set &node) {
+  lowered_expr = [&node, object = lower(node.child<0>()),
+                  value = lower(node.child<2>())](Interpreter &interpreter) {
+    auto target = object(interpreter);
+    if (!target.is_obj_type(Obj::Type::TREE_INSTANCE)) {
+      throw RuntimeError(node.child<1>(), "Can only set properties on objects");
+    }
+    auto assigned = value(interpreter);
+    target.as<Instance>()->set_field(node.child<1>(), assigned,
+                                     node.child<3>());
+    return assigned;
+  };
+}
+
+void ClosureCompiler::visit(This &node) {
+  lowered_expr = [depth = static_cast<size_t>(node.depth.value_or(0)),
+                  slot = node.slot](Interpreter &interpreter) {
+    return interpreter.environment->get_at(depth, slot);
+  };
+}
+
+// For arrays and 'super', which are rare in hot code, the Interpreter
+// evaluates the node and its children
+void ClosureCompiler::visit(Super &node) {
+  lowered_expr = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(ArrayLiteral &node) {
+  lowered_expr = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(Index &node) {
+  lowered_expr = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
+
+void ClosureCompiler::visit(SetIndex &node) {
+  lowered_expr = [&node](Interpreter &interpreter) {
+    return node.accept(interpreter);
+  };
+}
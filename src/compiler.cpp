@@ -0,0 +1,757 @@
+#include "compiler.hpp"
+
+#include <filesystem>
+#include <limits>
+
+#include "logging.hpp"
+#include "vm.hpp"
+
+using Type = Token::TokenType;
+
+namespace {
+/// Name declared by a statement, if it declares one
+const Token *declared_name(Statement &statement) {
+  if (auto *var = dynamic_cast<VarStmt *>(&statement)) {
+    return &var->child<0>();
+  }
+  if (auto *function = dynamic_cast<FunctionStmt *>(&statement)) {
+    return &function->child<0>();
+  }
+  if (auto *klass = dynamic_cast<ClassStmt *>(&statement)) {
+    return &klass->child<0>();
+  }
+  if (auto *import = dynamic_cast<ImportStmt *>(&statement)) {
+    return &import->child<1>();
+  }
+  return nullptr;
+}
+} // namespace
+
+Compiler::FunctionState::FunctionState(FunctionState *_enclosing,
+                                       Ref<ObjFunction> _function,
+                                       std::optional<FunctionKind> _kind)
+    : enclosing(_enclosing), function(std::move(_function)), kind(_kind) {
+  // Slot 0 holds the receiver for methods, and the callee otherwise. Users
+  // can only refer to it by 'this'
+  const bool has_receiver = kind == FunctionKind::METHOD ||
+                            kind == FunctionKind::CONSTRUCTOR ||
+                            kind == FunctionKind::GETTER;
+  locals.push_back(Local{has_receiver ? "this" : "", 0});
+}
+
+Compiler::Compiler(VM &_vm, std::shared_ptr<ErrorHandler> _err_handler)
+    : vm(_vm), err_handler(std::move(_err_handler)) {}
+
+Ref<ObjFunction> Compiler::compile(const std::vector<stmt> &statements) {
+  FunctionState script{
+      nullptr, make_obj<ObjFunction>("", FunctionKind::FUNCTION),
+      std::nullopt};
+  current = &script;
+
+  try {
+    compile_statements(statements);
+    emit_return();
+  } catch (const CompiletimeError &err) {
+    err_handler->error(err.token, err.what());
+    current = nullptr;
+    return {};
+  }
+
+  LOG_DEBUG("Compiled script:\n", script.function->chunk);
+
+  current = nullptr;
+  return std::move(script.function);
+}
+
+Ref<ObjFunction> Compiler::compile_module(const std::vector<stmt> &statements,
+                                          const std::string &path) {
+  for (const auto &statement : statements) {
+    if (const auto *name = declared_name(*statement)) {
+      module_globals.emplace(name->symbol,
+                             Symbol(path + "::" + name->symbol.str()));
+    }
+  }
+
+  FunctionState script{
+      nullptr, make_obj<ObjFunction>("", FunctionKind::FUNCTION),
+      std::nullopt};
+  current = &script;
+
+  try {
+    compile_statements(statements);
+    emit_module(statements, path);
+  } catch (const CompiletimeError &err) {
+    err_handler->error(err.token, err.what());
+    current = nullptr;
+    return {};
+  }
+
+  LOG_DEBUG("Compiled module ", path, ":\n", script.function->chunk);
+
+  current = nullptr;
+  return std::move(script.function);
+}
+
+void Compiler::emit_module(const std::vector<stmt> &statements,
+                           const std::string &path) {
+  // An instance of a class with a getter for each name, which reads the
+  // module's global. So the object sees later assignments in the module
+  emit(OpCode::CLASS);
+  emit_u16(identifier_constant(
+      Symbol("module " + std::filesystem::path(path).stem().string())));
+
+  for (const auto &statement : statements) {
+    if (const auto *name = declared_name(*statement)) {
+      at(*name);
+      const auto slot = global_slot(name->symbol);
+
+      auto getter = make_obj<ObjFunction>(std::string(name->lexeme),
+                                          FunctionKind::GETTER);
+      FunctionState state{current, std::move(getter), FunctionKind::GETTER};
+      current = &state;
+      emit(OpCode::GET_GLOBAL);
+      emit_u16(slot);
+      emit(OpCode::RETURN);
+      current = state.enclosing;
+
+      emit(OpCode::CLOSURE);
+      emit_u16(add_constant(state.function.get()));
+      emit(OpCode::METHOD);
+      emit_u16(identifier_constant(name->symbol));
+      emit(static_cast<uint8_t>(FunctionKind::GETTER));
+    }
+  }
+  emit(OpCode::CALL);
+  emit(static_cast<uint8_t>(0));
+  emit(OpCode::RETURN);
+}
+
+void Compiler::at(const Token &token) {
+  line = token.line;
+  lexeme = token.lexeme;
+}
+
+void Compiler::error(const std::string &message) const {
+  if (lexeme.empty()) {
+    throw CompiletimeError(NullType{}, message, line);
+  }
+  throw CompiletimeError(Token{Type::NIL, lexeme, NullType{}, line}, message);
+}
+
+void Compiler::compile(const stmt &statement) {
+  statement->accept(*this);
+}
+
+void Compiler::compile_statements(const std::vector<stmt> &statements) {
+  for (const auto &statement : statements) {
+    compile(statement);
+  }
+}
+
+void Compiler::compile(const expr &expression) { compile(*expression); }
+
+void Compiler::compile(Expr &expression) {
+  expression.accept(*this);
+}
+
+void Compiler::function(std::string_view name,
+                        const std::vector<Token> &params,
+                        const std::vector<stmt> &body, FunctionKind kind,
+                        bool is_pure) {
+  FunctionState state{current, make_obj<ObjFunction>(std::string(name), kind),
+                      kind};
+  current = &state;
+
+  state.function->arity = params.size();
+  state.function->is_pure = is_pure;
+
+  // Like in the Resolver, parameters and the body live in separate scopes, so
+  // body locals may shadow parameters. Both are discarded by the return.
+  begin_scope();
+  for (const auto &param : params) {
+    add_local(param.lexeme);
+  }
+  begin_scope();
+  compile_statements(body);
+  emit_return();
+
+  state.function->upvalue_count = state.upvalues.size();
+  LOG_DEBUG("Compiled ", state.function->to_string(), ":\n",
+            state.function->chunk);
+
+  current = state.enclosing;
+
+  emit(OpCode::CLOSURE);
+  emit_u16(add_constant(state.function.get()));
+  for (const auto &upvalue : state.upvalues) {
+    emit(static_cast<uint8_t>(upvalue.is_local ? 1 : 0));
+    emit(upvalue.index);
+  }
+}
+
+//------------------------------Emitting helpers------------------------------
+
+Chunk &Compiler::chunk() const { return current->function->chunk; }
+
+void Compiler::emit(OpCode op) { chunk().write(op, line, lexeme); }
+
+void Compiler::emit(uint8_t byte) { chunk().write(byte, line, lexeme); }
+
+void Compiler::emit_u16(uint16_t value) {
+  chunk().write_u16(value, line, lexeme);
+}
+
+void Compiler::emit_constant(Value value) {
+  emit(OpCode::CONSTANT);
+  emit_u16(add_constant(std::move(value)));
+}
+
+uint16_t Compiler::add_constant(Value value) {
+  if (chunk().constants.size() >= Chunk::MAX_CONSTANTS) {
+    error("Too many constants in one chunk.");
+  }
+  return chunk().add_constant(std::move(value));
+}
+
+void Compiler::emit_return() {
+  // Constructors implicitly return 'this', even on an empty return
+  if (current->kind == FunctionKind::CONSTRUCTOR) {
+    emit(OpCode::GET_LOCAL);
+    emit(static_cast<uint8_t>(0));
+  } else {
+    emit(OpCode::NIL);
+  }
+  emit(OpCode::RETURN);
+}
+
+size_t Compiler::emit_jump(OpCode op) {
+  emit(op);
+  emit_u16(std::numeric_limits<uint16_t>::max());
+  return chunk().code.size() - 2;
+}
+
+void Compiler::patch_jump(size_t offset) {
+  // -2 to adjust for the jump offset itself
+  const size_t jump = chunk().code.size() - offset - 2;
+  if (jump > std::numeric_limits<uint16_t>::max()) {
+    error("Too much code to jump over.");
+  }
+  chunk().code[offset] = static_cast<uint8_t>(jump >> 8U);
+  chunk().code[offset + 1] = static_cast<uint8_t>(jump & 0xFFU);
+}
+
+void Compiler::emit_loop(size_t loop_start) {
+  emit(OpCode::LOOP);
+  // +2 to jump over the LOOP instruction's own operand
+  const size_t offset = chunk().code.size() - loop_start + 2;
+  if (offset > std::numeric_limits<uint16_t>::max()) {
+    error("Loop body too large.");
+  }
+  emit_u16(static_cast<uint16_t>(offset));
+}
+
+uint16_t Compiler::identifier_constant(Symbol name) {
+  auto &constants = current->identifier_constants;
+  if (const auto it = constants.find(name); it != constants.cend()) {
+    return it->second;
+  }
+  const auto index = add_constant(intern_string(name));
+  constants.emplace(name, index);
+  return index;
+}
+
+//------------------------------Variables and scopes---------------------------
+
+uint16_t Compiler::global_slot(Symbol name) {
+  if (const auto global = module_globals.find(name);
+      global != module_globals.cend()) {
+    name = global->second;
+  }
+  if (!vm.has_global(name) && vm.global_count() >= VM::MAX_GLOBALS) {
+    error("Too many global variables.");
+  }
+  return vm.global_slot(name);
+}
+
+void Compiler::begin_scope() { ++current->scope_depth; }
+
+void Compiler::end_scope() {
+  --current->scope_depth;
+
+  auto &locals = current->locals;
+  while (!locals.empty() && locals.back().depth > current->scope_depth) {
+    if (const auto name = locals.back().name_index) {
+      chunk().local_names[*name].end =
+          static_cast<uint32_t>(chunk().code.size());
+    }
+    emit(locals.back().is_captured ? OpCode::CLOSE_UPVALUE : OpCode::POP);
+    locals.pop_back();
+  }
+}
+
+bool Compiler::is_global_scope() const {
+  return !current->kind.has_value() && current->scope_depth == 0;
+}
+
+void Compiler::add_local(std::string_view name) {
+  if (current->locals.size() >= VM::FRAME_SLOTS) {
+    error("Too many local variables in function.");
+  }
+  current->locals.push_back(Local{name, current->scope_depth});
+  // Names are kept for printEnv(), except that of the module being built
+  if (!name.empty()) {
+    auto &names = chunk().local_names;
+    current->locals.back().name_index = names.size();
+    names.push_back(Chunk::LocalName{
+        std::string(name), static_cast<uint8_t>(current->locals.size() - 1),
+        static_cast<uint32_t>(chunk().code.size())});
+  }
+}
+
+std::optional<uint8_t> Compiler::resolve_local(const FunctionState &state,
+                                               std::string_view name) {
+  for (size_t i = state.locals.size(); i-- > 0;) {
+    if (state.locals[i].name == name) {
+      return static_cast<uint8_t>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<uint8_t> Compiler::resolve_upvalue(FunctionState &state,
+                                                 std::string_view name) {
+  if (state.enclosing == nullptr) {
+    return std::nullopt;
+  }
+
+  if (const auto local = resolve_local(*state.enclosing, name)) {
+    state.enclosing->locals[*local].is_captured = true;
+    return add_upvalue(state, *local, true);
+  }
+
+  if (const auto upvalue = resolve_upvalue(*state.enclosing, name)) {
+    return add_upvalue(state, *upvalue, false);
+  }
+
+  return std::nullopt;
+}
+
+uint8_t Compiler::add_upvalue(FunctionState &state, uint8_t index,
+                              bool is_local) {
+  auto &upvalues = state.upvalues;
+  for (size_t i = 0; i < upvalues.size(); ++i) {
+    if (upvalues[i].index == index && upvalues[i].is_local == is_local) {
+      return static_cast<uint8_t>(i);
+    }
+  }
+
+  if (upvalues.size() >= VM::FRAME_SLOTS) {
+    error("Too many closure variables in function.");
+  }
+  upvalues.push_back(Upvalue{index, is_local});
+  return static_cast<uint8_t>(upvalues.size() - 1);
+}
+
+void Compiler::named_variable(const Token &name, bool assign) {
+  at(name);
+
+  if (const auto local = resolve_local(*current, name.lexeme)) {
+    emit(assign ? OpCode::SET_LOCAL : OpCode::GET_LOCAL);
+    emit(*local);
+  } else if (const auto upvalue = resolve_upvalue(*current, name.lexeme)) {
+    emit(assign ? OpCode::SET_UPVALUE : OpCode::GET_UPVALUE);
+    emit(*upvalue);
+  } else {
+    emit(assign ? OpCode::SET_GLOBAL : OpCode::GET_GLOBAL);
+    emit_u16(global_slot(name.symbol));
+  }
+}
+
+//-------------Statement Visitor Methods------------------------------------
+
+void Compiler::visit(VarStmt &node) {
+  const auto &name = node.child<0>();
+  compile(node.child<1>()); // Empty initializer compiles to nil
+  at(name);
+
+  if (is_global_scope()) {
+    emit(OpCode::DEFINE_GLOBAL);
+    emit_u16(global_slot(name.symbol));
+  } else {
+    // The initializer's value on the stack becomes the local's slot
+    add_local(name.lexeme);
+  }
+}
+
+void Compiler::visit(MalformedStmt &node) {
+  error("Malformed statement node in AST. Syntax was not valid. Lexer "
+        "message:\t" +
+        node.child<1>());
+}
+
+void Compiler::visit(BlockStmt &node) {
+  begin_scope();
+  compile_statements(node.child<0>());
+  end_scope();
+}
+
+void Compiler::visit(PrintStmt &node) {
+  compile(node.child<0>());
+  emit(OpCode::PRINT);
+}
+
+void Compiler::visit(ExprStmt &node) {
+  compile(node.child<0>());
+  // Top-level expression values are kept as result of the script for eval()
+  emit(is_global_scope() ? OpCode::RESULT : OpCode::POP);
+}
+
+void Compiler::visit(IfStmt &node) {
+  compile(node.child<0>());
+
+  const auto then_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+  emit(OpCode::POP);
+  compile(node.child<1>());
+  const auto else_jump = emit_jump(OpCode::JUMP);
+
+  patch_jump(then_jump);
+  emit(OpCode::POP);
+  compile(node.child<2>()); // No else branch compiles to nothing
+  patch_jump(else_jump);
+}
+
+void Compiler::visit(WhileStmt &node) {
+  const auto loop_start = chunk().code.size();
+  compile(node.child<0>());
+
+  const auto exit_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+  emit(OpCode::POP);
+  compile(node.child<1>());
+  emit_loop(loop_start);
+
+  patch_jump(exit_jump);
+  emit(OpCode::POP);
+}
+
+void Compiler::visit(EmptyStmt &) {}
+
+void Compiler::visit(ImportStmt &node) {
+  const auto &name = node.child<1>();
+  at(name);
+
+  emit(OpCode::IMPORT);
+  emit_u16(identifier_constant(
+      Symbol(std::get<std::string>(node.child<0>().value))));
+  if (node.child<2>()) {
+    emit(OpCode::POP); // The same module is bound already
+  } else if (is_global_scope()) {
+    emit(OpCode::DEFINE_MODULE);
+    emit_u16(global_slot(name.symbol));
+  } else {
+    add_local(name.lexeme);
+  }
+}
+
+void Compiler::visit(FunctionStmt &node) {
+  const auto &name = node.child<0>();
+  at(name);
+
+  if (is_global_scope()) {
+    function(name.lexeme, node.child<1>(), node.child<2>(), node.child<3>(),
+             node.child<4>());
+    emit(OpCode::DEFINE_GLOBAL);
+    emit_u16(global_slot(name.symbol));
+  } else {
+    // Declared before the body is compiled, so it can refer to itself
+    add_local(name.lexeme);
+    function(name.lexeme, node.child<1>(), node.child<2>(), node.child<3>(),
+             node.child<4>());
+  }
+}
+
+void Compiler::visit(ReturnStmt &node) {
+  at(node.child<0>());
+
+  if (dynamic_cast<Empty *>(node.child<1>().get()) != nullptr) {
+    emit_return();
+    return;
+  }
+
+  compile(node.child<1>());
+  emit(OpCode::RETURN);
+}
+
+void Compiler::visit(ClassStmt &node) {
+  const auto &name = node.child<0>();
+  at(name);
+
+  emit(OpCode::CLASS);
+  emit_u16(identifier_constant(name.symbol));
+  if (is_global_scope()) {
+    emit(OpCode::DEFINE_GLOBAL);
+    emit_u16(global_slot(name.symbol));
+  } else {
+    add_local(name.lexeme);
+  }
+
+  const auto &superclass = node.child<2>();
+  if (superclass != nullptr) {
+    // Like in the interpreter, 'super' is a variable in a scope surrounding
+    // the methods, bound once per class
+    begin_scope();
+    named_variable(superclass->child<0>(), false);
+    add_local("super");
+
+    named_variable(name, false);
+    at(superclass->child<0>());
+    emit(OpCode::INHERIT);
+  }
+
+  named_variable(name, false);
+  for (const auto &method : node.child<1>()) {
+    const auto &method_name = method->child<0>();
+    at(method_name);
+    const auto kind = method->child<3>();
+
+    function(method_name.lexeme, method->child<1>(), method->child<2>(), kind,
+             method->child<4>());
+    emit(OpCode::METHOD);
+    emit_u16(identifier_constant(method_name.symbol));
+    emit(static_cast<uint8_t>(kind));
+  }
+  emit(OpCode::POP);
+
+  if (superclass != nullptr) {
+    end_scope();
+  }
+}
+
+//-------------Expression Visitor Methods------------------------------------
+
+void Compiler::visit(Assign &node) {
+  compile(node.child<1>());
+  named_variable(node.child<0>(), true);
+}
+
+void Compiler::visit(Logical &node) {
+  compile(node.child<0>());
+  at(node.child<1>());
+
+  if (node.child<1>().type == Type::OR) {
+    const auto else_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+    const auto end_jump = emit_jump(OpCode::JUMP);
+    patch_jump(else_jump);
+    emit(OpCode::POP);
+    compile(node.child<2>());
+    patch_jump(end_jump);
+    return;
+  }
+
+  const auto end_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+  emit(OpCode::POP);
+  compile(node.child<2>());
+  patch_jump(end_jump);
+}
+
+void Compiler::visit(Variable &node) { named_variable(node.child<0>(), false); }
+
+void Compiler::visit(Empty &) { emit(OpCode::NIL); }
+
+void Compiler::visit(Literal &node) {
+  const auto &value = node.child<0>();
+  if (const auto *number = std::get_if<double>(&value)) {
+    emit_constant(*number);
+  } else if (std::holds_alternative<std::string>(value)) {
+    emit_constant(node.child<1>());
+  } else if (const auto *boolean = std::get_if<bool>(&value)) {
+    emit(*boolean ? OpCode::TRUE : OpCode::FALSE);
+  } else {
+    emit(OpCode::NIL);
+  }
+}
+
+void Compiler::visit(Unary &node) {
+  compile(node.child<1>());
+
+  const auto &op = node.child<0>();
+  at(op);
+  switch (op.type) {
+  case Type::MINUS:
+    emit(OpCode::NEGATE);
+    break;
+  case Type::BANG:
+    emit(OpCode::NOT);
+    break;
+  default:
+    throw CompiletimeError(op, "Unknown token type in unary operator");
+  }
+}
+
+void Compiler::visit(Binary &node) {
+  const auto &op = node.child<1>();
+
+  compile(node.child<0>());
+  if (op.type == Type::COMMA) { // Discard the left-hand side
+    emit(OpCode::POP);
+    compile(node.child<2>());
+    return;
+  }
+  compile(node.child<2>());
+
+  at(op);
+  switch (op.type) {
+  case Type::MINUS:
+    emit(OpCode::SUBTRACT);
+    break;
+  case Type::SLASH:
+    emit(OpCode::DIVIDE);
+    break;
+  case Type::STAR:
+    emit(OpCode::MULTIPLY);
+    break;
+  case Type::PLUS:
+    emit(OpCode::ADD);
+    break;
+  case Type::GREATER:
+    emit(OpCode::GREATER);
+    break;
+  case Type::GREATER_EQUAL:
+    emit(OpCode::GREATER_EQUAL);
+    break;
+  case Type::LESS:
+    emit(OpCode::LESS);
+    break;
+  case Type::LESS_EQUAL:
+    emit(OpCode::LESS_EQUAL);
+    break;
+  case Type::BANG_EQUAL:
+    emit(OpCode::NOT_EQUAL);
+    break;
+  case Type::EQUAL_EQUAL:
+    emit(OpCode::EQUAL);
+    break;
+  default:
+    throw CompiletimeError(op, "Unexpected operator in binary expression");
+  }
+}
+
+void Compiler::visit(Ternary &node) {
+  const auto &first_op = node.child<1>();
+  if (first_op.type != Type::QUESTION_MARK) {
+    throw CompiletimeError(first_op, "Unknown token type in ternary operator.");
+  }
+
+  compile(node.child<0>());
+  at(first_op);
+
+  const auto else_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+  emit(OpCode::POP);
+  compile(node.child<2>());
+  const auto end_jump = emit_jump(OpCode::JUMP);
+
+  patch_jump(else_jump);
+  emit(OpCode::POP);
+  compile(node.child<4>());
+  patch_jump(end_jump);
+}
+
+void Compiler::visit(Malformed &node) {
+  error("Malformed expression node in AST. Syntax was not valid. Lexer "
+        "message:\t" +
+        node.child<1>());
+}
+
+void Compiler::visit(Call &node) {
+  const auto &arguments = node.child<2>();
+
+  // Method calls skip creating a bound method for the callee
+  auto *get = dynamic_cast<Get *>(node.child<0>().get());
+  if (get != nullptr) {
+    compile(get->child<0>());
+  } else {
+    compile(node.child<0>());
+  }
+
+  for (const auto &argument : arguments) {
+    compile(argument);
+  }
+
+  at(node.child<1>());
+  if (get != nullptr) {
+    emit(node.child<3>() ? OpCode::TAIL_INVOKE : OpCode::INVOKE);
+    emit_u16(identifier_constant(get->child<1>().symbol));
+  } else {
+    emit(node.child<3>() ? OpCode::TAIL_CALL : OpCode::CALL);
+  }
+  emit(static_cast<uint8_t>(arguments.size()));
+}
+
+void Compiler::visit(Grouping &node) { compile(node.child<0>()); }
+
+void Compiler::visit(Lambda &node) {
+  function("", node.child<0>(), node.child<1>(), FunctionKind::LAMDBDA,
+           node.child<2>());
+}
+
+void Compiler::visit(Get &node) {
+  compile(node.child<0>());
+  at(node.child<1>());
+  emit(OpCode::GET_PROPERTY);
+  emit_u16(identifier_constant(node.child<1>().symbol));
+}
+
+void Compiler::visit(Set &node) {
+  compile(node.child<0>());
+  compile(node.child<2>());
+  at(node.child<1>());
+  emit(OpCode::SET_PROPERTY);
+  emit_u16(identifier_constant(node.child<1>().symbol));
+}
+
+void Compiler::visit(ArrayLiteral &node) {
+  // The Parser limits the number of elements to what fits the operand
+  const auto &elements = node.child<1>();
+  for (const auto &element : elements) {
+    compile(element);
+  }
+  at(node.child<0>());
+  emit(OpCode::ARRAY);
+  emit(static_cast<uint8_t>(elements.size()));
+}
+
+void Compiler::visit(Index &node) {
+  compile(node.child<0>());
+  compile(node.child<2>());
+  at(node.child<1>());
+  emit(OpCode::GET_INDEX);
+}
+
+void Compiler::visit(SetIndex &node) {
+  compile(node.child<0>());
+  compile(node.child<2>());
+  compile(node.child<3>());
+  at(node.child<1>());
+  emit(OpCode::SET_INDEX);
+}
+
+void Compiler::visit(This &node) { named_variable(node.child<0>(), false); }
+
+void Compiler::visit(Super &node) {
+  const auto &keyword = node.child<0>();
+  const auto &method = node.child<1>();
+  const Token this_token{Type::THIS, "this", NullType{}, keyword.line};
+
+  // The Resolver annotated whether we are in an unbound function, which has
+  // no 'this' to bind to
+  if (node.child<2>()) {
+    named_variable(keyword, false);
+    at(method);
+    emit(OpCode::GET_UNBOUND_SUPER);
+  } else {
+    named_variable(this_token, false);
+    named_variable(keyword, false);
+    at(method);
+    emit(OpCode::GET_SUPER);
+  }
+  emit_u16(identifier_constant(method.symbol));
+}
@@ -0,0 +1,117 @@
+#include "embed.hpp"
+
+#include <algorithm>
+
+#include "closure_compiler.hpp"
+#include "compiler.hpp"
+#include "lexer.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+
+namespace {
+/// Makes level the log level of this thread for as long as it lives. Changes
+/// made in the meantime are written back to level
+struct LogLevelScope {
+  explicit LogLevelScope(Logging::LogLevel &_level)
+      : level(_level), previous(Logging::get_log_level()) {
+    Logging::set_log_level(level);
+  }
+  ~LogLevelScope() {
+    level = Logging::get_log_level();
+    Logging::set_log_level(previous);
+  }
+
+  LogLevelScope(const LogLevelScope &) = delete;
+  LogLevelScope &operator=(const LogLevelScope &) = delete;
+  LogLevelScope(LogLevelScope &&) = delete;
+  LogLevelScope &operator=(LogLevelScope &&) = delete;
+
+  Logging::LogLevel &level;
+  const Logging::LogLevel previous;
+};
+} // namespace
+
+Isolate::Isolate() : Isolate(Options{}) {}
+
+Isolate::Isolate(const Options &_options)
+    : options(_options),
+      err_handler(std::make_shared<StreamErrorHandler>(errors)) {
+  const GC::HeapScope heap_scope{heap};
+  options.max_call_depth =
+      std::min(options.max_call_depth, Interpreter::MAX_CALL_DEPTH);
+  if (options.backend == Backend::VM) {
+    vm = std::make_unique<VM>(output, err_handler);
+    vm->set_max_call_depth(options.max_call_depth);
+  } else {
+    tree_walker = std::make_unique<Interpreter>(output, err_handler);
+    tree_walker->max_call_depth = options.max_call_depth;
+  }
+  heap.limit = options.max_heap_bytes;
+}
+
+Isolate::~Isolate() {
+  const GC::HeapScope heap_scope{heap};
+  vm = nullptr;
+  tree_walker = nullptr;
+  // Nothing outside the heap can refer to what is left
+  GC::collect();
+}
+
+Isolate::Result Isolate::run(std::string_view source) {
+  const GC::HeapScope heap_scope{heap};
+  const LogLevelScope log_level{options.log_level};
+
+  err_handler->reset_error();
+  err_handler->reset_runtime_error();
+  const auto status = execute(arena.copy(source));
+
+  Result result{status, output.str(), errors.str()};
+  output.str({});
+  errors.str({});
+  return result;
+}
+
+Isolate::Status Isolate::execute(std::string_view source) {
+  Interpreter &interpreter = vm != nullptr ? vm->host : *tree_walker;
+
+  Lexer lexer{source, err_handler};
+  Parser parser{lexer, arena, err_handler};
+  auto &statements = programs.emplace_back(parser.parse());
+  if (err_handler->has_error()) {
+    return Status::COMPILE_ERROR;
+  }
+
+  Resolver resolver{interpreter};
+  resolver.resolve(statements);
+  if (err_handler->has_error()) {
+    return Status::COMPILE_ERROR;
+  }
+
+  Optimizer optimizer{arena};
+  optimizer.optimize(statements);
+
+  try {
+    if (vm != nullptr) {
+      Compiler compiler{*vm, err_handler};
+      const auto script = compiler.compile(statements);
+      if (script) {
+        vm->interpret(script);
+      }
+    } else if (options.backend == Backend::CLOSURES) {
+      tree_walker->interpret(ClosureCompiler{}.compile(statements));
+    } else {
+      tree_walker->interpret(statements);
+    }
+  } catch (const Exit &) {
+    return Status::EXIT;
+  }
+
+  if (err_handler->has_error()) {
+    return Status::COMPILE_ERROR;
+  }
+  if (err_handler->has_runtime_error()) {
+    return Status::RUNTIME_ERROR;
+  }
+  return Status::OK;
+}
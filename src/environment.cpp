@@ -6,36 +6,40 @@
 #include "error.hpp"
 #include "logging.hpp"
 
-Environment::Environment(std::shared_ptr<Environment> _enclosing)
-    : enclosing(std::move(_enclosing)) {}
-
-void Environment::define(Token variable) {
-  if (variables.find(variable.lexeme) != variables.cend()) {
-    throw RuntimeError(variable, "Identifier '" + variable.lexeme +
-                                     "' is already defined in this scope.");
+Environment::Environment(EnvironmentPtr _enclosing)
+    : Obj(Type::ENVIRONMENT), enclosing(std::move(_enclosing)) {}
+
+void Environment::define(Symbol identifier, Value value) {
+  if (!slots.emplace(identifier, values.size()).second) {
+    throw RuntimeError(stringify(value),
+                       "Identifier '" + identifier.str() +
+                           "' is already defined in this scope.",
+                       0);
   }
-  variables.emplace(variable.lexeme, variable.value);
+  names.push_back(identifier);
+  values.push_back(std::move(value));
 }
 
-void Environment::define(std::string identifier, Token::Value value) {
-  if (variables.find(identifier) != variables.cend()) {
-    throw RuntimeError(
-        value,
-        "Identifier '" + identifier + "' is already defined in this scope.", 0);
-  }
-  variables.emplace(std::move(identifier), std::move(value));
+void Environment::define_local(Symbol name, Value value) {
+  names.push_back(name);
+  values.push_back(std::move(value));
 }
 
-const Token::Value &Environment::get(const Token &token) const {
+void Environment::truncate(size_t size) {
+  values.resize(size);
+  names.resize(size);
+}
+
+const Value &Environment::get(const Token &token) const {
   LOG_DEBUG("Getting variable ", token.lexeme, " from : ", *this);
-  if (variables.contains(token.lexeme)) {
-    return variables.at(token.lexeme);
+  if (const auto elem = slots.find(token.symbol); elem != slots.cend()) {
+    return values[elem->second];
   }
   if (enclosing != nullptr) {
     return enclosing->get(token);
   }
   throw RuntimeError(token, "Cannot access undefined identifier '" +
-                                token.lexeme + "'.");
+                                std::string(token.lexeme) + "'.");
 }
 
 namespace {
@@ -50,33 +54,35 @@ const Environment *ancestor(const Environment *env, size_t depth) {
 }
 } // namespace
 
-const Token::Value &Environment::get_at(size_t depth,
-                                        const std::string &name) const {
-  LOG_DEBUG("Get ", name, " at depth: ", depth, " with env:", depth,
-            *ancestor(this, depth));
+const Value &Environment::get_at(size_t depth, size_t slot) const {
+  LOG_DEBUG("Get slot ", slot, " at depth: ", depth,
+            " with env:", *ancestor(this, depth));
   // Existence must be ensured by resolver
-  return ancestor(this, depth)->variables.at(name);
+  const auto *env = ancestor(this, depth);
+  assert(slot < env->values.size() && "Slot out of range in get_at()");
+  return env->values[slot];
 }
 
-void Environment::assign(const Token &token, const Token::Value &value) {
-  auto elem = variables.find(token.lexeme);
-  if (elem == variables.end()) {
+void Environment::assign(const Token &token, const Value &value) {
+  auto elem = slots.find(token.symbol);
+  if (elem == slots.end()) {
     if (enclosing != nullptr) {
       return enclosing->assign(token, value);
     }
     throw RuntimeError(token, "Cannot assign to undefined identifier '" +
-                                  token.lexeme + "'.");
+                                  std::string(token.lexeme) + "'.");
   }
-  elem->second = value;
+  values[elem->second] = value;
 }
 
-void Environment::assign_at(size_t depth, const std::string &name,
-                            Token::Value value) {
+void Environment::assign_at(size_t depth, size_t slot, Value value) {
   LOG_DEBUG("Assign at: ", *ancestor(this, depth));
   // const-cast here is fine since we know the original object was non-const.
   // Reduces code duplication
-  const_cast<Environment *>(ancestor(this, depth))->variables.at(name) =
-      std::move(value); // NOLINT: ppcoreguidelines-pro-type-const-cast
+  // NOLINTNEXTLINE: cppcoreguidelines-pro-type-const-cast
+  auto *env = const_cast<Environment *>(ancestor(this, depth));
+  assert(slot < env->values.size() && "Slot out of range in assign_at()");
+  env->values[slot] = std::move(value);
 }
 
 std::string Environment::to_string() const {
@@ -84,14 +90,26 @@ std::string Environment::to_string() const {
 
   env << "{";
 
-  for (const auto &variable : variables) {
-    env << variable.first << ": " << variable.second << ", ";
+  for (size_t slot = 0; slot < values.size(); ++slot) {
+    env << names[slot] << ": " << values[slot] << ", ";
   }
   env << "}";
 
   return env.str();
 }
 
+void Environment::trace(Tracer tracer) const {
+  ::trace(tracer, enclosing);
+  for (const auto &value : values) {
+    ::trace(tracer, value);
+  }
+}
+
+void Environment::clear_references() {
+  enclosing = nullptr;
+  values.clear();
+}
+
 std::string Environment::to_string_recursive() const {
   std::string result = to_string();
   auto env = enclosing;
@@ -4,7 +4,8 @@
 Exit::Exit(const std::string &msg) : std::runtime_error(msg) {}
 
 RuntimeError::RuntimeError(Token _token, const std::string &msg)
-    : std::runtime_error("Runtime error at '" + _token.lexeme + ": " + msg),
+    : std::runtime_error("Runtime error at '" + std::string(_token.lexeme) +
+                         ": " + msg),
       token(std::move(_token)) {}
 
 RuntimeError::RuntimeError(Token::Value value, const std::string &msg,
@@ -17,9 +18,20 @@ RuntimeError::RuntimeError(const std::string &msg)
     : std::runtime_error("Runtime error: " + msg),
       token(Token{Token::TokenType::NIL, "RUNTIME_ERROR", NullType{}, 0}) {}
 
+RuntimeError::RuntimeError(const RuntimeError &err, unsigned int line)
+    : std::runtime_error(err),
+      token(Token{err.token.type, err.token.lexeme, err.token.value, line}) {}
+
+void rethrow_at(const RuntimeError &err, const Token &token) {
+  if (err.token.line != 0) {
+    throw;
+  }
+  throw RuntimeError(err, token.line);
+}
+
 CompiletimeError::CompiletimeError(Token _token, const std::string &msg)
-    : std::runtime_error("Compile-time error at '" + _token.lexeme + ": " +
-                         msg),
+    : std::runtime_error("Compile-time error at '" +
+                         std::string(_token.lexeme) + ": " + msg),
       token(std::move(_token)) {}
 
 CompiletimeError::CompiletimeError(Token::Value value, const std::string &msg,
@@ -33,6 +45,7 @@ CompiletimeError::CompiletimeError(Token::Value value, const std::string &msg,
 ErrorHandler::~ErrorHandler() = default;
 
 void ErrorHandler::reset_error() { had_error = false; }
+void ErrorHandler::reset_runtime_error() { had_runtime_error = false; }
 bool ErrorHandler::has_error() const { return had_error; }
 
 bool ErrorHandler::has_runtime_error() const { return had_runtime_error; }
@@ -49,7 +62,7 @@ void ErrorHandler::error(const Token &token, std::string_view message) {
 }
 
 void ErrorHandler::warn(const Token &token, std::string_view message) {
-  report(token.line, "at '" + token.lexeme + "'", message, false);
+  report(token.line, "at '" + std::string(token.lexeme) + "'", message, false);
 }
 
 void ErrorHandler::warn(unsigned int line, std::string_view message) {
@@ -87,3 +100,12 @@ void FileErrorHandler::report(unsigned int line, std::string_view where,
   err_stream << (is_error ? "] Error" : "] Warning");
   err_stream << where << ": " << message << '\n';
 }
+
+StreamErrorHandler::StreamErrorHandler(std::ostream &_err_stream)
+    : err_stream(_err_stream) {}
+
+void StreamErrorHandler::report(unsigned int line, std::string_view where,
+                                std::string_view message, bool is_error) {
+  err_stream << "[line " << line << (is_error ? "] Error" : "] Warning")
+             << where << ": " << message << '\n';
+}
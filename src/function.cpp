@@ -1,15 +1,24 @@
 #include "function.hpp"
+#include "instance.hpp"
 #include "interpreter.hpp"
 #include "logging.hpp"
+#include "profiler.hpp"
 #include <cassert>
 
 using FuncPtr = const FunctionStmt *;
 using LambdaPtr = const Lambda *;
 
+namespace {
+const Symbol this_symbol{"this"};
+} // namespace
+
 Function::Function(
     const std::variant<const FunctionStmt *, const Lambda *> &_declaration,
-    std::shared_ptr<Environment> _closure, FunctionKind _kind)
-    : declaration(_declaration), closure(std::move(_closure)), kind(_kind) {}
+    EnvironmentPtr _closure, EnvironmentPtr _globals, FunctionKind _kind,
+    Value _receiver)
+    : declaration(_declaration), closure(std::move(_closure)),
+      globals(std::move(_globals)), kind(_kind),
+      receiver(std::move(_receiver)) {}
 
 const std::vector<Token> &Function::parameters() const {
   if (const auto *decl = std::get_if<FuncPtr>(&declaration)) {
@@ -35,36 +44,99 @@ const std::vector<stmt> &Function::body() const {
   exit(1);
 }
 
-Token::Value Function::call(Interpreter &interpreter,
-                            const std::vector<Token::Value> &arguments) {
-  auto environment = std::make_shared<Environment>(closure);
+std::string_view Function::name() const {
+  if (const auto *decl = std::get_if<FuncPtr>(&declaration)) {
+    return (*decl)->child<0>().lexeme;
+  }
+  return "lambda";
+}
+
+std::string Function::qualified_name() const {
+  if (const auto *decl = std::get_if<LambdaPtr>(&declaration)) {
+    return "lambda:" + std::to_string((*decl)->child<3>().line);
+  }
+  if (class_name.empty()) {
+    return std::string(name());
+  }
+  return std::string(class_name) + "." + std::string(name());
+}
+
+bool Function::is_pure() const {
+  if (const auto *decl = std::get_if<FuncPtr>(&declaration)) {
+    return (*decl)->child<4>();
+  }
+  return std::get<LambdaPtr>(declaration)->child<2>();
+}
+
+Value Function::call(Interpreter &interpreter,
+                     const std::vector<Value> &arguments) {
+  return invoke(interpreter, receiver, arguments);
+}
+
+Value Function::invoke(Interpreter &interpreter, const Value &this_value,
+                       const std::vector<Value> &arguments) {
+  auto completion = execute_body(interpreter, this_value, arguments);
+  if (completion != Completion::TAIL_CALL) {
+    return result(interpreter, completion, this_value);
+  }
+
+  // Each tail call replaces the previous one instead of nesting in it, so
+  // tail recursion runs in constant space
+  while (true) {
+    auto call = std::move(interpreter.tail_call);
+    Profiler::Scope profiled{interpreter.profiler, *call.function};
+    completion =
+        call.function->execute_body(interpreter, call.receiver, call.arguments);
+    interpreter.release_arguments(std::move(call.arguments));
+    if (completion != Completion::TAIL_CALL) {
+      return call.function->result(interpreter, completion, call.receiver);
+    }
+  }
+}
+
+Completion Function::execute_body(Interpreter &interpreter,
+                                  const Value &this_value,
+                                  const std::vector<Value> &arguments) {
+  const Interpreter::ScopedGlobals scoped_globals{interpreter, globals};
+  auto environment = interpreter.new_environment(closure);
 
   LOG_DEBUG("Calling func with closure: ", *environment, " enclosed by ",
             *environment->enclosing);
 
+  if (has_receiver(kind)) {
+    environment->define_local(this_symbol, this_value);
+  }
+
   const auto &params = parameters();
 
   for (size_t i = 0; i < params.size(); ++i) {
-    auto parameter = params[i];
-    parameter.value = arguments[i];
-    environment->define(parameter);
+    environment->define_local(params[i].symbol, arguments[i]);
   }
 
-  try {
-    interpreter.execute_block(body(), std::move(environment));
-  } catch (const Interpreter::Return &returned) // Early return
+  // The body's locals are defined after the parameters in the same environment
+  const auto completion =
+      lowered_body != nullptr
+          ? interpreter.execute_block(*lowered_body, environment)
+          : interpreter.execute_block(body(), environment);
+  interpreter.release_environment(std::move(environment));
+  return completion;
+}
+
+Value Function::result(Interpreter &interpreter, Completion completion,
+                       const Value &this_value) const {
+  if (completion == Completion::RETURN) // Early return
   {
+    auto returned = std::move(interpreter.return_value);
     if (kind ==
         FunctionKind::CONSTRUCTOR) // Allow empty returns in constructors that
                                    // implicitly return 'this'
-      return closure->get_at(
-          0,
-          "this"); // Non-empty returns in constructors are caught by resolver
-    return returned.val;
+      // Non-empty returns in constructors are caught by resolver
+      return this_value;
+    return returned;
   }
 
   if (kind == FunctionKind::CONSTRUCTOR)
-    return closure->get_at(0, "this");
+    return this_value;
 
   return NullType{};
 }
@@ -74,7 +146,8 @@ size_t Function::arity() const { return parameters().size(); }
 std::string Function::to_string() const {
   switch (kind) {
   case FunctionKind::FUNCTION:
-    return "<User fn " + std::get<FuncPtr>(declaration)->child<0>().lexeme +
+    return "<User fn " +
+           std::string(std::get<FuncPtr>(declaration)->child<0>().lexeme) +
            ">";
   case FunctionKind::LAMDBDA:
     return "<User lambda>";
@@ -91,8 +164,22 @@ std::string Function::to_string() const {
   return "";
 }
 
+void Function::trace(Tracer tracer) const {
+  ::trace(tracer, closure);
+  ::trace(tracer, globals);
+  ::trace(tracer, receiver);
+}
+
+void Function::clear_references() {
+  closure = nullptr;
+  globals = nullptr;
+  receiver = NullType{};
+}
+
 FunctionPtr Function::bind(InstancePtr instance) {
-  auto env = std::make_shared<Environment>(closure);
-  env->define("this", std::move(instance));
-  return std::make_shared<Function>(declaration, std::move(env), kind);
+  auto method = make_obj<Function>(declaration, closure, globals, kind,
+                                   std::move(instance));
+  method->lowered_body = lowered_body;
+  method->class_name = class_name;
+  return method;
 }
@@ -0,0 +1,243 @@
+#include "gc.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "error.hpp"
+#include "logging.hpp"
+#include "value.hpp"
+
+namespace {
+using GC::Heap;
+
+// Trivially destructible, so objects can still be freed by static destructors
+thread_local Heap thread_heap;
+thread_local Heap *scoped_heap = nullptr;
+
+void subtract_internal_reference(Obj *obj) {
+  if (obj->is_tracked()) {
+    --obj->gc_refs;
+  }
+}
+
+void mark(Obj *obj) {
+  if (obj->is_tracked() && !obj->gc_reachable) {
+    obj->gc_reachable = true;
+    GC::current_heap().worklist->push_back(obj);
+  }
+}
+} // namespace
+
+Obj::Obj(Type _type) : type(_type) {
+  if (is_tracked()) {
+    auto &heap = GC::current_heap();
+    gc_next = heap.tracked;
+    if (heap.tracked != nullptr) {
+      heap.tracked->gc_previous = this;
+    }
+    heap.tracked = this;
+    ++heap.tracked_count;
+    ++heap.allocations;
+  }
+}
+
+Obj::~Obj() {
+  auto &heap = GC::current_heap();
+  if (is_tracked()) {
+    if (gc_previous != nullptr) {
+      gc_previous->gc_next = gc_next;
+    } else {
+      heap.tracked = gc_next;
+    }
+    if (gc_next != nullptr) {
+      gc_next->gc_previous = gc_previous;
+    }
+    --heap.tracked_count;
+  }
+  if (gc_bytes != 0) {
+    auto &allocated = heap.allocated[static_cast<size_t>(gc_kind)];
+    --allocated.live;
+    allocated.live_bytes -= gc_bytes;
+    heap.live_bytes -= gc_bytes;
+  }
+}
+
+// Destroying an object releases the objects it references. They are destroyed
+// after it instead of within its destructor, so that freeing a long chain of
+// objects, like a linked list, doesn't nest a destructor per element
+void destroy(Obj *obj) {
+  auto &heap = GC::current_heap();
+  if (heap.pending_destruction != nullptr) {
+    heap.pending_destruction->push_back(obj);
+    return;
+  }
+
+  std::vector<Obj *> pending;
+  heap.pending_destruction = &pending;
+  delete obj;
+  while (!pending.empty()) {
+    auto *next = pending.back();
+    pending.pop_back();
+    delete next;
+  }
+  heap.pending_destruction = nullptr;
+}
+
+namespace GC {
+
+namespace {
+// Objects are counted as at most 4 GiB
+uint32_t counted_bytes(size_t bytes) {
+  return static_cast<uint32_t>(
+      std::min<size_t>(bytes, std::numeric_limits<uint32_t>::max()));
+}
+
+[[noreturn]] void exceeded(const Heap &heap) {
+  throw RuntimeError("Heap limit of " + std::to_string(heap.limit) +
+                     " bytes exceeded.");
+}
+
+void count_live(Heap &heap, Allocations &allocated, uint32_t bytes) {
+  allocated.bytes += bytes;
+  allocated.live_bytes += bytes;
+  heap.live_bytes += bytes;
+  heap.peak_bytes = std::max(heap.peak_bytes, heap.live_bytes);
+}
+} // namespace
+
+void account(Obj &obj, Kind kind, size_t bytes) {
+  obj.gc_kind = kind;
+  obj.gc_bytes = counted_bytes(bytes);
+
+  auto &heap = current_heap();
+  auto &allocated = heap.allocated[static_cast<size_t>(kind)];
+  ++allocated.count;
+  ++allocated.live;
+  count_live(heap, allocated, obj.gc_bytes);
+  if (heap.limit != 0 && heap.live_bytes > heap.limit) {
+    exceeded(heap);
+  }
+}
+
+void grow(const Obj &obj, size_t bytes) {
+  if (obj.gc_bytes == 0) {
+    return; // Not counted, like the interned strings
+  }
+  reserve(bytes);
+  auto &heap = current_heap();
+  const auto grown = counted_bytes(obj.gc_bytes + bytes) - obj.gc_bytes;
+  obj.gc_bytes += grown;
+  count_live(heap, heap.allocated[static_cast<size_t>(obj.gc_kind)], grown);
+}
+
+void reserve(size_t bytes) {
+  const auto &heap = current_heap();
+  const auto room = heap.limit - std::min(heap.limit, heap.live_bytes);
+  if (heap.limit != 0 && bytes > room) {
+    exceeded(heap);
+  }
+}
+
+Heap &current_heap() {
+  return scoped_heap != nullptr ? *scoped_heap : thread_heap;
+}
+
+HeapScope::HeapScope(Heap &heap) : previous(scoped_heap) {
+  scoped_heap = &heap;
+}
+
+HeapScope::~HeapScope() { scoped_heap = previous; }
+
+size_t collect() {
+  auto &heap = current_heap();
+  if (heap.collecting) {
+    return 0;
+  }
+  heap.collecting = true;
+  heap.allocations = 0;
+
+  for (auto *obj = heap.tracked; obj != nullptr; obj = obj->gc_next) {
+    obj->gc_refs = obj->ref_count;
+    obj->gc_reachable = false;
+  }
+
+  for (auto *obj = heap.tracked; obj != nullptr; obj = obj->gc_next) {
+    obj->trace(subtract_internal_reference);
+  }
+
+  std::vector<Obj *> worklist;
+  heap.worklist = &worklist;
+  for (auto *obj = heap.tracked; obj != nullptr; obj = obj->gc_next) {
+    if (obj->gc_refs > 0) {
+      mark(obj);
+    }
+  }
+  while (!worklist.empty()) {
+    auto *obj = worklist.back();
+    worklist.pop_back();
+    obj->trace(mark);
+  }
+  heap.worklist = nullptr;
+
+  // Keep the garbage alive until all of its references are dropped, so no
+  // object is freed while it is still being cleared
+  std::vector<Obj *> garbage;
+  for (auto *obj = heap.tracked; obj != nullptr; obj = obj->gc_next) {
+    if (!obj->gc_reachable) {
+      retain(obj);
+      garbage.push_back(obj);
+    }
+  }
+  for (auto *obj : garbage) {
+    obj->clear_references();
+  }
+  for (auto *obj : garbage) {
+    release(obj);
+  }
+
+  heap.threshold = std::max(Heap::MIN_THRESHOLD, 2 * heap.tracked_count);
+  heap.live_bytes_after_collection = heap.live_bytes;
+  heap.collecting = false;
+
+  LOG_DEBUG("Collected ", garbage.size(), " objects, ", heap.tracked_count,
+            " remain");
+  return garbage.size();
+}
+
+void maybe_collect() {
+  const auto &heap = current_heap();
+  if (heap.allocations >= heap.threshold ||
+      (heap.limit != 0 &&
+       heap.live_bytes > heap.live_bytes_after_collection + heap.limit / 4)) {
+    collect();
+  }
+}
+
+size_t tracked_objects() { return current_heap().tracked_count; }
+
+void write_stats(std::ostream &os) {
+  constexpr std::array<const char *, KIND_COUNT> names{
+      "environments", "functions", "classes", "instances", "strings", "other"};
+
+  const auto &heap = current_heap();
+  os << "Heap: " << heap.live_bytes << " bytes live, " << heap.peak_bytes
+     << " bytes at peak";
+  if (heap.limit != 0) {
+    os << ", limit " << heap.limit << " bytes";
+  }
+  os << '\n';
+  for (size_t kind = 0; kind < KIND_COUNT; ++kind) {
+    const auto &allocated = heap.allocated[kind];
+    os << "  " << std::left << std::setw(13) << names[kind] << std::right
+       << std::setw(10) << allocated.live << " live " << std::setw(12)
+       << allocated.live_bytes << " bytes " << std::setw(10)
+       << allocated.count << " allocated " << std::setw(12) << allocated.bytes
+       << " bytes\n";
+  }
+}
+
+} // namespace GC
@@ -1,43 +1,132 @@
 #include "instance.hpp"
 
+#include <cstdlib>
+
 #include "error.hpp"
 #include "interpreter.hpp"
 #include "logging.hpp"
 
-Instance::Instance(ClassPtr _klass) : klass(std::move(_klass)) {}
+using Kind = PropertyCache::Kind;
+
+Instance::Instance(ClassPtr _klass)
+    : Obj(Type::TREE_INSTANCE), klass(std::move(_klass)),
+      shape(&klass->instance_shape()) {}
 
 std::string Instance::to_string() const { return klass->name() + " instance"; }
 
-Token::Value Instance::get_field(const Token &name, Interpreter &interpreter) {
-  if (const auto &getter = klass->get_getter(name.lexeme)) {
+void Instance::trace(Tracer tracer) const {
+  ::trace(tracer, klass);
+  for (const auto &field : fields) {
+    ::trace(tracer, field);
+  }
+}
+
+void Instance::clear_references() {
+  klass = nullptr;
+  fields.clear();
+}
+
+const PropertyCache::Entry &Instance::lookup(const Token &name,
+                                             PropertyCache &cache) {
+  if (const auto *entry = cache.find(*shape)) {
+    return *entry;
+  }
+  return cache.insert(lookup_get(name));
+}
+
+Value Instance::get_field(const Token &name, PropertyCache &cache,
+                          Interpreter &interpreter) {
+  const auto &entry = lookup(name, cache);
+
+  switch (entry.kind) {
+  case Kind::FIELD:
+    return fields[entry.slot];
+  case Kind::METHOD:
+    // The method is used as a value, so it needs to remember this instance.
+    // Direct calls don't get here, they invoke the method with the receiver
+    return entry.function->bind(InstancePtr(this));
+  case Kind::GETTER: {
     Interpreter::CheckedRecursiveDepth recursionCheck{interpreter, name};
-    return getter->bind(shared_from_this())->call(interpreter, {});
+    return entry.function->invoke(interpreter, Value{this}, {});
+  }
+  case Kind::BINDING:
+    return klass->module_globals()->values[entry.slot];
+  case Kind::ADD_FIELD:
+    break;
+  }
+  LOG_ERROR("Invalid property cache entry for getting ", name.lexeme);
+  std::abort();
+}
+
+void Instance::set_field(const Token &name, Value value,
+                         PropertyCache &cache) {
+  const auto *entry = cache.find(*shape);
+  if (entry == nullptr) {
+    entry = &cache.insert(lookup_set(name));
+  }
+
+  if (entry->kind == Kind::ADD_FIELD) {
+    shape = entry->transition;
+    fields.push_back(std::move(value));
+  } else {
+    fields[entry->slot] = std::move(value);
+  }
+}
+
+std::optional<size_t> Instance::module_binding(Symbol name) const {
+  const auto &globals = klass->module_globals();
+  if (globals == nullptr) {
+    return std::nullopt;
   }
+  if (const auto slot = globals->slots.find(name);
+      slot != globals->slots.cend()) {
+    return slot->second;
+  }
+  return std::nullopt;
+}
 
-  if (fields.contains(name.lexeme)) {
-    return fields.at(name.lexeme);
+PropertyCache::Entry Instance::lookup_get(const Token &name) const {
+  if (const auto slot = module_binding(name.symbol)) {
+    return {.shape_id = shape->id, .kind = Kind::BINDING, .slot = *slot};
+  }
+
+  if (const auto &getter = klass->get_getter(name.symbol)) {
+    return {.shape_id = shape->id,
+            .kind = Kind::GETTER,
+            .function = getter.get()};
+  }
+
+  if (const auto slot = shape->find(name.symbol); slot != Shape::NOT_FOUND) {
+    return {.shape_id = shape->id, .kind = Kind::FIELD, .slot = slot};
   }
 
   LOG_WARNING("Undefined property on object with fields: ");
-  for (const auto &field : fields) {
-    LOG_WARNING(field.first, ": ", field.second);
+  for (size_t slot = 0; slot < fields.size(); ++slot) {
+    LOG_WARNING(shape->field_names()[slot], ": ", fields[slot]);
   }
 
-  if (const auto &method = klass->get_method(name.lexeme)) {
-    // Create new env
-    // Bind assign to the name of the variable the method was called on
-    // Create a copy of the method surrounded by that environment (called bound
-    // method) Call that copy
-    return method->bind(shared_from_this());
+  if (const auto &method = klass->get_method(name.symbol)) {
+    return {.shape_id = shape->id,
+            .kind = Kind::METHOD,
+            .function = method.get()};
   }
 
-  throw RuntimeError(name, "Property " + name.lexeme + " is not defined");
+  throw RuntimeError(name, "Property " + std::string(name.lexeme) +
+                               " is not defined");
 }
 
-void Instance::set_field(const Token &name, Token::Value value) {
-  if (klass->get_getter(name.lexeme) != nullptr)
+PropertyCache::Entry Instance::lookup_set(const Token &name) {
+  // Names of a module are read-only outside of it, like getters
+  if (klass->get_getter(name.symbol) != nullptr ||
+      module_binding(name.symbol).has_value())
     throw RuntimeError(name, "A getter by this name exists. A property of the "
                              "same name would be inaccessible");
 
-  fields[name.lexeme] = std::move(value);
-}
\ No newline at end of file
+  if (const auto slot = shape->find(name.symbol); slot != Shape::NOT_FOUND) {
+    return {.shape_id = shape->id, .kind = Kind::FIELD, .slot = slot};
+  }
+  return {.shape_id = shape->id,
+          .kind = Kind::ADD_FIELD,
+          .slot = fields.size(),
+          .transition = shape->with_field(name.symbol)};
+}
@@ -2,31 +2,56 @@
 
 #include <cassert>
 #include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
 
+#include "array.hpp"
 #include "buildin.hpp"
 #include "callable.hpp"
 #include "class.hpp"
 #include "function.hpp"
+#include "gc.hpp"
 #include "instance.hpp"
+#include "lexer.hpp"
 #include "logging.hpp"
+#include "native_stack.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "resolver.hpp"
 
 using Type = Token::TokenType;
 
+namespace {
+const Symbol super_symbol{"super"};
+} // namespace
+
 Interpreter::Interpreter(std::ostream &_os,
                          std::shared_ptr<ErrorHandler> _err_handler)
-    : out_stream(_os), globals(std::make_shared<Environment>()),
-      environment(globals), err_handler(std::move(_err_handler)),
+    : out_stream(_os), globals(make_obj<Environment>()),
+      current_globals(globals), environment(globals),
+      err_handler(std::move(_err_handler)),
       interpreter_path{std::filesystem::current_path().string()} {
-  for (const auto &buildin : Buildin::get_buildins()) {
-    globals->define(buildin);
+  for (auto &[name, buildin] : Buildin::get_buildins()) {
+    globals->define(Symbol(name), std::move(buildin));
   }
 }
 
+// Functions defined at the top level close over the globals, so the globals
+// are part of a cycle that only the collector can free. So are modules
+Interpreter::~Interpreter() {
+  environment = nullptr;
+  modules.clear();
+  globals->clear_references();
+  GC::collect();
+}
+
 Interpreter::CheckedRecursiveDepth::CheckedRecursiveDepth(
     Interpreter &_interpreter, const Token &location)
     : interpreter(_interpreter) {
   interpreter.recursion_depth += 1;
-  if (interpreter.recursion_depth > MAX_RECURSION_DEPTH) {
+  if (interpreter.recursion_depth > interpreter.max_call_depth) {
     interpreter.recursion_depth -= 1;
     throw RuntimeError(
         location,
@@ -38,100 +63,292 @@ Interpreter::CheckedRecursiveDepth::~CheckedRecursiveDepth() {
   interpreter.recursion_depth -= 1;
 }
 
+Interpreter::ScopedGlobals::ScopedGlobals(Interpreter &_interpreter,
+                                          EnvironmentPtr env)
+    : interpreter(_interpreter),
+      enclosing(std::exchange(interpreter.current_globals, std::move(env))) {}
+
+Interpreter::ScopedGlobals::~ScopedGlobals() {
+  interpreter.current_globals = std::move(enclosing);
+}
+
 //----------Top-level interpretation, evaluation and execution methods----------
 
 void Interpreter::interpret(std::vector<stmt> &statements) {
+  run_program([&]() { execute_program(statements); });
+}
+
+void Interpreter::interpret(const LoweredBody &program) {
+  run_program([&]() {
+    try {
+      program(*this);
+    } catch (const RuntimeError &err) {
+      err_handler->runtime_error(err.token, err.what());
+    }
+  });
+}
+
+void Interpreter::run_program(const std::function<void()> &program) {
+  if (is_interpreting) {
+    program();
+    return;
+  }
+
+  // Every call nests native frames, so the depth of calls is bounded by the
+  // native stack. Running on a stack for max_call_depth calls lifts that bound.
+  // Fewer calls are allowed if only a smaller stack can be allocated
+  is_interpreting = true;
+  const auto configured_depth = max_call_depth;
+  try {
+    NativeStack::run(max_call_depth * NATIVE_STACK_PER_CALL,
+                     [&](size_t stack_size) {
+                       max_call_depth = std::min(
+                           max_call_depth, stack_size / NATIVE_STACK_PER_CALL);
+                       program();
+                     });
+  } catch (...) {
+    max_call_depth = configured_depth;
+    is_interpreting = false;
+    tasks.wait();
+    throw;
+  }
+  max_call_depth = configured_depth;
+  is_interpreting = false;
+  tasks.wait();
+}
+
+void Interpreter::execute_program(std::vector<stmt> &statements) {
   try {
     for (stmt &statement : statements) {
       execute(statement);
-
-      LOG_INFO("Last value after stmt: ", last_value);
     }
   } catch (const RuntimeError &err) {
     err_handler->runtime_error(err.token, err.what());
   }
 }
 
-void Interpreter::execute_block(const std::vector<stmt> &body,
-                                std::shared_ptr<Environment> enclosing_env) {
-  auto original_env = environment;
-  environment = std::make_shared<Environment>(std::move(enclosing_env));
+namespace {
+/// Restores the interpreter's environment when a block is left, also when a
+/// RuntimeError passes through it
+struct ScopedEnvironment {
+  ScopedEnvironment(Interpreter &_interpreter,
+                    EnvironmentPtr env)
+      : interpreter(_interpreter),
+        original_env(std::exchange(interpreter.environment, std::move(env))) {}
+  ~ScopedEnvironment() { interpreter.environment = std::move(original_env); }
+
+  ScopedEnvironment(const ScopedEnvironment &) = delete;
+  ScopedEnvironment &operator=(const ScopedEnvironment &) = delete;
+  ScopedEnvironment(ScopedEnvironment &&) = delete;
+  ScopedEnvironment &operator=(ScopedEnvironment &&) = delete;
+
+  Interpreter &interpreter;
+  EnvironmentPtr original_env;
+};
+} // namespace
+
+Completion Interpreter::execute_block(const LoweredBody &body,
+                                      EnvironmentPtr env) {
+  const ScopedEnvironment scope{*this, std::move(env)};
+  return body(*this);
+}
+
+Completion Interpreter::execute_block(const std::vector<stmt> &body,
+                                      EnvironmentPtr env) {
+  const ScopedEnvironment scope{*this, std::move(env)};
 
   LOG_DEBUG("Executing block statements with env: ", *environment,
             " enclosed by ", *environment->enclosing);
 
-  try {
-    for (const auto &statement : body) {
-      execute(statement);
+  return execute_statements(body);
+}
+
+EnvironmentPtr Interpreter::new_environment(EnvironmentPtr enclosing_env) {
+  if (environment_pool.empty()) {
+    return make_obj<Environment>(std::move(enclosing_env));
+  }
+  auto env = std::move(environment_pool.back());
+  environment_pool.pop_back();
+  env->enclosing = std::move(enclosing_env);
+  return env;
+}
+
+void Interpreter::release_environment(EnvironmentPtr env) {
+  if (env->ref_count != 1 ||
+      environment_pool.size() >= MAX_POOLED_ENVIRONMENTS) {
+    return;
+  }
+  // Keeps the capacity of the slots for the next user
+  env->truncate(0);
+  env->enclosing = nullptr;
+  environment_pool.push_back(std::move(env));
+}
+
+std::vector<Value> Interpreter::new_arguments() {
+  if (arguments_pool.empty()) {
+    return {};
+  }
+  auto arguments = std::move(arguments_pool.back());
+  arguments_pool.pop_back();
+  return arguments;
+}
+
+void Interpreter::release_arguments(std::vector<Value> &&arguments) {
+  if (arguments.capacity() == 0 ||
+      arguments_pool.size() >= MAX_POOLED_ARGUMENTS) {
+    return;
+  }
+  // Keeps the capacity for the next call
+  arguments.clear();
+  arguments_pool.push_back(std::move(arguments));
+}
+
+std::string Interpreter::module_path(const Token &path) const {
+  const auto file = std::filesystem::path(interpreter_path) /
+                    std::get<std::string>(path.value);
+  std::error_code error;
+  const auto canonical = std::filesystem::canonical(file, error);
+  if (error || !std::filesystem::is_regular_file(canonical, error)) {
+    throw RuntimeError(path, "Cannot find the module " + file.string());
+  }
+  return canonical.string();
+}
+
+std::unique_ptr<Interpreter::Program>
+Interpreter::parse_module(const std::string &path) {
+  std::ifstream ifs{path};
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  if (!ifs) {
+    return nullptr;
+  }
+
+  auto program = std::make_unique<Program>();
+  program->source = buffer.str();
+
+  Lexer lexer{program->source, err_handler};
+  Parser parser{lexer, program->arena, err_handler};
+  program->statements = parser.parse();
+  if (err_handler->has_error()) {
+    return nullptr;
+  }
+
+  Resolver resolver{*this};
+  resolver.resolve(program->statements);
+  if (err_handler->has_error()) {
+    return nullptr;
+  }
+
+  Optimizer optimizer{program->arena};
+  optimizer.optimize(program->statements);
+  return program;
+}
+
+Value Interpreter::import_module(const Token &path) {
+  auto file = module_path(path);
+  if (const auto module = modules.find(file); module != modules.cend()) {
+    if (module->second.is_nil()) {
+      throw RuntimeError(path, "Circular import of the module " + file);
     }
+    return module->second;
+  }
+
+  auto program = parse_module(file);
+  if (program == nullptr) {
+    throw RuntimeError(path, "Cannot load the module " + file);
+  }
+  const auto &statements =
+      module_programs.emplace_back(std::move(program))->statements;
+
+  // The module runs in globals of its own, and paths in it are relative to
+  // its file
+  auto module_globals = make_obj<Environment>(globals);
+  auto enclosing_path = std::exchange(
+      interpreter_path, std::filesystem::path(file).parent_path().string());
+  modules.emplace(file, NullType{});
+  try {
+    const ScopedGlobals scoped_globals{*this, module_globals};
+    const ScopedEnvironment scoped_env{*this, module_globals};
+    execute_statements(statements);
   } catch (...) {
-    LOG_DEBUG("Caught exception in block. Restoring original env.");
-    environment = std::move(original_env);
+    // Importing it again runs it again
+    modules.erase(file);
+    interpreter_path = std::move(enclosing_path);
     throw;
   }
-  environment = std::move(original_env);
-  LOG_DEBUG("Env at and of block execution: ", *environment);
+  interpreter_path = std::move(enclosing_path);
+
+  // The module's object reads its properties from the module's globals
+  const auto module = make_obj<Instance>(make_obj<Class>(
+      "module " + std::filesystem::path(file).stem().string(),
+      std::move(module_globals)));
+  return modules[file] = module;
+}
+
+Completion Interpreter::execute_statements(const std::vector<stmt> &body) {
+  for (const auto &statement : body) {
+    if (const auto completion = execute(statement);
+        completion != Completion::NORMAL) {
+      return completion;
+    }
+  }
+  return Completion::NORMAL;
 }
 
-void Interpreter::execute(const stmt &statement) {
-  dynamic_cast<StmtVisitableBase &>(*statement).accept(*this);
+Completion Interpreter::execute(const stmt &statement) {
+  return statement->accept(*this);
 }
 
-/// For a node, get the value of its visit. This is required because we only
-/// have visit functions returning void
-Token::Value Interpreter::get_evaluated(const expr &expression) {
-  dynamic_cast<ExprVisitableBase &>(*expression).accept(*this);
-  return last_value;
+Value Interpreter::get_evaluated(const expr &expression) {
+  return expression->accept(*this);
 }
 
-Token::Value Interpreter::get_evaluated(Expr &expression) {
-  dynamic_cast<ExprVisitableBase &>(expression).accept(*this);
-  return last_value;
+Value Interpreter::get_evaluated(Expr &expression) {
+  return expression.accept(*this);
+}
+
+void Interpreter::define(const Token &name, Value value) {
+  if (environment == current_globals) {
+    try {
+      current_globals->define(name.symbol, std::move(value));
+    } catch (const RuntimeError &) {
+      // At the name, instead of at the value without a line
+      throw RuntimeError(name, "Identifier '" + std::string(name.lexeme) +
+                                   "' is already defined in this scope.");
+    }
+  } else {
+    // Locals are only accessed through the slot assigned by the Resolver
+    environment->define_local(name.symbol, std::move(value));
+  }
 }
 
 //---------- Helper functions ------------
 namespace {
-template <class... Ts> struct overloaded : Ts... {
-  // Used to combine the operator() from multiple lambdas
-  using Ts::operator()...;
-};
-// Explicit deduction guide. Shouldn't be needed for C++20, but doesn't compile
-// without
-template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
-
-/* All values except NullType and the bool false are truthy, including "", 0,
- * functions, callables*/
-bool is_truthy(const Token::Value &value) {
-  // clang-format off
-    return std::visit(
-        overloaded{[](bool condition) { return condition; },
-                   [](NullType) { return false; },
-                   [](auto &&) { return true; }
-        }, value);
-  // clang-format on
-}
-
-/// Operands are variants. Returns true only of all variants hold value_type
-/// No operands returns true
-template <typename value_type, typename... Types>
-bool check_operand_types(const Types &...operands) {
-  return (std::holds_alternative<value_type>(operands) && ...);
-}
-
-/// Throw a RuntimeError if any operand is not of value_type.
-template <typename value_type, typename... Operands>
-void assert_operand_types(const Token &op, const Operands &...operands) {
-  if (not check_operand_types<value_type>(operands...)) {
-    if constexpr (std::is_same_v<value_type, double>) {
-      throw RuntimeError(op, "Operands must be numbers");
-    }
-    if constexpr (std::is_same_v<value_type, std::string>) {
-      throw RuntimeError(op, "Operands must be strings");
-    }
-    throw RuntimeError(op, "Operands must all be the same");
+/// Returns true only if all operands are numbers. No operands returns true
+template <typename... Operands>
+bool are_numbers(const Operands &...operands) {
+  return (operands.is_number() && ...);
+}
+
+/// Returns true only if all operands are strings. No operands returns true
+template <typename... Operands>
+bool are_strings(const Operands &...operands) {
+  return (operands.is_string() && ...);
+}
+
+/// Throw a RuntimeError if any operand is not a number.
+template <typename... Operands>
+void assert_numbers(const Token &op, const Operands &...operands) {
+  if (not are_numbers(operands...)) {
+    throw RuntimeError(op, "Operands must be numbers");
   }
 }
 
+/// Compare two string values like std::string::compare()
+int compare_strings(const Value &left, const Value &right) {
+  return left.as<ObjString>()->chars().compare(right.as<ObjString>()->chars());
+}
+
 /// Throw a runtime error if the condition is false
 void assert_true(bool condition, const Token &op, const std::string &message) {
   if (!condition) {
@@ -139,51 +356,134 @@ void assert_true(bool condition, const Token &op, const std::string &message) {
   }
 }
 
+/// Concatenation of the operands of op, which reports errors like exceeding
+/// the heap limit at op
+Value concatenate_at(const Token &op, const Value &left, const Value &right) {
+  try {
+    return concatenate(left, right);
+  } catch (const RuntimeError &err) {
+    rethrow_at(err, op);
+  }
+}
+
+/// Evaluate the operator of node for any operand types, observing them
+Value evaluate_generic(Binary &node, const Value &left, const Value &right) {
+  const Token &op = node.child<1>();
+  auto &feedback = node.child<3>();
+  if (feedback.observe(op.type, left, right) && right.is_number() &&
+      dynamic_cast<Literal *>(node.child<2>().get()) != nullptr) {
+    feedback.set_constant_right();
+  }
+
+  switch (op.type) {
+  case Type::MINUS:
+    assert_numbers(op, left, right);
+    return left.as_number() - right.as_number();
+  case Type::SLASH:
+    assert_numbers(op, left, right);
+    assert_true(right.as_number() != 0, op,
+                "Right operand of division must not be 0");
+    return left.as_number() / right.as_number();
+  case Type::STAR:
+    assert_numbers(op, left, right);
+    return left.as_number() * right.as_number();
+  case Type::PLUS:
+    if (are_numbers(left, right)) {
+      return left.as_number() + right.as_number();
+    }
+    if (left.is_string() || right.is_string()) {
+      return concatenate_at(op, left, right);
+    }
+    throw RuntimeError(op, "Operands must all be numbers or strings");
+  case Type::GREATER:
+    if (are_numbers(left, right)) {
+      return left.as_number() > right.as_number();
+    }
+    if (are_strings(left, right)) {
+      return compare_strings(left, right) > 0;
+    }
+    throw RuntimeError(op, "Operands must all be numbers or strings");
+  case Type::GREATER_EQUAL:
+    if (are_numbers(left, right)) {
+      return left.as_number() >= right.as_number();
+    }
+    if (are_strings(left, right)) {
+      return compare_strings(left, right) >= 0;
+    }
+    throw RuntimeError(op, "Operands must all be numbers or strings");
+  case Type::LESS:
+    if (are_numbers(left, right)) {
+      return left.as_number() < right.as_number();
+    }
+    if (are_strings(left, right)) {
+      return compare_strings(left, right) < 0;
+    }
+    throw RuntimeError(op, "Operands must all be numbers or strings");
+  case Type::LESS_EQUAL:
+    if (are_numbers(left, right)) {
+      return left.as_number() <= right.as_number();
+    }
+    if (are_strings(left, right)) {
+      return compare_strings(left, right) <= 0;
+    }
+    throw RuntimeError(op, "Operands must all be numbers or strings");
+  case Type::BANG_EQUAL:
+    return left != right;
+  case Type::EQUAL_EQUAL:
+    return left == right;
+  default:
+    throw RuntimeError(op, "Unexpected operator in binary expression eval");
+  }
+}
+
 } // namespace
 
 //-------------Statement Visitor Methods------------------------------------
 
-void Interpreter::visit(ReturnStmt &node) {
+Completion Interpreter::visit(ReturnStmt &node) {
+  if (node.child<2>()) {
+    return return_result(*node.child<1>());
+  }
   // If there is no value, the Empty expression will be evaluated to NullType
-  throw Return{get_evaluated(node.child<1>())};
+  return_value = get_evaluated(node.child<1>());
+  return Completion::RETURN;
 }
 
-void Interpreter::visit(FunctionStmt &node) {
-  auto function = node.child<0>();
+Completion Interpreter::visit(FunctionStmt &node) {
+  const auto &function = node.child<0>();
   LOG_DEBUG("Declaring func ", function.lexeme, " with env: ", *environment);
-  function.value =
-      std::make_shared<Function>(&node, environment, node.child<3>());
-  environment->define(std::move(function));
+  define(function,
+         make_obj<Function>(&node, environment, current_globals,
+                            node.child<3>()));
+  return Completion::NORMAL;
 }
 
 Class::ClassFunctions Interpreter::split_class_functions(
+    std::string_view class_name,
     const std::vector<FunctionStmtPtr> &class_functions) const {
   Class::FunctionMap methods;
   Class::FunctionMap unbounds;
   Class::FunctionMap getters;
   for (const auto &function : class_functions) {
     const auto &kind = function->child<3>();
+    // Every AST node method becomes a runtime function that captures the
+    // environment This allows methods to keep being associated with their
+    // original objects
+    auto method =
+        make_obj<Function>(function.get(), environment, current_globals, kind);
+    method->class_name = class_name;
     switch (kind) {
     case FunctionKind::METHOD:
     case FunctionKind::CONSTRUCTOR: {
-      // Every AST node method becomes a runtime function that captures the
-      // environment This allows methods to keep being associated with their
-      // original objects
-      methods.emplace(
-          function->child<0>().lexeme,
-          std::make_shared<Function>(function.get(), environment, kind));
+      methods.emplace(function->child<0>().symbol, std::move(method));
       break;
     }
     case FunctionKind::UNBOUND: {
-      unbounds.emplace(
-          function->child<0>().lexeme,
-          std::make_shared<Function>(function.get(), environment, kind));
+      unbounds.emplace(function->child<0>().symbol, std::move(method));
       break;
     }
     case FunctionKind::GETTER: {
-      getters.emplace(
-          function->child<0>().lexeme,
-          std::make_shared<Function>(function.get(), environment, kind));
+      getters.emplace(function->child<0>().symbol, std::move(method));
       break;
     }
     default: {
@@ -195,9 +495,7 @@ Class::ClassFunctions Interpreter::split_class_functions(
   return {std::move(methods), std::move(unbounds), std::move(getters)};
 }
 
-void Interpreter::visit(ClassStmt &node) {
-  auto klass = node.child<0>();
-
+Completion Interpreter::visit(ClassStmt &node) {
   auto &superclass_expr = node.child<2>();
   ClassPtr superclass = nullptr;
   if (superclass_expr != nullptr) {
@@ -206,34 +504,33 @@ void Interpreter::visit(ClassStmt &node) {
       throw RuntimeError(superclass_expr->child<0>(),
                          "Superclass must be a class.");
 
-    environment = std::make_shared<Environment>(environment);
-    environment->define(
-        "super", superclass); // Unlike 'this', super is defined once per class
+    environment = make_obj<Environment>(environment);
+    // Unlike 'this', super is defined once per class
+    environment->define_local(super_symbol, superclass);
   }
 
-  klass.value =
-      std::make_shared<Class>(node.child<0>().lexeme, std::move(superclass),
-                              split_class_functions(node.child<1>()));
+  Value klass = make_obj<Class>(std::string(node.child<0>().lexeme),
+                                std::move(superclass),
+                                split_class_functions(node.child<0>().lexeme,
+                                                      node.child<1>()));
 
   if (superclass_expr != nullptr)
     environment = environment->enclosing; // Pop the 'super' environment
 
-  environment->define(std::move(klass));
+  define(node.child<0>(), std::move(klass));
+  return Completion::NORMAL;
 }
 
-void Interpreter::visit(Super &node) {
-  const auto &name = node.child<1>().lexeme;
+Value Interpreter::visit(Super &node) {
+  const auto name = node.child<1>().symbol;
 
   if (node.child<2>()) // In unbound method
   {
-    // This is a horrible hack. The environment with 'this' doesn't exist in
-    // unbound methods, so we have to look one further up.
     const auto superclass =
-        get_callable_as<Class>(environment->get_at(*node.depth - 1, "super"));
+        get_callable_as<Class>(environment->get_at(*node.depth, 0));
 
-    if (auto unbound = superclass->get_unbound(name)) {
-      last_value = std::move(unbound);
-      return;
+    if (const auto &unbound = superclass->get_unbound(name)) {
+      return unbound;
     }
 
     throw RuntimeError(node.child<1>(),
@@ -242,62 +539,102 @@ void Interpreter::visit(Super &node) {
   }
 
   // 'this' needs to still be bound to the original object, even though we use a
-  // superclass method
-  auto object =
-      std::get<InstancePtr>(environment->get_at(*node.depth - 1, "this"));
+  // superclass method. It's the receiver of the method that encloses the
+  // 'super' environment
+  InstancePtr object{environment->get_at(*node.depth - 1, 0).as<Instance>()};
   const auto superclass =
-      get_callable_as<Class>(environment->get_at(*node.depth, "super"));
+      get_callable_as<Class>(environment->get_at(*node.depth, 0));
 
   if (const auto &method = superclass->get_method(name)) {
-    last_value = method->bind(std::move(object));
-  } else if (auto unbound = superclass->get_unbound(name)) {
-    last_value = std::move(unbound);
-  } else if (const auto &getter = superclass->get_getter(name)) {
-    last_value = getter->bind(std::move(object))->call(*this, {});
-  } else {
-    throw RuntimeError(node.child<1>(),
-                       "Undefined method or unbound function '" +
-                           node.child<1>().lexeme + "' on class '" +
-                           superclass->name() + '.');
+    return method->bind(std::move(object));
+  }
+  if (const auto &unbound = superclass->get_unbound(name)) {
+    return unbound;
   }
+  if (const auto &getter = superclass->get_getter(name)) {
+    return getter->invoke(*this, Value{object}, {});
+  }
+  throw RuntimeError(node.child<1>(),
+                     "Undefined method or unbound function '" +
+                         std::string(node.child<1>().lexeme) + "' on class '" +
+                         superclass->name() + '.');
 }
 
-void Interpreter::visit(IfStmt &node) {
-  if (is_truthy(get_evaluated(node.child<0>()))) {
-    execute(node.child<1>());
-  } else { // This correctly evaluates nothing with EmtpyStmt as else stmt (no
-           // else)
-    execute(node.child<2>());
+Completion Interpreter::visit(IfStmt &node) {
+  if (get_evaluated(node.child<0>()).is_truthy()) {
+    return execute(node.child<1>());
   }
+  // This correctly evaluates nothing with EmtpyStmt as else stmt (no else)
+  return execute(node.child<2>());
 }
 
-void Interpreter::visit(WhileStmt &node) {
-  while (is_truthy(get_evaluated(node.child<0>()))) {
-    execute(node.child<1>());
+Completion Interpreter::visit(WhileStmt &node) {
+  while (get_evaluated(node.child<0>()).is_truthy()) {
+    if (const auto completion = execute(node.child<1>());
+        completion != Completion::NORMAL) {
+      return completion;
+    }
   }
+  return Completion::NORMAL;
 }
 
-void Interpreter::visit(EmptyStmt &) { last_value = NullType(); }
+Completion Interpreter::visit(EmptyStmt &) { return Completion::NORMAL; }
 
-void Interpreter::visit(BlockStmt &node) {
-  execute_block(node.child<0>(), environment);
+Completion Interpreter::visit(ImportStmt &node) {
+  const auto &name = node.child<1>();
+  auto module = import_module(node.child<0>());
+  if (node.child<2>()) {
+    return Completion::NORMAL;
+  }
+  // A global is only bound again by importing the same module
+  if (environment == current_globals) {
+    if (const auto slot = current_globals->slots.find(name.symbol);
+        slot != current_globals->slots.cend() &&
+        current_globals->values[slot->second] == module) {
+      return Completion::NORMAL;
+    }
+  }
+  define(name, std::move(module));
+  return Completion::NORMAL;
 }
 
-void Interpreter::visit(VarStmt &node) {
-  auto variable = node.child<0>();
-  // This will correctly return NullType when the initializer is Empty
-  variable.value = get_evaluated(node.child<1>());
+Completion Interpreter::visit(BlockStmt &node) {
+  if (node.child<1>()) {
+    auto env = new_environment(environment);
+    const auto completion = execute_block(node.child<0>(), env);
+    release_environment(std::move(env));
+    return completion;
+  }
+  // The Resolver found that nothing in the block is captured, so its locals
+  // live in the enclosing environment. A block without declarations may also
+  // run directly in the globals, which must not be truncated.
+  if (environment == current_globals) {
+    return execute_statements(node.child<0>());
+  }
+  const ScopedLocals locals{*environment};
+  return execute_statements(node.child<0>());
+}
 
-  environment->define(std::move(variable));
+Completion Interpreter::visit(VarStmt &node) {
+  // This will correctly return NullType when the initializer is Empty
+  define(node.child<0>(), get_evaluated(node.child<1>()));
+  return Completion::NORMAL;
 }
 
-void Interpreter::visit(ExprStmt &node) { get_evaluated(node.child<0>()); }
+Completion Interpreter::visit(ExprStmt &node) {
+  auto value = get_evaluated(node.child<0>());
+  if (environment == globals) {
+    last_value = std::move(value);
+  }
+  return Completion::NORMAL;
+}
 
-void Interpreter::visit(PrintStmt &node) {
-  out_stream << get_evaluated(node.child<0>()) << std::endl;
+Completion Interpreter::visit(PrintStmt &node) {
+  out_stream << get_evaluated(node.child<0>()) << '\n';
+  return Completion::NORMAL;
 }
 
-void Interpreter::visit(MalformedStmt &node) {
+Completion Interpreter::visit(MalformedStmt &node) {
   bool is_critical = node.child<0>();
   std::string lexer_message = node.child<1>();
 
@@ -308,238 +645,420 @@ void Interpreter::visit(MalformedStmt &node) {
         "message:\t" +
             lexer_message);
   }
-  // Non-critical syntax errors just leave the last value untouched.
+  // Non-critical syntax errors are ignored
+  return Completion::NORMAL;
 }
 
 //-------------Expression Visitor Methods------------------------------------
 
-void Interpreter::visit(Lambda &node) {
+Value Interpreter::visit(Lambda &node) {
   LOG_DEBUG("Declaring lambda");
 
-  last_value =
-      std::make_shared<Function>(&node, environment, FunctionKind::LAMDBDA);
+  return make_obj<Function>(&node, environment, current_globals,
+                            FunctionKind::LAMDBDA);
 }
 
-void Interpreter::visit(Call &node) {
-  auto callee = get_evaluated(node.child<0>());
+Value Interpreter::visit(Call &node) {
+  auto callee = evaluate_callee(node);
+  if (callee.method != nullptr) {
+    return call_method(node, *callee.method, callee.receiver);
+  }
+  return call_value(node, callee.value);
+}
 
-  if (!std::holds_alternative<CallablePtr>(callee))
-    throw RuntimeError(node.child<1>(), "Can only call functions and classes.");
+Interpreter::Callee Interpreter::evaluate_callee(Call &node) {
+  // Creating a bound method is only needed for methods as values
+  if (auto *get = dynamic_cast<Get *>(node.child<0>().get())) {
+    auto object = get_evaluated(get->child<0>());
+    if (object.is_obj_type(Obj::Type::TREE_INSTANCE)) {
+      auto *instance = object.as<Instance>();
+      const auto &property = instance->lookup(get->child<1>(), get->child<2>());
+      if (property.kind == PropertyCache::Kind::METHOD) {
+        return {NullType{}, property.function, std::move(object)};
+      }
+    }
+    return {get_property(*get, object)};
+  }
+
+  if (auto *super = dynamic_cast<Super *>(node.child<0>().get());
+      super != nullptr && !super->child<2>()) {
+    const auto superclass =
+        get_callable_as<Class>(environment->get_at(*super->depth, 0));
+    if (const auto &method = superclass->get_method(super->child<1>().symbol)) {
+      return {NullType{}, method.get(),
+              environment->get_at(*super->depth - 1, 0)};
+    }
+  }
+
+  return {get_evaluated(node.child<0>())};
+}
+
+Completion Interpreter::return_result(Expr &returned) {
+  if (auto *call = dynamic_cast<Call *>(&returned);
+      call != nullptr && call->child<3>()) {
+    return return_call(*call);
+  }
+  if (auto *grouping = dynamic_cast<Grouping *>(&returned)) {
+    return return_result(*grouping->child<0>());
+  }
+  if (auto *ternary = dynamic_cast<Ternary *>(&returned)) {
+    return return_result(get_evaluated(ternary->child<0>()).is_truthy()
+                             ? *ternary->child<2>()
+                             : *ternary->child<4>());
+  }
+  return_value = get_evaluated(returned);
+  return Completion::RETURN;
+}
 
-  const auto &callable = std::get<CallablePtr>(callee);
+Completion Interpreter::return_call(Call &node) {
+  auto callee = evaluate_callee(node);
+  FunctionPtr function{callee.method};
+  if (function == nullptr) {
+    // Bound methods are called with their own receiver
+    function = get_callable_as<Function>(callee.value);
+    if (function == nullptr) {
+      return_value = call_value(node, callee.value);
+      return Completion::RETURN;
+    }
+    callee.receiver = function->bound_receiver();
+  }
 
+  GC::maybe_collect();
+
+  tail_call.arguments = evaluate_arguments(node, *function);
+  tail_call.function = std::move(function);
+  tail_call.receiver = std::move(callee.receiver);
+  return Completion::TAIL_CALL;
+}
+
+std::vector<Value> Interpreter::evaluate_arguments(Call &node,
+                                                   const Callable &callee) {
   // Check arity (number of arguments)
-  if (node.child<2>().size() != callable->arity()) {
+  if (node.child<2>().size() != callee.arity()) {
     throw RuntimeError(node.child<1>(),
-                       "Expected " + std::to_string(callable->arity()) +
+                       "Expected " + std::to_string(callee.arity()) +
                            " arguments but got " +
                            std::to_string(node.child<2>().size()) + ".");
   }
 
-  // Evaluate arguments
-  std::vector<Token::Value> arguments;
+  auto arguments = new_arguments();
+  arguments.reserve(node.child<2>().size());
   for (const auto &argument : node.child<2>()) {
     arguments.push_back(get_evaluated(argument));
   }
+  return arguments;
+}
+
+Value Interpreter::call_value(Call &node, const Value &callee) {
+  GC::maybe_collect();
+
+  if (!callee.is_obj_type(Obj::Type::CALLABLE))
+    throw RuntimeError(node.child<1>(), "Can only call functions and classes.");
+
+  auto *callable = callee.as<Callable>();
+  auto arguments = evaluate_arguments(node, *callable);
 
   Interpreter::CheckedRecursiveDepth recursionCheck{*this, node.child<1>()};
 
+  Profiler::Scope profiled{profiler, *callable};
+
   LOG_DEBUG("Calling callable in visit(Call): ", callable->to_string());
-  last_value = callable->call(*this, arguments);
+  try {
+    auto result = callable->call(*this, arguments);
+    release_arguments(std::move(arguments));
+    return result;
+  } catch (const RuntimeError &err) {
+    rethrow_at(err, node.child<1>());
+  }
 }
 
-void Interpreter::visit(Get &node) {
-  auto object = get_evaluated(node.child<0>());
+Value Interpreter::call_method(Call &node, Function &method,
+                               const Value &receiver) {
+  GC::maybe_collect();
+
+  auto arguments = evaluate_arguments(node, method);
+
+  Interpreter::CheckedRecursiveDepth recursionCheck{*this, node.child<1>()};
+
+  Profiler::Scope profiled{profiler, method};
+
+  LOG_DEBUG("Invoking method in visit(Call): ", method.to_string());
+  try {
+    auto result = method.invoke(*this, receiver, arguments);
+    release_arguments(std::move(arguments));
+    return result;
+  } catch (const RuntimeError &err) {
+    rethrow_at(err, node.child<1>());
+  }
+}
+
+Value Interpreter::visit(Get &node) {
+  return get_property(node, get_evaluated(node.child<0>()));
+}
 
-  if (const auto *obj = std::get_if<InstancePtr>(&object)) {
-    last_value = (*obj)->get_field(node.child<1>(), *this);
-  } else if (const auto klass = get_callable_as<Class>(object)) {
-    last_value = klass->get_unbound(node.child<1>().lexeme);
-    if (get_callable_as<Function>(last_value) == nullptr) {
+Value Interpreter::get_property(Get &node, const Value &object) {
+  if (object.is_obj_type(Obj::Type::TREE_INSTANCE)) {
+    return object.as<Instance>()->get_field(node.child<1>(), node.child<2>(),
+                                            *this);
+  }
+  if (const auto klass = get_callable_as<Class>(object)) {
+    const auto &unbound = klass->get_unbound(node.child<1>().symbol);
+    if (unbound == nullptr) {
       throw RuntimeError(node.child<1>(), "Undefined unbound function.");
     }
-  } else {
-    throw RuntimeError(
-        node.child<1>(),
-        "Can only access fields of objects or classes. Called with: " +
-            stringify(object));
+    return unbound;
   }
+  throw RuntimeError(
+      node.child<1>(),
+      "Can only access fields of objects or classes. Called with: " +
+          stringify(object));
 }
 
-void Interpreter::visit(Set &node) {
+Value Interpreter::visit(Set &node) {
   auto object = get_evaluated(node.child<0>());
 
-  if (!std::holds_alternative<InstancePtr>(object)) {
+  if (!object.is_obj_type(Obj::Type::TREE_INSTANCE)) {
     throw RuntimeError(node.child<1>(), "Can only set properties on objects");
   }
 
   auto value = get_evaluated(node.child<2>());
 
-  std::get<InstancePtr>(object)->set_field(node.child<1>(), value);
+  object.as<Instance>()->set_field(node.child<1>(), value, node.child<3>());
+
+  return value;
+}
+
+Value Interpreter::visit(ArrayLiteral &node) {
+  std::vector<double> elements;
+  elements.reserve(node.child<1>().size());
+  for (const auto &element : node.child<1>()) {
+    const auto value = get_evaluated(element);
+    if (!value.is_number()) {
+      throw RuntimeError(node.child<0>(), "Array elements must be numbers");
+    }
+    elements.push_back(value.as_number());
+  }
+  return make_array(std::move(elements));
+}
+
+namespace {
+/// Position of the indexed element in the array. Both are evaluated already
+size_t checked_position(const Value &array, const Value &index,
+                        const Token &bracket) {
+  if (!array.is_obj_type(Obj::Type::ARRAY)) {
+    throw RuntimeError(bracket, "Can only index arrays");
+  }
+  const auto position = array.as<ObjArray>()->position(index);
+  if (!position.has_value()) {
+    throw RuntimeError(bracket, "Array index " + stringify(index) +
+                                    " is not a whole number in range");
+  }
+  return *position;
+}
+} // namespace
+
+Value Interpreter::visit(Index &node) {
+  const auto array = get_evaluated(node.child<0>());
+  const auto index = get_evaluated(node.child<2>());
+  const auto position = checked_position(array, index, node.child<1>());
+  return array.as<ObjArray>()->elements[position];
+}
+
+Value Interpreter::visit(SetIndex &node) {
+  const auto array = get_evaluated(node.child<0>());
+  const auto index = get_evaluated(node.child<2>());
+  const auto position = checked_position(array, index, node.child<1>());
 
-  last_value = std::move(value);
+  auto value = get_evaluated(node.child<3>());
+  if (!value.is_number()) {
+    throw RuntimeError(node.child<1>(), "Array elements must be numbers");
+  }
+  array.as<ObjArray>()->elements[position] = value.as_number();
+  return value;
 }
 
-void Interpreter::visit(This &node) {
-  last_value = lookup_variable(node.child<0>(), node);
+Value Interpreter::visit(This &node) {
+  return lookup_variable(node.child<0>(), node);
 }
 
-void Interpreter::visit(Assign &node) {
-  Token::Value value = get_evaluated(node.child<1>());
+Value Interpreter::visit(Assign &node) {
+  Value value = get_evaluated(node.child<1>());
 
   const auto &identifier = node.child<0>();
   if (node.depth.has_value()) {
-    environment->assign_at(*node.depth, identifier.lexeme, value);
+    environment->assign_at(*node.depth, node.slot, value);
   } else {
-    globals->assign(identifier, value);
+    current_globals->assign(identifier, value);
   }
 
-  last_value = std::move(value);
+  return value;
 }
 
-void Interpreter::visit(Logical &node) {
-  Token::Value lhs = get_evaluated(node.child<0>());
+Value Interpreter::visit(Logical &node) {
+  Value lhs = get_evaluated(node.child<0>());
   const Token &op = node.child<1>();
   if (op.type == Type::OR) {
-    if (is_truthy(lhs))
-      last_value = lhs;
-    return;
-  }
-  if (!is_truthy(lhs)) {
-    last_value = lhs;
-    return;
+    if (lhs.is_truthy())
+      return lhs;
+  } else if (!lhs.is_truthy()) {
+    return lhs;
   }
-  last_value = get_evaluated(node.child<2>());
+  return get_evaluated(node.child<2>());
 }
 
-void Interpreter::visit(Variable &node) {
+Value Interpreter::visit(Variable &node) {
   LOG_DEBUG("Getting variable: ", node.child<0>().lexeme, " at depth ",
             environment->depth());
   LOG_DEBUG(environment->to_string_recursive());
-  last_value = lookup_variable(node.child<0>(), node);
+  return lookup_variable(node.child<0>(), node);
 }
 
-const Token::Value &Interpreter::lookup_variable(const Token &name,
-                                                 const Expr &node) const {
+const Value &Interpreter::lookup_variable(const Token &name,
+                                          const Expr &node) const {
   if (node.depth.has_value()) {
-    return environment->get_at(*node.depth, name.lexeme);
+    return environment->get_at(*node.depth, node.slot);
   }
 
-  return globals->get(name);
+  return current_globals->get(name);
 }
 
-void Interpreter::visit(Empty &) {
+Value Interpreter::visit(Empty &) {
   // Empty expressions just have a null value
-  last_value = NullType();
+  return NullType();
 }
 
-void Interpreter::visit(Literal &node) { last_value = node.child<0>(); }
+Value Interpreter::visit(Literal &node) {
+  return node.child<1>();
+}
 
-void Interpreter::visit(Grouping &node) {
-  last_value = get_evaluated(node.child<0>());
+Value Interpreter::visit(Grouping &node) {
+  return get_evaluated(node.child<0>());
 }
 
-void Interpreter::visit(Unary &node) {
-  Token::Value value = get_evaluated(node.child<1>());
+Value Interpreter::visit(Unary &node) {
+  Value value = get_evaluated(node.child<1>());
 
   const Token &op = node.child<0>();
 
+  auto &feedback = node.child<2>();
+  if (feedback.quickening().quickened == Quickened::NUMBER_NEGATE) {
+    if (value.is_number()) {
+      return -value.as_number();
+    }
+    feedback.deoptimize();
+  }
+  feedback.observe(op.type, value);
+
   switch (op.type) {
   case Type::MINUS:
-    assert_operand_types<double>(op, value);
-    last_value = -std::get<double>(value);
-    break;
+    assert_numbers(op, value);
+    return -value.as_number();
   case Type::BANG:
-    last_value = !is_truthy(value);
-    break;
+    return !value.is_truthy();
   default:
     throw RuntimeError(op, "Unknown token type in unary operator eval");
   }
 }
 
-void Interpreter::visit(Binary &node) {
+Value Interpreter::visit(Binary &node) {
   // This implementation defines left-to-right evaluation of binary
   // expressions
-  Token::Value left = get_evaluated(node.child<0>());
-  const Token &op = node.child<1>();
-  Token::Value right = get_evaluated(node.child<2>());
-
-  switch (op.type) {
-  case Type::MINUS:
-    assert_operand_types<double>(op, left, right);
-    last_value = std::get<double>(left) - std::get<double>(right);
-    break;
-  case Type::SLASH:
-    assert_operand_types<double>(op, left, right);
-    assert_true(std::get<double>(right) != 0, op,
-                "Right operand of division must not be 0");
-    last_value = std::get<double>(left) / std::get<double>(right);
-    break;
-  case Type::STAR:
-    assert_operand_types<double>(op, left, right);
-    last_value = std::get<double>(left) * std::get<double>(right);
-    break;
-  case Type::PLUS:
-    if (check_operand_types<double>(left, right)) {
-      last_value = std::get<double>(left) + std::get<double>(right);
-    } else if (check_operand_types<std::string>(left) ||
-               check_operand_types<std::string>(right)) {
-      last_value = stringify(left) + stringify(right);
-    } else {
-      throw RuntimeError(op, "Operands must all be numbers or strings");
-    }
-    break;
-  case Type::GREATER:
-    if (check_operand_types<double>(left, right)) {
-      last_value = std::get<double>(left) > std::get<double>(right);
+  Value left = get_evaluated(node.child<0>());
+  auto &feedback = node.child<3>();
+  const auto quickening = feedback.quickening();
+  Value right = quickening.constant_right
+                    ? *std::get_if<double>(
+                          &static_cast<Literal &>(*node.child<2>()).child<0>())
+                    : get_evaluated(node.child<2>());
+
+  // Quickened operators check only the types they were specialized to
+  if (const auto quickened = quickening.quickened;
+      quickened != Quickened::GENERIC) {
+    switch (quickened) {
+    case Quickened::NUMBER_ADD:
+      if (are_numbers(left, right)) {
+        return left.as_number() + right.as_number();
+      }
       break;
-    } else if (check_operand_types<std::string>(left, right)) {
-      last_value =
-          std::get<std::string>(left).compare(std::get<std::string>(right)) > 0;
+    case Quickened::NUMBER_SUBTRACT:
+      if (are_numbers(left, right)) {
+        return left.as_number() - right.as_number();
+      }
       break;
-    }
-    throw RuntimeError(op, "Operands must all be numbers or strings");
-  case Type::GREATER_EQUAL:
-    if (check_operand_types<double>(left, right)) {
-      last_value = std::get<double>(left) >= std::get<double>(right);
+    case Quickened::NUMBER_MULTIPLY:
+      if (are_numbers(left, right)) {
+        return left.as_number() * right.as_number();
+      }
       break;
-    } else if (check_operand_types<std::string>(left, right)) {
-      last_value = std::get<std::string>(left).compare(
-                       std::get<std::string>(right)) >= 0;
+    case Quickened::NUMBER_DIVIDE:
+      if (are_numbers(left, right) && right.as_number() != 0) {
+        return left.as_number() / right.as_number();
+      }
       break;
-    }
-    throw RuntimeError(op, "Operands must all be numbers or strings");
-  case Type::LESS:
-    if (check_operand_types<double>(left, right)) {
-      last_value = std::get<double>(left) < std::get<double>(right);
+    case Quickened::NUMBER_GREATER:
+      if (are_numbers(left, right)) {
+        return left.as_number() > right.as_number();
+      }
       break;
-    } else if (check_operand_types<std::string>(left, right)) {
-      last_value =
-          std::get<std::string>(left).compare(std::get<std::string>(right)) < 0;
+    case Quickened::NUMBER_GREATER_EQUAL:
+      if (are_numbers(left, right)) {
+        return left.as_number() >= right.as_number();
+      }
       break;
-    }
-    throw RuntimeError(op, "Operands must all be numbers or strings");
-  case Type::LESS_EQUAL:
-    if (check_operand_types<double>(left, right)) {
-      last_value = std::get<double>(left) <= std::get<double>(right);
+    case Quickened::NUMBER_LESS:
+      if (are_numbers(left, right)) {
+        return left.as_number() < right.as_number();
+      }
       break;
-    } else if (check_operand_types<std::string>(left, right)) {
-      last_value = std::get<std::string>(left).compare(
-                       std::get<std::string>(right)) <= 0;
+    case Quickened::NUMBER_LESS_EQUAL:
+      if (are_numbers(left, right)) {
+        return left.as_number() <= right.as_number();
+      }
+      break;
+    case Quickened::NUMBER_EQUAL:
+      if (are_numbers(left, right)) {
+        return left.as_number() == right.as_number();
+      }
+      break;
+    case Quickened::NUMBER_NOT_EQUAL:
+      if (are_numbers(left, right)) {
+        return left.as_number() != right.as_number();
+      }
+      break;
+    case Quickened::STRING_CONCATENATE:
+      if (are_strings(left, right)) {
+        return concatenate_at(node.child<1>(), left, right);
+      }
+      break;
+    case Quickened::STRING_GREATER:
+      if (are_strings(left, right)) {
+        return compare_strings(left, right) > 0;
+      }
+      break;
+    case Quickened::STRING_GREATER_EQUAL:
+      if (are_strings(left, right)) {
+        return compare_strings(left, right) >= 0;
+      }
+      break;
+    case Quickened::STRING_LESS:
+      if (are_strings(left, right)) {
+        return compare_strings(left, right) < 0;
+      }
+      break;
+    case Quickened::STRING_LESS_EQUAL:
+      if (are_strings(left, right)) {
+        return compare_strings(left, right) <= 0;
+      }
+      break;
+    default:
       break;
     }
-    throw RuntimeError(op, "Operands must all be numbers or strings");
-  case Type::BANG_EQUAL:
-    last_value = left != right;
-    break;
-  case Type::EQUAL_EQUAL:
-    last_value = left == right;
-    break;
-  default:
-    throw RuntimeError(op, "Unexpected operator in binary expression eval");
+    feedback.deoptimize();
   }
+  return evaluate_generic(node, left, right);
 }
-void Interpreter::visit(Malformed &node) {
+
+Value Interpreter::visit(Malformed &node) {
   bool is_critical = node.child<0>();
   std::string lexer_message = node.child<1>();
 
@@ -549,18 +1068,18 @@ void Interpreter::visit(Malformed &node) {
                        "valid. Lexer message:\t" +
                            lexer_message);
   }
-  // Non-critical syntax errors just leave the last value untouched.
+  // Non-critical syntax errors just evaluate to nil
+  return NullType{};
 }
 
-void Interpreter::visit(Ternary &node) {
-  Token::Value condition = get_evaluated(node.child<0>());
+Value Interpreter::visit(Ternary &node) {
+  Value condition = get_evaluated(node.child<0>());
   const Token &first_op = node.child<1>();
   const expr &first = node.child<2>();
   const expr &second = node.child<4>();
 
-  if (first_op.type == Type::QUESTION_MARK)
-    last_value =
-        is_truthy(condition) ? get_evaluated(first) : get_evaluated(second);
-  else
+  if (first_op.type != Type::QUESTION_MARK)
     throw RuntimeError(first_op, "Unknown token type in ternary operator.");
+
+  return condition.is_truthy() ? get_evaluated(first) : get_evaluated(second);
 }
@@ -1,21 +1,130 @@
 #include "lexer.hpp"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+
+namespace {
+using Type = Lexer::Type;
+
+enum CharClass : uint8_t {
+  DIGIT = 1U << 0U,
+  ALPHA = 1U << 1U,
+  BLANK = 1U << 2U, // Whitespace other than newlines
+};
+
+/// Classes of all characters, indexed by their unsigned value. Only ASCII
+/// letters and digits can be part of a name or number
+constexpr auto char_classes = [] {
+  std::array<uint8_t, 256> classes{};
+  for (auto c = '0'; c <= '9'; ++c) {
+    classes[static_cast<unsigned char>(c)] = DIGIT;
+  }
+  for (auto c = 'a'; c <= 'z'; ++c) {
+    classes[static_cast<unsigned char>(c)] = ALPHA;
+    classes[static_cast<unsigned char>(c - 'a' + 'A')] = ALPHA;
+  }
+  for (const auto c : {' ', '\t', '\r'}) {
+    classes[static_cast<unsigned char>(c)] = BLANK;
+  }
+  return classes;
+}();
+
+bool has_class(char c, uint8_t char_class) {
+  return (char_classes[static_cast<unsigned char>(c)] & char_class) != 0;
+}
+
+/// End of the run of spaces at begin. Indentation is skipped a word at a
+/// time
+const char *skip_spaces(const char *begin, const char *end) {
+  constexpr uint64_t SPACES = 0x2020202020202020ULL;
+  while (end - begin >= static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+    uint64_t word = 0;
+    std::memcpy(&word, begin, sizeof(word));
+    if (word != SPACES) {
+      break;
+    }
+    begin += sizeof(word);
+  }
+  while (begin != end && *begin == ' ') {
+    ++begin;
+  }
+  return begin;
+}
+
+/// Index of the first character at or after position that isn't of
+/// char_class
+unsigned int skip_class(std::string_view source, unsigned int position,
+                        uint8_t char_class) {
+  while (position < source.size() && has_class(source[position], char_class)) {
+    ++position;
+  }
+  return position;
+}
+
+/// Number of newlines in text
+unsigned int count_lines(std::string_view text) {
+  return static_cast<unsigned int>(
+      std::count(text.cbegin(), text.cend(), '\n'));
+}
+
+struct Keyword {
+  std::string_view name;
+  Type type = Type::IDENTIFIER;
+};
+
 // clang-format off
-const std::unordered_map<std::string, Lexer::Type> Lexer::keywords{
-    {"and", Type::AND}, {"class", Type::CLASS}, {"else", Type::ELSE}, 
-    {"false", Type::FALSE}, {"for", Type::FOR}, {"fun", Type::FUN}, 
-    {"fn", Type::FUN}, {"if", Type::IF}, {"nil", Type::NIL}, 
-    {"or", Type::OR}, {"print", Type::PRINT}, {"return", Type::RETURN}, 
-    {"super", Type::SUPER}, {"this", Type::THIS}, {"true", Type::TRUE}, 
-    {"var", Type::VAR}, {"while", Type::WHILE}, {"let", Type::VAR},
-    {"return", Type::RETURN}, {"unbound", Type::UNBOUND}};
+constexpr std::array keyword_list{
+    Keyword{"and", Type::AND}, Keyword{"class", Type::CLASS},
+    Keyword{"else", Type::ELSE}, Keyword{"false", Type::FALSE},
+    Keyword{"for", Type::FOR}, Keyword{"fun", Type::FUN},
+    Keyword{"fn", Type::FUN}, Keyword{"if", Type::IF},
+    Keyword{"nil", Type::NIL}, Keyword{"or", Type::OR},
+    Keyword{"print", Type::PRINT}, Keyword{"return", Type::RETURN},
+    Keyword{"super", Type::SUPER}, Keyword{"this", Type::THIS},
+    Keyword{"true", Type::TRUE}, Keyword{"var", Type::VAR},
+    Keyword{"while", Type::WHILE}, Keyword{"let", Type::VAR},
+    Keyword{"unbound", Type::UNBOUND}, Keyword{"import", Type::IMPORT}};
 // clang-format on
 
-Lexer::Lexer(std::string _source, std::shared_ptr<ErrorHandler> _err_handler)
-    : source(std::move(_source)), err_handler(std::move(_err_handler)) {
-  tokens.reserve(source.size() / 3);
+constexpr size_t KEYWORD_TABLE_SIZE = 64;
+
+/// Perfect hash of the keywords: no two of them share a slot. text must
+/// not be empty
+constexpr size_t keyword_hash(std::string_view text) {
+  return (static_cast<size_t>(text.front()) * 2 +
+          static_cast<size_t>(text.back()) * 28 + text.size()) %
+         KEYWORD_TABLE_SIZE;
 }
 
+/// Every keyword in the slot of its hash. Fails to compile if the hash
+/// isn't perfect for the keywords
+constexpr auto keyword_table = [] {
+  std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+  for (const auto &keyword : keyword_list) {
+    auto &slot = table[keyword_hash(keyword.name)];
+    if (!slot.name.empty()) {
+      throw "Keywords collide in the keyword table";
+    }
+    slot = keyword;
+  }
+  return table;
+}();
+} // namespace
+
+Lexer::Type Lexer::keyword(std::string_view text) {
+  if (text.empty()) {
+    return Type::IDENTIFIER;
+  }
+  const auto &slot = keyword_table[keyword_hash(text)];
+  return slot.name == text ? slot.type : Type::IDENTIFIER;
+}
+
+Lexer::Lexer(std::string_view _source,
+             std::shared_ptr<ErrorHandler> _err_handler)
+    : source(_source), err_handler(std::move(_err_handler)) {}
+
 bool Lexer::is_at_end() const { return current >= source.size(); }
 
 char Lexer::advance() { return source[current++]; }
@@ -36,6 +145,12 @@ void Lexer::scan_token() {
   case '}':
     add_token(Type::RIGHT_BRACE);
     break;
+  case '[':
+    add_token(Type::LEFT_BRACKET);
+    break;
+  case ']':
+    add_token(Type::RIGHT_BRACKET);
+    break;
   case '|':
     add_token(Type::PIPE);
     break;
@@ -81,6 +196,7 @@ void Lexer::scan_token() {
   case '\t':
   case ' ':
   case '\r':
+    skip_blanks();
     break;
   case '\n':
     ++line;
@@ -89,9 +205,9 @@ void Lexer::scan_token() {
     string();
     break;
   default:
-    if (isdigit(c) != 0) {
+    if (has_class(c, DIGIT)) {
       number();
-    } else if (isalpha(c) != 0) {
+    } else if (has_class(c, ALPHA)) {
       identifier();
     } else {
       last_character_expected = false;
@@ -102,52 +218,54 @@ void Lexer::scan_token() {
   }
 }
 
+void Lexer::skip_blanks() {
+  const auto *begin = source.data();
+  const auto *end = begin + source.size();
+  const auto *position = begin + current;
+  while (position != end) {
+    position = skip_spaces(position, end);
+    if (position == end || !has_class(*position, BLANK)) {
+      break;
+    }
+    ++position;
+  }
+  current = static_cast<unsigned int>(position - begin);
+}
+
 void Lexer::slash_or_comment() {
   if (expect('/')) {
     // Comment till end of line
-    while (peek() != '\n' && !is_at_end()) {
-      advance();
-    }
+    current = static_cast<unsigned int>(
+        std::min(source.find('\n', current), source.size()));
   } else if (expect('*')) {
     unsigned int start_line = line;
     // Comment till matching */
-    while (!is_at_end()) {
-      while (peek() != '*' && !is_at_end()) {
-        if (peek() == '\n') {
-          ++line;
-        }
-        advance();
-      }
-      if (is_at_end()) {
-        err_handler->error(line, "Unterminated comment starting at line " +
-                                     std::to_string(start_line));
-        return;
-      }
-      advance(); // Consume the *
-
-      if (peek() == '/') { // Look for closing /
-        advance();
-        return;
-      }
+    const auto end = std::min(source.find("*/", current), source.size());
+    line += count_lines(source.substr(current, end - current));
+    if (end == source.size()) {
+      current = end;
+      had_error = true;
+      err_handler->error(line, "Unterminated comment starting at line " +
+                                   std::to_string(start_line));
+      return;
     }
+    current = static_cast<unsigned int>(end + 2);
   } else {
     add_token(Type::SLASH);
   }
 }
 
 void Lexer::number() {
-  while (isdigit(peek()) != 0) {
-    advance();
-  }
+  current = skip_class(source, current, DIGIT);
 
-  if (peek() == '.' && isdigit(peek_next()) != 0) {
+  if (peek() == '.' && has_class(peek_next(), DIGIT)) {
     advance(); // Consume the .
 
-    while (isdigit(peek()) != 0) {
-      advance();
-    }
+    current = skip_class(source, current, DIGIT);
   }
-  add_token(Type::NUMBER, std::stod(source.substr(start, current - start)));
+  double number = 0;
+  std::from_chars(source.data() + start, source.data() + current, number);
+  add_token(Type::NUMBER, number);
 }
 
 char Lexer::peek_next() const {
@@ -159,14 +277,12 @@ char Lexer::peek_next() const {
 
 void Lexer::string() {
   unsigned int start_line = line;
-  while (peek() != '"' && !is_at_end()) {
-    if (peek() == '\n') {
-      ++line;
-    }
-    advance();
-  }
+  const auto end = std::min(source.find('"', current), source.size());
+  line += count_lines(source.substr(current, end - current));
+  current = static_cast<unsigned int>(end);
 
   if (is_at_end()) {
+    had_error = true;
     err_handler->error(line, "Unterminated string starting at line " +
                                  std::to_string(start_line));
     return;
@@ -174,8 +290,9 @@ void Lexer::string() {
 
   advance(); // Consume the closing "
 
-  std::string str = source.substr(start + 1, current - start - 2);
-  add_token(Type::STRING, str);
+  // Only the payload of string literals is copied out of the source
+  add_token(Type::STRING,
+            std::string(source.substr(start + 1, current - start - 2)));
 }
 
 char Lexer::peek() {
@@ -190,8 +307,8 @@ void Lexer::add_token(Type type, Token::Value value) {
     last_character_expected = true;
     report_last_syntax_error();
   }
-  std::string text = source.substr(start, current - start);
-  tokens.emplace_back(type, std::move(text), std::move(value), line);
+  scanned.emplace(type, source.substr(start, current - start),
+                  std::move(value), line);
 }
 
 bool Lexer::expect(char expected) {
@@ -203,31 +320,36 @@ bool Lexer::expect(char expected) {
 }
 
 std::vector<Token> Lexer::lex() {
+  std::vector<Token> tokens;
+  tokens.reserve(source.size() / 3);
+  do {
+    tokens.push_back(next_token());
+  } while (tokens.back().type != Type::EOF_);
+  return tokens;
+}
+
+Token Lexer::next_token() {
   while (!is_at_end()) {
     start = current;
     scan_token();
+    if (scanned.has_value()) {
+      Token token = std::move(*scanned);
+      scanned.reset();
+      return token;
+    }
   }
 
   if (!last_character_expected) {
+    last_character_expected = true;
     report_last_syntax_error();
   }
 
-  tokens.emplace_back(Type::EOF_, "", NullType(), line);
-  return tokens;
+  return {Type::EOF_, "", NullType(), line};
 }
 
 void Lexer::identifier() {
-  while (isalnum(peek()) != 0) {
-    advance();
-  }
-
-  std::string str = source.substr(start, current - start);
-  const auto keyword_it = keywords.find(str);
-  if (keyword_it != keywords.cend()) {
-    add_token(keyword_it->second);
-  } else {
-    add_token(Type::IDENTIFIER);
-  }
+  current = skip_class(source, current, DIGIT | ALPHA);
+  add_token(keyword(source.substr(start, current - start)));
 }
 
 // Syntax Error Handling:
@@ -242,6 +364,7 @@ void Lexer::report_last_syntax_error() {
   error_str += last_syntax_error.size() >= 50 ? " with more than 50 characters"
                                               : "'" + last_syntax_error + "'";
 
+  had_error = true;
   err_handler->error(line, error_str);
   last_syntax_error.clear();
   syntax_error_start_line = line;
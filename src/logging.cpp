@@ -19,14 +19,8 @@ std::ostream &operator<<(std::ostream &os, LogLevel level) {
 }
 
 void newline(LogLevel level) {
-  if (static_cast<int>(level) >= static_cast<int>(get_log_level()))
-    std::cout << std::endl;
+  if (is_enabled(level))
+    std::cout << '\n';
 }
 
-static LogLevel log_level = LogLevel::WARNING;
-
-void set_log_level(LogLevel level) { log_level = level; }
-
-LogLevel get_log_level() { return log_level; }
-
 } // namespace Logging
@@ -0,0 +1,72 @@
+#include "memo_cache.hpp"
+
+#include <algorithm>
+
+namespace {
+bool has_array(const std::vector<Value> &values) {
+  return std::any_of(values.cbegin(), values.cend(), [](const Value &value) {
+    return value.is_obj_type(Obj::Type::ARRAY);
+  });
+}
+} // namespace
+
+MemoCache::MemoCache(size_t _capacity) : capacity(_capacity) {}
+
+size_t MemoCache::Hash::operator()(
+    const std::vector<Value> &arguments) const noexcept {
+  size_t hash = arguments.size();
+  for (const auto &argument : arguments) {
+    hash ^= std::hash<Value>{}(argument) + 0x9e3779b97f4a7c15 + (hash << 6) +
+            (hash >> 2);
+  }
+  return hash;
+}
+
+const Value *MemoCache::find(const std::vector<Value> &arguments) {
+  if (has_array(arguments)) {
+    return nullptr;
+  }
+  const auto position = positions.find(arguments);
+  if (position == positions.end()) {
+    return nullptr;
+  }
+  entries.splice(entries.begin(), entries, position->second);
+  return &position->second->result;
+}
+
+void MemoCache::insert(std::vector<Value> arguments, Value result) {
+  if (result.is_obj_type(Obj::Type::ARRAY) || has_array(arguments)) {
+    return;
+  }
+  // The call may have cached the same arguments already, e.g. by recursion
+  const auto position = positions.find(arguments);
+  if (position != positions.end()) {
+    position->second->result = std::move(result);
+    entries.splice(entries.begin(), entries, position->second);
+    return;
+  }
+
+  entries.push_front(Entry{arguments, std::move(result)});
+  positions.emplace(std::move(arguments), entries.begin());
+
+  if (entries.size() > capacity) {
+    positions.erase(entries.back().arguments);
+    entries.pop_back();
+  }
+}
+
+void MemoCache::trace(Tracer tracer) const {
+  // The arguments are referenced by both their entry and its key
+  for (const auto &[arguments, position] : positions) {
+    for (const auto &argument : arguments) {
+      ::trace(tracer, argument);
+      ::trace(tracer, argument);
+    }
+    ::trace(tracer, position->result);
+  }
+}
+
+void MemoCache::clear() {
+  positions.clear();
+  entries.clear();
+}
@@ -0,0 +1,89 @@
+#include "native_stack.hpp"
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <exception>
+
+#include "gc.hpp"
+#include "logging.hpp"
+
+namespace NativeStack {
+namespace {
+struct Task {
+  const std::function<void(size_t)> &body;
+  size_t size;
+  std::exception_ptr error;
+  // Thread-local state of the caller
+  GC::Heap &heap;
+  Logging::LogLevel log_level;
+};
+
+void *run_task(void *argument) {
+  auto &task = *static_cast<Task *>(argument);
+  const GC::HeapScope heap{task.heap};
+  Logging::set_log_level(task.log_level);
+  try {
+    task.body(task.size);
+  } catch (...) {
+    task.error = std::current_exception();
+  }
+  task.log_level = Logging::get_log_level();
+  return nullptr;
+}
+
+/// What the current stack probably has left. Half of its limit, since an
+/// unknown part of it is in use already
+size_t current_stack_left() {
+  constexpr size_t DEFAULT_SIZE = 8 * 1024 * 1024;
+  rlimit limit{};
+  if (getrlimit(RLIMIT_STACK, &limit) != 0 ||
+      limit.rlim_cur == RLIM_INFINITY) {
+    return DEFAULT_SIZE / 2;
+  }
+  return static_cast<size_t>(limit.rlim_cur) / 2;
+}
+
+/// Start a thread running task on a stack of task.size bytes
+bool start(pthread_t &thread, Task &task) {
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  const bool started =
+      pthread_attr_setstacksize(&attributes, task.size) == 0 &&
+      pthread_create(&thread, &attributes, run_task, &task) == 0;
+  pthread_attr_destroy(&attributes);
+  return started;
+}
+} // namespace
+
+void run(size_t size, const std::function<void(size_t)> &body) {
+  // A thread of its own is the portable way to get a stack of a given size.
+  // The caller waits for it, so nothing runs concurrently
+  Task task{body, std::max(size, MIN_SIZE), nullptr, GC::current_heap(),
+            Logging::get_log_level()};
+  pthread_t thread;
+  bool started = start(thread, task);
+  while (!started && task.size / 2 >= MIN_SIZE) {
+    task.size /= 2;
+    started = start(thread, task);
+  }
+
+  if (!started) {
+    LOG_WARNING("No native stack of ", size, " bytes. Using the current stack");
+    body(current_stack_left());
+    return;
+  }
+  if (task.size < size) {
+    LOG_WARNING("No native stack of ", size, " bytes. Using one of ",
+                task.size, " bytes");
+  }
+
+  pthread_join(thread, nullptr);
+  Logging::set_log_level(task.log_level);
+  if (task.error) {
+    std::rethrow_exception(task.error);
+  }
+}
+
+} // namespace NativeStack
@@ -0,0 +1,151 @@
+#include "object.hpp"
+
+ObjFunction::ObjFunction(std::string _name, FunctionKind _kind)
+    : Obj(Type::FUNCTION), name(std::move(_name)), kind(_kind) {}
+
+// Same representation as the tree-walker's Function::to_string()
+std::string ObjFunction::to_string() const {
+  switch (kind) {
+  case FunctionKind::FUNCTION:
+    return name.empty() ? "<script>" : "<User fn " + name + ">";
+  case FunctionKind::LAMDBDA:
+    return "<User lambda>";
+  case FunctionKind::CONSTRUCTOR:
+    return "<User constructor>";
+  case FunctionKind::METHOD:
+    return "<User method>";
+  case FunctionKind::UNBOUND:
+    return "<User unbound fn>";
+  case FunctionKind::GETTER:
+    return "<User getter>";
+  }
+  return "";
+}
+
+ObjNative::ObjNative(std::string _name, size_t _arity, Fn _function,
+                     Value _wrapped)
+    : Obj(Type::NATIVE), name(std::move(_name)), arity(_arity),
+      function(std::move(_function)), wrapped(std::move(_wrapped)) {}
+
+std::string ObjNative::to_string() const {
+  return "<Native fn '" + name + "'>";
+}
+
+ObjUpvalue::ObjUpvalue(Value *_location)
+    : Obj(Type::UPVALUE), location(_location) {}
+
+std::string ObjUpvalue::to_string() const { return "<upvalue>"; }
+
+// While open, the variable lives on the VM stack, which is a root anyway
+void ObjUpvalue::trace(Tracer tracer) const { ::trace(tracer, closed); }
+
+void ObjUpvalue::clear_references() { closed = Value{}; }
+
+ObjClosure::ObjClosure(Ref<ObjFunction> _function)
+    : Obj(Type::CLOSURE), function(std::move(_function)) {
+  upvalues.reserve(function->upvalue_count);
+}
+
+std::string ObjClosure::to_string() const { return function->to_string(); }
+
+void ObjClosure::trace(Tracer tracer) const {
+  for (const auto &upvalue : upvalues) {
+    ::trace(tracer, upvalue);
+  }
+}
+
+void ObjClosure::clear_references() { upvalues.clear(); }
+
+ObjClass::ObjClass(std::string _name)
+    : Obj(Type::CLASS), name(std::move(_name)) {}
+
+// Same representation as the tree-walker's Class::to_string()
+std::string ObjClass::to_string() const {
+  std::string representation = "class " + name + "\nMethods:";
+  for (const auto &method : methods) {
+    representation += "\n\t" + method.first.str();
+  }
+  representation += "\nUnbound functions:";
+  for (const auto &unbound : unbounds) {
+    representation += "\n\t" + unbound.first.str();
+  }
+
+  return representation + '\n';
+}
+
+void ObjClass::trace(Tracer tracer) const {
+  for (const auto *functions : {&methods, &unbounds, &getters}) {
+    for (const auto &[_, function] : *functions) {
+      ::trace(tracer, function);
+    }
+  }
+}
+
+void ObjClass::clear_references() {
+  methods.clear();
+  unbounds.clear();
+  getters.clear();
+}
+
+void ObjClass::inherit(const ObjClass &superclass) {
+  methods.insert(superclass.methods.cbegin(), superclass.methods.cend());
+  unbounds.insert(superclass.unbounds.cbegin(), superclass.unbounds.cend());
+  getters.insert(superclass.getters.cbegin(), superclass.getters.cend());
+}
+
+void ObjClass::add_function(Symbol name, Ref<ObjClosure> function) {
+  switch (function->function->kind) {
+  case FunctionKind::METHOD:
+  case FunctionKind::CONSTRUCTOR:
+    methods.insert_or_assign(name, std::move(function));
+    break;
+  case FunctionKind::UNBOUND:
+    unbounds.insert_or_assign(name, std::move(function));
+    break;
+  case FunctionKind::GETTER:
+    getters.insert_or_assign(name, std::move(function));
+    break;
+  default:
+    break;
+  }
+}
+
+ObjClosure *ObjClass::find(const MethodMap &functions, Symbol name) {
+  const auto it = functions.find(name);
+  return it == functions.cend() ? nullptr : it->second.get();
+}
+
+ObjInstance::ObjInstance(Ref<ObjClass> _klass)
+    : Obj(Type::INSTANCE), klass(std::move(_klass)) {}
+
+std::string ObjInstance::to_string() const {
+  return klass->name + " instance";
+}
+
+void ObjInstance::trace(Tracer tracer) const {
+  ::trace(tracer, klass);
+  for (const auto &[_, field] : fields) {
+    ::trace(tracer, field);
+  }
+}
+
+void ObjInstance::clear_references() {
+  klass = nullptr;
+  fields.clear();
+}
+
+ObjBoundMethod::ObjBoundMethod(Value _receiver, Ref<ObjClosure> _method)
+    : Obj(Type::BOUND_METHOD), receiver(std::move(_receiver)),
+      method(std::move(_method)) {}
+
+std::string ObjBoundMethod::to_string() const { return method->to_string(); }
+
+void ObjBoundMethod::trace(Tracer tracer) const {
+  ::trace(tracer, receiver);
+  ::trace(tracer, method);
+}
+
+void ObjBoundMethod::clear_references() {
+  receiver = Value{};
+  method = nullptr;
+}
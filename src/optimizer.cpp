@@ -0,0 +1,307 @@
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <optional>
+
+using Type = Token::TokenType;
+
+namespace {
+/// Same truthiness as Value::is_truthy()
+bool is_truthy(const Token::Value &value) {
+  if (std::holds_alternative<NullType>(value)) {
+    return false;
+  }
+  if (const auto *boolean = std::get_if<bool>(&value)) {
+    return *boolean;
+  }
+  return true;
+}
+
+template <typename T>
+bool are(const Token::Value &left, const Token::Value &right) {
+  return std::holds_alternative<T>(left) && std::holds_alternative<T>(right);
+}
+
+/// Evaluate a comparison like the Interpreter does. Anything but two numbers
+/// or two strings is a RuntimeError, and not folded.
+std::optional<bool> compare(Type op, const Token::Value &left,
+                            const Token::Value &right) {
+  int order = 0;
+  if (are<double>(left, right)) {
+    const auto lhs = std::get<double>(left);
+    const auto rhs = std::get<double>(right);
+    order = lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+  } else if (are<std::string>(left, right)) {
+    order = std::get<std::string>(left).compare(std::get<std::string>(right));
+  } else {
+    return std::nullopt;
+  }
+
+  switch (op) {
+  case Type::GREATER:
+    return order > 0;
+  case Type::GREATER_EQUAL:
+    return order >= 0;
+  case Type::LESS:
+    return order < 0;
+  case Type::LESS_EQUAL:
+    return order <= 0;
+  default:
+    return std::nullopt;
+  }
+}
+
+/// The folded value of a binary operator, if it can't fail at runtime
+std::optional<Token::Value> fold(Type op, const Token::Value &left,
+                                 const Token::Value &right) {
+  switch (op) {
+  case Type::EQUAL_EQUAL:
+    return left == right;
+  case Type::BANG_EQUAL:
+    return left != right;
+  case Type::GREATER:
+  case Type::GREATER_EQUAL:
+  case Type::LESS:
+  case Type::LESS_EQUAL:
+    if (const auto result = compare(op, left, right)) {
+      return *result;
+    }
+    return std::nullopt;
+  case Type::PLUS:
+    if (are<std::string>(left, right)) {
+      return std::get<std::string>(left) + std::get<std::string>(right);
+    }
+    break;
+  default:
+    break;
+  }
+
+  if (!are<double>(left, right)) {
+    return std::nullopt;
+  }
+  const auto lhs = std::get<double>(left);
+  const auto rhs = std::get<double>(right);
+  switch (op) {
+  case Type::PLUS:
+    return lhs + rhs;
+  case Type::MINUS:
+    return lhs - rhs;
+  case Type::STAR:
+    return lhs * rhs;
+  case Type::SLASH:
+    // Division by zero is reported at runtime
+    if (rhs == 0) {
+      return std::nullopt;
+    }
+    return lhs / rhs;
+  default:
+    return std::nullopt;
+  }
+}
+
+bool is_empty(const stmt &statement) {
+  return dynamic_cast<const EmptyStmt *>(statement.get()) != nullptr;
+}
+} // namespace
+
+Optimizer::Optimizer(Arena &_arena) : arena(_arena) {}
+
+void Optimizer::optimize(std::vector<stmt> &statements) {
+  for (auto &statement : statements) {
+    optimize(statement);
+  }
+  std::erase_if(statements, is_empty);
+}
+
+void Optimizer::optimize(stmt &statement) {
+  statement->accept(*this);
+  if (stmt_replacement != nullptr) {
+    statement = std::move(stmt_replacement);
+  }
+}
+
+void Optimizer::optimize(expr &expression) {
+  expression->accept(*this);
+  if (expr_replacement != nullptr) {
+    expression = std::move(expr_replacement);
+  }
+}
+
+const Token::Value *Optimizer::constant(const expr &expression) {
+  const auto *literal = dynamic_cast<const Literal *>(expression.get());
+  return literal == nullptr ? nullptr : &literal->child<0>();
+}
+
+void Optimizer::replace_with_literal(Token::Value value) {
+  expr_replacement = new_literal(arena, std::move(value));
+}
+
+//-------------Statements------------------------------------
+void Optimizer::visit(IfStmt &node) {
+  optimize(node.child<0>());
+  optimize(node.child<1>());
+  optimize(node.child<2>());
+
+  if (const auto *condition = constant(node.child<0>())) {
+    stmt_replacement =
+        std::move(is_truthy(*condition) ? node.child<1>() : node.child<2>());
+  }
+}
+
+void Optimizer::visit(WhileStmt &node) {
+  optimize(node.child<0>());
+  optimize(node.child<1>());
+
+  if (const auto *condition = constant(node.child<0>());
+      condition != nullptr && !is_truthy(*condition)) {
+    stmt_replacement = new_stmt<EmptyStmt>(arena);
+  }
+}
+
+void Optimizer::visit(BlockStmt &node) {
+  optimize(node.child<0>());
+
+  if (node.child<0>().empty()) {
+    stmt_replacement = new_stmt<EmptyStmt>(arena);
+  }
+}
+
+void Optimizer::visit(VarStmt &node) { optimize(node.child<1>()); }
+
+void Optimizer::visit(ExprStmt &node) { optimize(node.child<0>()); }
+
+void Optimizer::visit(PrintStmt &node) { optimize(node.child<0>()); }
+
+void Optimizer::visit(ReturnStmt &node) { optimize(node.child<1>()); }
+
+void Optimizer::visit(FunctionStmt &node) { optimize(node.child<2>()); }
+
+void Optimizer::visit(ClassStmt &node) {
+  for (auto &method : node.child<1>()) {
+    optimize(method->child<2>());
+  }
+}
+
+void Optimizer::visit(ImportStmt &) {}
+
+void Optimizer::visit(MalformedStmt &) {}
+
+void Optimizer::visit(EmptyStmt &) {}
+
+//-------------Expressions------------------------------------
+void Optimizer::visit(Grouping &node) {
+  optimize(node.child<0>());
+  expr_replacement = std::move(node.child<0>());
+}
+
+void Optimizer::visit(Unary &node) {
+  optimize(node.child<1>());
+
+  const auto *operand = constant(node.child<1>());
+  if (operand == nullptr) {
+    return;
+  }
+
+  switch (node.child<0>().type) {
+  case Type::BANG:
+    replace_with_literal(!is_truthy(*operand));
+    break;
+  case Type::MINUS:
+    // Negating anything but a number is reported at runtime
+    if (const auto *number = std::get_if<double>(operand)) {
+      replace_with_literal(-*number);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void Optimizer::visit(Binary &node) {
+  optimize(node.child<0>());
+  optimize(node.child<2>());
+
+  const auto *left = constant(node.child<0>());
+  const auto *right = constant(node.child<2>());
+  if (left == nullptr || right == nullptr) {
+    return;
+  }
+
+  if (auto value = fold(node.child<1>().type, *left, *right)) {
+    replace_with_literal(std::move(*value));
+  }
+}
+
+void Optimizer::visit(Logical &node) {
+  optimize(node.child<0>());
+  optimize(node.child<2>());
+
+  const auto *left = constant(node.child<0>());
+  if (left == nullptr) {
+    return;
+  }
+
+  // 'or' short-circuits on a truthy operand, 'and' on a falsy one
+  const bool short_circuits =
+      (node.child<1>().type == Type::OR) == is_truthy(*left);
+  expr_replacement =
+      std::move(short_circuits ? node.child<0>() : node.child<2>());
+}
+
+void Optimizer::visit(Ternary &node) {
+  optimize(node.child<0>());
+  optimize(node.child<2>());
+  optimize(node.child<4>());
+
+  if (const auto *condition = constant(node.child<0>())) {
+    expr_replacement =
+        std::move(is_truthy(*condition) ? node.child<2>() : node.child<4>());
+  }
+}
+
+void Optimizer::visit(Assign &node) { optimize(node.child<1>()); }
+
+void Optimizer::visit(Call &node) {
+  optimize(node.child<0>());
+  for (auto &argument : node.child<2>()) {
+    optimize(argument);
+  }
+}
+
+void Optimizer::visit(Lambda &node) { optimize(node.child<1>()); }
+
+void Optimizer::visit(Get &node) { optimize(node.child<0>()); }
+
+void Optimizer::visit(Set &node) {
+  optimize(node.child<0>());
+  optimize(node.child<2>());
+}
+
+void Optimizer::visit(ArrayLiteral &node) {
+  for (auto &element : node.child<1>()) {
+    optimize(element);
+  }
+}
+
+void Optimizer::visit(Index &node) {
+  optimize(node.child<0>());
+  optimize(node.child<2>());
+}
+
+void Optimizer::visit(SetIndex &node) {
+  optimize(node.child<0>());
+  optimize(node.child<2>());
+  optimize(node.child<3>());
+}
+
+void Optimizer::visit(Literal &) {}
+
+void Optimizer::visit(Variable &) {}
+
+void Optimizer::visit(This &) {}
+
+void Optimizer::visit(Super &) {}
+
+void Optimizer::visit(Empty &) {}
+
+void Optimizer::visit(Malformed &) {}
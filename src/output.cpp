@@ -0,0 +1,77 @@
+#include "output.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+OutputBuffer::OutputBuffer(int _fd, size_t capacity)
+    : fd(_fd), buffer(capacity), line_buffered(isatty(_fd) == 1) {
+  setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+OutputBuffer::~OutputBuffer() { write_buffer(); }
+
+bool OutputBuffer::write_all(const char *text, size_t count) const {
+  while (count > 0) {
+    const auto written = write(fd, text, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    text += written;
+    count -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+bool OutputBuffer::write_buffer() {
+  const auto count = static_cast<size_t>(pptr() - pbase());
+  setp(buffer.data(), buffer.data() + buffer.size());
+  return write_all(buffer.data(), count);
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type character) {
+  if (!write_buffer()) {
+    return traits_type::eof();
+  }
+  if (traits_type::eq_int_type(character, traits_type::eof())) {
+    return traits_type::not_eof(character);
+  }
+
+  const auto ch = traits_type::to_char_type(character);
+  if (buffer.empty()) {
+    return write_all(&ch, 1) ? character : traits_type::eof();
+  }
+  *pptr() = ch;
+  pbump(1);
+  if (line_buffered && ch == '\n' && !write_buffer()) {
+    return traits_type::eof();
+  }
+  return character;
+}
+
+std::streamsize OutputBuffer::xsputn(const char *text, std::streamsize count) {
+  const auto size = static_cast<size_t>(count);
+  const auto space = static_cast<size_t>(epptr() - pptr());
+
+  if (size <= space) {
+    std::memcpy(pptr(), text, size);
+    pbump(static_cast<int>(size));
+  } else {
+    // Larger than what is left: write both, without copying the text first
+    if (!write_buffer() || !write_all(text, size)) {
+      return 0;
+    }
+  }
+
+  if (line_buffered && std::memchr(text, '\n', size) != nullptr &&
+      !write_buffer()) {
+    return 0;
+  }
+  return count;
+}
+
+int OutputBuffer::sync() { return write_buffer() ? 0 : -1; }
@@ -2,8 +2,11 @@
 
 #include <algorithm>
 #include <cassert>
+#include <filesystem>
+#include <type_traits>
 
 #include "function.hpp"
+#include "lexer.hpp"
 #include "logging.hpp"
 
 using Type = Token::TokenType;
@@ -14,11 +17,11 @@ constexpr size_t MAX_PARAM_COUNT = 255;
 // dynamic_ptr_cast for unique_ptr. Transfers ownership of param to the
 // reuturned ptr if it can be converted. Otherwise, does not transfer ownership
 // and returns nullptr
-template <typename To> std::unique_ptr<To> owned_as(expr &expression) {
+template <typename To> ArenaPtr<To> owned_as(expr &expression) {
   // Needs to be done in two stages. Otherwise, memory leaks if the conversion
   // of a unique_ptr fails
   if (auto *cast = dynamic_cast<To *>(expression.get())) {
-    std::unique_ptr<To> result(
+    ArenaPtr<To> result(
         cast); // Dangerous, takes ownership of an already-owned ptr
     static_cast<void>(expression.release()); // This makes it ok
     return result;
@@ -27,17 +30,24 @@ template <typename To> std::unique_ptr<To> owned_as(expr &expression) {
 }
 } // namespace
 
-Parser::Parser(std::vector<Token> _tokens,
+Parser::Parser(std::vector<Token> _tokens, Arena &_arena,
                std::shared_ptr<ErrorHandler> _err_handler)
-    : err_handler(std::move(_err_handler)), tokens(std::move(_tokens)) {}
+    : err_handler(std::move(_err_handler)), arena(_arena),
+      tokens(std::move(_tokens)) {}
 
-const char *Parser::ParseError::what() const noexcept { return message; }
+Parser::Parser(Lexer &lexer, Arena &_arena,
+               std::shared_ptr<ErrorHandler> _err_handler)
+    : err_handler(std::move(_err_handler)), arena(_arena), tokens(lexer) {}
+
+const char *Parser::ParseError::what() const noexcept {
+  return message.c_str();
+}
 
 //---------------Primitive parser function implementations-----------------
 
 bool Parser::is_at_end() const { return peek().type == Type::EOF_; }
 
-const Token &Parser::peek() const { return tokens[current]; }
+const Token &Parser::peek() const { return tokens.peek(); }
 
 bool Parser::check(Type type) const {
   if (is_at_end()) {
@@ -46,12 +56,10 @@ bool Parser::check(Type type) const {
   return peek().type == type;
 }
 
-const Token &Parser::previous() const { return tokens[current - 1]; }
+const Token &Parser::previous() const { return tokens.previous(); }
 
 const Token &Parser::advance() {
-  if (!is_at_end()) {
-    ++current;
-  }
+  tokens.advance();
   return previous();
 }
 
@@ -78,23 +86,45 @@ stmt Parser::declaration() {
       return var_declaration();
     if (match(Type::CLASS))
       return class_declaration();
+    if (match(Type::IMPORT))
+      return import_declaration();
 
     return statement();
   } catch (const ParseError &err) {
     synchronize();
-    return new_stmt<MalformedStmt>(true, err.what());
+    return new_stmt<MalformedStmt>(arena, true, err.what());
   }
 }
 
 stmt Parser::var_declaration() {
   Token name = consume(Type::IDENTIFIER, "Expect variable identitifier");
 
-  expr initializer = new_expr<Empty>();
+  expr initializer = new_expr<Empty>(arena);
   if (match(Type::EQUAL)) {
     initializer = expression();
   }
   consume(Type::SEMICOLON, "Expect ';' after variable declaration");
-  return new_stmt<VarStmt>(std::move(name), std::move(initializer));
+  return new_stmt<VarStmt>(arena, std::move(name), std::move(initializer));
+}
+
+stmt Parser::import_declaration() {
+  const Token path = consume(Type::STRING, "Expect the module's path");
+
+  // The module is bound to the name of its file, like 'math' for "lib/math.lox"
+  const auto stem =
+      std::filesystem::path(std::get<std::string>(path.value)).stem().string();
+  if (stem.empty() || isalpha(static_cast<unsigned char>(stem[0])) == 0 ||
+      !std::all_of(stem.cbegin(), stem.cend(),
+                   [](char c) {
+                     return isalnum(static_cast<unsigned char>(c)) != 0;
+                   }) ||
+      Lexer::keyword(stem) != Type::IDENTIFIER) {
+    throw error(path, "The file name of a module must be a valid identifier");
+  }
+
+  consume(Type::SEMICOLON, "Expect ';' after import");
+  Token name{Type::IDENTIFIER, arena.copy(stem), NullType{}, path.line};
+  return new_stmt<ImportStmt>(arena, path, std::move(name), false);
 }
 
 stmt Parser::statement() {
@@ -105,7 +135,7 @@ stmt Parser::statement() {
   if (match(Type::WHILE))
     return while_statement();
   if (match(Type::LEFT_BRACE))
-    return new_stmt<BlockStmt>(block());
+    return new_stmt<BlockStmt>(arena, block(), true);
   if (match(Type::PRINT))
     return print_statement();
   if (match(Type::RETURN))
@@ -117,8 +147,8 @@ stmt Parser::statement() {
 FunctionStmtPtr Parser::getter_declaration(Token name) {
   consume(Type::LEFT_BRACE, "Expect '{' after getter identifier");
 
-  return std::make_unique<FunctionStmt>(std::move(name), std::vector<Token>{},
-                                        block(), FunctionKind::GETTER);
+  return arena.make<FunctionStmt>(std::move(name), std::vector<Token>{},
+                                  block(), FunctionKind::GETTER, false);
 }
 
 FunctionStmtPtr Parser::function_declaration(FunctionKind kind) {
@@ -134,8 +164,9 @@ FunctionStmtPtr Parser::function_declaration(FunctionKind kind) {
   consume(Type::RIGHT_PAREN, "Expect ')' after parameter list.");
   consume(Type::LEFT_BRACE, "Expect '{' before " + str(kind) + " body.");
 
-  return std::make_unique<FunctionStmt>(std::move(name), std::move(params),
-                                        block(), kind);
+  // Purity is analysed by the Resolver
+  return arena.make<FunctionStmt>(std::move(name), std::move(params), block(),
+                                  kind, false);
 }
 
 stmt Parser::class_declaration() {
@@ -145,7 +176,7 @@ stmt Parser::class_declaration() {
   VarPtr superclass = nullptr;
   if (match(Type::LESS)) {
     auto superclass_name = consume(Type::IDENTIFIER, "Expect superclass name");
-    superclass = std::make_unique<Variable>(std::move(superclass_name));
+    superclass = arena.make<Variable>(std::move(superclass_name));
   }
 
   consume(Type::LEFT_BRACE, "Expect '{' after class identifier");
@@ -160,7 +191,7 @@ stmt Parser::class_declaration() {
 
   consume(Type::RIGHT_BRACE, "Expect '}' after class body");
 
-  return new_stmt<ClassStmt>(std::move(name), std::move(methods),
+  return new_stmt<ClassStmt>(arena, std::move(name), std::move(methods),
                              std::move(superclass));
 }
 
@@ -210,21 +241,21 @@ stmt Parser::for_statement() {
   if (increment != nullptr) { // Add increment into while loop body
     std::vector<stmt> body_statements;
     body_statements.push_back(std::move(body));
-    body_statements.push_back(new_stmt<ExprStmt>(std::move(increment)));
+    body_statements.push_back(new_stmt<ExprStmt>(arena, std::move(increment)));
 
-    body = new_stmt<BlockStmt>(std::move(body_statements));
+    body = new_stmt<BlockStmt>(arena, std::move(body_statements), true);
   }
 
   if (condition == nullptr) { // Add condition, or true if none specified
-    condition = new_expr<Literal>(true);
+    condition = new_literal(arena, true);
   }
-  body = new_stmt<WhileStmt>(std::move(condition), std::move(body));
+  body = new_stmt<WhileStmt>(arena, std::move(condition), std::move(body));
 
   if (initializer != nullptr) { // Add outer block with init if necessary
     std::vector<stmt> full_statements;
     full_statements.push_back(std::move(initializer));
     full_statements.push_back(std::move(body));
-    body = new_stmt<BlockStmt>(std::move(full_statements));
+    body = new_stmt<BlockStmt>(arena, std::move(full_statements), true);
   }
 
   return body;
@@ -236,7 +267,7 @@ stmt Parser::while_statement() {
   consume(Type::RIGHT_PAREN, "Expect ')' after while condition");
   stmt body = statement();
 
-  return new_stmt<WhileStmt>(std::move(cond), std::move(body));
+  return new_stmt<WhileStmt>(arena, std::move(cond), std::move(body));
 }
 
 stmt Parser::if_statement() {
@@ -245,12 +276,12 @@ stmt Parser::if_statement() {
   consume(Type::RIGHT_PAREN, "Expect ')' after condition of if statement.");
 
   stmt then_stmt = statement();
-  stmt else_stmt = new_stmt<EmptyStmt>();
+  stmt else_stmt = new_stmt<EmptyStmt>(arena);
   if (match(Type::ELSE)) {
     else_stmt = statement();
   }
 
-  return new_stmt<IfStmt>(std::move(cond), std::move(then_stmt),
+  return new_stmt<IfStmt>(arena, std::move(cond), std::move(then_stmt),
                           std::move(else_stmt));
 }
 
@@ -268,18 +299,18 @@ std::vector<stmt> Parser::block() {
 stmt Parser::print_statement() {
   expr value = expression();
   consume(Type::SEMICOLON, "Expect ';' after statement");
-  return new_stmt<PrintStmt>(std::move(value));
+  return new_stmt<PrintStmt>(arena, std::move(value));
 }
 
 stmt Parser::expression_statement() {
   expr value = expression();
   consume(Type::SEMICOLON, "Expect ';' after expression");
-  return new_stmt<ExprStmt>(std::move(value));
+  return new_stmt<ExprStmt>(arena, std::move(value));
 }
 
 stmt Parser::return_statement() {
   Token return_keyword = previous(); // Keep for error-reporting
-  expr body = new_expr<Empty>();     // Returned value is optional.
+  expr body = new_expr<Empty>(arena);     // Returned value is optional.
 
   if (not check(Type::SEMICOLON)) {
     body = expression();
@@ -287,7 +318,9 @@ stmt Parser::return_statement() {
 
   consume(Type::SEMICOLON, "Expect ';' after 'return' statement's expression");
 
-  return new_stmt<ReturnStmt>(std::move(return_keyword), std::move(body));
+  // Tail calls are marked by the Resolver
+  return new_stmt<ReturnStmt>(arena, std::move(return_keyword),
+                              std::move(body), false);
 }
 
 /** Binary left-associative productions of the form
@@ -303,18 +336,22 @@ static expr left_associative_binary_production(Parser *owner) {
   if (owner->match(error_types)) { // Erroneous use of binary operator as unary
     Token prev = owner->previous();
     (owner->*production)(); // Discard result
-    owner->err_handler->error(prev,
-                              "Illegal use of unary operator " + prev.lexeme);
-    return new_expr<Malformed>(true,
-                               "Illegal use of unary operator " + prev.lexeme);
+    auto message = "Illegal use of unary operator " + std::string(prev.lexeme);
+    owner->report(prev, message);
+    return new_expr<Malformed>(owner->arena, true, std::move(message));
   }
   expr result = (owner->*production)();
 
   while (owner->match(matched_types)) {
     Token op = owner->previous();
     expr rhs = (owner->*production)();
-    result =
-        new_expr<expr_type>(std::move(result), std::move(op), std::move(rhs));
+    if constexpr (std::is_same_v<expr_type, Binary>) {
+      result = new_expr<Binary>(owner->arena, std::move(result), std::move(op),
+                                std::move(rhs), TypeFeedback{});
+    } else {
+      result = new_expr<expr_type>(owner->arena, std::move(result),
+                                   std::move(op), std::move(rhs));
+    }
   }
   return result;
 }
@@ -332,16 +369,22 @@ expr Parser::assignment() {
   expr x_value = ternary_conditional();
 
   if (match(Type::EQUAL)) {
-    const auto &equal = previous();
+    Token equal = previous();
     expr value = assignment();
 
     if (auto variable = owned_as<Variable>(x_value)) {
-      return new_expr<Assign>(std::move(variable->child<0>()),
+      return new_expr<Assign>(arena, std::move(variable->child<0>()),
                               std::move(value));
     }
     if (auto get = owned_as<Get>(x_value)) {
-      return new_expr<Set>(std::move(get->child<0>()),
-                           std::move(get->child<1>()), std::move(value));
+      return new_expr<Set>(arena, std::move(get->child<0>()),
+                           std::move(get->child<1>()), std::move(value),
+                           PropertyCache{});
+    }
+    if (auto index = owned_as<Index>(x_value)) {
+      return new_expr<SetIndex>(arena, std::move(index->child<0>()),
+                                std::move(index->child<1>()),
+                                std::move(index->child<2>()), std::move(value));
     }
 
     static_cast<void>(error(equal, // NOLINT: I don't throw this on purpose
@@ -359,9 +402,9 @@ expr Parser::ternary_conditional() {
     Token colon = consume(
         Type::COLON, "Expected ':' after '?' for ternary conditional operator");
     expr right = expression();
-    result = new_expr<Ternary>(std::move(result), std::move(question_mark),
-                               std::move(middle), std::move(colon),
-                               std::move(right));
+    result = new_expr<Ternary>(arena, std::move(result),
+                               std::move(question_mark), std::move(middle),
+                               std::move(colon), std::move(right));
   }
   return result;
 }
@@ -411,7 +454,7 @@ expr Parser::multiplication() {
 expr Parser::unary() {
   if (match({Type::BANG, Type::MINUS})) {
     Token prev = previous();
-    return new_expr<Unary>(std::move(prev), unary());
+    return new_expr<Unary>(arena, std::move(prev), unary(), TypeFeedback{});
   }
   return call();
 }
@@ -424,7 +467,14 @@ expr Parser::call() {
       result = finish_call(std::move(result));
     } else if (match(Type::DOT)) {
       auto name = consume(Type::IDENTIFIER, "Expect property name after '.'");
-      result = new_expr<Get>(std::move(result), std::move(name));
+      result = new_expr<Get>(arena, std::move(result), std::move(name),
+                             PropertyCache{});
+    } else if (match(Type::LEFT_BRACKET)) {
+      auto bracket = previous();
+      auto index = expression();
+      consume(Type::RIGHT_BRACKET, "Expect ']' after index");
+      result = new_expr<Index>(arena, std::move(result), std::move(bracket),
+                               std::move(index));
     } else {
       break;
     }
@@ -446,65 +496,84 @@ expr Parser::finish_call(expr callee) {
 
   Token paren = consume(Type::RIGHT_PAREN, "Expect ')' after arguments");
 
-  return new_expr<Call>(std::move(callee), std::move(paren),
-                        std::move(arguments));
+  return new_expr<Call>(arena, std::move(callee), std::move(paren),
+                        std::move(arguments), false);
 }
 
 expr Parser::primary() {
   if (match(Type::FALSE))
-    return new_expr<Literal>(false);
+    return new_literal(arena, false);
   if (match(Type::TRUE))
-    return new_expr<Literal>(true);
+    return new_literal(arena, true);
 
   if (match(Type::NIL))
-    return new_expr<Literal>(NullType());
+    return new_literal(arena, NullType());
 
   if (match({Type::NUMBER, Type::STRING})) {
     auto previous_val = previous().value;
-    return new_expr<Literal>(std::move(previous_val));
+    return new_literal(arena, std::move(previous_val));
   }
 
   if (match(Type::THIS)) {
     // Copy required because ExprProduction takes rvalue refs in constructor.
     auto this_token = previous();
-    return new_expr<This>(std::move(this_token));
+    return new_expr<This>(arena, std::move(this_token));
   }
 
   if (match(Type::IDENTIFIER)) {
     auto variable = previous();
-    return new_expr<Variable>(std::move(variable));
+    return new_expr<Variable>(arena, std::move(variable));
   }
 
   if (match(Type::LEFT_PAREN)) {
     expr middle = expression();
     consume(Type::RIGHT_PAREN, "Expected ')' after expression");
-    return new_expr<Grouping>(std::move(middle));
+    return new_expr<Grouping>(arena, std::move(middle));
+  }
+
+  if (match(Type::LEFT_BRACKET)) {
+    auto bracket = previous();
+    std::vector<expr> elements;
+    if (!check(Type::RIGHT_BRACKET)) {
+      do {
+        if (elements.size() >= MAX_PARAM_COUNT) {
+          throw error(peek(), "Cannot have more than 255 array elements");
+        }
+        elements.push_back(comma_expression());
+      } while (match(Type::COMMA));
+    }
+    consume(Type::RIGHT_BRACKET, "Expect ']' after array elements");
+    return new_expr<ArrayLiteral>(arena, std::move(bracket),
+                                  std::move(elements));
   }
 
   if (match(Type::SUPER)) {
     auto super_keyword = previous();
     consume(Type::DOT, "Expect '.' after super");
     return new_expr<Super>(
-        std::move(super_keyword),
+        arena, std::move(super_keyword),
         cp(consume(Type::IDENTIFIER, "Expect identifier for super access")),
         false);
   }
 
   if (match(Type::PIPE)) {
+    auto pipe = previous();
     auto params = check(Type::PIPE) ? std::vector<Token>{} : parameters();
     consume(Type::PIPE, "Expect '|' to finish lambda parameter list");
     if (match(Type::LEFT_BRACE)) {
-      return new_expr<Lambda>(std::move(params), block());
+      return new_expr<Lambda>(arena, std::move(params), block(), false,
+                              std::move(pipe));
     }
 
     Token return_keyword =
         previous(); // Keep for error-reporting. Copy required here
-    stmt implicit_return =
-        std::make_unique<ReturnStmt>(std::move(return_keyword), expression());
+    stmt implicit_return = arena.make<ReturnStmt>(std::move(return_keyword),
+                                                  expression(), false);
     std::vector<stmt> block; // Initialization in constructor not possible
                              // because of unique_ptr
     block.emplace_back(std::move(implicit_return));
-    return new_expr<Lambda>(std::move(params), std::move(block));
+    return new_expr<Lambda>(arena, std::move(params), std::move(block),
+                            false, std::move(pipe));
   }
 
   throw error(peek(), "Expect expression.");
@@ -517,9 +586,15 @@ const Token &Parser::consume(Type type, const std::string &message) {
   throw error(peek(), message);
 }
 
+void Parser::report(const Token &token, const std::string &message) {
+  if (!tokens.lexing_failed()) {
+    err_handler->error(token, message);
+  }
+}
+
 Parser::ParseError Parser::error(const Token &token,
                                  const std::string &message) {
-  err_handler->error(token, message.c_str());
+  report(token, message);
   return ParseError(message);
 }
 
@@ -529,6 +604,7 @@ void Parser::synchronize() {
   while (!is_at_end() && previous().type != Type::SEMICOLON) {
     switch (peek().type) {
     case Type::CLASS:
+    case Type::IMPORT:
     case Type::FUN:
     case Type::VAR:
     case Type::FOR:
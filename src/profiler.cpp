@@ -0,0 +1,113 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+
+#include "class.hpp"
+#include "function.hpp"
+
+namespace {
+const std::string top_level_name = "<script>";
+
+std::string frame_name(const Callable &callee) {
+  if (const auto *function = dynamic_cast<const Function *>(&callee)) {
+    return function->qualified_name();
+  }
+  if (const auto *klass = dynamic_cast<const Class *>(&callee)) {
+    return klass->name();
+  }
+  return callee.to_string();
+}
+
+double milliseconds(Profiler::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+} // namespace
+
+Profiler::Profiler() { enter(top_level_name); }
+
+void Profiler::enter(const std::string &name) {
+  auto &stats = functions[name];
+  ++stats.calls;
+  ++stats.active;
+
+  const auto parent_path_length = path.size();
+  if (!frames.empty()) {
+    path += ';';
+  }
+  path += name;
+
+  frames.push_back(Frame{&stats, Clock::now(), {}, parent_path_length});
+}
+
+void Profiler::leave() {
+  const auto end = Clock::now();
+  assert(!frames.empty() && "Left more frames than were entered");
+  const auto frame = frames.back();
+  frames.pop_back();
+
+  const auto inclusive = end - frame.start;
+  const auto exclusive = inclusive - frame.callees;
+
+  if (--frame.stats->active == 0) {
+    frame.stats->inclusive += inclusive;
+  }
+  frame.stats->exclusive += exclusive;
+  stacks[path] += exclusive;
+
+  path.resize(frame.parent_path_length);
+  if (!frames.empty()) {
+    frames.back().callees += inclusive;
+  }
+}
+
+void Profiler::stop() {
+  while (!frames.empty()) {
+    leave();
+  }
+}
+
+void Profiler::write_summary(std::ostream &os) const {
+  std::vector<std::pair<std::string, FunctionStats>> sorted(functions.begin(),
+                                                            functions.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.exclusive > b.second.exclusive;
+  });
+
+  os << std::left << std::setw(30) << "function" << std::right
+     << std::setw(12) << "calls" << std::setw(16) << "inclusive ms"
+     << std::setw(16) << "exclusive ms" << '\n';
+
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  for (const auto &[name, stats] : sorted) {
+    os << std::left << std::setw(30) << name << std::right << std::setw(12)
+       << stats.calls << std::setw(16) << milliseconds(stats.inclusive)
+       << std::setw(16) << milliseconds(stats.exclusive) << '\n';
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void Profiler::write_collapsed(std::ostream &os) const {
+  for (const auto &[stack, time] : stacks) {
+    os << stack << ' '
+       << std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()
+       << '\n';
+  }
+}
+
+Profiler::Scope::Scope(Profiler *_profiler, const Callable &callee)
+    : profiler(_profiler) {
+  if (profiler != nullptr) {
+    profiler->enter(frame_name(callee));
+  }
+}
+
+Profiler::Scope::~Scope() {
+  if (profiler != nullptr) {
+    profiler->leave();
+  }
+}
@@ -1,23 +1,64 @@
 #include "resolver.hpp"
 
+#include <algorithm>
 #include <cassert>
 
+#include "buildin.hpp"
 #include "logging.hpp"
 
+namespace {
+const Symbol this_symbol{"this"};
+const Symbol super_symbol{"super"};
+const Symbol init_symbol{"init"};
+const Symbol memoize_symbol{"memoize"};
+
+/// Mark the calls whose result is the returned value. Nothing is left to do
+/// in the function after them, so they can replace its call. Returns whether
+/// there are any
+bool mark_tail_calls(Expr &returned) {
+  if (auto *call = dynamic_cast<Call *>(&returned)) {
+    call->child<3>() = true;
+    return true;
+  }
+  if (auto *grouping = dynamic_cast<Grouping *>(&returned)) {
+    return mark_tail_calls(*grouping->child<0>());
+  }
+  if (auto *ternary = dynamic_cast<Ternary *>(&returned)) {
+    const auto first = mark_tail_calls(*ternary->child<2>());
+    const auto second = mark_tail_calls(*ternary->child<4>());
+    return first || second;
+  }
+  return false;
+}
+
+/// Whether value is memoize(name). Memoizing a function keeps it pure
+bool is_memoized(Symbol name, Expr &value) {
+  auto *call = dynamic_cast<Call *>(&value);
+  if (call == nullptr || call->child<2>().size() != 1) {
+    return false;
+  }
+  auto *callee = dynamic_cast<Variable *>(call->child<0>().get());
+  auto *argument = dynamic_cast<Variable *>(call->child<2>()[0].get());
+  return callee != nullptr && argument != nullptr &&
+         callee->child<0>().symbol == memoize_symbol &&
+         argument->child<0>().symbol == name;
+}
+} // namespace
+
 Resolver::Resolver(Interpreter &_interpreter) : interpreter(_interpreter) {}
 
 void Resolver::resolve(const expr &expression) { resolve(expression.get()); }
 
 void Resolver::resolve(Expr *expression) {
   if (expression != nullptr) {
-    dynamic_cast<ExprVisitableBase &>(*expression).accept(*this);
+    expression->accept(*this);
   }
 }
 
 void Resolver::resolve(const stmt &statement) {
   try {
     if (statement != nullptr) {
-      dynamic_cast<StmtVisitableBase &>(*statement).accept(*this);
+      statement->accept(*this);
     }
   } catch (const CompiletimeError &err) {
     interpreter.err_handler->error(err.token, err.what());
@@ -28,11 +69,20 @@ void Resolver::resolve(const std::vector<stmt> &statements) {
   for (const auto &statement : statements) {
     resolve(statement);
   }
+  // Functions may call functions declared after them, so their purity is only
+  // known once the whole program is resolved
+  if (scopes.empty()) {
+    analyse_purity();
+  }
 }
 
 void Resolver::declare(const Token &identifier) {
   if (!scopes.empty()) {
-    if (not scopes.back().emplace(identifier.lexeme, false).second) {
+    auto &bindings = scopes.back().bindings;
+    // Slots are handed out in declaration order. The Interpreter defines the
+    // locals of a scope in the same order.
+    if (not bindings.emplace(identifier.symbol, Binding{false, bindings.size()})
+                .second) {
       throw CompiletimeError(
           identifier,
           "Variable with this name is already declared in this scope");
@@ -42,17 +92,95 @@ void Resolver::declare(const Token &identifier) {
 
 void Resolver::define(const Token &identifier) {
   if (!scopes.empty()) {
-    scopes.back().insert_or_assign(identifier.lexeme, true);
+    scopes.back().bindings.at(identifier.symbol).is_initialized = true;
+  }
+}
+
+void Resolver::begin_scope(ScopeKind kind, BlockStmt *block) {
+  const auto parent = scopes.empty() ? NO_SCOPE : scopes.back().info;
+  const auto parent_declarations =
+      scopes.empty() ? 0 : scopes.back().bindings.size();
+  scopes.push_back(Scope{{}, {}, scope_infos.size()});
+  scope_infos.push_back(ScopeInfo{.kind = kind,
+                                  .parent = parent,
+                                  .parent_declarations = parent_declarations,
+                                  .block = block});
+}
+
+void Resolver::end_scope() {
+  scope_infos[scopes.back().info].declarations =
+      scopes.back().bindings.size();
+  scopes.pop_back();
+  if (scopes.empty()) {
+    assign_slots();
+  }
+}
+
+void Resolver::assign_slots() {
+  // Parents always precede their children
+  for (auto &scope : scope_infos) {
+    const auto *parent =
+        scope.parent == NO_SCOPE ? nullptr : &scope_infos[scope.parent];
+    const auto parent_home = parent == nullptr ? NO_SCOPE : parent->home;
+
+    switch (scope.kind) {
+    case ScopeKind::FUNCTION:
+    case ScopeKind::SUPER:
+      scope.has_environment = true;
+      break;
+    case ScopeKind::BODY:
+      // The body runs once per call, like the parameters
+      scope.has_environment = false;
+      break;
+    case ScopeKind::BLOCK:
+      // Captured locals need a new binding each time the block runs. Blocks
+      // at the top level have no enclosing environment to live in.
+      scope.has_environment =
+          scope.declarations > 0 &&
+          (scope.is_captured || parent_home == NO_SCOPE);
+      break;
+    }
+
+    if (scope.has_environment) {
+      scope.home = static_cast<size_t>(&scope - scope_infos.data());
+    } else {
+      scope.home = parent_home;
+      if (parent != nullptr) {
+        scope.first_slot = parent->first_slot + scope.parent_declarations;
+      }
+    }
+
+    if (scope.block != nullptr) {
+      scope.block->child<1>() = scope.has_environment;
+    }
+  }
+
+  for (const auto &use : uses) {
+    const auto &declaration = scope_infos[use.declaration_scope];
+    int depth = 0;
+    for (auto scope = use.scope; scope != declaration.home;
+         scope = scope_infos[scope].parent) {
+      depth += scope_infos[scope].has_environment ? 1 : 0;
+    }
+    // Save the depth and slot in the AST node for usage by the interpreter
+    use.node->depth = depth;
+    use.node->slot = declaration.first_slot + use.index;
   }
+
+  scope_infos.clear();
+  uses.clear();
 }
 
 void Resolver::visit(BlockStmt &node) {
-  scopes.emplace_back();
+  begin_scope(ScopeKind::BLOCK, &node);
   resolve(node.child<0>());
-  scopes.pop_back();
+  end_scope();
 }
 
 void Resolver::visit(VarStmt &node) {
+  if (scopes.empty()) {
+    rebind_global(node.child<0>().symbol);
+  }
   declare(node.child<0>());
 
   resolve(node.child<1>());
@@ -65,10 +193,18 @@ void Resolver::visit(Variable &node) {
 
   // Var exists in current scope and is uninitialized -> We are currently
   // declaring this variable
-  if (not scopes.empty() && scopes.back().contains(node.child<0>().lexeme) &&
-      not scopes.back().at(node.child<0>().lexeme)) {
-    throw CompiletimeError(node.child<0>(),
-                           "Can't read local variable in its own initializer.");
+  if (not scopes.empty()) {
+    const auto &bindings = scopes.back().bindings;
+    if (const auto binding = bindings.find(node.child<0>().symbol);
+        binding != bindings.cend() && not binding->second.is_initialized) {
+      throw CompiletimeError(
+          node.child<0>(), "Can't read local variable in its own initializer.");
+    }
+  }
+
+  // Outer variables may change between calls of the current function
+  if (declaration_of(node.child<0>().symbol) != Declaration::LOCAL) {
+    add_effect();
   }
 
   // Otherwise, it might exist somewhere in an outer scope (global if no scopes
@@ -77,31 +213,70 @@ void Resolver::visit(Variable &node) {
 }
 
 void Resolver::resolve_local(Expr &node, const Token &identifier) {
-  LOG_DEBUG("Resolving local for ", identifier.lexeme);
+  LOG_DEBUG("Resolving local for ", identifier.symbol);
 
   for (const auto &scope : scopes) {
     LOG_DEBUG("Scope:");
-    for (const auto &pair : scope) {
-      LOG_DEBUG(pair.first, ": ", pair.second);
+    for (const auto &pair : scope.bindings) {
+      LOG_DEBUG(pair.first, ": ", pair.second.is_initialized, " at index ",
+                pair.second.index);
     }
   }
 
-  for (int i = scopes.size() - 1; i >= 0; --i) {
-    if (scopes.at(i).contains(identifier.lexeme)) {
-      LOG_DEBUG("Setting depth up for ", identifier.lexeme, " at ",
-                scopes.size() - 1 - i);
-      // Save the depth information in the AST node for usage by the interpreter
-      node.depth = scopes.size() - 1 - i;
+  bool crosses_function = false;
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+    const auto binding = scope->bindings.find(identifier.symbol);
+    if (binding != scope->bindings.cend()) {
+      LOG_DEBUG("Found ", identifier.symbol, " ",
+                scope - scopes.rbegin(), " scopes up");
+      if (crosses_function) {
+        scope_infos[scope->info].is_captured = true;
+      }
+      // Depth and slot are only known once all scopes in between are closed
+      uses.push_back(Use{.node = &node,
+                         .scope = scopes.back().info,
+                         .declaration_scope = scope->info,
+                         .index = binding->second.index});
       return;
     }
+    if (scope_infos[scope->info].kind == ScopeKind::FUNCTION) {
+      crosses_function = true;
+    }
   }
   // In fall-through case, the variable is not local -> must be global or
   // undefined. Depth information is not saved in the AST
 }
 
+Resolver::Declaration Resolver::declaration_of(Symbol name) const {
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+    if (scope->bindings.contains(name)) {
+      return Declaration::LOCAL;
+    }
+    if (scope_infos[scope->info].kind == ScopeKind::FUNCTION) {
+      break;
+    }
+  }
+  for (const auto &scope : scopes) {
+    if (scope.bindings.contains(name)) {
+      return Declaration::ENCLOSING_FUNCTION;
+    }
+  }
+  return Declaration::GLOBAL;
+}
+
 void Resolver::visit(Assign &node) {
   resolve(node.child<1>());
 
+  const auto name = node.child<0>().symbol;
+  const auto declaration = declaration_of(name);
+  if (declaration != Declaration::LOCAL) {
+    add_effect();
+  }
+  if (declaration == Declaration::GLOBAL &&
+      !is_memoized(name, *node.child<1>())) {
+    rebind_global(name);
+  }
+
   resolve_local(node, node.child<0>());
 }
 
@@ -113,41 +288,102 @@ void Resolver::visit(FunctionStmt &node) {
   declare(name);
   define(name);
 
-  resolve_function(node.child<1>(), node.child<2>(), node.child<3>());
+  if (scopes.empty()) {
+    // The purity of the function is added next
+    const auto [function, is_new] =
+        global_functions.emplace(name.symbol, purities.size());
+    if (!is_new) {
+      function->second = std::nullopt;
+    }
+  }
+
+  resolve_function(node.child<1>(), node.child<2>(), node.child<3>(),
+                   node.child<4>());
 }
 
 void Resolver::resolve_function(const std::vector<Token> &params,
                                 const std::vector<stmt> &body,
-                                FunctionKind kind) {
+                                FunctionKind kind, bool &is_pure) {
+  has_declared_functions = true;
   auto enclosing_function = function_kind;
   function_kind = kind;
 
+  enclosing_purities.push_back(purities.size());
+  purities.push_back(Purity{&is_pure});
+
   LOG_DEBUG("Resolving function with kind: ", kind);
 
-  scopes.emplace_back();
+  begin_scope(ScopeKind::FUNCTION);
+
+  if (has_receiver(kind)) {
+    // 'this' is passed like an implicit first parameter
+    scopes.back().bindings.emplace(this_symbol, Binding{true, 0});
+  }
 
   for (const auto &param : params) {
     declare(param);
     define(param);
   }
 
-  // Needs two scopes: One for function (where parameters live) and one for the
-  // body block (where locals live) This separation isn't quite necessary, but a
-  // consequence of my block always creating a new env to execute in The
-  // parameters live in the first block, so to be correctly looked up at
-  // interpretation, we need to simulate that inner block here as well.
-  scopes.emplace_back();
+  // The body is a separate scope, so that locals may shadow parameters. Its
+  // locals still live in the environment of the parameters.
+  begin_scope(ScopeKind::BODY);
 
   resolve(body);
 
-  scopes.pop_back();
-  scopes.pop_back();
+  end_scope();
+  end_scope();
 
+  enclosing_purities.pop_back();
   function_kind = enclosing_function;
 }
 
+void Resolver::add_effect() {
+  if (!enclosing_purities.empty()) {
+    purities[enclosing_purities.back()].has_effects = true;
+  }
+}
+
+void Resolver::rebind_global(Symbol name) {
+  global_functions.insert_or_assign(name, std::nullopt);
+}
+
+void Resolver::analyse_purity() {
+  // Assume that all functions without effects of their own are pure. Then
+  // drop the ones that call impure functions, until nothing changes. This
+  // keeps recursive functions pure
+  for (const auto &purity : purities) {
+    *purity.is_pure = !purity.has_effects;
+  }
+
+  const auto is_pure_global = [this](Symbol name) {
+    const auto function = global_functions.find(name);
+    if (function == global_functions.cend()) {
+      return Buildin::is_pure(name.str());
+    }
+    return function->second.has_value() && *purities[*function->second].is_pure;
+  };
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto &purity : purities) {
+      if (*purity.is_pure && !std::all_of(purity.called_globals.cbegin(),
+                                          purity.called_globals.cend(),
+                                          is_pure_global)) {
+        *purity.is_pure = false;
+        changed = true;
+      }
+    }
+  }
+
+  purities.clear();
+  global_functions.clear();
+}
+
 void Resolver::visit(Lambda &node) {
-  resolve_function(node.child<0>(), node.child<1>(), FunctionKind::LAMDBDA);
+  resolve_function(node.child<0>(), node.child<1>(), FunctionKind::LAMDBDA,
+                   node.child<2>());
 }
 
 void Resolver::visit(ReturnStmt &node) {
@@ -164,19 +400,26 @@ void Resolver::visit(ReturnStmt &node) {
     function_needs_return = false;
   }
 
+  // Constructors can't return calls, since they return 'this'
+  node.child<2>() = mark_tail_calls(*node.child<1>());
+
   resolve(node.child<1>());
 }
 
 void Resolver::visit(ClassStmt &node) {
+  has_declared_functions = true;
   auto previous_type = class_kind;
   class_kind = ClassKind::CLASS;
 
+  if (scopes.empty()) {
+    rebind_global(node.child<0>().symbol);
+  }
   declare(node.child<0>());
   define(node.child<0>());
 
   const auto &superclass = node.child<2>();
   if (superclass != nullptr &&
-      superclass->child<0>().lexeme == node.child<0>().lexeme) {
+      superclass->child<0>().symbol == node.child<0>().symbol) {
     throw CompiletimeError(superclass->child<0>(),
                            "A class can't inherit from itself.");
   }
@@ -187,27 +430,22 @@ void Resolver::visit(ClassStmt &node) {
     class_kind = ClassKind::SUBCLASS;
 
     resolve(superclass.get());
-    scopes.emplace_back();
-    // Like 'this', 'super' is just a variable that lives in an outer scope.
-    // 'super' is only bound once per class, rather than per instance. The
-    // difference is in the interpreter
-    scopes.back().emplace("super", true);
+    begin_scope(ScopeKind::SUPER);
+    // 'super' is just a variable that lives in an outer scope. Unlike 'this',
+    // it is only bound once per class, rather than per call
+    scopes.back().bindings.emplace(super_symbol, Binding{true, 0});
   }
 
-  scopes.emplace_back(); // 'this' variable needs a scope to live in
-  // 'this' always resolved to a "local" variable that lives just
-  // outside the block defined by a class's method
-  scopes.back().emplace("this", true);
-
   for (const auto &method : node.child<1>()) {
     auto &kind = method->child<3>();
-    if (method->child<0>().lexeme == "init") {
+    if (method->child<0>().symbol == init_symbol) {
       kind = FunctionKind::CONSTRUCTOR;
     }
 
     function_needs_return = (kind == FunctionKind::GETTER);
 
-    resolve_function(method->child<1>(), method->child<2>(), kind);
+    resolve_function(method->child<1>(), method->child<2>(), kind,
+                     method->child<4>());
 
     if (function_needs_return) {
       interpreter.err_handler->warn(method->child<0>(),
@@ -215,10 +453,8 @@ void Resolver::visit(ClassStmt &node) {
     }
   }
 
-  scopes.pop_back();
-
   if (superclass != nullptr) {
-    scopes.pop_back();
+    end_scope();
     class_kind = previous_class_kind;
   }
 
@@ -271,7 +507,10 @@ void Resolver::visit(IfStmt &node) {
   resolve(node.child<2>());
 }
 
-void Resolver::visit(PrintStmt &node) { resolve(node.child<0>()); }
+void Resolver::visit(PrintStmt &node) {
+  add_effect();
+  resolve(node.child<0>());
+}
 
 void Resolver::visit(WhileStmt &node) {
   resolve(node.child<0>());
@@ -285,7 +524,20 @@ void Resolver::visit(Binary &node) {
 }
 
 void Resolver::visit(Call &node) {
-  resolve(node.child<0>());
+  // Only calls of global functions are known statically. Rebinding them is
+  // tracked separately, so they are not reads of outer variables
+  auto *callee = dynamic_cast<Variable *>(node.child<0>().get());
+  if (callee != nullptr &&
+      declaration_of(callee->child<0>().symbol) == Declaration::GLOBAL) {
+    if (!enclosing_purities.empty()) {
+      purities[enclosing_purities.back()].called_globals.push_back(
+          callee->child<0>().symbol);
+    }
+    resolve_local(*callee, callee->child<0>());
+  } else {
+    add_effect();
+    resolve(node.child<0>());
+  }
   // Like if, always resolve body of while
   for (const auto &argument : node.child<2>()) {
     resolve(argument);
@@ -317,9 +569,37 @@ void Resolver::visit(MalformedStmt &) {}
 
 void Resolver::visit(EmptyStmt &) {}
 
-void Resolver::visit(Get &node) { resolve(node.child<0>()); }
+void Resolver::visit(ImportStmt &node) {
+  if (scopes.empty()) {
+    rebind_global(node.child<1>().symbol);
+  }
+  // Running the module can have any effect
+  add_effect();
+  const auto &name = node.child<1>();
+  const auto &path = std::get<std::string>(node.child<0>().value);
+  if (!scopes.empty()) {
+    // Importing the same path again in a scope imports the same module, which
+    // stays bound. Globals are checked when the import runs
+    auto &imports = scopes.back().imports;
+    if (const auto import = imports.find(name.symbol);
+        import != imports.cend() && import->second == path) {
+      node.child<2>() = true;
+      return;
+    }
+    imports.emplace(name.symbol, path);
+  }
+  declare(name);
+  define(name);
+}
+
+void Resolver::visit(Get &node) {
+  // The property may be a getter with effects
+  add_effect();
+  resolve(node.child<0>());
+}
 
 void Resolver::visit(Set &node) {
+  add_effect();
   resolve(node.child<0>());
 
   // Note, the property is dynamically-evaluated, so no variable is introduced
@@ -327,3 +607,21 @@ void Resolver::visit(Set &node) {
 
   resolve(node.child<2>());
 }
+
+void Resolver::visit(ArrayLiteral &node) {
+  for (const auto &element : node.child<1>()) {
+    resolve(element);
+  }
+}
+
+void Resolver::visit(Index &node) {
+  resolve(node.child<0>());
+  resolve(node.child<2>());
+}
+
+void Resolver::visit(SetIndex &node) {
+  add_effect();
+  resolve(node.child<0>());
+  resolve(node.child<2>());
+  resolve(node.child<3>());
+}
@@ -0,0 +1,342 @@
+#include "script_cache.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+#include "source.hpp"
+#include "vm.hpp"
+
+namespace {
+constexpr std::string_view MAGIC = "LOXC";
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+// Functions nest only as deep as they are written, so deeper ones are corrupt
+constexpr size_t MAX_FUNCTION_DEPTH = 1024;
+
+enum class Constant : uint8_t { NIL, FALSE, TRUE, NUMBER, STRING, FUNCTION };
+
+/// FNV-1a
+uint64_t hash(uint64_t seed, std::string_view bytes) {
+  for (const auto byte : bytes) {
+    seed = (seed ^ static_cast<uint8_t>(byte)) * FNV_PRIME;
+  }
+  return seed;
+}
+
+/// Identifies the build of the running interpreter by its executable, so
+/// rebuilding it invalidates all caches
+std::optional<uint64_t> interpreter_stamp() {
+  static const auto stamp = []() -> std::optional<uint64_t> {
+    struct stat status {};
+    if (stat("/proc/self/exe", &status) != 0) {
+      return std::nullopt;
+    }
+    const auto build = std::to_string(status.st_ino) + ":" +
+                       std::to_string(status.st_size) + ":" +
+                       std::to_string(status.st_mtim.tv_sec) + "." +
+                       std::to_string(status.st_mtim.tv_nsec);
+    return hash(FNV_OFFSET, build);
+  }();
+  return stamp;
+}
+
+/// Appends values in the byte order of this machine. Caches are only read
+/// by the same build, so they need no portable layout
+struct Writer {
+  template <typename T> void put(T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void put_string(std::string_view text) {
+    put(static_cast<uint32_t>(text.size()));
+    bytes.append(text);
+  }
+
+  /// False if it has a constant that can't be stored
+  [[nodiscard]] bool put_function(const ObjFunction &function) {
+    put_string(function.name);
+    put(static_cast<uint8_t>(function.kind));
+    put(static_cast<uint32_t>(function.arity));
+    put(static_cast<uint32_t>(function.upvalue_count));
+    put(function.is_pure);
+
+    const auto &chunk = function.chunk;
+    put_string({reinterpret_cast<const char *>(chunk.code.data()),
+                chunk.code.size()});
+    // Lines are stored as runs, since every byte of code has one
+    std::vector<std::pair<unsigned int, uint32_t>> runs;
+    for (const auto line : chunk.lines) {
+      if (runs.empty() || runs.back().first != line) {
+        runs.emplace_back(line, 0);
+      }
+      ++runs.back().second;
+    }
+    put(static_cast<uint32_t>(runs.size()));
+    for (const auto &[line, count] : runs) {
+      put(line);
+      put(count);
+    }
+    put(static_cast<uint32_t>(chunk.lexemes.size()));
+    for (const auto &lexeme : chunk.lexemes) {
+      put(lexeme.start);
+      put_string(lexeme.text);
+    }
+
+    put(static_cast<uint32_t>(chunk.constants.size()));
+    for (const auto &constant : chunk.constants) {
+      if (constant.is_nil()) {
+        put(Constant::NIL);
+      } else if (constant.is_bool()) {
+        put(constant.as_bool() ? Constant::TRUE : Constant::FALSE);
+      } else if (constant.is_number()) {
+        put(Constant::NUMBER);
+        put(constant.as_number());
+      } else if (constant.is_string()) {
+        put(Constant::STRING);
+        put_string(constant.as<ObjString>()->chars());
+      } else if (constant.is_obj_type(Obj::Type::FUNCTION)) {
+        put(Constant::FUNCTION);
+        if (!put_function(*constant.as<ObjFunction>())) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+
+    put(static_cast<uint32_t>(chunk.local_names.size()));
+    for (const auto &local : chunk.local_names) {
+      put_string(local.name);
+      put(local.slot);
+      put(local.start);
+      put(local.end);
+    }
+    return true;
+  }
+
+  std::string bytes;
+};
+
+/// Reads what the Writer appended. Running out of bytes or reading invalid
+/// values sets failed, and everything read after that is zero
+struct Reader {
+  template <typename T> T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value{};
+    if (bytes.size() < sizeof(T)) {
+      failed = true;
+      return value;
+    }
+    std::memcpy(&value, bytes.data(), sizeof(T));
+    bytes.remove_prefix(sizeof(T));
+    return value;
+  }
+
+  std::string_view get_bytes(size_t count) {
+    if (bytes.size() < count) {
+      failed = true;
+      return {};
+    }
+    const auto read = bytes.substr(0, count);
+    bytes.remove_prefix(count);
+    return read;
+  }
+
+  std::string_view get_string() { return get_bytes(get<uint32_t>()); }
+
+  Ref<ObjFunction> get_function(size_t depth) {
+    const auto name = get_string();
+    const auto kind = get<uint8_t>();
+    if (depth > MAX_FUNCTION_DEPTH ||
+        kind > static_cast<uint8_t>(FunctionKind::GETTER)) {
+      failed = true;
+      return nullptr;
+    }
+
+    auto function = make_obj<ObjFunction>(std::string(name),
+                                          static_cast<FunctionKind>(kind));
+    function->arity = get<uint32_t>();
+    function->upvalue_count = get<uint32_t>();
+    function->is_pure = get<bool>();
+
+    auto &chunk = function->chunk;
+    const auto code = get_string();
+    chunk.code.assign(code.cbegin(), code.cend());
+    chunk.lines.reserve(code.size());
+    const auto run_count = get<uint32_t>();
+    for (uint32_t i = 0; i < run_count && !failed; ++i) {
+      const auto line = get<unsigned int>();
+      const auto count = get<uint32_t>();
+      if (count > code.size() - chunk.lines.size()) {
+        failed = true;
+        return nullptr;
+      }
+      chunk.lines.insert(chunk.lines.cend(), count, line);
+    }
+    if (chunk.lines.size() != code.size()) {
+      failed = true;
+      return nullptr;
+    }
+    const auto lexeme_count = get<uint32_t>();
+    for (uint32_t i = 0; i < lexeme_count && !failed; ++i) {
+      const auto start = get<uint32_t>();
+      const auto text = get_string();
+      // Lookups need them in order
+      if (start >= code.size() ||
+          (!chunk.lexemes.empty() && start <= chunk.lexemes.back().start)) {
+        failed = true;
+        return nullptr;
+      }
+      chunk.lexemes.push_back(Chunk::Lexeme{start, std::string(text)});
+    }
+
+    const auto constant_count = get<uint32_t>();
+    for (uint32_t i = 0; i < constant_count && !failed; ++i) {
+      switch (get<Constant>()) {
+      case Constant::NIL:
+        chunk.constants.emplace_back(NullType{});
+        break;
+      case Constant::FALSE:
+        chunk.constants.emplace_back(false);
+        break;
+      case Constant::TRUE:
+        chunk.constants.emplace_back(true);
+        break;
+      case Constant::NUMBER:
+        chunk.constants.emplace_back(get<double>());
+        break;
+      case Constant::STRING:
+        chunk.constants.push_back(intern_string(Symbol(get_string())));
+        break;
+      case Constant::FUNCTION:
+        if (auto nested = get_function(depth + 1)) {
+          chunk.constants.emplace_back(std::move(nested));
+        }
+        break;
+      default:
+        failed = true;
+      }
+    }
+
+    const auto local_count = get<uint32_t>();
+    for (uint32_t i = 0; i < local_count && !failed; ++i) {
+      const auto local_name = get_string();
+      const auto slot = get<uint8_t>();
+      const auto start = get<uint32_t>();
+      const auto end = get<uint32_t>();
+      chunk.local_names.push_back(
+          Chunk::LocalName{std::string(local_name), slot, start, end});
+    }
+    return failed ? nullptr : function;
+  }
+
+  std::string_view bytes;
+  bool failed = false;
+};
+} // namespace
+
+ScriptCache::ScriptCache(const std::string &script, std::string_view source)
+    : path(script + ".loxc") {
+  // Scripts read from pipes or devices like /dev/stdin have no place for one
+  struct stat status {};
+  if (stat(script.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+    return;
+  }
+  if (const auto stamp = interpreter_stamp()) {
+    key = hash(*stamp, source);
+  }
+}
+
+Ref<ObjFunction> ScriptCache::load(VM &vm) const {
+  if (!key.has_value()) {
+    return nullptr;
+  }
+  const auto file = SourceFile::map(path);
+  if (!file.has_value()) {
+    return nullptr;
+  }
+
+  Reader reader{file->text()};
+  if (reader.get_bytes(MAGIC.size()) != MAGIC ||
+      reader.get<uint32_t>() != FORMAT_VERSION ||
+      reader.get<uint64_t>() != *key) {
+    return nullptr;
+  }
+  // Guards against files that were damaged after they were written
+  const auto checksum = reader.get<uint64_t>();
+  if (reader.failed || hash(FNV_OFFSET, reader.bytes) != checksum) {
+    return nullptr;
+  }
+
+  const auto global_count = reader.get<uint32_t>();
+  if (reader.bytes.size() / sizeof(uint32_t) < global_count) {
+    return nullptr;
+  }
+  std::vector<std::string_view> globals(global_count);
+  for (auto &name : globals) {
+    name = reader.get_string();
+  }
+  auto script = reader.get_function(0);
+  if (reader.failed || !reader.bytes.empty()) {
+    return nullptr;
+  }
+
+  // The compiled code refers to globals by slot, so the globals must be
+  // created in the same order. The ones vm has, like the builtins, must match
+  const auto existing = vm.global_names();
+  if (existing.size() > globals.size() ||
+      !std::equal(existing.cbegin(), existing.cend(), globals.cbegin())) {
+    return nullptr;
+  }
+  for (auto i = existing.size(); i < globals.size(); ++i) {
+    vm.global_slot(Symbol(globals[i]));
+  }
+  return script;
+}
+
+void ScriptCache::store(const ObjFunction &script, const VM &vm) const {
+  if (!key.has_value()) {
+    return;
+  }
+
+  Writer body;
+  const auto globals = vm.global_names();
+  body.put(static_cast<uint32_t>(globals.size()));
+  for (const auto &name : globals) {
+    body.put_string(name);
+  }
+  if (!body.put_function(script)) {
+    return;
+  }
+
+  Writer header;
+  header.bytes = MAGIC;
+  header.put(FORMAT_VERSION);
+  header.put(*key);
+  header.put(hash(FNV_OFFSET, body.bytes));
+
+  // Renamed into place once complete, so no reader sees a partial cache
+  const auto temporary = path + "." + std::to_string(getpid()) + ".tmp";
+  std::error_code error;
+  {
+    std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+    file << header.bytes << body.bytes;
+    file.close();
+    if (!file) {
+      std::filesystem::remove(temporary, error);
+      return;
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+  }
+}
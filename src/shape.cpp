@@ -0,0 +1,33 @@
+#include "shape.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+uint64_t next_shape_id() {
+  static std::atomic<uint64_t> counter = 1;
+  return counter++;
+}
+} // namespace
+
+Shape::Shape() : id(next_shape_id()) {}
+
+size_t Shape::find(Symbol name) const {
+  const auto field = std::find(fields.cbegin(), fields.cend(), name);
+  return field == fields.cend() ? NOT_FOUND
+                                : static_cast<size_t>(field - fields.cbegin());
+}
+
+Shape *Shape::with_field(Symbol name) {
+  auto &transition = transitions[name];
+  if (transition == nullptr) {
+    transition = std::make_unique<Shape>();
+    transition->fields = fields;
+    transition->fields.push_back(name);
+  }
+  return transition.get();
+}
+
+std::ostream &operator<<(std::ostream &os, const PropertyCache &) {
+  return os;
+}
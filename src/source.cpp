@@ -0,0 +1,94 @@
+#include "source.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <utility>
+
+std::optional<SourceFile> SourceFile::map(const std::string &filename) {
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  struct stat status {};
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    return std::nullopt;
+  }
+  if (!S_ISREG(status.st_mode)) {
+    return read(fd);
+  }
+
+  const auto size = static_cast<size_t>(status.st_size);
+  if (size == 0) {
+    // Empty mappings are not allowed
+    close(fd);
+    return SourceFile{nullptr, 0};
+  }
+
+  void *memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (memory == MAP_FAILED) {
+    return read(fd);
+  }
+  // The mapping stays valid without the descriptor
+  close(fd);
+  // The lexer reads the whole file front to back
+  madvise(memory, size, MADV_SEQUENTIAL);
+
+  return SourceFile{static_cast<const char *>(memory), size};
+}
+
+std::optional<SourceFile> SourceFile::read(int fd) {
+  constexpr size_t CHUNK_SIZE = 64 * 1024;
+  std::vector<char> text;
+  while (true) {
+    const auto old_size = text.size();
+    text.resize(old_size + CHUNK_SIZE);
+    const auto count = ::read(fd, text.data() + old_size, CHUNK_SIZE);
+    if (count < 0 && errno == EINTR) {
+      text.resize(old_size);
+      continue;
+    }
+    if (count < 0) {
+      close(fd);
+      return std::nullopt;
+    }
+    text.resize(old_size + static_cast<size_t>(count));
+    if (count == 0) {
+      break;
+    }
+  }
+  close(fd);
+  if (text.empty()) {
+    return SourceFile{nullptr, 0};
+  }
+  return SourceFile{std::move(text)};
+}
+
+SourceFile::SourceFile(const char *_data, size_t _size)
+    : data(_data), size(_size) {}
+
+SourceFile::SourceFile(std::vector<char> &&_buffer)
+    : data(_buffer.data()), size(_buffer.size()), buffer(std::move(_buffer)) {}
+
+SourceFile::SourceFile(SourceFile &&other) noexcept
+    : data(std::exchange(other.data, nullptr)),
+      size(std::exchange(other.size, 0)), buffer(std::move(other.buffer)) {}
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept {
+  std::swap(data, other.data);
+  std::swap(size, other.size);
+  std::swap(buffer, other.buffer);
+  return *this;
+}
+
+SourceFile::~SourceFile() {
+  if (data != nullptr && buffer.empty()) {
+    // NOLINTNEXTLINE: cppcoreguidelines-pro-type-const-cast
+    munmap(const_cast<char *>(data), size);
+  }
+}
@@ -26,6 +26,11 @@ std::ostream &operator<<(std::ostream &os, FunctionKind kind) {
   return os << str(kind);
 }
 
+bool has_receiver(FunctionKind kind) {
+  return kind == FunctionKind::METHOD || kind == FunctionKind::CONSTRUCTOR ||
+         kind == FunctionKind::GETTER;
+}
+
 std::ostream &operator<<(std::ostream &os, const Statement &rhs) {
   rhs.print(os);
   return os;
@@ -0,0 +1,51 @@
+#include "symbol.hpp"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+/// Hashes strings and string_views alike, so names are looked up without
+/// copying them into a string first
+struct NameHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view name) const {
+    return std::hash<std::string_view>{}(name);
+  }
+};
+
+struct Interner {
+  std::mutex mutex;
+  // Node-based, so the interned strings never move
+  std::unordered_set<std::string, NameHash, std::equal_to<>> strings;
+};
+
+Interner &interner() {
+  // Never destroyed, so Symbols stay valid during static destruction
+  static auto *instance = new Interner;
+  return *instance;
+}
+
+const std::string &empty_string() {
+  static const std::string empty;
+  return empty;
+}
+} // namespace
+
+Symbol::Symbol(std::string_view name) {
+  auto &table = interner();
+  const std::lock_guard lock{table.mutex};
+  // Most names were interned before, so they are only copied when new
+  auto interned = table.strings.find(name);
+  if (interned == table.strings.end()) {
+    interned = table.strings.emplace(name).first;
+  }
+  string = &*interned;
+}
+
+const std::string &Symbol::str() const {
+  return string != nullptr ? *string : empty_string();
+}
+
+std::ostream &operator<<(std::ostream &os, Symbol symbol) {
+  return os << symbol.str();
+}
@@ -0,0 +1,182 @@
+#include "task.hpp"
+
+#include <algorithm>
+
+#include "array.hpp"
+#include "native_stack.hpp"
+
+namespace {
+// Set on the threads of a Scheduler, to the worker they run
+thread_local const Scheduler *current_scheduler = nullptr;
+thread_local size_t current_worker = 0;
+} // namespace
+
+std::optional<Message> to_message(const Value &value) {
+  if (value.is_nil()) {
+    return NullType{};
+  }
+  if (value.is_bool()) {
+    return value.as_bool();
+  }
+  if (value.is_number()) {
+    return value.as_number();
+  }
+  if (value.is_string()) {
+    return value.as<ObjString>()->chars();
+  }
+  if (value.is_obj_type(Obj::Type::ARRAY)) {
+    return value.as<ObjArray>()->elements;
+  }
+  return std::nullopt;
+}
+
+Value from_message(const Message &message) {
+  if (const auto *boolean = std::get_if<bool>(&message)) {
+    return *boolean;
+  }
+  if (const auto *number = std::get_if<double>(&message)) {
+    return *number;
+  }
+  if (const auto *string = std::get_if<std::string>(&message)) {
+    return make_string(*string);
+  }
+  if (const auto *elements = std::get_if<std::vector<double>>(&message)) {
+    return make_array(*elements);
+  }
+  return NullType{};
+}
+
+void TaskState::run(const std::function<Message()> &task) {
+  Message task_result;
+  std::exception_ptr task_error;
+  try {
+    task_result = task();
+  } catch (...) {
+    task_error = std::current_exception();
+  }
+
+  const std::lock_guard lock{mutex};
+  result = std::move(task_result);
+  error = std::move(task_error);
+  done = true;
+  finished.notify_all();
+}
+
+const Message &TaskState::wait() {
+  std::unique_lock lock{mutex};
+  finished.wait(lock, [this] { return done; });
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return result;
+}
+
+ObjFuture::ObjFuture(std::shared_ptr<TaskState> _state)
+    : Obj(Type::FUTURE), state(std::move(_state)) {}
+
+std::string ObjFuture::to_string() const { return "<future>"; }
+
+void TaskGroup::add() {
+  const std::lock_guard lock{mutex};
+  ++running;
+}
+
+void TaskGroup::finish() {
+  // Notified while locked, since the group may be destroyed right after
+  const std::lock_guard lock{mutex};
+  if (--running == 0) {
+    idle.notify_all();
+  }
+}
+
+void TaskGroup::wait() {
+  std::unique_lock lock{mutex};
+  idle.wait(lock, [this] { return running == 0; });
+}
+
+Scheduler::Scheduler(size_t worker_count) {
+  worker_count = std::max<size_t>(worker_count, 1);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < worker_count; ++i) {
+    threads.emplace_back([this, i] {
+      NativeStack::run(STACK_SIZE, [this, i](size_t) { work(i); });
+    });
+  }
+}
+
+Scheduler::~Scheduler() {
+  {
+    const std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  queued_task.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void Scheduler::submit(std::function<void()> task) {
+  const auto index = current_scheduler == this
+                         ? current_worker
+                         : next_worker++ % workers.size();
+  {
+    auto &worker = *workers[index];
+    const std::lock_guard lock{worker.mutex};
+    worker.tasks.push_back(std::move(task));
+  }
+  {
+    const std::lock_guard lock{mutex};
+    ++queued;
+  }
+  queued_task.notify_one();
+}
+
+Scheduler &Scheduler::shared() {
+  static Scheduler scheduler{std::thread::hardware_concurrency()};
+  return scheduler;
+}
+
+void Scheduler::work(size_t index) {
+  current_scheduler = this;
+  current_worker = index;
+
+  while (true) {
+    {
+      std::unique_lock lock{mutex};
+      queued_task.wait(lock, [this] { return stopping || queued > 0; });
+      // Queued tasks are dropped. Nothing can await them anymore
+      if (stopping) {
+        return;
+      }
+      --queued;
+    }
+    take(index)();
+  }
+}
+
+std::function<void()> Scheduler::take(size_t index) {
+  // Every claimed task is in some queue, but it may be taken from a queue
+  // that was already looked at. So look until it is found
+  while (true) {
+    {
+      auto &own = *workers[index];
+      const std::lock_guard lock{own.mutex};
+      if (!own.tasks.empty()) {
+        auto task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return task;
+      }
+    }
+    for (size_t i = 1; i < workers.size(); ++i) {
+      auto &victim = *workers[(index + i) % workers.size()];
+      const std::lock_guard lock{victim.mutex};
+      if (!victim.tasks.empty()) {
+        auto task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return task;
+      }
+    }
+  }
+}
@@ -3,14 +3,20 @@
 #include <cassert>
 #include <cmath>
 
-#include "callable.hpp"
 #include "error.hpp"
-#include "instance.hpp"
 
-Token::Token(TokenType _type, std::string _lexeme, Value _value,
+namespace {
+bool is_name(Token::TokenType type) {
+  using enum Token::TokenType;
+  return type == IDENTIFIER || type == THIS || type == SUPER;
+}
+} // namespace
+
+Token::Token(TokenType _type, std::string_view _lexeme, Value _value,
              unsigned int _line)
-    : type(_type), lexeme(std::move(_lexeme)), value(std::move(_value)),
-      line(_line) {}
+    : type(_type), lexeme(_lexeme),
+      symbol(is_name(type) ? Symbol(lexeme) : Symbol()),
+      value(std::move(_value)), line(_line) {}
 
 bool operator==(const NullType &, const NullType &) { return true; }
 bool operator!=(const NullType &, const NullType &) { return false; }
@@ -44,8 +50,6 @@ struct StringifyVisitor {
     }
     return std::to_string(num);
   }
-  std::string operator()(const CallablePtr &arg) { return arg->to_string(); }
-  std::string operator()(const InstancePtr &arg) { return arg->to_string(); }
 };
 
 std::string stringify(const Token::Value &arg) {
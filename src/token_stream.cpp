@@ -0,0 +1,40 @@
+#include "token_stream.hpp"
+
+#include <cassert>
+
+TokenStream::TokenStream(Lexer &_lexer) : lexer(&_lexer) {
+  ring[slot(current)].emplace(pull());
+}
+
+TokenStream::TokenStream(std::vector<Token> _tokens)
+    : tokens(std::move(_tokens)) {
+  assert(!tokens.empty() && tokens.back().type == Token::TokenType::EOF_ &&
+         "Lexed tokens must end with EOF_");
+  ring[slot(current)].emplace(pull());
+}
+
+Token TokenStream::pull() {
+  if (lexer != nullptr) {
+    return lexer->next_token();
+  }
+  return std::move(tokens[next_token++]);
+}
+
+const Token &TokenStream::peek() const { return *ring[slot(current)]; }
+
+const Token &TokenStream::previous() const {
+  assert(current > 0 && "No token consumed yet");
+  return *ring[slot(current - 1)];
+}
+
+bool TokenStream::lexing_failed() const {
+  return lexer != nullptr && lexer->has_error();
+}
+
+void TokenStream::advance() {
+  if (peek().type == Token::TokenType::EOF_) {
+    return;
+  }
+  ++current;
+  ring[slot(current)].emplace(pull());
+}
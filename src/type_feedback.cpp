@@ -0,0 +1,97 @@
+#include "type_feedback.hpp"
+
+using Type = Token::TokenType;
+
+namespace {
+/// The specialized version of op for the operand types, if it has one
+Quickened specialize(Type op, bool is_unary, OperandTypes types) {
+  if (is_unary) {
+    return op == Type::MINUS && types == OperandTypes::NUMBERS
+               ? Quickened::NUMBER_NEGATE
+               : Quickened::GENERIC;
+  }
+  if (types == OperandTypes::NUMBERS) {
+    switch (op) {
+    case Type::PLUS:
+      return Quickened::NUMBER_ADD;
+    case Type::MINUS:
+      return Quickened::NUMBER_SUBTRACT;
+    case Type::STAR:
+      return Quickened::NUMBER_MULTIPLY;
+    case Type::SLASH:
+      return Quickened::NUMBER_DIVIDE;
+    case Type::GREATER:
+      return Quickened::NUMBER_GREATER;
+    case Type::GREATER_EQUAL:
+      return Quickened::NUMBER_GREATER_EQUAL;
+    case Type::LESS:
+      return Quickened::NUMBER_LESS;
+    case Type::LESS_EQUAL:
+      return Quickened::NUMBER_LESS_EQUAL;
+    case Type::EQUAL_EQUAL:
+      return Quickened::NUMBER_EQUAL;
+    case Type::BANG_EQUAL:
+      return Quickened::NUMBER_NOT_EQUAL;
+    default:
+      return Quickened::GENERIC;
+    }
+  }
+  if (types == OperandTypes::STRINGS) {
+    switch (op) {
+    case Type::PLUS:
+      return Quickened::STRING_CONCATENATE;
+    case Type::GREATER:
+      return Quickened::STRING_GREATER;
+    case Type::GREATER_EQUAL:
+      return Quickened::STRING_GREATER_EQUAL;
+    case Type::LESS:
+      return Quickened::STRING_LESS;
+    case Type::LESS_EQUAL:
+      return Quickened::STRING_LESS_EQUAL;
+    default:
+      return Quickened::GENERIC;
+    }
+  }
+  return Quickened::GENERIC;
+}
+} // namespace
+
+bool TypeFeedback::record(Type op, bool is_unary, OperandTypes types) {
+  auto current = state.load(std::memory_order_relaxed);
+  if (current.deoptimizations == MAX_DEOPTIMIZATIONS) {
+    return false;
+  }
+  if (current.types != types) {
+    current.types = types;
+    current.observations = 0;
+  } else if (current.observations == STABLE_OBSERVATIONS) {
+    // Stable, but without a specialized version
+    return false;
+  }
+
+  const bool stable = ++current.observations == STABLE_OBSERVATIONS;
+  if (stable) {
+    current.quickened = specialize(op, is_unary, types);
+  }
+  state.store(current, std::memory_order_relaxed);
+  return stable && current.quickened != Quickened::GENERIC;
+}
+
+void TypeFeedback::set_constant_right() {
+  auto current = state.load(std::memory_order_relaxed);
+  current.constant_right = true;
+  state.store(current, std::memory_order_relaxed);
+}
+
+void TypeFeedback::deoptimize() {
+  auto current = state.load(std::memory_order_relaxed);
+  current.quickened = Quickened::GENERIC;
+  current.observations = 0;
+  ++current.deoptimizations;
+  current.constant_right = false;
+  state.store(current, std::memory_order_relaxed);
+}
+
+std::ostream &operator<<(std::ostream &os, const TypeFeedback &) {
+  return os;
+}
@@ -0,0 +1,172 @@
+#include "value.hpp"
+
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+bool operator==(const Value &lhs, const Value &rhs) {
+  if (lhs.is_number() && rhs.is_number()) {
+    return lhs.as_number() == rhs.as_number();
+  }
+  if (lhs.is_string() && rhs.is_string()) {
+    const auto *lhs_string = lhs.as<ObjString>();
+    const auto *rhs_string = rhs.as<ObjString>();
+    if (lhs_string == rhs_string) {
+      return true;
+    }
+    if (lhs_string->symbol && rhs_string->symbol) {
+      return false; // Different interned strings
+    }
+    return lhs_string->size() == rhs_string->size() &&
+           lhs_string->chars() == rhs_string->chars();
+  }
+  // Remaining values are equal exactly if they have the same representation.
+  // This is identity for objects.
+  if (lhs.is_obj() && rhs.is_obj()) {
+    return lhs.as_obj() == rhs.as_obj();
+  }
+  if (lhs.is_bool() && rhs.is_bool()) {
+    return lhs.as_bool() == rhs.as_bool();
+  }
+  return lhs.is_nil() && rhs.is_nil();
+}
+
+bool operator!=(const Value &lhs, const Value &rhs) { return !(lhs == rhs); }
+
+size_t std::hash<Value>::operator()(const Value &value) const noexcept {
+  if (value.is_number()) {
+    // 0 and -0 are equal
+    return value.as_number() == 0 ? 0 : std::hash<uint64_t>{}(value.bits);
+  }
+  if (value.is_string()) {
+    return std::hash<std::string_view>{}(value.as<ObjString>()->chars());
+  }
+  return std::hash<uint64_t>{}(value.bits);
+}
+
+std::string stringify(const Value &value) {
+  if (value.is_number()) {
+    return stringify(Token::Value{value.as_number()});
+  }
+  if (value.is_bool()) {
+    return stringify(Token::Value{value.as_bool()});
+  }
+  if (value.is_obj()) {
+    return value.as_obj()->to_string();
+  }
+  return stringify(Token::Value{NullType{}});
+}
+
+std::ostream &operator<<(std::ostream &os, const Value &value) {
+  if (value.is_string()) {
+    // Without copying the characters
+    return os << value.as<ObjString>()->chars();
+  }
+  return os << stringify(value);
+}
+
+ObjString::ObjString(std::string _chars, Symbol _symbol)
+    : Obj(Type::STRING), symbol(_symbol), flat(std::move(_chars)),
+      length(flat.size()) {}
+
+ObjString::ObjString(Ref<ObjString> _left, Ref<ObjString> _right)
+    : Obj(Type::STRING), left(std::move(_left)), right(std::move(_right)),
+      length(left->size() + right->size()) {}
+
+// Ropes built by appending in a loop are as deep as the number of appends.
+// Parts that are only referenced by their rope are released iteratively
+// instead of recursively, so this doesn't overflow the stack
+ObjString::~ObjString() {
+  std::vector<Ref<ObjString>> parts;
+  parts.push_back(std::move(left));
+  parts.push_back(std::move(right));
+
+  while (!parts.empty()) {
+    auto part = std::move(parts.back());
+    parts.pop_back();
+    if (part != nullptr && part->ref_count == 1) {
+      parts.push_back(std::move(part->left));
+      parts.push_back(std::move(part->right));
+    }
+  }
+}
+
+std::string ObjString::to_string() const { return chars(); }
+
+const std::string &ObjString::chars() const {
+  if (left != nullptr) {
+    flatten();
+  }
+  return flat;
+}
+
+void ObjString::flatten() const {
+  GC::grow(*this, length);
+  flat.reserve(length);
+
+  // Depth first, left to right. Iterative for the same reason as the
+  // destructor
+  std::vector<const ObjString *> pending{right.get(), left.get()};
+  while (!pending.empty()) {
+    const auto *part = pending.back();
+    pending.pop_back();
+    if (part->left != nullptr) {
+      pending.push_back(part->right.get());
+      pending.push_back(part->left.get());
+    } else {
+      flat += part->flat;
+    }
+  }
+
+  left = nullptr;
+  right = nullptr;
+}
+
+Value make_string(std::string chars) {
+  return make_obj<ObjString>(std::move(chars));
+}
+
+namespace {
+Ref<ObjString> as_string(const Value &value) {
+  if (value.is_string()) {
+    return Ref<ObjString>(value.as<ObjString>());
+  }
+  return make_obj<ObjString>(stringify(value));
+}
+} // namespace
+
+Value concatenate(const Value &left, const Value &right) {
+  auto lhs = as_string(left);
+  auto rhs = as_string(right);
+  if (lhs->size() + rhs->size() < ObjString::MIN_ROPE_LENGTH) {
+    return make_string(lhs->chars() + rhs->chars());
+  }
+  return make_obj<ObjString>(std::move(lhs), std::move(rhs));
+}
+
+Value intern_string(Symbol symbol) {
+  static std::mutex mutex;
+  // Never destroyed, so the interned strings outlive all values
+  static auto *strings = new std::unordered_map<Symbol, ObjString *>;
+
+  const std::lock_guard lock{mutex};
+  auto &string = (*strings)[symbol];
+  if (string == nullptr) {
+    string = new ObjString(symbol.str(), symbol);
+    string->ref_count = Obj::IMMORTAL;
+  }
+  return Value(string);
+}
+
+Value from_literal(const Token::Value &literal) {
+  if (const auto *number = std::get_if<double>(&literal)) {
+    return *number;
+  }
+  if (const auto *string = std::get_if<std::string>(&literal)) {
+    return intern_string(Symbol(*string));
+  }
+  if (const auto *boolean = std::get_if<bool>(&literal)) {
+    return *boolean;
+  }
+  return NullType{};
+}
@@ -0,0 +1,1135 @@
+#include "vm.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <limits>
+
+#include "array.hpp"
+#include "buildin.hpp"
+#include "callable.hpp"
+#include "compiler.hpp"
+#include "gc.hpp"
+#include "lexer.hpp"
+#include "logging.hpp"
+#include "memo_cache.hpp"
+#include "native_stack.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "task.hpp"
+
+namespace {
+const Symbol init_symbol{"init"};
+
+/// An error of the instruction being executed, like a type error of its
+/// operands. It is reported at the token the instruction was compiled from
+struct InstructionError : RuntimeError {
+  explicit InstructionError(const std::string &msg)
+      : RuntimeError(msg), message(msg) {}
+
+  const std::string message;
+};
+
+/// The function of value, if value can run as a task. That are pure closures
+/// without a receiver. A memoized function runs without its cache
+const ObjFunction *task_function(const Value &value) {
+  const auto &closure =
+      value.is_obj_type(Obj::Type::NATIVE) ? value.as<ObjNative>()->wrapped
+                                           : value;
+  if (!closure.is_obj_type(Obj::Type::CLOSURE)) {
+    return nullptr;
+  }
+  const auto &function = *closure.as<ObjClosure>()->function;
+  if (!function.is_pure || function.upvalue_count != 0 ||
+      (function.kind != FunctionKind::FUNCTION &&
+       function.kind != FunctionKind::LAMDBDA)) {
+    return nullptr;
+  }
+  return &function;
+}
+
+/// Copy of a compiled function that shares no objects with it, except the
+/// immortal interned strings. So it can be handed to another thread
+Ref<ObjFunction> copy_function(const ObjFunction &function) {
+  auto copy = make_obj<ObjFunction>(function.name, function.kind);
+  copy->arity = function.arity;
+  copy->upvalue_count = function.upvalue_count;
+  copy->is_pure = function.is_pure;
+  copy->chunk.code = function.chunk.code;
+  copy->chunk.lines = function.chunk.lines;
+  copy->chunk.lexemes = function.chunk.lexemes;
+  copy->chunk.local_names = function.chunk.local_names;
+
+  copy->chunk.constants.reserve(function.chunk.constants.size());
+  for (const auto &constant : function.chunk.constants) {
+    if (constant.is_obj_type(Obj::Type::FUNCTION)) {
+      copy->chunk.constants.emplace_back(
+          copy_function(*constant.as<ObjFunction>()));
+    } else if (constant.is_string() && !constant.as<ObjString>()->symbol) {
+      copy->chunk.constants.push_back(
+          make_string(constant.as<ObjString>()->chars()));
+    } else {
+      copy->chunk.constants.push_back(constant);
+    }
+  }
+  return copy;
+}
+} // namespace
+
+VM::VM(std::ostream &_os, std::shared_ptr<ErrorHandler> _err_handler)
+    : out_stream(_os), err_handler(std::move(_err_handler)),
+      host(out_stream, err_handler) {
+  set_max_call_depth(Interpreter::DEFAULT_MAX_CALL_DEPTH);
+  define_buildins();
+}
+
+void VM::set_max_call_depth(size_t depth) {
+  frames.resize(depth);
+  // A single frame may still use all of its slots
+  stack_size = depth * AVERAGE_FRAME_SLOTS + FRAME_SLOTS;
+  stack = std::make_unique<Value[]>(stack_size);
+  stack_top = stack.get();
+}
+
+VM::~VM() {
+  // Upvalues may still point into the stack if execution was aborted
+  close_upvalues(stack.get());
+}
+
+uint16_t VM::global_slot(Symbol name) {
+  if (const auto it = global_slots.find(name); it != global_slots.cend()) {
+    return it->second;
+  }
+  if (globals.size() >= MAX_GLOBALS) {
+    throw CompiletimeError(NullType{}, "Too many global variables.", 0);
+  }
+  const auto slot = static_cast<uint16_t>(globals.size());
+  globals.push_back(Global{name.str(), Value{}});
+  global_slots.emplace(name, slot);
+  return slot;
+}
+
+bool VM::has_global(Symbol name) const { return global_slots.contains(name); }
+
+size_t VM::global_count() const { return globals.size(); }
+
+std::vector<std::string> VM::global_names() const {
+  std::vector<std::string> names;
+  names.reserve(globals.size());
+  for (const auto &global : globals) {
+    names.push_back(global.name);
+  }
+  return names;
+}
+
+void VM::define_native(const std::string &name, size_t arity,
+                       ObjNative::Fn fn) {
+  auto &global = globals[global_slot(Symbol(name))];
+  global.value = make_obj<ObjNative>(name, arity, std::move(fn)).get();
+  global.defined = true;
+}
+
+void VM::define_buildins() {
+  for (auto &[name, callable] : Buildin::get_buildins()) {
+    if (name == "eval" || name == "printEnv" || name == "map" ||
+        name == "memoize" || name == "spawn") {
+      // These need access to the VM state, see below. Their slots are taken
+      // here, so the globals are in the same order as the tree-walker's
+      global_slot(Symbol(name));
+      continue;
+    }
+
+    const auto arity = callable->arity();
+    define_native(name, arity,
+                  [callable = std::move(callable),
+                   arity](VM &vm, const Value *arguments) {
+                    return callable->call(
+                        vm.host, std::vector<Value>(arguments,
+                                                    arguments + arity));
+                  });
+  }
+
+  define_native("eval", 1, [](VM &vm, const Value *arguments) -> Value {
+    if (!arguments[0].is_string()) {
+      throw RuntimeError(
+          stringify(arguments[0]),
+          "eval()'s first argument must be a string containing the source "
+          "code",
+          0);
+    }
+
+    const auto &source = arguments[0].as<ObjString>()->chars();
+    if (const auto cached = vm.eval_scripts.find(source);
+        cached != vm.eval_scripts.cend()) {
+      // Copied, since the script may evaluate sources that replace it
+      const auto script = cached->second;
+      vm.interpret(script);
+      return vm.last_value;
+    }
+
+    Lexer lexer{source, vm.err_handler};
+
+    // The AST is only needed until it is compiled
+    Arena arena;
+    Parser parser{lexer, arena, vm.err_handler};
+    auto statements = parser.parse();
+    if (vm.err_handler->has_error()) {
+      return NullType{};
+    }
+
+    Resolver resolver{vm.host};
+    resolver.resolve(statements);
+    if (vm.err_handler->has_error()) {
+      return NullType{};
+    }
+
+    Optimizer optimizer{arena};
+    optimizer.optimize(statements);
+
+    Compiler compiler{vm, vm.err_handler};
+    const auto script = compiler.compile(statements);
+    if (!script) {
+      return NullType{};
+    }
+
+    if (vm.eval_scripts.size() < MAX_EVAL_SCRIPTS) {
+      vm.eval_scripts.emplace(source, script);
+    }
+    vm.interpret(script);
+    return vm.last_value;
+  });
+
+  define_native("map", 2, [](VM &vm, const Value *arguments) -> Value {
+    if (!arguments[0].is_obj_type(Obj::Type::ARRAY)) {
+      throw RuntimeError(stringify(arguments[0]), "must be an array", 0);
+    }
+    const Ref<ObjArray> array{arguments[0].as<ObjArray>()};
+    const auto function = arguments[1];
+
+    std::vector<double> mapped;
+    mapped.reserve(array->elements.size());
+    // The function may change the array, so elements are read by index
+    for (size_t i = 0; i < array->elements.size(); ++i) {
+      const Value element = array->elements[i];
+      const auto result = vm.call_to_completion(function, &element, 1);
+      if (!result.is_number()) {
+        throw RuntimeError(stringify(result), "must be a number", 0);
+      }
+      mapped.push_back(result.as_number());
+    }
+    return make_array(std::move(mapped));
+  });
+
+  define_native("memoize", 1, [](VM &, const Value *arguments) -> Value {
+    if (!arguments[0].is_obj_type(Obj::Type::CLOSURE) ||
+        !arguments[0].as<ObjClosure>()->function->is_pure) {
+      throw RuntimeError(stringify(arguments[0]), "must be a pure function",
+                         0);
+    }
+    const auto closure = arguments[0];
+    const auto &function = *closure.as<ObjClosure>()->function;
+    const auto arity = function.arity;
+    auto cache = std::make_shared<MemoCache>();
+
+    return make_obj<ObjNative>(
+        "memoized " + function.name, arity,
+        [closure, arity, cache](VM &vm, const Value *arguments) -> Value {
+          std::vector<Value> key(arguments, arguments + arity);
+          if (const auto *result = cache->find(key)) {
+            return *result;
+          }
+          auto result = vm.call_to_completion(
+              closure, key.data(), static_cast<uint8_t>(arity));
+          cache->insert(std::move(key), result);
+          return result;
+        },
+        closure);
+  });
+
+  // Like the tree-walker's spawn(), but the task gets a VM of its own with
+  // copies of the compiled functions
+  define_native("spawn", 2, [](VM &vm, const Value *arguments) -> Value {
+    const auto *function = task_function(arguments[0]);
+    if (function == nullptr || function->arity != 1) {
+      throw RuntimeError(stringify(arguments[0]),
+                         "must be a pure function with one parameter", 0);
+    }
+    auto argument = to_message(arguments[1]);
+    if (!argument.has_value()) {
+      throw RuntimeError(stringify(arguments[1]),
+                         "can't be passed to a task. Only nil, booleans, "
+                         "numbers, strings and arrays can",
+                         0);
+    }
+
+    // The compiled code refers to globals by slot, so the task's VM gets the
+    // same slots
+    std::vector<std::string> names;
+    std::vector<std::pair<size_t, Ref<ObjFunction>>> functions;
+    names.reserve(vm.globals.size());
+    for (size_t slot = 0; slot < vm.globals.size(); ++slot) {
+      names.push_back(vm.globals[slot].name);
+      if (const auto *global = task_function(vm.globals[slot].value)) {
+        functions.emplace_back(slot, copy_function(*global));
+      }
+    }
+
+    auto state = std::make_shared<TaskState>();
+    Scheduler::shared().submit([function = copy_function(*function),
+                                names = std::move(names),
+                                functions = std::move(functions),
+                                argument = std::move(*argument), state,
+                                limit = GC::current_heap().limit] {
+      state->run([&]() -> Message {
+        GC::Heap heap;
+        const GC::HeapScope heap_scope{heap};
+
+        // Pure functions don't print, and errors are thrown to await()
+        std::ostream sink{nullptr};
+        VM worker{sink, std::make_shared<StreamErrorHandler>(sink)};
+        heap.limit = limit;
+        for (size_t slot = 0; slot < names.size(); ++slot) {
+          [[maybe_unused]] const auto worker_slot =
+              worker.global_slot(Symbol(names[slot]));
+          assert(worker_slot == slot && "Globals of the task don't match");
+        }
+        for (const auto &[slot, global] : functions) {
+          worker.globals[slot].value = make_obj<ObjClosure>(global).get();
+          worker.globals[slot].defined = true;
+        }
+
+        const Value closure = make_obj<ObjClosure>(function).get();
+        const auto task_argument = from_message(argument);
+        const auto result =
+            worker.call_to_completion(closure, &task_argument, 1);
+        auto message = to_message(result);
+        if (!message.has_value()) {
+          throw RuntimeError(stringify(result),
+                             "can't be returned from a task", 0);
+        }
+        return std::move(*message);
+      });
+    });
+    return make_obj<ObjFuture>(std::move(state));
+  });
+
+  define_native("printEnv", 0, [](VM &vm, const Value *) -> Value {
+    const auto print_globals = [&vm]() {
+      for (const auto &global : vm.globals) {
+        if (global.defined) {
+          vm.out_stream << global.name << ": " << global.value << ", ";
+        }
+      }
+    };
+    vm.out_stream << "Globals: \n{";
+    print_globals();
+    vm.out_stream << "}" << std::endl;
+
+    // The caller's locals that are in scope at the call, in declaration order
+    vm.out_stream << "Locals: \n{";
+    const auto &caller = vm.frames[vm.frame_count - 1];
+    const auto &function = *caller.closure->function;
+    const auto position =
+        static_cast<size_t>(caller.ip - function.chunk.code.data());
+    bool has_locals = false;
+    for (const auto &local : function.chunk.local_names) {
+      if (local.start <= position && position < local.end &&
+          local.name != "super") {
+        vm.out_stream << local.name << ": " << caller.slots[local.slot] << ", ";
+        has_locals = true;
+      }
+    }
+    // Outside of blocks in a script, the globals are its locals, like on the
+    // tree-walker
+    if (!has_locals && function.name.empty() &&
+        function.kind == FunctionKind::FUNCTION) {
+      print_globals();
+    }
+    vm.out_stream << "}" << std::endl;
+    return NullType{};
+  });
+}
+
+void VM::interpret(const Ref<ObjFunction> &script) {
+  if (max_nested_runs != 0) {
+    execute(script);
+    return;
+  }
+
+  // Natives that call back into Lox nest native frames, up to once per call.
+  // Running on a stack for that many nested runs lifts the bound of the
+  // current stack
+  NativeStack::run(frames.size() * Interpreter::NATIVE_STACK_PER_CALL,
+                   [&](size_t stack_size) {
+                     max_nested_runs = std::max<size_t>(
+                         stack_size / Interpreter::NATIVE_STACK_PER_CALL, 1);
+                     try {
+                       execute(script);
+                     } catch (...) {
+                       max_nested_runs = 0;
+                       throw;
+                     }
+                     max_nested_runs = 0;
+                   });
+}
+
+void VM::execute(const Ref<ObjFunction> &script) {
+  const auto base_frame = frame_count;
+  auto *const base_top = stack_top;
+
+  try {
+    auto closure = make_obj<ObjClosure>(script);
+    push(closure.get());
+    call(closure.get(), 0);
+    run(base_frame);
+    pop(); // The script's return value
+  } catch (const RuntimeError &err) {
+    const auto error_line = err.token.line != 0 ? err.token.line
+                                                : current_line();
+    err_handler->runtime_error(error_line, err.what());
+
+    close_upvalues(base_top);
+    pop_until(base_top);
+    frame_count = base_frame;
+  }
+}
+
+Value VM::import_module(const std::string &path) {
+  const Token token{Token::TokenType::STRING, path, path, current_line()};
+  auto file = host.module_path(token);
+  if (const auto module = modules.find(file); module != modules.cend()) {
+    if (module->second.is_nil()) {
+      throw RuntimeError(token, "Circular import of the module " + file);
+    }
+    return module->second;
+  }
+
+  // The AST is only needed until it is compiled
+  Ref<ObjFunction> script;
+  if (const auto program = host.parse_module(file)) {
+    Compiler compiler{*this, err_handler};
+    script = compiler.compile_module(program->statements, file);
+  }
+  if (!script) {
+    throw RuntimeError(token, "Cannot load the module " + file);
+  }
+
+  // Paths in the module are relative to its file
+  auto enclosing_path =
+      std::exchange(host.interpreter_path,
+                    std::filesystem::path(file).parent_path().string());
+  modules.emplace(file, NullType{});
+  Value module;
+  try {
+    const auto closure = make_obj<ObjClosure>(script);
+    module = call_to_completion(closure.get(), nullptr, 0);
+  } catch (...) {
+    // Importing it again runs it again
+    modules.erase(file);
+    host.interpreter_path = std::move(enclosing_path);
+    throw;
+  }
+  host.interpreter_path = std::move(enclosing_path);
+  return modules[file] = module;
+}
+
+void VM::pop_until(Value *new_top) {
+  while (stack_top > new_top) {
+    *--stack_top = Value{};
+  }
+}
+
+unsigned int VM::current_line() const {
+  if (frame_count == 0) {
+    return 0;
+  }
+  const auto &frame = frames[frame_count - 1];
+  const auto &chunk = frame.closure->function->chunk;
+  const auto offset = static_cast<size_t>(frame.ip - chunk.code.data());
+  return chunk.lines[offset == 0 ? 0 : offset - 1];
+}
+
+RuntimeError VM::instruction_error(const std::string &message) const {
+  if (frame_count == 0) {
+    return RuntimeError(message);
+  }
+  const auto &frame = frames[frame_count - 1];
+  const auto &chunk = frame.closure->function->chunk;
+  const auto offset = static_cast<size_t>(frame.ip - chunk.code.data());
+  const auto lexeme = chunk.lexeme_at(offset == 0 ? 0 : offset - 1);
+  if (lexeme.empty()) {
+    return RuntimeError(message);
+  }
+  return RuntimeError(
+      Token{Token::TokenType::NIL, lexeme, NullType{}, current_line()},
+      message);
+}
+
+//---------------------------------Calls--------------------------------------
+
+namespace {
+InstructionError arity_error(size_t expected, size_t got) {
+  return InstructionError("Expected " + std::to_string(expected) +
+                          " arguments but got " + std::to_string(got) + ".");
+}
+} // namespace
+
+void VM::call(ObjClosure *closure, uint8_t argc) {
+  // Calls are safe points: everything live is on the stack or in globals
+  GC::maybe_collect();
+
+  const auto &function = *closure->function;
+  if (argc != function.arity) {
+    throw arity_error(function.arity, argc);
+  }
+  if (frame_count == frames.size() ||
+      stack_top + FRAME_SLOTS >= stack.get() + stack_size) {
+    throw InstructionError(
+        "Maximum recursion depth reached. Are you recursing without basecase?");
+  }
+
+  frames[frame_count++] = CallFrame{closure, function.chunk.code.data(),
+                                    stack_top - argc - 1};
+}
+
+void VM::call_value(const Value &callee, uint8_t argc) {
+  if (callee.is_obj()) {
+    switch (callee.as_obj()->type) {
+    case Obj::Type::CLOSURE:
+      call(callee.as<ObjClosure>(), argc);
+      return;
+    case Obj::Type::NATIVE: {
+      const auto &native = *callee.as<ObjNative>();
+      if (argc != native.arity) {
+        throw arity_error(native.arity, argc);
+      }
+      auto result = native.function(*this, stack_top - argc);
+      pop_until(stack_top - argc - 1);
+      push(std::move(result));
+      return;
+    }
+    case Obj::Type::CLASS: {
+      Ref<ObjClass> klass{callee.as<ObjClass>()};
+      // The instance takes the place of the callee and becomes 'this'
+      peek(argc) = make_obj<ObjInstance>(klass).get();
+      if (auto *constructor = ObjClass::find(klass->methods, init_symbol)) {
+        call(constructor, argc);
+      } else if (argc != 0) {
+        throw arity_error(0, argc);
+      }
+      return;
+    }
+    case Obj::Type::CALLABLE: {
+      // Created by builtins shared with the tree-walker, like stringBuilder()
+      const Ref<Callable> callable{callee.as<Callable>()};
+      if (argc != callable->arity()) {
+        throw arity_error(callable->arity(), argc);
+      }
+      auto result =
+          callable->call(host, std::vector<Value>(stack_top - argc, stack_top));
+      pop_until(stack_top - argc - 1);
+      push(std::move(result));
+      return;
+    }
+    case Obj::Type::BOUND_METHOD: {
+      Ref<ObjBoundMethod> bound{callee.as<ObjBoundMethod>()};
+      peek(argc) = bound->receiver;
+      call(bound->method.get(), argc);
+      return;
+    }
+    default:
+      break;
+    }
+  }
+  throw InstructionError("Can only call functions and classes.");
+}
+
+void VM::call_getter(ObjClosure *getter) { call(getter, 0); }
+
+void VM::replace_caller_frame() {
+  auto &callee = frames[frame_count - 1];
+  auto &caller = frames[frame_count - 2];
+  close_upvalues(caller.slots);
+
+  // The callee hasn't run yet, so its slots are only the callee or receiver
+  // and the arguments
+  const auto slot_count = stack_top - callee.slots;
+  for (std::ptrdiff_t i = 0; i < slot_count; ++i) {
+    caller.slots[i] = std::move(callee.slots[i]);
+  }
+  pop_until(caller.slots + slot_count);
+
+  caller = CallFrame{callee.closure, callee.ip, caller.slots};
+  --frame_count;
+}
+
+Value VM::call_to_completion(const Value &callee, const Value *arguments,
+                             uint8_t argc) {
+  push(callee);
+  for (uint8_t i = 0; i < argc; ++i) {
+    push(arguments[i]);
+  }
+  const auto frames_before = frame_count;
+  call_value(peek(argc), argc);
+  // Natives have left their result already
+  if (frame_count > frames_before) {
+    run(frame_count - 1);
+  }
+  return pop();
+}
+
+void VM::invoke(Symbol name, uint8_t argc) {
+  const auto &receiver = peek(argc);
+  // Like in the tree-walker, failing to look up the method is an error at
+  // its name, and calling it one at the call's parenthesis
+  const auto lookup_error = [&](const std::string &message) {
+    return RuntimeError(Token{Token::TokenType::IDENTIFIER, name.str(),
+                              NullType{}, current_line()},
+                        message);
+  };
+
+  if (receiver.is_obj_type(Obj::Type::INSTANCE)) {
+    auto *instance = receiver.as<ObjInstance>();
+
+    if (auto *getter = ObjClass::find(instance->klass->getters, name)) {
+      // The getter's result is the callee. Run the getter to completion
+      // with a copy of the receiver, before the actual call
+      push(receiver);
+      call_getter(getter);
+      run(frame_count - 1);
+      auto callee = pop();
+      peek(argc) = std::move(callee);
+      call_value(peek(argc), argc);
+      return;
+    }
+
+    if (const auto field = instance->fields.find(name);
+        field != instance->fields.cend()) {
+      peek(argc) = field->second;
+      call_value(peek(argc), argc);
+      return;
+    }
+
+    if (auto *method = ObjClass::find(instance->klass->methods, name)) {
+      call(method, argc);
+      return;
+    }
+
+    throw lookup_error("Property " + name.str() + " is not defined");
+  }
+
+  if (receiver.is_obj_type(Obj::Type::CLASS)) {
+    auto *const klass = receiver.as<ObjClass>();
+    if (auto *unbound = ObjClass::find(klass->unbounds, name)) {
+      peek(argc) = unbound;
+      call(unbound, argc);
+      return;
+    }
+    throw lookup_error("Undefined unbound function.");
+  }
+
+  throw lookup_error(
+      "Can only access fields of objects or classes. Called with: " +
+      stringify(receiver));
+}
+
+//--------------------------------Upvalues------------------------------------
+
+ObjUpvalue *VM::capture_upvalue(Value *local) {
+  ObjUpvalue *previous = nullptr;
+  ObjUpvalue *upvalue = open_upvalues;
+  while (upvalue != nullptr && upvalue->location > local) {
+    previous = upvalue;
+    upvalue = upvalue->next_open;
+  }
+
+  if (upvalue != nullptr && upvalue->location == local) {
+    return upvalue;
+  }
+
+  // The list of open upvalues holds a reference until the upvalue is closed
+  auto *created = make_obj<ObjUpvalue>(local).release();
+  created->next_open = upvalue;
+  if (previous == nullptr) {
+    open_upvalues = created;
+  } else {
+    previous->next_open = created;
+  }
+  return created;
+}
+
+void VM::close_upvalues(const Value *last) {
+  while (open_upvalues != nullptr && open_upvalues->location >= last) {
+    auto *upvalue = open_upvalues;
+    upvalue->closed = std::move(*upvalue->location);
+    upvalue->location = &upvalue->closed;
+    open_upvalues = upvalue->next_open;
+    release(upvalue);
+  }
+}
+
+//------------------------------Execution loop--------------------------------
+
+namespace {
+void assert_numbers(const Value &lhs, const Value &rhs) {
+  if (!lhs.is_number() || !rhs.is_number()) {
+    throw InstructionError("Operands must be numbers");
+  }
+}
+
+/// Numbers compare numerically, strings lexicographically
+template <typename Compare>
+bool compare(const Value &lhs, const Value &rhs, Compare comparison) {
+  if (lhs.is_number() && rhs.is_number()) {
+    return comparison(lhs.as_number(), rhs.as_number());
+  }
+  if (lhs.is_string() && rhs.is_string()) {
+    return comparison(
+        lhs.as<ObjString>()->chars().compare(rhs.as<ObjString>()->chars()), 0);
+  }
+  throw InstructionError("Operands must all be numbers or strings");
+}
+
+/// Position of the indexed element in the array
+size_t checked_position(const Value &array, const Value &index) {
+  if (!array.is_obj_type(Obj::Type::ARRAY)) {
+    throw InstructionError("Can only index arrays");
+  }
+  const auto position = array.as<ObjArray>()->position(index);
+  if (!position.has_value()) {
+    throw InstructionError("Array index " + stringify(index) +
+                           " is not a whole number in range");
+  }
+  return *position;
+}
+} // namespace
+
+VM::NestedRun::NestedRun(VM &_vm) : vm(_vm) {
+  if (vm.max_nested_runs != 0 && vm.nested_runs == vm.max_nested_runs) {
+    throw InstructionError(
+        "Maximum recursion depth reached. Are you recursing without basecase?");
+  }
+  ++vm.nested_runs;
+}
+
+VM::NestedRun::~NestedRun() { --vm.nested_runs; }
+
+void VM::run(size_t base_frame) {
+  const NestedRun nested{*this};
+
+  CallFrame *frame = &frames[frame_count - 1];
+  const uint8_t *ip = frame->ip;
+
+  const auto read_byte = [&ip]() { return *ip++; };
+  const auto read_u16 = [&ip]() {
+    ip += 2;
+    return static_cast<uint16_t>((ip[-2] << 8U) | ip[-1]);
+  };
+  const auto read_constant = [&]() -> const Value & {
+    return frame->closure->function->chunk.constants[read_u16()];
+  };
+  const auto read_name = [&]() {
+    return read_constant().as<ObjString>()->symbol;
+  };
+  // Calls push a new frame, which has to be picked up afterwards
+  const auto save_frame = [&]() { frame->ip = ip; };
+  const auto load_frame = [&]() {
+    frame = &frames[frame_count - 1];
+    ip = frame->ip;
+  };
+
+  try {
+    while (true) {
+      const auto op = static_cast<OpCode>(read_byte());
+      switch (op) {
+      case OpCode::CONSTANT:
+        push(read_constant());
+        break;
+      case OpCode::NIL:
+        push(NullType{});
+        break;
+      case OpCode::TRUE:
+        push(true);
+        break;
+      case OpCode::FALSE:
+        push(false);
+        break;
+      case OpCode::POP:
+        pop();
+        break;
+      case OpCode::RESULT:
+        last_value = pop();
+        break;
+      case OpCode::GET_LOCAL:
+        push(frame->slots[read_byte()]);
+        break;
+      case OpCode::SET_LOCAL:
+        frame->slots[read_byte()] = peek(0);
+        break;
+      case OpCode::GET_GLOBAL: {
+        const auto &global = globals[read_u16()];
+        if (!global.defined) {
+          throw InstructionError("Cannot access undefined identifier '" +
+                                 global.name + "'.");
+        }
+        push(global.value);
+        break;
+      }
+      case OpCode::DEFINE_GLOBAL: {
+        auto &global = globals[read_u16()];
+        if (global.defined) {
+          throw InstructionError("Identifier '" + global.name +
+                                 "' is already defined in this scope.");
+        }
+        global.value = pop();
+        global.defined = true;
+        break;
+      }
+      case OpCode::DEFINE_MODULE: {
+        auto &global = globals[read_u16()];
+        if (global.defined && global.value == peek(0)) {
+          pop(); // Imported again
+          break;
+        }
+        if (global.defined) {
+          throw InstructionError("Identifier '" + global.name +
+                                 "' is already defined in this scope.");
+        }
+        global.value = pop();
+        global.defined = true;
+        break;
+      }
+      case OpCode::SET_GLOBAL: {
+        auto &global = globals[read_u16()];
+        if (!global.defined) {
+          throw InstructionError("Cannot assign to undefined identifier '" +
+                                 global.name + "'.");
+        }
+        global.value = peek(0);
+        break;
+      }
+      case OpCode::GET_UPVALUE:
+        push(*frame->closure->upvalues[read_byte()]->location);
+        break;
+      case OpCode::SET_UPVALUE:
+        *frame->closure->upvalues[read_byte()]->location = peek(0);
+        break;
+      case OpCode::GET_PROPERTY: {
+        const auto name = read_name();
+        auto &receiver = peek(0);
+
+        if (receiver.is_obj_type(Obj::Type::INSTANCE)) {
+          auto *instance = receiver.as<ObjInstance>();
+          if (auto *getter = ObjClass::find(instance->klass->getters, name)) {
+            save_frame();
+            call_getter(getter);
+            load_frame();
+          } else if (const auto field = instance->fields.find(name);
+                     field != instance->fields.cend()) {
+            receiver = field->second;
+          } else if (auto *method =
+                         ObjClass::find(instance->klass->methods, name)) {
+            receiver = make_obj<ObjBoundMethod>(receiver, Ref{method}).get();
+          } else {
+            throw InstructionError("Property " + name.str() +
+                                   " is not defined");
+          }
+        } else if (receiver.is_obj_type(Obj::Type::CLASS)) {
+          auto *unbound =
+              ObjClass::find(receiver.as<ObjClass>()->unbounds, name);
+          if (unbound == nullptr) {
+            throw InstructionError("Undefined unbound function.");
+          }
+          receiver = unbound;
+        } else {
+          throw InstructionError(
+              "Can only access fields of objects or classes. Called with: " +
+              stringify(receiver));
+        }
+        break;
+      }
+      case OpCode::SET_PROPERTY: {
+        const auto name = read_name();
+        const auto &object = peek(1);
+        if (!object.is_obj_type(Obj::Type::INSTANCE)) {
+          throw InstructionError("Can only set properties on objects");
+        }
+        auto *instance = object.as<ObjInstance>();
+        if (ObjClass::find(instance->klass->getters, name) != nullptr) {
+          throw InstructionError("A getter by this name exists. A property "
+                                 "of the same name would be inaccessible");
+        }
+        auto value = pop();
+        instance->fields.insert_or_assign(name, value);
+        peek(0) = std::move(value); // Leave the assigned value
+        break;
+      }
+      case OpCode::ARRAY: {
+        const auto count = read_byte();
+        std::vector<double> elements;
+        elements.reserve(count);
+        for (const auto *element = stack_top - count; element < stack_top;
+             ++element) {
+          if (!element->is_number()) {
+            throw InstructionError("Array elements must be numbers");
+          }
+          elements.push_back(element->as_number());
+        }
+        pop_until(stack_top - count);
+        push(make_array(std::move(elements)));
+        break;
+      }
+      case OpCode::GET_INDEX: {
+        const auto position = checked_position(peek(1), peek(0));
+        const auto element = peek(1).as<ObjArray>()->elements[position];
+        pop_until(stack_top - 2);
+        push(element);
+        break;
+      }
+      case OpCode::SET_INDEX: {
+        const auto position = checked_position(peek(2), peek(1));
+        if (!peek(0).is_number()) {
+          throw InstructionError("Array elements must be numbers");
+        }
+        const auto element = peek(0).as_number();
+        peek(2).as<ObjArray>()->elements[position] = element;
+        pop_until(stack_top - 3);
+        push(element); // Leave the assigned value
+        break;
+      }
+      case OpCode::GET_SUPER: {
+        const auto name = read_name();
+        const auto superclass = pop();
+        const auto &klass = *superclass.as<ObjClass>();
+        auto &receiver = peek(0);
+
+        if (auto *method = ObjClass::find(klass.methods, name)) {
+          receiver = make_obj<ObjBoundMethod>(receiver, Ref{method}).get();
+        } else if (auto *unbound = ObjClass::find(klass.unbounds, name)) {
+          receiver = unbound;
+        } else if (auto *getter = ObjClass::find(klass.getters, name)) {
+          save_frame();
+          call_getter(getter);
+          load_frame();
+        } else {
+          throw InstructionError("Undefined method or unbound function '" +
+                                 name.str() + "' on class '" + klass.name +
+                                 '.');
+        }
+        break;
+      }
+      case OpCode::GET_UNBOUND_SUPER: {
+        const auto name = read_name();
+        auto &superclass = peek(0);
+        auto *unbound =
+            ObjClass::find(superclass.as<ObjClass>()->unbounds, name);
+        if (unbound == nullptr) {
+          throw InstructionError(
+              "Undefined unbound method. You can only access unbound super "
+              "methods in an unbound submethod.");
+        }
+        superclass = unbound;
+        break;
+      }
+      case OpCode::EQUAL: {
+        const auto rhs = pop();
+        peek(0) = peek(0) == rhs;
+        break;
+      }
+      case OpCode::NOT_EQUAL: {
+        const auto rhs = pop();
+        peek(0) = peek(0) != rhs;
+        break;
+      }
+      case OpCode::GREATER: {
+        const auto rhs = pop();
+        peek(0) = compare(peek(0), rhs, std::greater<>{});
+        break;
+      }
+      case OpCode::GREATER_EQUAL: {
+        const auto rhs = pop();
+        peek(0) = compare(peek(0), rhs, std::greater_equal<>{});
+        break;
+      }
+      case OpCode::LESS: {
+        const auto rhs = pop();
+        peek(0) = compare(peek(0), rhs, std::less<>{});
+        break;
+      }
+      case OpCode::LESS_EQUAL: {
+        const auto rhs = pop();
+        peek(0) = compare(peek(0), rhs, std::less_equal<>{});
+        break;
+      }
+      case OpCode::ADD: {
+        const auto rhs = pop();
+        auto &lhs = peek(0);
+        if (lhs.is_number() && rhs.is_number()) {
+          lhs = lhs.as_number() + rhs.as_number();
+        } else if (lhs.is_string() || rhs.is_string()) {
+          lhs = concatenate(lhs, rhs);
+        } else {
+          throw InstructionError("Operands must all be numbers or strings");
+        }
+        break;
+      }
+      case OpCode::SUBTRACT: {
+        const auto rhs = pop();
+        auto &lhs = peek(0);
+        assert_numbers(lhs, rhs);
+        lhs = lhs.as_number() - rhs.as_number();
+        break;
+      }
+      case OpCode::MULTIPLY: {
+        const auto rhs = pop();
+        auto &lhs = peek(0);
+        assert_numbers(lhs, rhs);
+        lhs = lhs.as_number() * rhs.as_number();
+        break;
+      }
+      case OpCode::DIVIDE: {
+        const auto rhs = pop();
+        auto &lhs = peek(0);
+        assert_numbers(lhs, rhs);
+        if (rhs.as_number() == 0) {
+          throw InstructionError("Right operand of division must not be 0");
+        }
+        lhs = lhs.as_number() / rhs.as_number();
+        break;
+      }
+      case OpCode::NOT:
+        peek(0) = !peek(0).is_truthy();
+        break;
+      case OpCode::NEGATE:
+        if (!peek(0).is_number()) {
+          throw InstructionError("Operands must be numbers");
+        }
+        peek(0) = -peek(0).as_number();
+        break;
+      case OpCode::PRINT:
+        out_stream << pop() << '\n';
+        break;
+      case OpCode::JUMP:
+        ip += read_u16();
+        break;
+      case OpCode::JUMP_IF_FALSE: {
+        const auto offset = read_u16();
+        if (!peek(0).is_truthy()) {
+          ip += offset;
+        }
+        break;
+      }
+      case OpCode::LOOP: {
+        const auto offset = read_u16();
+        ip -= offset;
+        break;
+      }
+      case OpCode::CALL: {
+        const auto argc = read_byte();
+        save_frame();
+        call_value(peek(argc), argc);
+        load_frame();
+        break;
+      }
+      case OpCode::TAIL_CALL: {
+        const auto argc = read_byte();
+        const auto frames_before = frame_count;
+        save_frame();
+        call_value(peek(argc), argc);
+        if (frame_count > frames_before) {
+          replace_caller_frame();
+        }
+        load_frame();
+        break;
+      }
+      case OpCode::INVOKE: {
+        const auto name = read_name();
+        const auto argc = read_byte();
+        save_frame();
+        invoke(name, argc);
+        load_frame();
+        break;
+      }
+      case OpCode::TAIL_INVOKE: {
+        const auto name = read_name();
+        const auto argc = read_byte();
+        const auto frames_before = frame_count;
+        save_frame();
+        invoke(name, argc);
+        if (frame_count > frames_before) {
+          replace_caller_frame();
+        }
+        load_frame();
+        break;
+      }
+      case OpCode::CLOSURE: {
+        const auto &function = read_constant();
+        auto closure =
+            make_obj<ObjClosure>(Ref{function.as<ObjFunction>()});
+        for (size_t i = 0; i < closure->function->upvalue_count; ++i) {
+          const auto is_local = read_byte();
+          const auto index = read_byte();
+          closure->upvalues.emplace_back(
+              is_local != 0 ? capture_upvalue(frame->slots + index)
+                            : frame->closure->upvalues[index].get());
+        }
+        push(closure.get());
+        break;
+      }
+      case OpCode::CLOSE_UPVALUE:
+        close_upvalues(stack_top - 1);
+        pop();
+        break;
+      case OpCode::RETURN: {
+        auto result = pop();
+        close_upvalues(frame->slots);
+        --frame_count;
+        pop_until(frame->slots);
+        push(std::move(result));
+
+        if (frame_count == base_frame) {
+          return;
+        }
+        load_frame();
+        break;
+      }
+      case OpCode::CLASS:
+        push(make_obj<ObjClass>(read_name().str()).get());
+        break;
+      case OpCode::INHERIT: {
+        const auto &superclass = peek(1);
+        if (!superclass.is_obj_type(Obj::Type::CLASS)) {
+          throw InstructionError("Superclass must be a class.");
+        }
+        peek(0).as<ObjClass>()->inherit(*superclass.as<ObjClass>());
+        pop(); // The subclass
+        break;
+      }
+      case OpCode::METHOD: {
+        const auto name = read_name();
+        read_byte(); // The kind is also known by the function itself
+        auto method = pop();
+        peek(0).as<ObjClass>()->add_function(name,
+                                             Ref{method.as<ObjClosure>()});
+        break;
+      }
+      case OpCode::IMPORT: {
+        const auto &path = read_name().str();
+        save_frame();
+        auto module = import_module(path);
+        load_frame();
+        push(std::move(module));
+        break;
+      }
+      }
+    }
+  } catch (const InstructionError &err) {
+    save_frame();
+    throw instruction_error(err.message);
+  } catch (...) {
+    // Keep the position of the failing instruction for error reporting
+    save_frame();
+    throw;
+  }
+}